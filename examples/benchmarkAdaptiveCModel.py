@@ -0,0 +1,121 @@
+#!/usr/bin/env python
+#
+# LSST Data Management System
+# Copyright 2008-2017 LSST Corporation.
+#
+# This product includes software developed by the
+# LSST Project (http://www.lsstcorp.org/).
+#
+# This program is free software: you can redistribute it and/or modify
+# it under the terms of the GNU General Public License as published by
+# the Free Software Foundation, either version 3 of the License, or
+# (at your option) any later version.
+#
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU General Public License for more details.
+#
+# You should have received a copy of the LSST License Statement and
+# the GNU General Public License along with this program.  If not,
+# see <http://www.lsstcorp.org/LegalNotices/>.
+#
+"""
+A script that compares the speed and fluxes of CModel with and without SNR-adaptive exp and dev bases,
+on noisy PSF-convolved exponential galaxies over a range of fluxes.
+
+Usage: benchmarkAdaptiveCModel.py [nSources] [threshold] [nComponents]
+"""
+from __future__ import print_function
+
+import time
+import numpy
+
+import lsst.afw.coord
+import lsst.afw.detection
+import lsst.afw.geom
+import lsst.afw.geom.ellipses
+import lsst.afw.image
+import lsst.shapelet
+import lsst.meas.modelfit
+
+PSF_SIGMA = 2.0
+
+
+def makeExposure(flux, radius, rng):
+    """Make a noisy postage stamp containing a round exponential galaxy convolved with a Gaussian PSF.
+    """
+    crval = lsst.afw.coord.IcrsCoord(45.0*lsst.afw.geom.degrees, 45.0*lsst.afw.geom.degrees)
+    cdelt = (0.2*lsst.afw.geom.arcseconds).asDegrees()
+    wcs = lsst.afw.image.makeWcs(crval, lsst.afw.geom.Point2D(0.0, 0.0), cdelt, 0.0, 0.0, cdelt)
+    calib = lsst.afw.image.Calib()
+    calib.setFluxMag0(1e12)
+    bbox = lsst.afw.geom.Box2I(lsst.afw.geom.Point2I(-40, -40), lsst.afw.geom.Point2I(40, 40))
+    exposure = lsst.afw.image.ExposureF(bbox)
+    exposure.setWcs(wcs)
+    exposure.setCalib(calib)
+    exposure.setPsf(lsst.afw.detection.GaussianPsf(25, 25, PSF_SIGMA))
+    basis = lsst.shapelet.RadialProfile.get("lux").getBasis(6)
+    ellipse = lsst.afw.geom.ellipses.Ellipse(lsst.afw.geom.ellipses.Axes(radius, radius, 0.0))
+    msf = basis.makeFunction(ellipse, numpy.array([flux], dtype=float))
+    msf = msf.convolve(makePsf())
+    msf.evaluate().addToImage(exposure.getMaskedImage().getImage())
+    exposure.getMaskedImage().getVariance().getArray()[:, :] = 1.0
+    exposure.getMaskedImage().getImage().getArray()[:, :] += rng.randn(bbox.getHeight(), bbox.getWidth())
+    return exposure
+
+
+def makePsf():
+    s = lsst.shapelet.ShapeletFunction(0, lsst.shapelet.HERMITE, PSF_SIGMA)
+    s.getCoefficients()[0] = 1.0 / lsst.shapelet.ShapeletFunction.FLUX_FACTOR
+    m = lsst.shapelet.MultiShapeletFunction()
+    m.addComponent(s)
+    return m
+
+
+def run(ctrl, exposures):
+    algorithm = lsst.meas.modelfit.CModelAlgorithm(ctrl)
+    psf = makePsf()
+    center = lsst.afw.geom.Point2D(0.0, 0.0)
+    fluxes = numpy.zeros(len(exposures), dtype=float)
+    sigmas = numpy.zeros(len(exposures), dtype=float)
+    initialSn = numpy.zeros(len(exposures), dtype=float)
+    t0 = time.time()
+    for i, exposure in enumerate(exposures):
+        result = algorithm.apply(exposure, psf, center, exposure.getPsf().computeShape())
+        fluxes[i] = result.flux
+        sigmas[i] = result.fluxSigma
+        initialSn[i] = result.initial.flux/result.initial.fluxSigma
+    return time.time() - t0, fluxes, sigmas, initialSn
+
+
+def main(nSources, threshold, nComponents):
+    rng = numpy.random.RandomState(500)
+    inputFluxes = 10.0**rng.uniform(1.5, 4.0, size=nSources)
+    exposures = [makeExposure(flux, rng.uniform(1.0, 4.0), rng) for flux in inputFluxes]
+    ctrl = lsst.meas.modelfit.CModelControl()
+    fullTime, fullFluxes, fullSigmas, initialSn = run(ctrl, exposures)
+    for stageCtrl in (ctrl.exp, ctrl.dev):
+        stageCtrl.adaptiveSnThresholds = [threshold]
+        stageCtrl.adaptiveComponents = [nComponents]
+    adaptiveTime, adaptiveFluxes, adaptiveSigmas, _ = run(ctrl, exposures)
+    print("full bases:     %8.3f s (%6.1f sources/s)" % (fullTime, nSources/fullTime))
+    print("adaptive bases: %8.3f s (%6.1f sources/s)" % (adaptiveTime, nSources/adaptiveTime))
+    # Bin by the initial fit's S/N, which is what the adaptive bases are selected with.
+    good = numpy.isfinite(fullFluxes) & numpy.isfinite(adaptiveFluxes) & numpy.isfinite(initialSn)
+    faint = initialSn[good] < threshold
+    delta = (adaptiveFluxes[good] - fullFluxes[good])/fullSigmas[good]
+    print("%d of %d sources below S/N=%g" % (faint.sum(), good.sum(), threshold))
+    if faint.any():
+        print("flux difference for faint sources, in units of fluxSigma: max |d|=%g, rms=%g"
+              % (numpy.abs(delta[faint]).max(), (delta[faint]**2).mean()**0.5))
+    if (~faint).any():
+        print("flux difference for bright sources, in units of fluxSigma: max |d|=%g"
+              % numpy.abs(delta[~faint]).max())
+
+
+if __name__ == "__main__":
+    import sys
+    main(int(sys.argv[1]) if len(sys.argv) > 1 else 200,
+         float(sys.argv[2]) if len(sys.argv) > 2 else 20.0,
+         int(sys.argv[3]) if len(sys.argv) > 3 else 3)
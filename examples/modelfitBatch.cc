@@ -0,0 +1,552 @@
+// -*- lsst-c++ -*-
+/*
+ * LSST Data Management System
+ * Copyright 2008-2017 LSST Corporation.
+ *
+ * This product includes software developed by the
+ * LSST Project (http://www.lsst.org/).
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the LSST License Statement and
+ * the GNU General Public License along with this program.  If not,
+ * see <http://www.lsstcorp.org/LegalNotices/>.
+ */
+
+/*
+ * A standalone driver that fits a shapelet approximation to the PSF and then runs CModel on every source
+ * in a catalog, using a pool of threads (and optionally several processes) and without going through the
+ * Python measurement framework.  It's intended both for large batch runs and as a harness for native
+ * profiling tools.
+ *
+ * Usage: modelfitBatch EXPOSURE CATALOG OUTPUT [NTHREADS [PSF [NPROCESSES]]]
+ *
+ *   EXPOSURE  FITS file containing an ExposureF with a Psf, Wcs, and Calib
+ *   CATALOG   FITS file containing a SourceCatalog with Footprints and centroid (and ideally shape and
+ *             PsfFlux) slots defined
+ *   OUTPUT    FITS file to write the output catalog to; it contains all input fields except any existing
+ *             "modelfit_" outputs, which are replaced
+ *   NTHREADS  number of threads to use in each process (default 0, meaning one per hardware thread)
+ *   PSF       "double" to use DoubleShapeletPsfApprox (default) or "general" to use GeneralPsfFitter
+ *             with the same double-shapelet model as the GeneralShapeletPsfApprox plugin's default
+ *   NPROCESSES  number of worker processes (default 1, meaning all work is done in this process)
+ *
+ * With more than one process, the pixels are copied once into read-only shared memory and the catalog
+ * is split into spatially contiguous shards, one per worker process (forked after everything else is
+ * set up, so the workers share the inputs and algorithm objects).  Each worker fits its shard and copies
+ * its records into a shared buffer, from which they're merged back into the output catalog in the
+ * original order.  The results depend on the number of processes and threads (through PSF fit seeding)
+ * but not on how they're scheduled.
+ *
+ * All algorithms use their default configuration.  Throughput statistics are printed to stdout.  If the
+ * MODELFIT_PERF_COUNTERS environment variable is set, hardware performance counters (see PerfCounters)
+ * are also collected during the CModel fits, and a report of them per thread (and per worker process)
+ * is printed as well.
+ */
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <set>
+#include <string>
+#include <vector>
+
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "boost/format.hpp"
+
+#include "lsst/afw/image/Exposure.h"
+#include "lsst/afw/table/Source.h"
+#include "lsst/pex/exceptions.h"
+#include "lsst/meas/base/exceptions.h"
+#include "lsst/meas/modelfit/CModel.h"
+#include "lsst/meas/modelfit/DoubleShapeletPsfApprox.h"
+#include "lsst/meas/modelfit/GeneralPsfFitter.h"
+#include "lsst/meas/modelfit/PerfCounters.h"
+#include "lsst/meas/modelfit/SpatialSeedIndex.h"
+#include "lsst/meas/modelfit/detail/parallel.h"
+
+namespace afwGeom = lsst::afw::geom;
+namespace afwImage = lsst::afw::image;
+namespace afwTable = lsst::afw::table;
+namespace measBase = lsst::meas::base;
+namespace modelfit = lsst::meas::modelfit;
+
+namespace {
+
+typedef std::chrono::steady_clock Clock;
+
+std::string const PREFIX = "modelfit_";
+
+// Seeding radius for GeneralPsfFitterAlgorithm::measureCatalog, matching the plugin config's default.
+double const MAX_SEED_DISTANCE = 200.0;
+
+double secondsSince(Clock::time_point start) {
+    return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+// Format a processing rate for the timing summary; phases with no sources (or too short to time) have no
+// meaningful rate.
+std::string formatRate(int nSources, double seconds) {
+    if (nSources == 0 || !(seconds > 0.0)) {
+        return "n/a";
+    }
+    return (boost::format("%.1f sources/s") % (nSources / seconds)).str();
+}
+
+// Schema::forEach functor that maps all fields that aren't in the minimal schema (which has already
+// been mapped) or modelfit outputs (which we're about to recreate).
+struct MapInputFields {
+
+    template <typename T>
+    void operator()(afwTable::SchemaItem<T> const & item) const {
+        std::string const & name = item.field.getName();
+        if (minimal.count(name) || name.compare(0, PREFIX.size(), PREFIX) == 0) {
+            return;
+        }
+        mapper->addMapping(item.key);
+    }
+
+    afwTable::SchemaMapper * mapper;
+    std::set<std::string> minimal;
+};
+
+// Run an algorithm's measure() through the same failure handling the measurement framework uses:
+// MeasurementErrors and other recoverable exceptions set flags, and FatalAlgorithmErrors propagate.
+// Returns true on success.
+template <typename Algorithm, typename Measure>
+bool runAlgorithm(Algorithm const & algorithm, afwTable::SourceRecord & record, Measure measure) {
+    try {
+        measure();
+        return true;
+    } catch (measBase::FatalAlgorithmError &) {
+        throw;
+    } catch (measBase::MeasurementError & error) {
+        algorithm.fail(record, &error);
+    } catch (lsst::pex::exceptions::Exception &) {
+        algorithm.fail(record, nullptr);
+    }
+    return false;
+}
+
+// An anonymous memory mapping that is shared with (and, once protected, read-only in) forked children.
+class SharedMemory {
+public:
+
+    explicit SharedMemory(std::size_t size) : _size(std::max(size, std::size_t(1))) {
+        _data = ::mmap(nullptr, _size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+        if (_data == MAP_FAILED) {
+            throw LSST_EXCEPT(
+                lsst::pex::exceptions::MemoryError,
+                (boost::format("Could not map %d bytes of shared memory") % _size).str()
+            );
+        }
+    }
+
+    SharedMemory(SharedMemory const &) = delete;
+    SharedMemory & operator=(SharedMemory const &) = delete;
+
+    ~SharedMemory() { ::munmap(_data, _size); }
+
+    char * get() const { return static_cast<char *>(_data); }
+
+    void protect() { ::mprotect(_data, _size, PROT_READ); }
+
+private:
+    std::size_t _size;
+    void * _data;
+};
+
+// Copy an image plane into read-only shared memory, returning an image that views it.  The image keeps
+// the mapping alive.
+template <typename ImageT>
+std::shared_ptr<ImageT> shareImage(ImageT const & image) {
+    typedef typename ImageT::Pixel Pixel;
+    int const width = image.getWidth();
+    int const height = image.getHeight();
+    auto memory = std::make_shared<SharedMemory>(sizeof(Pixel)*width*height);
+    Pixel * data = reinterpret_cast<Pixel *>(memory->get());
+    for (int y = 0; y < height; ++y) {
+        std::copy(image.row_begin(y), image.row_end(y), data + static_cast<std::ptrdiff_t>(y)*width);
+    }
+    memory->protect();
+    ndarray::Array<Pixel,2,1> array = ndarray::external(
+        data, ndarray::makeVector(height, width), ndarray::makeVector(width, 1), memory
+    );
+    return std::make_shared<ImageT>(array, false, image.getXY0());
+}
+
+// Return a shallow copy of an Exposure whose pixels have been moved into read-only shared memory.
+std::shared_ptr<afwImage::ExposureF> shareExposure(afwImage::ExposureF const & exposure) {
+    afwImage::MaskedImageF const & mi = exposure.getMaskedImage();
+    afwImage::MaskedImageF shared(
+        shareImage(*mi.getImage()), shareImage(*mi.getMask()), shareImage(*mi.getVariance())
+    );
+    auto result = std::make_shared<afwImage::ExposureF>(exposure, false);
+    result->setMaskedImage(shared);
+    return result;
+}
+
+// Copies the fixed-size fields of records to and from buffer rows that have the same layout as the
+// records themselves (variable-length arrays, which aren't stored in the record, are not transferred).
+class RecordTransfer {
+public:
+
+    explicit RecordTransfer(afwTable::Schema const & schema) : _rowSize(schema.getRecordSize()) {
+        CollectFields collect = {this};
+        schema.forEach(collect);
+    }
+
+    std::size_t getRowSize() const { return _rowSize; }
+
+    void save(afwTable::BaseRecord const & record, char * row) const {
+        for (auto const & save : _save) {
+            save(record, row);
+        }
+    }
+
+    void load(char const * row, afwTable::BaseRecord & record) const {
+        for (auto const & load : _load) {
+            load(row, record);
+        }
+    }
+
+private:
+
+    struct CollectFields {
+
+        template <typename T>
+        void operator()(afwTable::SchemaItem<T> const & item) const {
+            afwTable::Key<T> const key = item.key;
+            std::size_t const offset = key.getOffset();
+            std::size_t const size = key.getElementCount()*sizeof(typename afwTable::Field<T>::Element);
+            self->_save.push_back([key, offset, size](afwTable::BaseRecord const & record, char * row) {
+                std::memcpy(row + offset, record.getElement(key), size);
+            });
+            self->_load.push_back([key, offset, size](char const * row, afwTable::BaseRecord & record) {
+                std::memcpy(record.getElement(key), row + offset, size);
+            });
+        }
+
+        void operator()(afwTable::SchemaItem<afwTable::Flag> const & item) const {
+            typedef afwTable::Field<afwTable::Flag>::Element Word;
+            afwTable::Key<afwTable::Flag> const key = item.key;
+            std::size_t const offset = key.getOffset();
+            Word const mask = Word(1) << key.getBit();
+            self->_save.push_back([key, offset, mask](afwTable::BaseRecord const & record, char * row) {
+                Word word;
+                std::memcpy(&word, row + offset, sizeof(Word));
+                word = record.get(key) ? (word | mask) : (word & ~mask);
+                std::memcpy(row + offset, &word, sizeof(Word));
+            });
+            self->_load.push_back([key, offset, mask](char const * row, afwTable::BaseRecord & record) {
+                Word word;
+                std::memcpy(&word, row + offset, sizeof(Word));
+                record.set(key, (word & mask) != 0);
+            });
+        }
+
+        RecordTransfer * self;
+    };
+
+    std::size_t _rowSize;
+    std::vector<std::function<void(afwTable::BaseRecord const &, char *)>> _save;
+    std::vector<std::function<void(char const *, afwTable::BaseRecord &)>> _load;
+};
+
+// The algorithms run on every source; exactly one of the two PSF approximations is set.
+struct Algorithms {
+    std::shared_ptr<modelfit::DoubleShapeletPsfApproxAlgorithm> doublePsf;
+    std::shared_ptr<modelfit::GeneralPsfFitterAlgorithm> generalPsf;
+    std::shared_ptr<modelfit::CModelAlgorithm> cmodel;
+};
+
+// Wall-clock and per-thread timing for one run of fitCatalog.
+struct Timing {
+    double psf;
+    double cmodel;
+    double cmodelThreads;
+};
+
+// Run the PSF approximation and then CModel on every record of a catalog, with the given number of
+// threads.
+Timing fitCatalog(
+    Algorithms const & algorithms,
+    afwTable::SourceCatalog & catalog,
+    afwImage::ExposureF const & exposure,
+    int nThreads
+) {
+    Timing timing = {0.0, 0.0, 0.0};
+    // Psf and Wcs objects cache intermediate results, so each thread gets its own copies; the
+    // pixels are shared.
+    nThreads = std::min(modelfit::detail::resolveThreadCount(nThreads),
+                        std::max(1, static_cast<int>(catalog.size())));
+    std::vector<afwImage::ExposureF> threadExposures;
+    threadExposures.reserve(nThreads);
+    for (int t = 0; t < nThreads; ++t) {
+        threadExposures.push_back(afwImage::ExposureF(exposure, false));
+        threadExposures.back().setPsf(exposure.getPsf()->clone());
+        threadExposures.back().setWcs(exposure.getWcs()->clone());
+    }
+
+    // The PSF approximation algorithms have their own catalog-level entry points, which seed each
+    // fit from a nearby source's result and manage their own threads.
+    Clock::time_point const startPsf = Clock::now();
+    if (algorithms.generalPsf) {
+        algorithms.generalPsf->measureCatalog(catalog, *exposure.getPsf(), MAX_SEED_DISTANCE, nThreads);
+    } else {
+        algorithms.doublePsf->measureCatalog(catalog, exposure, nThreads);
+    }
+    timing.psf = secondsSince(startPsf);
+
+    // Only report hardware counters for CModel (the PSF fits use the Optimizer, too).
+    modelfit::PerfCounters::reset();
+    std::vector<double> cmodelTime(nThreads, 0.0);
+    modelfit::CModelAlgorithm const & cmodel = *algorithms.cmodel;
+    Clock::time_point const startMeasure = Clock::now();
+    modelfit::detail::parallelFor(
+        catalog.size(), nThreads,
+        [&](int n, int thread) {
+            afwTable::SourceRecord & record = catalog[n];
+            Clock::time_point const start = Clock::now();
+            runAlgorithm(cmodel, record, [&]() { cmodel.measure(record, threadExposures[thread]); });
+            cmodelTime[thread] += secondsSince(start);
+        }
+    );
+    timing.cmodel = secondsSince(startMeasure);
+    for (int t = 0; t < nThreads; ++t) {
+        timing.cmodelThreads += cmodelTime[t];
+    }
+    return timing;
+}
+
+// Fit the catalog in nProcesses forked worker processes, each with its own spatially contiguous shard,
+// and merge the results back into the catalog.  Returns the timing of the slowest worker in each stage
+// (with summed thread time).
+Timing fitCatalogInProcesses(
+    Algorithms const & algorithms,
+    afwTable::SourceCatalog & catalog,
+    afwImage::ExposureF const & exposure,
+    int nThreads,
+    int nProcesses
+) {
+    int const n = catalog.size();
+    std::vector<afwGeom::Point2D> positions;
+    positions.reserve(n);
+    for (auto const & record : catalog) {
+        positions.push_back(record.getCentroid());
+    }
+    std::vector<int> const order = modelfit::SpatialSeedIndex(positions, MAX_SEED_DISTANCE).getOrder();
+
+    RecordTransfer transfer(catalog.getSchema());
+    SharedMemory rows(transfer.getRowSize()*n);
+    SharedMemory timings(sizeof(Timing)*nProcesses);
+    std::vector<pid_t> workers;
+    for (int p = 0; p < nProcesses; ++p) {
+        pid_t const pid = ::fork();
+        if (pid < 0) {
+            throw LSST_EXCEPT(lsst::pex::exceptions::RuntimeError, "Could not fork worker process");
+        }
+        if (pid == 0) {
+            int status = 0;
+            try {
+                int const begin = (static_cast<long>(n)*p)/nProcesses;
+                int const end = (static_cast<long>(n)*(p + 1))/nProcesses;
+                afwTable::SourceCatalog shard(catalog.getTable());
+                shard.reserve(end - begin);
+                for (int k = begin; k < end; ++k) {
+                    shard.push_back(catalog.get(order[k]));
+                }
+                Timing const timing = fitCatalog(algorithms, shard, exposure, nThreads);
+                std::memcpy(timings.get() + sizeof(Timing)*p, &timing, sizeof(Timing));
+                for (int k = begin; k < end; ++k) {
+                    transfer.save(catalog[order[k]], rows.get() + transfer.getRowSize()*order[k]);
+                }
+                if (modelfit::PerfCounters::isEnabled()) {
+                    std::cout << (boost::format("worker %d hardware counters:\n%s")
+                                  % p % modelfit::PerfCounters::formatReport()) << std::flush;
+                }
+            } catch (std::exception & err) {
+                std::cerr << "worker " << p << ": " << err.what() << std::endl;
+                status = 1;
+            }
+            // Skip the parent's destructors and atexit handlers.
+            std::_Exit(status);
+        }
+        workers.push_back(pid);
+    }
+
+    int nFailed = 0;
+    for (pid_t pid : workers) {
+        int status = 0;
+        if (::waitpid(pid, &status, 0) < 0 || !WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+            ++nFailed;
+        }
+    }
+    if (nFailed) {
+        throw LSST_EXCEPT(
+            lsst::pex::exceptions::RuntimeError,
+            (boost::format("%d of %d worker processes failed") % nFailed % nProcesses).str()
+        );
+    }
+    for (int i = 0; i < n; ++i) {
+        transfer.load(rows.get() + transfer.getRowSize()*i, catalog[i]);
+    }
+
+    Timing result = {0.0, 0.0, 0.0};
+    for (int p = 0; p < nProcesses; ++p) {
+        Timing timing;
+        std::memcpy(&timing, timings.get() + sizeof(Timing)*p, sizeof(Timing));
+        result.psf = std::max(result.psf, timing.psf);
+        result.cmodel = std::max(result.cmodel, timing.cmodel);
+        result.cmodelThreads += timing.cmodelThreads;
+    }
+    return result;
+}
+
+void printUsage(char const * program) {
+    std::cerr << "Usage: " << program
+              << " EXPOSURE CATALOG OUTPUT [NTHREADS [double|general [NPROCESSES]]]\n";
+}
+
+} // anonymous
+
+int main(int argc, char ** argv) {
+    if (argc < 4 || argc > 7) {
+        printUsage(argv[0]);
+        return 1;
+    }
+    int const nThreads = (argc > 4) ? std::atoi(argv[4]) : 0;
+    std::string const psfChoice = (argc > 5) ? argv[5] : "double";
+    if (psfChoice != "double" && psfChoice != "general") {
+        printUsage(argv[0]);
+        return 1;
+    }
+    bool const useGeneralPsf = (psfChoice == "general");
+    int nProcesses = (argc > 6) ? std::atoi(argv[6]) : 1;
+    if (nProcesses < 1) {
+        printUsage(argv[0]);
+        return 1;
+    }
+    if (std::getenv("MODELFIT_PERF_COUNTERS") && !modelfit::PerfCounters::enable()) {
+        std::cerr << "Hardware performance counters are not available; not collecting them" << std::endl;
+    }
+
+    try {
+        Clock::time_point const startRead = Clock::now();
+        auto exposure = std::make_shared<afwImage::ExposureF>(argv[1]);
+        afwTable::SourceCatalog input = afwTable::SourceCatalog::readFits(argv[2]);
+        double const readTime = secondsSince(startRead);
+        if (!exposure->getPsf() || !exposure->getWcs()) {
+            std::cerr << argv[1] << " does not have both a Psf and a Wcs" << std::endl;
+            return 1;
+        }
+
+        // Build the output schema: input fields (minus old modelfit outputs) plus the new outputs.
+        afwTable::Schema const & inputSchema = input.getSchema();
+        afwTable::SchemaMapper mapper(inputSchema);
+        afwTable::Schema minimal = afwTable::SourceTable::makeMinimalSchema();
+        mapper.addMinimalSchema(minimal, true);
+        MapInputFields mapInputFields = {&mapper, minimal.getNames()};
+        inputSchema.forEach(mapInputFields);
+        afwTable::Schema & schema = mapper.editOutput();
+        schema.setAliasMap(std::make_shared<afwTable::AliasMap>(*inputSchema.getAliasMap()));
+
+        modelfit::CModelControl cmodelCtrl;
+        Algorithms algorithms;
+        if (useGeneralPsf) {
+            modelfit::GeneralPsfFitterControl psfCtrl;
+            psfCtrl.primary.order = 2;
+            psfCtrl.wings.order = 1;
+            std::string const psfName = PREFIX + "GeneralShapeletPsfApprox_DoubleShapelet";
+            algorithms.generalPsf = std::make_shared<modelfit::GeneralPsfFitterAlgorithm>(
+                psfCtrl, schema, psfName
+            );
+            cmodelCtrl.psfName = psfName;
+        } else {
+            algorithms.doublePsf = std::make_shared<modelfit::DoubleShapeletPsfApproxAlgorithm>(
+                modelfit::DoubleShapeletPsfApproxControl(), PREFIX + "DoubleShapeletPsfApprox", schema
+            );
+        }
+        algorithms.cmodel = std::make_shared<modelfit::CModelAlgorithm>(
+            PREFIX + "CModel", cmodelCtrl, schema
+        );
+
+        afwTable::SourceCatalog output(afwTable::SourceTable::make(schema));
+        output.reserve(input.size());
+        for (afwTable::SourceCatalog::const_iterator i = input.begin(); i != input.end(); ++i) {
+            output.addNew()->assign(*i, mapper);
+        }
+
+        Timing timing;
+        double shareTime = 0.0;
+        nProcesses = std::min(nProcesses, std::max(1, static_cast<int>(output.size())));
+        if (nProcesses > 1) {
+            Clock::time_point const startShare = Clock::now();
+            exposure = shareExposure(*exposure);  // releases the private copy of the pixels
+            shareTime = secondsSince(startShare);
+            timing = fitCatalogInProcesses(algorithms, output, *exposure, nThreads, nProcesses);
+        } else {
+            timing = fitCatalog(algorithms, output, *exposure, nThreads);
+        }
+
+        afwTable::Key<afwTable::Flag> psfFlag = useGeneralPsf ?
+            schema[PREFIX + "GeneralShapeletPsfApprox_DoubleShapelet"]["flag"] :
+            schema[PREFIX + "DoubleShapeletPsfApprox"]["flag"];
+        afwTable::Key<afwTable::Flag> cmodelFlag = schema[PREFIX + "CModel"]["flag"];
+        int nPsfFailed = 0;
+        int nCModelFailed = 0;
+        for (auto const & record : output) {
+            if (record.get(psfFlag)) {
+                ++nPsfFailed;
+            }
+            if (record.get(cmodelFlag)) {
+                ++nCModelFailed;
+            }
+        }
+
+        Clock::time_point const startWrite = Clock::now();
+        output.writeFits(argv[3]);
+        double const writeTime = secondsSince(startWrite);
+
+        int const nSources = output.size();
+        double const perSource = 1E3 / std::max(nSources, 1);
+        std::cout << boost::format("sources:          %d (%d PSF failures, %d CModel failures)\n")
+            % nSources % nPsfFailed % nCModelFailed;
+        std::cout << boost::format("processes:        %d\n") % nProcesses;
+        std::cout << boost::format("threads:          %d per process\n")
+            % modelfit::detail::resolveThreadCount(nThreads);
+        std::cout << boost::format("read time:        %.3f s\n") % readTime;
+        if (nProcesses > 1) {
+            std::cout << boost::format("share time:       %.3f s\n") % shareTime;
+        }
+        std::cout << boost::format("PSF approx time:  %.3f s (%s)\n")
+            % timing.psf % formatRate(nSources, timing.psf);
+        std::cout << boost::format("CModel time:      %.3f s (%s)\n")
+            % timing.cmodel % formatRate(nSources, timing.cmodel);
+        std::cout << boost::format("write time:       %.3f s\n") % writeTime;
+        std::cout << boost::format("CModel:           %.3f ms/source (thread time)\n")
+            % (timing.cmodelThreads * perSource);
+        if (modelfit::PerfCounters::isEnabled() && nProcesses == 1) {
+            std::cout << "hardware counters:\n" << modelfit::PerfCounters::formatReport();
+        }
+    } catch (std::exception & err) {
+        std::cerr << err.what() << std::endl;
+        return 1;
+    }
+    return 0;
+}
@@ -25,6 +25,7 @@
 #define LSST_MEAS_MODELFIT_H
 
 #include "lsst/meas/modelfit/AdaptiveImportanceSampler.h"
+#include "lsst/meas/modelfit/EnsembleSampler.h"
 #include "lsst/meas/modelfit/Sampler.h"
 #include "lsst/meas/modelfit/TruncatedGaussian.h"
 #include "lsst/meas/modelfit/Likelihood.h"
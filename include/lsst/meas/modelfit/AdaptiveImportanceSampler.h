@@ -54,9 +54,27 @@ public:
         maxRepeat, int,
         "Maximum number of times this iteration will be repeated to meet the perplexityTarget"
     );
+    LSST_CONTROL_FIELD(
+        doQuasiRandom, bool,
+        "Draw samples from a scrambled Halton sequence (see Mixture::drawQuasiRandom) instead of "
+        "pseudo-random deviates; this usually reduces the variance of the importance-sampling "
+        "estimates for a given nSamples"
+    );
+
+    LSST_CONTROL_FIELD(
+        nBlockSamples, int,
+        "If positive, evaluate samples in blocks of this size, and stop drawing (before nSamples is "
+        "reached) once the effective sample size of this iteration reaches targetEffectiveSampleSize"
+    );
+    LSST_CONTROL_FIELD(
+        targetEffectiveSampleSize, double,
+        "Effective sample size (1/sum(w^2) for normalized weights w) at which block sampling stops; "
+        "ignored if nBlockSamples <= 0"
+    );
 
     ImportanceSamplerControl() :
-        nSamples(2000), nUpdateSteps(2), tau1(1E-4), tau2(0.5), targetPerplexity(1.0), maxRepeat(0)
+        nSamples(2000), nUpdateSteps(2), tau1(1E-4), tau2(0.5), targetPerplexity(1.0), maxRepeat(0),
+        doQuasiRandom(false), nBlockSamples(0), targetEffectiveSampleSize(200.0)
     {}
 };
 
@@ -79,12 +97,17 @@ public:
      *  @param[in]  ctrls             Vector of control objects that define the iterations.
      *  @param[in]  doSaveIterations  Whether to save intermediate SampleSets and associated
      *                                proposal distributions.
+     *  @param[in]  doRecycleSamples  Whether to keep the samples from all iterations and weight
+     *                                them against the deterministic mixture of all proposals used
+     *                                so far, so every objective evaluation contributes to the
+     *                                final sample set (and to the proposal updates).
      */
     AdaptiveImportanceSampler(
         afw::table::Schema & sampleSchema,
         PTR(afw::math::Random) rng,
         std::map<int,ImportanceSamplerControl> const & ctrls,
-        bool doSaveIterations=false
+        bool doSaveIterations=false,
+        bool doRecycleSamples=false
     );
 
     void run(
@@ -99,6 +122,7 @@ public:
 
 private:
     bool _doSaveIterations;
+    bool _doRecycleSamples;
     PTR(afw::math::Random)  _rng;
     std::map<int,ImportanceSamplerControl> _ctrls;
     afw::table::Key<Scalar> _weightKey;
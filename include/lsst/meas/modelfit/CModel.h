@@ -24,6 +24,12 @@
 #ifndef LSST_MEAS_MODELFIT_CModelFit_h_INCLUDED
 #define LSST_MEAS_MODELFIT_CModelFit_h_INCLUDED
 
+#include <functional>
+#include <map>
+#include <string>
+#include <utility>
+#include <vector>
+
 #include "ndarray.h"
 
 #include "lsst/pex/config.h"
@@ -38,9 +44,16 @@
 #include "lsst/meas/modelfit/UnitTransformedLikelihood.h"
 #include "lsst/meas/modelfit/optimizer.h"
 #include "lsst/meas/modelfit/PixelFitRegion.h"
+#include "lsst/meas/modelfit/PerfCounters.h"
 
 namespace lsst { namespace meas { namespace modelfit {
 
+namespace detail {
+
+struct CModelFitCheckpoint;
+
+} // namespace detail
+
 /**
  *  @page modelfitCModel CModel Magnitudes
  *
@@ -143,6 +156,8 @@ struct CModelStageControl {
         priorName(),
         nComponents(8),
         maxRadius(0),
+        adaptiveSnThresholds(),
+        adaptiveComponents(),
         usePixelWeights(false),
         weightsMultiplier(1.0),
         doRecordHistory(true),
@@ -155,6 +170,14 @@ struct CModelStageControl {
 
     PTR(Model) getModel() const;
 
+    /**
+     *  Return the Models for the reduced-complexity bases used for low signal-to-noise sources, paired
+     *  with the signal-to-noise thresholds below which they apply, in order of increasing threshold.
+     *
+     *  Throws FatalAlgorithmError if adaptiveSnThresholds and adaptiveComponents are inconsistent.
+     */
+    std::vector<std::pair<Scalar,PTR(Model)>> getAdaptiveModels() const;
+
     PTR(Prior) getPrior() const;
 
     LSST_CONTROL_FIELD(
@@ -192,6 +215,22 @@ struct CModelStageControl {
         "Maximum radius used in approximating profile with Gaussians (0=default for this profile)"
     );
 
+    LSST_CONTROL_FIELD(
+        adaptiveSnThresholds,
+        std::vector<double>,
+        "Increasing initial-fit signal-to-noise thresholds below which this stage uses the basis with "
+        "the corresponding number of Gaussians in adaptiveComponents instead of nComponents (empty to "
+        "always use nComponents).  Not used by the initial stage itself.  Requires "
+        "CModelControl.doFluxSigma."
+    );
+
+    LSST_CONTROL_FIELD(
+        adaptiveComponents,
+        std::vector<int>,
+        "Number of Gaussians used to approximate the profile for sources below each of the "
+        "adaptiveSnThresholds"
+    );
+
     LSST_CONTROL_FIELD(
         usePixelWeights,
         bool,
@@ -231,7 +270,11 @@ struct CModelControl {
     CModelControl() :
         psfName("modelfit_DoubleShapeletPsfApprox"),
         minInitialRadius(0.1),
-        fallbackInitialMomentsPsfFactor(1.5)
+        fallbackInitialMomentsPsfFactor(1.5),
+        precomputeInverseSigma(false),
+        doFluxInner(true),
+        doFluxSigma(true),
+        doEllipses(true)
     {
         initial.nComponents = 3; // use very rough model in initial fit
         initial.optimizer.gradientThreshold = 1E-2; // with coarse convergence criteria
@@ -240,6 +283,11 @@ struct CModelControl {
         dev.profileName = "luv";
         exp.nComponents = 6;
         exp.optimizer.maxOuterIterations = 250;
+        // The exp and dev fits reject many trial steps, so evaluate a few at a time; this uses the
+        // process-wide thread pool only when the fits aren't already spread over threads (see
+        // OptimizerControl::nTrialSteps).  Pipelines limited to one core per process should set it to 1.
+        exp.optimizer.nTrialSteps = 3;
+        dev.optimizer.nTrialSteps = 3;
     }
 
     LSST_CONTROL_FIELD(
@@ -281,6 +329,32 @@ struct CModelControl {
         "  If <= 0.0, abort the fit early instead."
     );
 
+    LSST_CONTROL_FIELD(
+        precomputeInverseSigma, bool,
+        "Compute 1/sqrt(variance) once for the whole image being measured (on the first source) and "
+        "reuse it for every fit, instead of recomputing it for each fit region.  Faster when most of "
+        "the image is covered by fit regions; the plane for the most recent image is kept in memory."
+    );
+
+    LSST_CONTROL_FIELD(
+        doFluxInner, bool,
+        "Compute the flux within the fit region (fluxInner) for each stage and the final fit.  If False, "
+        "the fluxInner fields are not added to the schema and are NaN in Result objects."
+    );
+
+    LSST_CONTROL_FIELD(
+        doFluxSigma, bool,
+        "Compute flux uncertainties for each stage and the final fit.  If False, the fluxSigma fields are "
+        "NaN.  Must be True if exp or dev use adaptiveSnThresholds, which are compared to the initial "
+        "fit's flux signal-to-noise."
+    );
+
+    LSST_CONTROL_FIELD(
+        doEllipses, bool,
+        "Compute the half-light ellipse of each stage and the fracDev-weighted final ellipse.  If False, "
+        "the ellipse fields are not added to the schema and are NaN in Result objects."
+    );
+
 };
 
 /**
@@ -312,6 +386,7 @@ struct CModelStageResult {
     Scalar fluxInner;    ///< Flux measured strictly within the fit region (no extrapolation).
     Scalar objective;    ///< Value of the objective function at the best fit point: chisq/2 - ln(prior)
     Scalar time;         ///< Time spent in this fit in seconds.
+    PerfCounters::Counts counters;  ///< Hardware event counts for this fit, if PerfCounters are enabled.
     afw::geom::ellipses::Quadrupole ellipse;  ///< Best fit half-light ellipse in pixel coordinates
 
     ndarray::Array<Scalar const,1,1> nonlinear;  ///< Opaque nonlinear parameters in specialized units
@@ -374,6 +449,116 @@ struct CModelResult {
     std::bitset<N_FLAGS> flags; ///< Array of flags.
 };
 
+/**
+ *  A contiguous buffer holding the outputs of CModel for many sources, with one fixed-layout row per
+ *  source.
+ *
+ *  The buffer is a C-contiguous (size, rowSize) array of 8-byte fields, described by getFields().
+ *  Floating-point fields hold Scalars; flag fields hold the corresponding std::bitset as an unsigned
+ *  64-bit integer, with bit i set when FlagBit i is.  The layout depends only on the Control the batch
+ *  is constructed with, so Python can view the buffer as a NumPy structured array without copying
+ *  (see CModelResultBatch.getArray), or construct a batch around a structured array it has already
+ *  allocated (see CModelResultBatch.fromArray).
+ *
+ *  Each row contains the final flux, fluxSigma, fluxInner, fracDev, objective, fracDev-weighted
+ *  ellipse, initial and final fit regions, flags and a "done" marker (1 for rows that have been set,
+ *  0 otherwise), followed by the flux, fluxSigma, fluxInner,
+ *  objective, ellipse, nonlinear, amplitudes, fixed and flags fields of each of the "initial", "exp" and
+ *  "dev" stages, whose names are prefixed with the stage name (e.g. "exp_flux").  Ellipses are stored as
+ *  (xx, yy, xy) moments.  Optional outputs disabled in the Control (see CModelControl::doFluxInner) are
+ *  still present, but are NaN.
+ *
+ *  A batch may also hold an "in-flight" state for rows whose fit was in progress when it was last
+ *  checkpointed (see CModelAlgorithm::applyCatalog); these opaque blobs are not part of the buffer, and
+ *  must be saved alongside it.
+ */
+class CModelResultBatch {
+public:
+
+    /// Description of a (possibly array-valued) field in every row.
+    struct Field {
+        std::string name;  ///< Name of the field, e.g. "flux" or "exp_nonlinear".
+        int offset;        ///< Offset of the field from the start of the row, in 8-byte units.
+        int size;          ///< Number of elements in the field (1 for scalars).
+        bool isFlags;      ///< Whether the field holds unsigned 64-bit flag bits rather than a Scalar.
+    };
+
+    /**
+     *  Allocate a batch with room for the given number of sources.
+     *
+     *  All floating-point fields are initialized to NaN, all flags are cleared, and no rows are done.
+     */
+    CModelResultBatch(CModelControl const & ctrl, int size);
+
+    /**
+     *  Construct a batch that writes to an existing buffer, which is not initialized.
+     *
+     *  A buffer saved from another batch with the same Control keeps its rows and "done" markers, so
+     *  this can be used to resume a run (see CModelAlgorithm::applyCatalog).
+     *
+     *  @throw pex::exceptions::LengthError if the second dimension of the buffer is not the row size
+     *         implied by the Control.
+     */
+    CModelResultBatch(CModelControl const & ctrl, ndarray::Array<Scalar,2,2> const & buffer);
+
+    /// Return the number of rows.
+    int getSize() const { return _buffer.getSize<0>(); }
+
+    /// Return the number of 8-byte fields in each row.
+    int getRowSize() const { return _rowSize; }
+
+    /// Return descriptions of the fields in each row, ordered by offset.
+    std::vector<Field> const & getFields() const { return _fields; }
+
+    /// Return the buffer itself; this is a view, not a copy.
+    ndarray::Array<Scalar,2,2> const & getBuffer() const { return _buffer; }
+
+    /// Return whether a row has been set since the buffer was allocated.
+    bool isDone(int index) const;
+
+    /// Return the number of rows that have been set.
+    int countDone() const;
+
+    /**
+     *  Copy a Result into a row, mark it done, and clear its in-flight state.
+     *
+     *  Array-valued fields whose size does not match the layout (e.g. because the stage failed before
+     *  its parameters were set) are filled with NaN.
+     */
+    void set(int index, CModelResult const & result);
+
+    /// Return the in-flight state of a row, or an empty string if it has none.
+    std::string getInFlightState(int index) const;
+
+    /// Set the in-flight state of a row; an empty state clears it.
+    void setInFlightState(int index, std::string const & state);
+
+    /// Return the in-flight states of all rows that have one, keyed by row index.
+    std::map<int,std::string> const & getInFlightStates() const { return _inFlight; }
+
+private:
+
+    // Sizes of the array-valued fields of a stage.
+    struct StageLayout {
+        int nonlinear;
+        int amplitudes;
+        int fixed;
+    };
+
+    void _initialize(CModelControl const & ctrl);
+
+    void _addField(std::string const & name, int size, bool isFlags=false);
+
+    void _checkIndex(int index) const;
+
+    int _rowSize;
+    int _doneOffset;
+    StageLayout _stages[3];  // initial, exp, dev
+    std::vector<Field> _fields;
+    ndarray::Array<Scalar,2,2> _buffer;
+    std::map<int,std::string> _inFlight;
+};
+
 /**
  *  Main public interface class for CModel algorithm.
  *
@@ -381,6 +566,10 @@ struct CModelResult {
  *
  *  This class provides the methods that actually execute the algorithm, and (depending on how it is
  *  constructed) holds the Key objects necessary to use SourceRecords for input and output.
+ *
+ *  The apply and measure methods may be called concurrently on different sources from multiple threads,
+ *  as long as each thread uses its own Exposure (which may share pixels) and the configured priors are
+ *  safe to evaluate concurrently (as the default 'EMPIRICAL' and 'LINEAR' priors are).
  */
 class CModelAlgorithm {
 public:
@@ -536,9 +725,90 @@ public:
         meas::base::MeasurementError * error
     ) const;
 
+    /**
+     *  Run the CModel algorithm on every source in a catalog, writing the outputs to a batch buffer
+     *  rather than to the catalog.
+     *
+     *  Inputs are read from each record as in measure(): the shapelet PSF approximation identified by
+     *  Control::psfName, the centroid, shape and PsfFlux slots, the Kron radius (if present) and the
+     *  Footprint.  Sources that fail with a MeasurementError or other recoverable exception have the
+     *  FAILED flag (and the error's flag, if any) set in their row, just as fail() would set them in a
+     *  record; FatalAlgorithmErrors are propagated.
+     *
+     *  This only requires the Control, so it may be called on an algorithm instance constructed without
+     *  a Schema.  Each thread gets its own shallow copy of the Exposure, with its own Psf and Wcs.
+     *
+     *  Long runs can be made resumable by saving the batch in the checkpoint callback, which is called
+     *  after every checkpointInterval sources complete and (if checkpointStepInterval > 0) after every
+     *  checkpointStepInterval optimizer steps, summed over all sources; no rows are written while it runs,
+     *  so every row it sees is either done or untouched.  When there is a checkpoint callback, the
+     *  optimizer state of the stage each source in progress is fitting (as of its last optimizer step) is
+     *  also recorded in the batch before each checkpoint (see CModelResultBatch::getInFlightStates), and
+     *  should be saved with the buffer.  Passing the saved batch back with resume=true then only fits the
+     *  sources that were not done, and sources with an in-flight state redo the (deterministic) stages
+     *  before the saved one and resume the saved stage from its last step instead of from the start.
+     *  Either way, they get the same results they would have had without the interruption.  In-flight
+     *  states that do not match the stage they were saved for (e.g. because the Control has changed) are
+     *  ignored.
+     *
+     *  @param[in]     catalog   Catalog providing the inputs, in the same order as the batch rows.
+     *  @param[in]     exposure  Image to be measured.  Must have a valid Psf, Wcs, and Calib.
+     *  @param[in,out] output    Batch with the same size as the catalog, to which results are written.
+     *  @param[in]     nThreads  Number of threads to use; <= 0 uses all hardware threads.
+     *  @param[in]     resume    If true, skip sources whose rows are already done.
+     *  @param[in]     checkpoint          Callable to pass the batch to periodically; may be empty.
+     *  @param[in]     checkpointInterval  Number of sources to complete between checkpoints.
+     *  @param[in]     checkpointStepInterval  Number of optimizer steps between checkpoints; <= 0 to only
+     *                                         take checkpoints when sources complete.
+     */
+    void applyCatalog(
+        afw::table::SourceCatalog const & catalog,
+        afw::image::Exposure<Pixel> const & exposure,
+        CModelResultBatch & output,
+        int nThreads=0,
+        bool resume=false,
+        std::function<void(CModelResultBatch const &)> const & checkpoint=nullptr,
+        int checkpointInterval=1000,
+        int checkpointStepInterval=0
+    ) const;
+
     /// Copy values from a Result struct to a BaseRecord object.
     void writeResultToRecord(Result const & result, afw::table::BaseRecord & record) const;
 
+    /**
+     *  Add the PSF-convolved best-fit models for all sources in a catalog to an image.
+     *
+     *  Each source's final (exp + dev) model is reconstructed from its CModel fields (the exp and dev
+     *  nonlinear and fixed parameters, the final flux and fracDev), its slot centroid, and the
+     *  shapelet PSF approximation identified by Control::psfName, using the Wcs of the given Exposure
+     *  to transform from the fit coordinate system.  Models are evaluated only within a box
+     *  containing the given number of standard deviations of every Gaussian component.  The image is
+     *  divided into square tiles that are rendered in parallel, so the result does not depend on the
+     *  number of threads.
+     *
+     *  Sources whose CModel flag is set or whose flux or centroid is not finite are skipped.  If the
+     *  schema has an aperture correction field for the final flux ("<name>_apCorr"), it is divided out.
+     *
+     *  This only requires the Control the catalog was measured with, so it may be called on an
+     *  algorithm instance constructed without a Schema.  It is not supported for forced-mode catalogs,
+     *  which do not contain nonlinear parameters.
+     *
+     *  @param[in]     catalog   Catalog containing non-forced CModel outputs.
+     *  @param[in,out] exposure  Exposure whose image plane the models are added to.  Must have a Wcs.
+     *  @param[in]     name      Prefix of the CModel fields in the catalog schema.
+     *  @param[in]     nSigma    Half-size of the per-component support, in standard deviations.
+     *  @param[in]     tileSize  Width and height of the tiles that are rendered independently.
+     *  @param[in]     nThreads  Number of threads to use; <= 0 uses all hardware threads.
+     */
+    void renderModels(
+        afw::table::SourceCatalog const & catalog,
+        afw::image::Exposure<Pixel> & exposure,
+        std::string const & name="modelfit_CModel",
+        double nSigma=6.0,
+        int tileSize=256,
+        int nThreads=0
+    ) const;
+
 private:
 
     friend class CModelAlgorithmControl;
@@ -553,7 +823,8 @@ private:
         afw::geom::ellipses::Quadrupole const & moments,
         Scalar approxFlux,
         Scalar kronRadius=-1,
-        int footprintArea=-1
+        int footprintArea=-1,
+        detail::CModelFitCheckpoint * checkpoint=nullptr
     ) const;
 
     // Actual implementations go here; we use an output argument for the result so we can get partial
@@ -40,8 +40,14 @@ public:
     DoubleShapeletPsfApproxControl() :
         innerOrder(2), outerOrder(1),
         radiusRatio(2.0), peakRatio(0.1),
-        minRadius(1.0), minRadiusDiff(0.5), maxRadiusBoxFraction(0.4)
-    {}
+        minRadius(1.0), minRadiusDiff(0.5), maxRadiusBoxFraction(0.4),
+        maxSeedDistance(200.0)
+    {
+        // The radius bounds are often active at the best fit (e.g. for nearly Gaussian PSFs, which
+        // want two components of the same size), and stepping along them converges much faster than
+        // rejecting every step that crosses them.
+        optimizer.doUseConstraints = true;
+    }
 
     LSST_CONTROL_FIELD(innerOrder, int, "Shapelet order of inner expansion (0 == Gaussian)");
 
@@ -69,9 +75,16 @@ public:
         "Don't allow the semi-major radius of any component to go above this fraction of the PSF image width"
     );
 
+    LSST_CONTROL_FIELD(
+        maxSeedDistance, double,
+        "Maximum distance (pixels) to a previously-fit source whose profile is used to initialize the fit "
+        "in DoubleShapeletPsfApproxAlgorithm::measureCatalog(); <= 0 disables seeding"
+    );
+
     LSST_NESTED_CONTROL_FIELD(
         optimizer, lsst.meas.modelfit.optimizer, OptimizerControl,
-        "Configuration of the optimizer used by DoubleShapeletPsfsApproxAlgorithm::fitProfile()."
+        "Configuration of the optimizer used by DoubleShapeletPsfsApproxAlgorithm::fitProfile(); "
+        "doUseConstraints is enabled by default"
     );
 
 };
@@ -135,6 +148,25 @@ public:
      */
     static shapelet::MultiShapeletFunction initializeResult(Control const & ctrl);
 
+    /**
+     *  Create a MultiShapeletFunction with the zeroth-order profile of a previous fit.
+     *
+     *  The result has the orders from the control object, unit total flux and unit circle moments, and
+     *  the relative amplitudes, radii, and ellipticities of the zeroth-order terms of the given fit
+     *  (higher-order terms are set to zero).  Because the PSF model usually varies slowly, this is a
+     *  much better starting point for fitProfile() at a nearby position than the result of
+     *  initializeResult(ctrl).
+     *
+     *  @param[in] ctrl    Control object specifying the details of the model and how to fit it.
+     *  @param[in] seed    Result of a previous fit with the same configuration.
+     *
+     *  @throw pex::exceptions::InvalidParameterError if seed does not have exactly two components.
+     */
+    static shapelet::MultiShapeletFunction initializeResult(
+        Control const & ctrl,
+        shapelet::MultiShapeletFunction const & seed
+    );
+
     /**
      *  Update a MultiShapeletFunction's ellipses to match the first and second moments of a PSF image.
      *
@@ -250,6 +282,37 @@ public:
         afw::image::Exposure<float> const & exposure
     ) const;
 
+    /**
+     *  Run the algorithm on every source in a catalog, seeding each fit with the result for the nearest
+     *  source that has already been fit.
+     *
+     *  Sources are processed in the spatial order defined by SpatialSeedIndex.  When a previously-fit
+     *  source lies within ctrl.maxSeedDistance, its profile is used (via initializeResult(ctrl, seed))
+     *  in place of the configured initial profile, which typically leaves fitProfile() with only a few
+     *  iterations to do.  If the seeded fit fails, the source is refit from the default starting point,
+     *  so the results and failure flags are the same as those of measure() unless the two starting
+     *  points converge to different solutions.  Failures are handled by calling fail(), as the
+     *  measurement framework would; FatalAlgorithmErrors are propagated.
+     *
+     *  Positions are taken from the centroid slot, and sources with no valid centroid are simply
+     *  measured without a seed.
+     *
+     *  With nThreads != 1, the spatial order is split into contiguous chunks that are fit in parallel
+     *  (see detail::parallelSeededFor), each thread using its own copy of the Psf and its own
+     *  workspace Arena; seeds are never taken from another chunk, so results depend on the number of
+     *  threads (through the chunk boundaries) but not on thread scheduling.  The Python binding releases
+     *  the GIL for the duration of the call.
+     *
+     *  @param[in,out] catalog    Catalog whose records will be measured.
+     *  @param[in]     exposure   Exposure whose Psf will be approximated.
+     *  @param[in]     nThreads   Number of threads to use; <= 0 uses one per hardware thread.
+     */
+    void measureCatalog(
+        afw::table::SourceCatalog & catalog,
+        afw::image::Exposure<float> const & exposure,
+        int nThreads=1
+    ) const;
+
     /**
      *  Handle failures caught by the measurement plugin system, setting failure flags as appropriate.
      */
@@ -259,6 +322,12 @@ public:
     ) const;
 
 private:
+
+    PTR(afw::image::Image<Scalar>) _computePsfImage(
+        afw::table::SourceRecord & measRecord,
+        afw::detection::Psf const & psf
+    ) const;
+
     Control _ctrl;
     meas::base::SafeCentroidExtractor _centroidExtractor;
     shapelet::MultiShapeletFunctionKey _key;
@@ -0,0 +1,132 @@
+// -*- lsst-c++ -*-
+/*
+ * LSST Data Management System
+ * Copyright 2016 LSST/AURA
+ *
+ * This product includes software developed by the
+ * LSST Project (http://www.lsst.org/).
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the LSST License Statement and
+ * the GNU General Public License along with this program.  If not,
+ * see <http://www.lsstcorp.org/LegalNotices/>.
+ */
+
+#ifndef LSST_MEAS_MODELFIT_EnsembleSampler_h_INCLUDED
+#define LSST_MEAS_MODELFIT_EnsembleSampler_h_INCLUDED
+
+#include "lsst/pex/config.h"
+#include "lsst/afw/table/Schema.h"
+#include "lsst/meas/modelfit/Sampler.h"
+#include "lsst/meas/modelfit/Mixture.h"
+
+namespace lsst { namespace meas { namespace modelfit {
+
+/**
+ *  @brief Control object for EnsembleSampler
+ */
+class EnsembleSamplerControl {
+public:
+    LSST_CONTROL_FIELD(
+        nWalkers, int,
+        "Number of walkers in the ensemble; must be even and should be at least twice the number "
+        "of parameters"
+    );
+    LSST_CONTROL_FIELD(nBurnIn, int, "Number of ensemble updates to run before recording samples");
+    LSST_CONTROL_FIELD(
+        nSteps, int,
+        "Number of ensemble updates to record; the sample catalog will have nWalkers*nSteps records"
+    );
+    LSST_CONTROL_FIELD(
+        stretch, double,
+        "Scale parameter a of the stretch move, which draws z from g(z) ~ 1/sqrt(z) on [1/a, a]"
+    );
+    LSST_CONTROL_FIELD(
+        maxInitAttempts, int,
+        "Maximum number of draws from the proposal per walker when looking for a starting point "
+        "with a finite objective value"
+    );
+    LSST_CONTROL_FIELD(
+        nThreads, int,
+        "Number of threads used to evaluate the objective for the walkers in each half-ensemble "
+        "(<= 0 to use all hardware threads).  Values other than 1 require the SamplingObjective "
+        "to be safe to call concurrently."
+    );
+
+    EnsembleSamplerControl() :
+        nWalkers(32), nBurnIn(50), nSteps(100), stretch(2.0), maxInitAttempts(100), nThreads(1)
+    {}
+
+    /// Raise InvalidParameterException if the configuration options are invalid.
+    void validate() const;
+
+};
+
+/**
+ *  @brief Sampler class that implements the affine-invariant ensemble ("stretch move") Markov Chain
+ *         Monte Carlo algorithm of Goodman & Weare (2010).
+ *
+ *  Walkers are split into two halves, and each walker in one half is moved along the line joining
+ *  it to a randomly-chosen walker in the other half.  Because the moves within a half depend only on
+ *  the other half, the objective evaluations for a half can be computed concurrently.  All random
+ *  numbers are drawn in the calling thread before each half-step, so results do not depend on the
+ *  number of threads.
+ *
+ *  The proposal Mixture passed to run() is only used to draw the initial positions of the walkers,
+ *  and it is not modified.  The output sample catalog has the same schema as that produced by
+ *  AdaptiveImportanceSampler, with one record for each walker after each recorded ensemble update;
+ *  all weights are equal, and the "proposal" field is set to NaN.
+ *
+ *  The sampler's behavior is invariant under affine transformations of the parameters, so it does
+ *  not need to be tuned to the scales and correlations of the posterior.  Unlike importance
+ *  sampling, successive samples are correlated; the effective sample size should be estimated from
+ *  the autocorrelation of the chains.
+ */
+class EnsembleSampler : public Sampler {
+public:
+
+    /**
+     *  @brief Construct a new sampler
+     *
+     *  @param[in,out] sampleSchema   Schema for the catalog of samples filled by the Sampler;
+     *                                will be modified to include sampler-specific fields.
+     *  @param[in]  rng               Random number generator to use to generate samples.
+     *  @param[in]  ctrl              Control object that configures the sampler.
+     */
+    EnsembleSampler(
+        afw::table::Schema & sampleSchema,
+        PTR(afw::math::Random) rng,
+        EnsembleSamplerControl const & ctrl
+    );
+
+    void run(
+        SamplingObjective const & objective,
+        PTR(Mixture) proposal,
+        afw::table::BaseCatalog & samples
+    ) const override;
+
+    /// Return the fraction of proposed moves accepted in the last call to run() (including burn-in)
+    double getAcceptanceFraction() const { return _acceptanceFraction; }
+
+private:
+    EnsembleSamplerControl _ctrl;
+    PTR(afw::math::Random)  _rng;
+    afw::table::Key<Scalar> _weightKey;
+    afw::table::Key<Scalar> _objectiveKey;
+    afw::table::Key<Scalar> _proposalKey;
+    afw::table::Key< afw::table::Array<Scalar> > _parametersKey;
+    mutable double _acceptanceFraction;
+};
+
+}}} // namespace lsst::meas::modelfit
+
+#endif // !LSST_MEAS_MODELFIT_EnsembleSampler_h_INCLUDED
@@ -25,6 +25,7 @@
 #define LSST_MEAS_MODELFIT_GeneralPsfFitter_h_INCLUDED
 
 #include <memory>
+#include <vector>
 
 #include "lsst/pex/config.h"
 #include "lsst/shapelet/FunctorKeys.h"
@@ -32,6 +33,7 @@
 #include "lsst/meas/modelfit/Prior.h"
 #include "lsst/meas/modelfit/Likelihood.h"
 #include "lsst/afw/table/Source.h"
+#include "lsst/afw/detection/Psf.h"
 #include "lsst/meas/base/exceptions.h"
 #include "lsst/meas/base/FlagHandler.h"
 #include "lsst/meas/modelfit/optimizer.h"
@@ -296,6 +298,46 @@ public:
         afw::geom::ellipses::Quadrupole const & moments
     ) const;
 
+    /**
+     *  Fit the PSF model at the position of every record in a catalog, in parallel, seeding each fit
+     *  with the result for the nearest record that has already been fit.
+     *
+     *  Records are processed in spatially-ordered chunks (see detail::parallelSeededFor), and each
+     *  fit is initialized from the result of this fitter for the nearest successfully-fit record in the
+     *  same chunk within maxSeedDistance.  When there is no such record or the seeded fit fails, the
+     *  fit is initialized from the record's results for the last of the previous fitters in a sequence
+     *  that succeeded (via adapt()), and from the PSF moments if none did.  Failures are handled by
+     *  calling fail(), as the measurement framework would; FatalAlgorithmErrors are propagated.
+     *
+     *  Each thread uses its own copy of the Psf and its own workspace Arena.  The Python binding
+     *  releases the GIL for the duration of the call.
+     *
+     *  @param[in,out] catalog          Catalog whose records will be measured; positions are taken
+     *                                  from the centroid slot.
+     *  @param[in]     psf              PSF model to approximate.
+     *  @param[in]     maxSeedDistance  Maximum distance (pixels) between a record and the record that
+     *                                  seeds it; <= 0 disables seeding.
+     *  @param[in]     nThreads         Number of threads to use; <= 0 uses one per hardware thread.
+     *  @param[in]     previous         Fitters that precede this one in the sequence, in order, whose
+     *                                  results are already in the catalog.
+     */
+    void measureCatalog(
+        afw::table::SourceCatalog & catalog,
+        afw::detection::Psf const & psf,
+        double maxSeedDistance,
+        int nThreads,
+        std::vector<GeneralPsfFitterAlgorithm const *> const & previous
+    ) const;
+
+    /// Fit the PSF model to every record in a catalog, as above, after at most one other fitter.
+    void measureCatalog(
+        afw::table::SourceCatalog & catalog,
+        afw::detection::Psf const & psf,
+        double maxSeedDistance=0.0,
+        int nThreads=1,
+        GeneralPsfFitterAlgorithm const * previous=nullptr
+    ) const;
+
     void fail(
         afw::table::SourceRecord & measRecord,
         lsst::meas::base::MeasurementError * error=nullptr
@@ -123,6 +123,13 @@ public:
         bool doApplyWeights=true
     ) const = 0;
 
+    /**
+     *  Return true if computeModelMatrix may safely be called from multiple threads at once.
+     *
+     *  The default implementation returns false.
+     */
+    virtual bool supportsConcurrentEvaluation() const { return false; }
+
     virtual ~Likelihood() {}
 
     // No copying
@@ -94,11 +94,20 @@ private:
 
     friend class Mixture;
 
+    // Largest dimension for which Mixture uses fixed-size kernels (and we store _packedInverseL).
+    static int const MAX_FIXED_DIM = 4;
+
+    // Recompute _sqrtDet and _packedInverseL from _sigmaLLT.
+    void _updateFactors();
+
     void _stream(std::ostream & os, int offset=0) const;
 
     Scalar _sqrtDet;
     Vector _mu;
     Eigen::LLT<Matrix> _sigmaLLT;
+    // Lower triangle of the inverse of the Cholesky factor of sigma, packed row by row; only set when
+    // the dimension is <= MAX_FIXED_DIM.  Unaligned storage lets components live in a std::vector.
+    Eigen::Matrix<Scalar,MAX_FIXED_DIM*(MAX_FIXED_DIM+1)/2,1,Eigen::DontAlign> _packedInverseL;
 };
 
 /**
@@ -256,6 +265,25 @@ public:
      */
     void draw(afw::math::Random & rng, ndarray::Array<Scalar,2,1> const & x) const;
 
+    /**
+     *  @brief Draw quasi-random variates from the distribution.
+     *
+     *  Points are generated from a Halton low-discrepancy sequence whose digits are scrambled
+     *  with random permutations drawn from the given random number generator, so each call
+     *  produces an independent randomized quasi-Monte Carlo point set.  One coordinate of the
+     *  sequence is used to select the component, and the rest are mapped through the inverse
+     *  normal (and, for Student's T components, chi-squared) distribution functions and the
+     *  component's Cholesky factor.
+     *
+     *  For smooth integrands, importance-sampling estimates computed from these points converge
+     *  faster than those computed from draw(), but the points are not independent and should
+     *  not be used for anything that relies on that.
+     *
+     *  @param[in,out] rng random number generator used only to scramble the sequence
+     *  @param[out] x      array of points, shape=(numSamples, dim)
+     */
+    void drawQuasiRandom(afw::math::Random & rng, ndarray::Array<Scalar,2,1> const & x) const;
+
     /**
      *  @brief Perform an Expectation-Maximization step, updating the component parameters to match
      *         the given weighted samples.
@@ -316,6 +344,56 @@ public:
         Scalar tau1=0.0, Scalar tau2=0.5
     );
 
+    /**
+     *  @brief Create a mixture initialized by weighted k-means clustering of the given samples.
+     *
+     *  Cluster centers are seeded with the k-means++ algorithm (each new center is drawn from the
+     *  samples with probability proportional to its weight times its squared distance from the nearest
+     *  existing center) and then refined with Lloyd iterations.  Each component's weight, mu and sigma
+     *  are then set from the weighted samples assigned to it, so the result is ready to be refined with
+     *  updateEM(), usually in far fewer iterations than are needed from a generic starting point.
+     *
+     *  Distances are computed after scaling each dimension by its weighted standard deviation.  The
+     *  samples are processed in fixed-size blocks that are distributed over threads, with per-block
+     *  results combined in order, so the result does not depend on the number of threads.
+     *
+     *  @param[in] x             array of variables, shape=(numSamples, dim)
+     *  @param[in] w             array of weights, shape=(numSamples,)
+     *  @param[in] nComponents   number of components (and clusters)
+     *  @param[in,out] rng       random number generator used to seed the cluster centers
+     *  @param[in] restriction   Functor used to restrict the form of the component mu and sigma
+     *  @param[in] nIterations   number of Lloyd iterations
+     *  @param[in] df            number of degrees of freedom for component Student's T distributions
+     *                           (inf=Gaussian)
+     *  @param[in] nThreads      number of threads to use; <= 0 means one per hardware thread
+     */
+    static PTR(Mixture) makeFromKMeans(
+        ndarray::Array<Scalar const,2,1> const & x,
+        ndarray::Array<Scalar const,1,0> const & w,
+        int nComponents,
+        afw::math::Random & rng,
+        UpdateRestriction const & restriction,
+        int nIterations=5,
+        Scalar df=std::numeric_limits<Scalar>::infinity(),
+        int nThreads=1
+    );
+
+    /**
+     *  @brief Create a mixture initialized by weighted k-means clustering of the given samples,
+     *         with no restrictions on the component parameters.
+     *
+     *  See the overload that takes an UpdateRestriction for details.
+     */
+    static PTR(Mixture) makeFromKMeans(
+        ndarray::Array<Scalar const,2,1> const & x,
+        ndarray::Array<Scalar const,1,0> const & w,
+        int nComponents,
+        afw::math::Random & rng,
+        int nIterations=5,
+        Scalar df=std::numeric_limits<Scalar>::infinity(),
+        int nThreads=1
+    );
+
     /// Polymorphic deep copy
     virtual PTR(Mixture) clone() const;
 
@@ -350,11 +428,46 @@ private:
 
     template <typename Derived>
     Scalar _computeZ(Component const & component, Eigen::MatrixBase<Derived> const & x) const {
+        switch (_dim) {
+        case 1:
+            return _computeZFixed<1>(component, x);
+        case 2:
+            return _computeZFixed<2>(component, x);
+        case 3:
+            return _computeZFixed<3>(component, x);
+        case 4:
+            return _computeZFixed<4>(component, x);
+        }
         _workspace = x - component._mu;
         component._sigmaLLT.matrixL().solveInPlace(_workspace);
         return _workspace.squaredNorm();
     }
 
+    // Fixed-size version of _computeZ, using the precomputed inverse Cholesky factor instead of a
+    // triangular solve.
+    template <int N, typename Derived>
+    Scalar _computeZFixed(Component const & component, Eigen::MatrixBase<Derived> const & x) const {
+        Eigen::Matrix<Scalar,N,1> const dx = x - component._mu;
+        Scalar const * l = component._packedInverseL.data();
+        Scalar z = 0.0;
+        for (int i = 0; i < N; ++i) {
+            Scalar s = 0.0;
+            for (int j = 0; j <= i; ++j, ++l) {
+                s += (*l) * dx[j];
+            }
+            z += s*s;
+        }
+        return z;
+    }
+
+    // Fixed-size version of evaluateDerivatives (after argument checking).
+    template <int N>
+    void _evaluateDerivativesFixed(
+        ndarray::Array<Scalar const,1,1> const & x,
+        ndarray::Array<Scalar,1,1> const & gradient,
+        ndarray::Array<Scalar,2,1> const & hessian
+    ) const;
+
     // Helper function used in updateEM
     void updateDampedSigma(int k, Matrix const & sigma, double tau1, double tau2);
 
@@ -77,6 +77,12 @@ public:
         bool multiplyWeights=false
     ) const override;
 
+    /// @copydoc Prior::makeAmplitudePosterior
+    AmplitudePosterior makeAmplitudePosterior(
+        Vector const & gradient, Matrix const & hessian,
+        ndarray::Array<Scalar const,1,1> const & nonlinear
+    ) const override;
+
     /**
      *  @brief Return a MixtureUpdateRestriction appropriate for (e1,e2,r) data.
      *
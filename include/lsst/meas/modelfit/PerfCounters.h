@@ -0,0 +1,171 @@
+// -*- lsst-c++ -*-
+/*
+ * LSST Data Management System
+ * Copyright 2008-2017 LSST Corporation.
+ *
+ * This product includes software developed by the
+ * LSST Project (http://www.lsst.org/).
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the LSST License Statement and
+ * the GNU General Public License along with this program.  If not,
+ * see <http://www.lsstcorp.org/LegalNotices/>.
+ */
+
+#ifndef LSST_MEAS_MODELFIT_PerfCounters_h_INCLUDED
+#define LSST_MEAS_MODELFIT_PerfCounters_h_INCLUDED
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace lsst { namespace meas { namespace modelfit {
+
+namespace detail {
+
+struct ThreadPerfCounters;
+
+} // namespace detail
+
+/**
+ *  @brief Optional hardware performance counters for the fitting code.
+ *
+ *  When enabled, each thread opens Linux perf_event counters for CPU cycles, instructions, cache misses
+ *  and branch misses (in user space only), and the counts are attributed to a few instrumented regions
+ *  of the code: the three CModel stages, Optimizer steps and model matrix evaluation.  Regions nest, and
+ *  the counts for each region include those of the regions it contains (e.g. a CModel stage includes its
+ *  Optimizer steps).  Counts are accumulated per thread; getReport() and formatReport() summarize them,
+ *  and each CModelStageResult also holds the counts for its own fit.
+ *
+ *  Counters are disabled by default, in which case the instrumented regions cost a single relaxed
+ *  atomic load each.  They are unavailable on platforms other than Linux, and when the kernel does not
+ *  allow unprivileged processes to count their own events (see /proc/sys/kernel/perf_event_paranoid).
+ *
+ *  Counts should only be read (or reset) while no fits are running.
+ */
+class PerfCounters {
+public:
+
+    /// Instrumented code regions.
+    enum Region {
+        CMODEL_INITIAL = 0,
+        CMODEL_EXP,
+        CMODEL_DEV,
+        OPTIMIZER_STEP,
+        MODEL_MATRIX,
+        N_REGIONS
+    };
+
+    /// Hardware events counted in each region.
+    enum Event {
+        CYCLES = 0,
+        INSTRUCTIONS,
+        CACHE_MISSES,
+        BRANCH_MISSES,
+        N_EVENTS
+    };
+
+    /// Event counts accumulated over one or more executions of a region.
+    struct Counts {
+        std::array<std::uint64_t,N_EVENTS> events;  ///< Counts indexed by Event.
+        std::uint64_t calls;                        ///< Number of executions of the region.
+
+        Counts() : events(), calls(0) {}
+
+        Counts & operator+=(Counts const & other);
+
+        /// Return instructions per cycle, or NaN if no cycles were counted.
+        double getInstructionsPerCycle() const;
+    };
+
+    /// Counts for all regions executed by a single thread.
+    struct ThreadReport {
+        int thread;  ///< Index of the thread, in the order threads first entered an instrumented region.
+        std::array<Counts,N_REGIONS> regions;  ///< Counts indexed by Region.
+    };
+
+    /**
+     *  Enable counting in all threads.
+     *
+     *  @return Whether counters could be opened; if not, counting remains disabled.
+     */
+    static bool enable();
+
+    /// Disable counting; counts accumulated so far are kept.
+    static void disable();
+
+    /// Return whether counting is enabled.
+    static bool isEnabled() { return _enabled.load(std::memory_order_relaxed); }
+
+    /// Zero all counts, and forget threads that have exited.
+    static void reset();
+
+    /// Return the counts for every thread that has executed an instrumented region since the last reset.
+    static std::vector<ThreadReport> getReport();
+
+    /// Return a human-readable table of the counts per thread and region, with totals over threads.
+    static std::string formatReport();
+
+    /// Return the name of a region, e.g. "CModel.exp".
+    static std::string getRegionName(Region region);
+
+    /// Return the name of an event, e.g. "cycles".
+    static std::string getEventName(Event event);
+
+private:
+    static std::atomic<bool> _enabled;
+};
+
+/**
+ *  @brief RAII object that attributes the events counted during its lifetime to a region.
+ *
+ *  Does nothing if PerfCounters are disabled when it is constructed.
+ */
+class PerfScope {
+public:
+
+    explicit PerfScope(PerfCounters::Region region) : _counters(nullptr), _region(region) {
+        if (PerfCounters::isEnabled()) {
+            _start();
+        }
+    }
+
+    PerfScope(PerfScope const &) = delete;
+    PerfScope & operator=(PerfScope const &) = delete;
+
+    /**
+     *  Stop counting, add the counts to the thread's totals for the region, and return them.
+     *
+     *  Returns zero counts if the scope was not counting (or has already been stopped).
+     */
+    PerfCounters::Counts stop();
+
+    ~PerfScope() {
+        if (_counters) {
+            stop();
+        }
+    }
+
+private:
+
+    void _start();
+
+    detail::ThreadPerfCounters * _counters;
+    PerfCounters::Region _region;
+    std::array<std::uint64_t,PerfCounters::N_EVENTS> _begin;
+};
+
+}}} // namespace lsst::meas::modelfit
+
+#endif // !LSST_MEAS_MODELFIT_PerfCounters_h_INCLUDED
@@ -27,9 +27,60 @@
 #include "lsst/base.h"
 #include "lsst/afw/math/Random.h"
 #include "lsst/meas/modelfit/common.h"
+#include "lsst/meas/modelfit/TruncatedGaussian.h"
 
 namespace lsst { namespace meas { namespace modelfit {
 
+/**
+ *  @brief The prior*likelihood product as a function of amplitude, at fixed nonlinear parameters.
+ *
+ *  This is returned by Prior::makeAmplitudePosterior(), and lets the marginalize(), maximize(), and
+ *  drawAmplitudes() operations of a Prior share a single factorization of the amplitude likelihood
+ *  when more than one of them is needed at the same point.  For the one- and two-amplitude models
+ *  supported by TruncatedGaussian, constructing one and calling marginalize() or maximize() does not
+ *  allocate heap memory.
+ */
+class AmplitudePosterior {
+public:
+
+    /**
+     *  @brief Construct from the amplitude likelihood and the prior on the nonlinear parameters.
+     *
+     *  @param[in]  gradient           Gradient of the -log likelihood in the amplitudes (see
+     *                                 Prior::marginalize).
+     *  @param[in]  hessian            Second derivatives of the -log likelihood in the amplitudes.
+     *  @param[in]  nonlinearDensity   The (marginal) prior density of the nonlinear parameters.
+     */
+    AmplitudePosterior(Vector const & gradient, Matrix const & hessian, Scalar nonlinearDensity);
+
+    /// Return the -log amplitude integral of the prior*likelihood product; see Prior::marginalize.
+    Scalar marginalize() const { return _tg.getLogIntegral() + _nonlinearTerm; }
+
+    /**
+     *  @brief Compute the amplitude vector that maximizes the prior*likelihood product.
+     *
+     *  @param[out] amplitudes   The posterior-maximum amplitude parameters.
+     *
+     *  @return The -log(posterior) at the computed amplitude point; see Prior::maximize.
+     */
+    Scalar maximize(ndarray::Array<Scalar,1,1> const & amplitudes) const;
+
+    /// Draw a set of Monte Carlo amplitude vectors; see Prior::drawAmplitudes.
+    void drawAmplitudes(
+        afw::math::Random & rng,
+        ndarray::Array<Scalar,2,1> const & amplitudes,
+        ndarray::Array<Scalar,1,1> const & weights,
+        bool multiplyWeights=false
+    ) const;
+
+    /// Return the truncated Gaussian that represents the amplitude likelihood
+    TruncatedGaussian const & getTruncatedGaussian() const { return _tg; }
+
+private:
+    TruncatedGaussian _tg;
+    Scalar _nonlinearTerm;  // -log of the prior density of the nonlinear parameters
+};
+
 /**
  *  @brief Base class for Bayesian priors
  */
@@ -158,6 +209,51 @@ public:
         bool multiplyWeights=false
     ) const = 0;
 
+    /**
+     *  @brief Return an object that evaluates marginalize(), maximize() and drawAmplitudes() for
+     *         the same likelihood and nonlinear parameters.
+     *
+     *  This is more efficient than calling more than one of those methods directly, as the amplitude
+     *  likelihood is only factored once.
+     *
+     *  The default implementation throws LogicError.
+     *
+     *  @param[in]  gradient     Gradient of the -log likelihood in @f$\alpha@f$ at fixed @f$\theta@f$.
+     *  @param[in]  hessian      Second derivatives of of the -log likelihood in @f$\alpha@f$ at fixed
+     *                           @f$\theta@f$.
+     *  @param[in]  nonlinear    The nonlinear parameters @f$\theta@f$.
+     */
+    virtual AmplitudePosterior makeAmplitudePosterior(
+        Vector const & gradient, Matrix const & hessian,
+        ndarray::Array<Scalar const,1,1> const & nonlinear
+    ) const;
+
+    /**
+     *  @brief Set hard bounds on the parameters, outside of which the prior is zero.
+     *
+     *  Objects that fit with a prior (e.g. the objective returned by
+     *  OptimizerObjective::makeFromLikelihood) use these as constraints, so the fitter never has to
+     *  discover the edges of the prior's support by trial and error.  The arrays are initialized to
+     *  infinite bounds by the caller, and only finite bounds need to be set.
+     *
+     *  The default implementation sets no bounds and returns false.
+     *
+     *  @param[out] nonlinearLower   Lower bounds on the nonlinear parameters.
+     *  @param[out] nonlinearUpper   Upper bounds on the nonlinear parameters.
+     *  @param[out] amplitudeLower   Lower bounds on the linear parameters.
+     *  @param[out] amplitudeUpper   Upper bounds on the linear parameters.
+     *
+     *  @return true if any bounds were set.
+     */
+    virtual bool fillBounds(
+        ndarray::Array<Scalar,1,1> const & nonlinearLower,
+        ndarray::Array<Scalar,1,1> const & nonlinearUpper,
+        ndarray::Array<Scalar,1,1> const & amplitudeLower,
+        ndarray::Array<Scalar,1,1> const & amplitudeUpper
+    ) const {
+        return false;
+    }
+
     virtual ~Prior() {}
 
     // No copying
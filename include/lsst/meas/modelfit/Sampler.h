@@ -45,6 +45,9 @@ public:
 protected:
     explicit SamplingObjective(PTR(Likelihood) likelihood);
 
+    /// Construct an objective that does not evaluate a Likelihood (e.g. an analytic target density).
+    SamplingObjective() {}
+
     PTR(Likelihood) _likelihood;
     ndarray::Array<Pixel,2,-1> _modelMatrix;
 };
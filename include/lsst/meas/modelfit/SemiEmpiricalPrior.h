@@ -128,6 +128,12 @@ public:
         bool multiplyWeights=false
     ) const override;
 
+    /// @copydoc Prior::makeAmplitudePosterior
+    AmplitudePosterior makeAmplitudePosterior(
+        Vector const & gradient, Matrix const & hessian,
+        ndarray::Array<Scalar const,1,1> const & nonlinear
+    ) const override;
+
 private:
 
     struct Impl;
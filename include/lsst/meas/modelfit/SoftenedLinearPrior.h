@@ -125,6 +125,20 @@ public:
         bool multiplyWeights=false
     ) const override;
 
+    /// @copydoc Prior::makeAmplitudePosterior
+    AmplitudePosterior makeAmplitudePosterior(
+        Vector const & gradient, Matrix const & hessian,
+        ndarray::Array<Scalar const,1,1> const & nonlinear
+    ) const override;
+
+    /// @copydoc Prior::fillBounds
+    bool fillBounds(
+        ndarray::Array<Scalar,1,1> const & nonlinearLower,
+        ndarray::Array<Scalar,1,1> const & nonlinearUpper,
+        ndarray::Array<Scalar,1,1> const & amplitudeLower,
+        ndarray::Array<Scalar,1,1> const & amplitudeUpper
+    ) const override;
+
     Control const & getControl() const { return _ctrl; }
 
 private:
@@ -0,0 +1,90 @@
+// -*- lsst-c++ -*-
+/*
+ * LSST Data Management System
+ * Copyright 2008-2017 LSST Corporation.
+ *
+ * This product includes software developed by the
+ * LSST Project (http://www.lsstcorp.org/).
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the LSST License Statement and
+ * the GNU General Public License along with this program.  If not,
+ * see <http://www.lsstcorp.org/LegalNotices/>.
+ */
+
+#ifndef LSST_MEAS_MODELFIT_SpatialSeedIndex_h_INCLUDED
+#define LSST_MEAS_MODELFIT_SpatialSeedIndex_h_INCLUDED
+
+#include <vector>
+
+#include "lsst/afw/geom/Point.h"
+
+namespace lsst { namespace meas { namespace modelfit {
+
+/**
+ *  A spatial index used to seed per-source fits of smoothly-varying quantities (such as PSF
+ *  approximations) with the result of the nearest previously-fit source.
+ *
+ *  The index provides an order in which to process the sources (a serpentine raster over a grid of
+ *  cells, so consecutive sources are close together) and a nearest-neighbor search restricted to the
+ *  sources that have been marked as successfully fit.  Sources with non-finite positions are placed at
+ *  the end of the order; they are never given a seed and are never used as one.
+ */
+class SpatialSeedIndex {
+public:
+
+    /**
+     *  Construct from the positions of all sources.
+     *
+     *  @param[in] positions     Positions of the sources, in the order they appear in their catalog.
+     *  @param[in] maxDistance   Maximum distance (in the same units as the positions) between a source
+     *                           and the neighbor that seeds it.  If not positive, no seeds are ever
+     *                           returned and the processing order is just the input order.
+     */
+    SpatialSeedIndex(std::vector<afw::geom::Point2D> const & positions, double maxDistance);
+
+    /// Return the indices of all sources, in the order in which they should be processed.
+    std::vector<int> const & getOrder() const { return _order; }
+
+    /// Return the maximum distance between a source and its seed.
+    double getMaxDistance() const { return _maxDistance; }
+
+    /**
+     *  Return the index of the nearest source that has been marked as fit and is within
+     *  getMaxDistance() of source i, or -1 if there is no such source.
+     */
+    int findNearest(int i) const;
+
+    /// Mark source i as successfully fit, making it available as a seed for later sources.
+    void markFitted(int i);
+
+private:
+
+    bool _isIndexed(int i) const { return _cells[i] >= 0; }
+
+    std::vector<int> const & _getFitted(int cellX, int cellY) const {
+        return _fitted[cellY*_nCellsX + cellX];
+    }
+
+    double _maxDistance;
+    double _cellSize;
+    int _nCellsX;
+    int _nCellsY;
+    std::vector<afw::geom::Point2D> _positions;
+    std::vector<int> _cells;                // flattened cell index for each source, or -1 if not indexed
+    std::vector<std::vector<int>> _fitted;  // indices of fitted sources in each cell
+    std::vector<int> _order;
+};
+
+}}} // namespace lsst::meas::modelfit
+
+#endif // !LSST_MEAS_MODELFIT_SpatialSeedIndex_h_INCLUDED
@@ -49,7 +49,9 @@ class TruncatedGaussianLogEvaluator;
  *  Currently only 1 and 2 dimensions are supported, and all dimensions must be truncated.
  *  Computing integrals is the only operation for which > 2-d is not implemented,
  *  but the integrals must be computed upon construction, so we can't support any other
- *  operations for > 2-d either.
+ *  operations for > 2-d either.  Because the dimension is bounded, all internal storage has
+ *  a fixed maximum size, and constructing, copying, evaluating and maximizing a TruncatedGaussian
+ *  never allocates heap memory.
  *
  *  Many operations on TruncatedGaussians are defined in -log space, as underflow/overflow
  *  problems will often occur in the non-log forms.
@@ -88,6 +90,13 @@ public:
     typedef TruncatedGaussianLogEvaluator LogEvaluator;
     typedef TruncatedGaussianEvaluator Evaluator;
 
+    /// Maximum number of dimensions supported
+    static int const MAX_DIM = 2;
+
+    /// Vector and matrix types used for internal storage, with dynamic size <= MAX_DIM
+    typedef Eigen::Matrix<Scalar,Eigen::Dynamic,1,Eigen::DontAlign,MAX_DIM,1> SmallVector;
+    typedef Eigen::Matrix<Scalar,Eigen::Dynamic,Eigen::Dynamic,Eigen::DontAlign,MAX_DIM,MAX_DIM> SmallMatrix;
+
     /**
      *  @brief Create from the first and second logarithmic derivatives of the Gaussian
      *
@@ -190,6 +199,13 @@ public:
      */
     Vector maximize() const;
 
+    /**
+     *  @brief Compute the location of the maximum of the truncated Gaussian into an existing array.
+     *
+     *  This is equivalent to the overload that returns a Vector, but does not allocate memory.
+     */
+    void maximize(ndarray::Array<Scalar,1,1> const & alpha) const;
+
     /**
      *  @brief Return the fraction of the Gaussian integral that was truncated by the bounds
      *
@@ -225,18 +241,24 @@ public:
      */
     Scalar getLogIntegral() const;
 
-    ~TruncatedGaussian();
-
 private:
 
     friend class TruncatedGaussianSampler;
     friend class TruncatedGaussianLogEvaluator;
 
-    class Impl;
+    explicit TruncatedGaussian(int n) :
+        _untruncatedFraction(1.0), _logPeakAmplitude(1.0), _logIntegral(1.0),
+        _mu(n), _s(n), _v(n, n)
+    {}
 
-    explicit TruncatedGaussian(PTR(Impl) impl) : _impl(impl) {}
+    SmallVector _maximize() const;
 
-    PTR(Impl) _impl;
+    Scalar _untruncatedFraction;
+    Scalar _logPeakAmplitude;
+    Scalar _logIntegral;
+    SmallVector _mu;
+    SmallVector _s;  // H = Sigma^{-1} = V S V^T
+    SmallMatrix _v;
 };
 
 /**
@@ -263,9 +285,9 @@ public:
 
 protected:
     Scalar _norm;
-    Vector _mu;
-    mutable Vector _workspace;
-    Matrix _rootH;
+    TruncatedGaussian::SmallVector _mu;
+    mutable TruncatedGaussian::SmallVector _workspace;
+    TruncatedGaussian::SmallMatrix _rootH;
 };
 
 /**
@@ -26,6 +26,7 @@
 
 #include <vector>
 #include <memory>
+#include <mutex>
 
 #include "ndarray.h"
 
@@ -56,9 +57,45 @@ public:
     LSST_CONTROL_FIELD(weightsMultiplier, double,
                        "Scaling factor to apply to weights.");
 
+    LSST_CONTROL_FIELD(minEpochInformationFraction, double,
+                       "When fitting multiple epochs, drop those whose estimated Fisher information on the "
+                       "source flux is below this fraction of the total over all epochs (0 keeps all epochs; "
+                       "the most informative epoch is always kept).");
+
     explicit UnitTransformedLikelihoodControl(bool usePixelWeights_=false, double weightsMultiplier_=1.0)
-        : usePixelWeights(usePixelWeights_), weightsMultiplier(weightsMultiplier_) {}
+        : usePixelWeights(usePixelWeights_), weightsMultiplier(weightsMultiplier_),
+          minEpochInformationFraction(0.0) {}
+
+};
+
+/**
+ *  @brief A lazily-computed inverse-sigma (1/sqrt(variance)) plane for an entire exposure.
+ *
+ *  UnitTransformedLikelihood normally converts variances to weights for just the pixels in each fit
+ *  region, every time it is constructed.  When many sources (or many fits per source) use the same
+ *  exposure, an InverseSigmaImage can be shared between them instead: the full plane is computed once,
+ *  on first use, and weights are then simply copied out of it.  Once constructed, an InverseSigmaImage
+ *  may be used from multiple threads.
+ */
+class InverseSigmaImage {
+public:
+
+    /// Construct from a variance plane; no computation is done until get() is first called.
+    explicit InverseSigmaImage(PTR(afw::image::Image<Pixel> const) variance);
+
+    InverseSigmaImage(InverseSigmaImage const &) = delete;
+    InverseSigmaImage & operator=(InverseSigmaImage const &) = delete;
 
+    /// Return the inverse-sigma image, computing it if this is the first call.
+    afw::image::Image<Pixel> const & get() const;
+
+    /// Return true if this was constructed from the given variance plane (compared by identity).
+    bool isFor(afw::image::Image<Pixel> const & variance) const { return &variance == _variance.get(); }
+
+private:
+    PTR(afw::image::Image<Pixel> const) _variance;
+    mutable std::once_flag _once;
+    mutable PTR(afw::image::Image<Pixel> const) _inverseSigma;
 };
 
 /**
@@ -74,16 +111,20 @@ public:
      * @param[in] footprint     Footprint of source (galaxy) on calexp
      * @param[in] exposure      Subregion of calexp that includes footprint
      * @param[in] psf           Multi-shapelet representation of exposure PSF evaluated at location of galaxy
+     * @param[in] inverseSigma  Optional precomputed inverse-sigma plane for the exposure; must cover the
+     *                          footprint.
      */
     explicit EpochFootprint(
         afw::detection::Footprint const &footprint,
         afw::image::Exposure<Pixel> const &exposure,
-        shapelet::MultiShapeletFunction const &psf
+        shapelet::MultiShapeletFunction const &psf,
+        PTR(InverseSigmaImage const) inverseSigma=PTR(InverseSigmaImage const)()
     );
 
     afw::detection::Footprint const footprint;  ///< footprint of source (galaxy)
     afw::image::Exposure<Pixel> const exposure; ///< subregion of exposure that includes footprint
     shapelet::MultiShapeletFunction const psf;   ///< multi-shapelet model of exposure PSF
+    PTR(InverseSigmaImage const) const inverseSigma; ///< precomputed inverse-sigma plane (may be null)
 };
 
 /**
@@ -108,6 +149,9 @@ public:
         bool doApplyWeights=true
     ) const override;
 
+    /// Return true: computeModelMatrix uses a separate workspace for each concurrent call.
+    bool supportsConcurrentEvaluation() const override { return true; }
+
     /**
      * @brief Initialize a UnitTransformedLikelihood with data from multiple exposures.
      *
@@ -117,6 +161,11 @@ public:
      * @param[in] position          Sky position of object being fit
      * @param[in] epochFootprintList   List of shared pointers to EpochFootprint
      * @param[in] ctrl              Control object with various options
+     *
+     * If ctrl.minEpochInformationFraction is nonzero, the information each epoch carries about the
+     * source's flux is first estimated from its weights, its PSF, and how much of the PSF its footprint
+     * covers, and epochs below that fraction of the total are left out of the likelihood entirely; see
+     * getDroppedEpochs() and getEpochInformation().
      */
     explicit UnitTransformedLikelihood(
         PTR(Model) model,
@@ -138,6 +187,9 @@ public:
      * @param[in] footprint         Footprint that defines the pixels to include in the fit
      * @param[in] psf               Shapelet approximation to the PSF
      * @param[in] ctrl              Control object with various options
+     * @param[in] inverseSigma      Optional precomputed inverse-sigma plane for the exposure; if
+     *                              provided, weights are copied from it instead of being computed
+     *                              from the variance.  Must cover the footprint.
      */
     explicit UnitTransformedLikelihood(
         PTR(Model) model,
@@ -147,9 +199,19 @@ public:
         afw::image::Exposure<Pixel> const & exposure,
         afw::detection::Footprint const & footprint,
         shapelet::MultiShapeletFunction const & psf,
-        UnitTransformedLikelihoodControl const & ctrl
+        UnitTransformedLikelihoodControl const & ctrl,
+        PTR(InverseSigmaImage const) inverseSigma=PTR(InverseSigmaImage const)()
     );
 
+    /// Return the indices (into the list passed at construction) of epochs culled for low information.
+    std::vector<int> const & getDroppedEpochs() const;
+
+    /**
+     *  Return the estimated Fisher information on the source flux for each epoch passed at construction,
+     *  in fit-system units, or an empty array if epoch culling was not enabled.
+     */
+    ndarray::Array<Scalar const,1,1> getEpochInformation() const;
+
     virtual ~UnitTransformedLikelihood();
 
 private:
@@ -0,0 +1,160 @@
+// -*- lsst-c++ -*-
+/*
+ * LSST Data Management System
+ * Copyright 2016 LSST/AURA
+ *
+ * This product includes software developed by the
+ * LSST Project (http://www.lsst.org/).
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the LSST License Statement and
+ * the GNU General Public License along with this program.  If not,
+ * see <http://www.lsstcorp.org/LegalNotices/>.
+ */
+
+#ifndef LSST_MEAS_MODELFIT_DETAIL_Arena_h_INCLUDED
+#define LSST_MEAS_MODELFIT_DETAIL_Arena_h_INCLUDED
+
+#include <cstddef>
+#include <memory>
+#include <vector>
+
+#include "ndarray.h"
+
+namespace lsst { namespace meas { namespace modelfit { namespace detail {
+
+/**
+ *  @brief A bump allocator for short-lived ndarray workspace.
+ *
+ *  Arrays are carved out of a small number of large blocks, so a sequence of allocations costs a
+ *  pointer increment each instead of a trip through malloc.  Each array holds a reference to the
+ *  block it lives in, so arrays that outlive a reset() are always safe to use: reset() only recycles
+ *  blocks that are no longer referenced by any array, and simply forgets the others (which are then
+ *  freed when their last array goes away).
+ *
+ *  Arenas are not thread-safe; the intended usage is one per thread, via ArenaScope and
+ *  allocateTemporary().
+ */
+class Arena {
+public:
+
+    /// Alignment (in bytes) of every array returned by the arena.
+    static std::size_t const ALIGNMENT = 64;
+
+    /// Default size (in bytes) of the blocks the arena allocates from the heap.
+    static std::size_t const DEFAULT_BLOCK_SIZE = 1 << 22;
+
+    explicit Arena(std::size_t blockSize=DEFAULT_BLOCK_SIZE);
+
+    // No copying
+    Arena(Arena const &) = delete;
+    Arena & operator=(Arena const &) = delete;
+
+    /// Allocate an uninitialized 1-d array.
+    template <typename T>
+    ndarray::Array<T,1,1> allocate(int n) {
+        std::shared_ptr<char> owner;
+        T * data = reinterpret_cast<T*>(_allocateBytes(sizeof(T)*n, owner));
+        return ndarray::external(data, ndarray::makeVector(n), ndarray::makeVector(1), owner);
+    }
+
+    /// Allocate an uninitialized row-major 2-d array.
+    template <typename T>
+    ndarray::Array<T,2,2> allocate(int rows, int cols) {
+        std::shared_ptr<char> owner;
+        T * data = reinterpret_cast<T*>(_allocateBytes(sizeof(T)*rows*cols, owner));
+        return ndarray::external(data, ndarray::makeVector(rows, cols), ndarray::makeVector(cols, 1),
+                                 owner);
+    }
+
+    /**
+     *  Make all memory not referenced by an outstanding array available for reuse.
+     *
+     *  Blocks that are still referenced are released to their arrays rather than recycled.
+     */
+    void reset();
+
+    /// Return the number of bytes handed out since the last reset.
+    std::size_t getBytesUsed() const { return _bytesUsed; }
+
+    /// Return the total size of the blocks currently owned by the arena.
+    std::size_t getBytesReserved() const;
+
+    /// Return the active arena for the calling thread, or nullptr if there is no active ArenaScope.
+    static Arena * getActive();
+
+private:
+
+    struct Block {
+        std::shared_ptr<char> data;
+        std::size_t size;
+    };
+
+    void * _allocateBytes(std::size_t size, std::shared_ptr<char> & owner);
+
+    std::size_t _blockSize;
+    std::size_t _bytesUsed;
+    std::size_t _current;   // index of the block we're currently allocating from
+    std::size_t _offset;    // offset of the first free byte in the current block
+    std::vector<Block> _blocks;
+};
+
+/**
+ *  @brief RAII object that activates the calling thread's Arena, and resets it on destruction.
+ *
+ *  Scopes may be nested; only the outermost one has any effect, so the arena is reset once the
+ *  outermost unit of work (e.g. the measurement of a single source) is complete.
+ */
+class ArenaScope {
+public:
+
+    ArenaScope();
+
+    ~ArenaScope();
+
+    // No copying
+    ArenaScope(ArenaScope const &) = delete;
+    ArenaScope & operator=(ArenaScope const &) = delete;
+
+private:
+    bool _isOuter;
+};
+
+/**
+ *  Allocate an uninitialized 1-d array, from the thread's active Arena if there is one and from the
+ *  heap otherwise.
+ */
+template <typename T>
+ndarray::Array<T,1,1> allocateTemporary(int n) {
+    Arena * arena = Arena::getActive();
+    if (arena) {
+        return arena->allocate<T>(n);
+    }
+    return ndarray::allocate(n);
+}
+
+/**
+ *  Allocate an uninitialized row-major 2-d array, from the thread's active Arena if there is one
+ *  and from the heap otherwise.
+ */
+template <typename T>
+ndarray::Array<T,2,2> allocateTemporary(int rows, int cols) {
+    Arena * arena = Arena::getActive();
+    if (arena) {
+        return arena->allocate<T>(rows, cols);
+    }
+    return ndarray::allocate(rows, cols);
+}
+
+}}}} // namespace lsst::meas::modelfit::detail
+
+#endif // !LSST_MEAS_MODELFIT_DETAIL_Arena_h_INCLUDED
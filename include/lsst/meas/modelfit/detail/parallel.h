@@ -0,0 +1,307 @@
+// -*- lsst-c++ -*-
+/*
+ * LSST Data Management System
+ * Copyright 2016 LSST/AURA
+ *
+ * This product includes software developed by the
+ * LSST Project (http://www.lsst.org/).
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the LSST License Statement and
+ * the GNU General Public License along with this program.  If not,
+ * see <http://www.lsstcorp.org/LegalNotices/>.
+ */
+
+#ifndef LSST_MEAS_MODELFIT_DETAIL_parallel_h_INCLUDED
+#define LSST_MEAS_MODELFIT_DETAIL_parallel_h_INCLUDED
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace lsst { namespace meas { namespace modelfit { namespace detail {
+
+/**
+ *  @brief Return the number of threads to use for a requested thread count.
+ *
+ *  Values <= 0 are interpreted as "use all hardware threads".
+ */
+inline int resolveThreadCount(int nThreads) {
+    if (nThreads > 0) {
+        return nThreads;
+    }
+    return std::max(1, static_cast<int>(std::thread::hardware_concurrency()));
+}
+
+/**
+ *  @brief RAII object that marks the calling thread as running part of a parallel loop.
+ *
+ *  Loops started (with parallelFor or a ThreadPool) by a thread inside such a scope run serially in
+ *  that thread, so nested parallelism stays within the thread budget of the outermost loop instead of
+ *  multiplying it.
+ */
+class ParallelRegionScope {
+public:
+
+    ParallelRegionScope();
+
+    ParallelRegionScope(ParallelRegionScope const &) = delete;
+    ParallelRegionScope & operator=(ParallelRegionScope const &) = delete;
+
+    ~ParallelRegionScope();
+
+    /// Return whether the calling thread is inside a ParallelRegionScope.
+    static bool isActive();
+
+private:
+    bool _previous;
+};
+
+// Shared state of a parallel loop: indices are handed out dynamically to the threads that call
+// operator(), and the first exception thrown by func is kept (and the remaining indices skipped).
+template <typename Function>
+class ParallelLoop {
+public:
+
+    ParallelLoop(int n, Function & func) : _n(n), _func(func), _next(0) {}
+
+    void operator()(int thread) {
+        for (int i = _next++; i < _n; i = _next++) {
+            try {
+                _func(i, thread);
+            } catch (...) {
+                std::lock_guard<std::mutex> lock(_errorMutex);
+                if (!_error) {
+                    _error = std::current_exception();
+                }
+                _next = _n;
+            }
+        }
+    }
+
+    void rethrow() const {
+        if (_error) {
+            std::rethrow_exception(_error);
+        }
+    }
+
+private:
+    int const _n;
+    Function & _func;
+    std::atomic<int> _next;
+    std::exception_ptr _error;
+    std::mutex _errorMutex;
+};
+
+/**
+ *  @brief Call func(i, thread) for every i in [0, n), distributing the calls over up to nThreads threads.
+ *
+ *  Indices are handed out dynamically, so the assignment of indices to threads is not deterministic;
+ *  the second argument passed to func is the index of the calling thread (in [0, nThreads)), which can
+ *  be used to select per-thread workspace.  With nThreads == 1 (or n <= 1), or when called from inside
+ *  another parallel loop (see ParallelRegionScope), everything runs in the calling thread.  If any call
+ *  throws, remaining indices are skipped and the first exception is rethrown in the calling thread
+ *  after all threads have joined.
+ *
+ *  Threads are started and joined on every call; code that runs many small loops should use a
+ *  ThreadPool instead.
+ */
+template <typename Function>
+void parallelFor(int n, int nThreads, Function func) {
+    nThreads = ParallelRegionScope::isActive() ? 1 : std::min(resolveThreadCount(nThreads), n);
+    if (nThreads <= 1) {
+        for (int i = 0; i < n; ++i) {
+            func(i, 0);
+        }
+        return;
+    }
+    ParallelLoop<Function> loop(n, func);
+    std::vector<std::thread> threads;
+    threads.reserve(nThreads - 1);
+    for (int t = 1; t < nThreads; ++t) {
+        threads.emplace_back([&loop, t]() {
+            ParallelRegionScope scope;
+            loop(t);
+        });
+    }
+    {
+        ParallelRegionScope scope;
+        loop(0);
+    }
+    for (std::vector<std::thread>::iterator t = threads.begin(); t != threads.end(); ++t) {
+        t->join();
+    }
+    loop.rethrow();
+}
+
+/**
+ *  @brief A set of persistent worker threads for running many small parallel loops.
+ *
+ *  A pool with nThreads threads owns nThreads - 1 workers, which wait between loops instead of being
+ *  started and joined each time; the thread that calls parallelFor does its share of the work too.
+ *  A pool runs one loop at a time: a loop started while the pool is busy with another thread's loop,
+ *  or from inside another parallel loop (see ParallelRegionScope), runs serially in the calling thread.
+ *  Most code should use the process-wide pool returned by getShared(), so the number of threads never
+ *  exceeds the number of cores.
+ */
+class ThreadPool {
+public:
+
+    /// Start a pool with resolveThreadCount(nThreads) threads, including the caller.
+    explicit ThreadPool(int nThreads);
+
+    // No copying
+    ThreadPool(ThreadPool const &) = delete;
+    ThreadPool & operator=(ThreadPool const &) = delete;
+
+    /// Stop and join all workers.
+    ~ThreadPool();
+
+    /// Return the number of threads that can run a loop, including the caller.
+    int getThreadCount() const { return _workers.size() + 1; }
+
+    /**
+     *  Return the number of threads a loop started by the calling thread would use: 1 inside another
+     *  parallel loop, getThreadCount() otherwise.
+     *
+     *  This does not account for the pool being busy with another thread's loop.
+     */
+    int getAvailableThreadCount() const { return ParallelRegionScope::isActive() ? 1 : getThreadCount(); }
+
+    /**
+     *  Call func(i, thread) for every i in [0, n), using up to getAvailableThreadCount() threads.
+     *
+     *  The semantics are the same as those of the free function parallelFor.
+     */
+    template <typename Function>
+    void parallelFor(int n, Function func) {
+        int const nThreads = std::min(getAvailableThreadCount(), n);
+        std::unique_lock<std::mutex> busy(_busyMutex, std::defer_lock);
+        if (nThreads <= 1 || !busy.try_lock()) {
+            for (int i = 0; i < n; ++i) {
+                func(i, 0);
+            }
+            return;
+        }
+        ParallelLoop<Function> loop(n, func);
+        _run([&loop](int thread) { loop(thread); }, nThreads);
+        loop.rethrow();
+    }
+
+    /// Return the process-wide pool, with one thread per hardware thread, creating it on first use.
+    static ThreadPool & getShared();
+
+private:
+
+    // Run task(thread) on the calling thread (thread=0) and workers 1 through nThreads-1, and wait
+    // for all of them to finish.  The task must not throw.
+    void _run(std::function<void(int)> const & task, int nThreads);
+
+    void _work(int thread);
+
+    std::vector<std::thread> _workers;
+    std::mutex _busyMutex;    // held by the thread whose loop the pool is running
+    std::mutex _mutex;
+    std::condition_variable _wake;
+    std::condition_variable _done;
+    std::function<void(int)> const * _task;
+    int _nThreads;            // number of threads (including the caller) running the current task
+    int _nRunning;            // number of workers that have not yet finished the current task
+    unsigned long _generation;  // incremented for every task, so workers can tell a new one has started
+    bool _stop;
+};
+
+/**
+ *  @brief A thread-safe pool of reusable workspace objects.
+ *
+ *  Objects are created by a factory function when no idle one is available, and are returned to the
+ *  pool when the Lease that holds them is destroyed, so a pool holds at most as many objects as there
+ *  have ever been concurrent leases.  This lets a const method that needs mutable scratch space be
+ *  called from several threads at once.
+ */
+template <typename T>
+class WorkspacePool {
+public:
+
+    typedef std::function<std::unique_ptr<T>()> Factory;
+
+    /// RAII handle for a workspace object; returns it to the pool on destruction.
+    class Lease {
+    public:
+
+        Lease(Lease && other) : _pool(other._pool), _object(std::move(other._object)) {}
+
+        Lease(Lease const &) = delete;
+        Lease & operator=(Lease const &) = delete;
+        Lease & operator=(Lease &&) = delete;
+
+        ~Lease() {
+            if (_object) {
+                _pool->_release(std::move(_object));
+            }
+        }
+
+        T & operator*() const { return *_object; }
+        T * operator->() const { return _object.get(); }
+
+    private:
+
+        friend class WorkspacePool;
+
+        Lease(WorkspacePool const * pool, std::unique_ptr<T> object) :
+            _pool(pool), _object(std::move(object))
+        {}
+
+        WorkspacePool const * _pool;
+        std::unique_ptr<T> _object;
+    };
+
+    explicit WorkspacePool(Factory factory) : _factory(std::move(factory)) {}
+
+    // No copying (the factory may capture the owner of the pool)
+    WorkspacePool(WorkspacePool const &) = delete;
+    WorkspacePool & operator=(WorkspacePool const &) = delete;
+
+    /// Return an idle workspace object, creating a new one if there are none.
+    Lease acquire() const {
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            if (!_idle.empty()) {
+                std::unique_ptr<T> object = std::move(_idle.back());
+                _idle.pop_back();
+                return Lease(this, std::move(object));
+            }
+        }
+        return Lease(this, _factory());
+    }
+
+private:
+
+    void _release(std::unique_ptr<T> object) const {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _idle.push_back(std::move(object));
+    }
+
+    Factory _factory;
+    mutable std::mutex _mutex;
+    mutable std::vector<std::unique_ptr<T>> _idle;
+};
+
+}}}} // namespace lsst::meas::modelfit::detail
+
+#endif // !LSST_MEAS_MODELFIT_DETAIL_parallel_h_INCLUDED
@@ -0,0 +1,88 @@
+// -*- lsst-c++ -*-
+/*
+ * LSST Data Management System
+ * Copyright 2008-2017 LSST Corporation.
+ *
+ * This product includes software developed by the
+ * LSST Project (http://www.lsstcorp.org/).
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the LSST License Statement and
+ * the GNU General Public License along with this program.  If not,
+ * see <http://www.lsstcorp.org/LegalNotices/>.
+ */
+
+#ifndef LSST_MEAS_MODELFIT_DETAIL_parallelSeeded_h_INCLUDED
+#define LSST_MEAS_MODELFIT_DETAIL_parallelSeeded_h_INCLUDED
+
+#include <algorithm>
+#include <vector>
+
+#include "lsst/meas/modelfit/SpatialSeedIndex.h"
+#include "lsst/meas/modelfit/detail/parallel.h"
+
+namespace lsst { namespace meas { namespace modelfit { namespace detail {
+
+/**
+ *  @brief Call func(i, seed, thread) for every source, in spatial order, distributing the work over up
+ *         to nThreads threads.
+ *
+ *  The spatial order of all sources (see SpatialSeedIndex) is split into contiguous chunks (one chunk
+ *  when nThreads == 1, several per thread otherwise, for load balancing).  Each chunk is processed
+ *  sequentially by a single thread, and seed is the index of the nearest source in the same chunk that
+ *  has already been processed successfully and lies within maxDistance, or -1 if there is none.  func
+ *  must return true if source i was processed successfully (and hence may seed others).
+ *
+ *  Because seeds never cross chunk boundaries, the seed chosen for each source depends on nThreads but
+ *  not on how the threads are scheduled.  Exceptions are handled as in parallelFor.
+ */
+template <typename Function>
+void parallelSeededFor(
+    std::vector<afw::geom::Point2D> const & positions,
+    double maxDistance,
+    int nThreads,
+    Function func
+) {
+    static int const CHUNKS_PER_THREAD = 4;
+    int const n = positions.size();
+    if (n == 0) {
+        return;
+    }
+    nThreads = std::min(resolveThreadCount(nThreads), n);
+    SpatialSeedIndex index(positions, maxDistance);
+    std::vector<int> const & order = index.getOrder();
+    int const nChunks = (nThreads == 1) ? 1 : std::min(n, CHUNKS_PER_THREAD*nThreads);
+    parallelFor(
+        nChunks, nThreads,
+        [&](int chunk, int thread) {
+            int const begin = (static_cast<long>(n)*chunk)/nChunks;
+            int const end = (static_cast<long>(n)*(chunk + 1))/nChunks;
+            std::vector<afw::geom::Point2D> chunkPositions;
+            chunkPositions.reserve(end - begin);
+            for (int k = begin; k < end; ++k) {
+                chunkPositions.push_back(positions[order[k]]);
+            }
+            SpatialSeedIndex chunkIndex(chunkPositions, maxDistance);
+            for (int local : chunkIndex.getOrder()) {
+                int const nearest = chunkIndex.findNearest(local);
+                int const seed = (nearest >= 0) ? order[begin + nearest] : -1;
+                if (func(order[begin + local], seed, thread)) {
+                    chunkIndex.markFitted(local);
+                }
+            }
+        }
+    );
+}
+
+}}}} // namespace lsst::meas::modelfit::detail
+
+#endif // !LSST_MEAS_MODELFIT_DETAIL_parallelSeeded_h_INCLUDED
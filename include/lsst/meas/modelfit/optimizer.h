@@ -24,6 +24,10 @@
 #ifndef LSST_MEAS_MODELFIT_optimizer_h_INCLUDED
 #define LSST_MEAS_MODELFIT_optimizer_h_INCLUDED
 
+#include <functional>
+#include <string>
+#include <vector>
+
 #include "ndarray.h"
 
 #include "lsst/base.h"
@@ -38,6 +42,36 @@ class Likelihood;
 class Prior;
 class Optimizer;
 
+/**
+ *  @brief Hard constraints on the parameters of an OptimizerObjective.
+ *
+ *  The feasible region is defined by elementwise bounds
+ *  @f[
+ *    \text{lower} \le x \le \text{upper}
+ *  @f]
+ *  (with infinite values indicating unbounded parameters) and linear inequality constraints
+ *  @f[
+ *    \text{inequalityMatrix}\;x \ge \text{inequalityVector}
+ *  @f]
+ *  Optimizer keeps all trial steps inside this region, rather than relying on the prior to reject
+ *  infeasible steps.
+ */
+class OptimizerConstraints {
+public:
+
+    ndarray::Array<Scalar,1,1> lower;             ///< lower bounds; shape (parameterSize)
+    ndarray::Array<Scalar,1,1> upper;             ///< upper bounds; shape (parameterSize)
+    ndarray::Array<Scalar,2,2> inequalityMatrix;  ///< shape (nInequalities, parameterSize)
+    ndarray::Array<Scalar,1,1> inequalityVector;  ///< shape (nInequalities)
+
+    /// Construct with infinite bounds and zero-initialized inequality constraints.
+    explicit OptimizerConstraints(int parameterSize, int nInequalities=0);
+
+    /// Return true if the given parameter vector satisfies all constraints.
+    bool isFeasible(ndarray::Array<Scalar const,1,1> const & parameters) const;
+
+};
+
 /**
  *  @brief Base class for objective functions for Optimizer
  */
@@ -125,6 +159,57 @@ public:
         return false;
     }
 
+    /**
+     *  Return true if the Objective implements computeNormalEquations().
+     *
+     *  The default implementation returns false.
+     */
+    virtual bool hasNormalEquations() const { return false; }
+
+    /**
+     *  Evaluate the least-squares objective and its Gauss-Newton derivatives in a single pass.
+     *
+     *  With @f$r@f$ the residuals and @f$J@f$ their derivatives with respect to the parameters, this
+     *  computes @f$\frac{1}{2}\|r\|^2@f$, @f$J^T r@f$, and @f$J^T J@f$ together, which lets
+     *  implementations accumulate them over blocks of data points without ever storing the full
+     *  residual vector or Jacobian matrix.  When hasNormalEquations() returns true, Optimizer uses
+     *  this instead of computeResiduals() and differentiateResiduals().
+     *
+     *  The default implementation throws LogicError.
+     *
+     *  @param[in]  parameters    An array of parameters with shape (parameterSize).
+     *  @param[out] jtr           Output array for @f$J^T r@f$.  Must be allocated to shape
+     *                            (parameterSize), but need not be initialized.
+     *  @param[out] jtj           Output array for @f$J^T J@f$.  Must be allocated to shape
+     *                            (parameterSize, parameterSize), but need not be initialized.  Only
+     *                            the lower triangle is used.
+     *
+     *  @return half the sum of squared residuals (the objective without any prior term).
+     */
+    virtual Scalar computeNormalEquations(
+        ndarray::Array<Scalar const,1,1> const & parameters,
+        ndarray::Array<Scalar,1,1> const & jtr,
+        ndarray::Array<Scalar,2,1> const & jtj
+    ) const;
+
+    /**
+     *  Return true if computeResiduals and computeNormalEquations may safely be called from multiple
+     *  threads at once.
+     *
+     *  This allows Optimizer to evaluate trial steps concurrently (see OptimizerControl::nTrialSteps).
+     *  The prior is always evaluated serially.  The default implementation returns false.
+     */
+    virtual bool supportsConcurrentEvaluation() const { return false; }
+
+    /**
+     *  Return hard constraints on the parameters, or an empty pointer if there are none.
+     *
+     *  This is called once, when an Optimizer is constructed, and only if OptimizerControl::doUseConstraints
+     *  is set.  The default implementation returns an empty pointer.
+     */
+    virtual PTR(OptimizerConstraints const) getConstraints() const {
+        return PTR(OptimizerConstraints const)();
+    }
 
     /**
      *  Return true if the Objective has a Bayesian prior as well as a likelihood.
@@ -261,6 +346,40 @@ public:
         "value passed as the tolerance to solveTrustRegion"
     );
 
+    LSST_CONTROL_FIELD(
+        trustRegionSolver, std::string,
+        "One of 'EIGEN', 'CG', or 'AUTO': whether to solve the trust region subproblem with an "
+        "eigendecomposition (solveTrustRegion), with Steihaug-Toint truncated conjugate gradients "
+        "(solveTrustRegionCG), or to choose based on the number of parameters and truncatedCGThreshold"
+    );
+
+    LSST_CONTROL_FIELD(
+        truncatedCGThreshold, int,
+        "minimum number of parameters for which trustRegionSolver='AUTO' uses truncated conjugate gradients"
+    );
+
+    LSST_CONTROL_FIELD(
+        nTrialSteps, int,
+        "number of trial steps (for successively smaller trust radii) to evaluate concurrently when the "
+        "objective supports concurrent evaluation; each step still makes the same decisions as the serial "
+        "algorithm, but rejected steps cost less wall-clock time.  Steps are evaluated by the process-wide "
+        "thread pool, so no more are tried at once than there are cores, and only one inside another "
+        "parallel loop (e.g. CModelAlgorithm::applyCatalog with nThreads != 1)"
+    );
+
+    LSST_CONTROL_FIELD(
+        doUseNormalEquations, bool,
+        "whether to evaluate the objective with its fused normal equations when it provides them (see "
+        "OptimizerObjective::hasNormalEquations), which avoids storing the residuals and their derivatives; "
+        "Optimizer::getResiduals() is unavailable when they are used"
+    );
+
+    LSST_CONTROL_FIELD(
+        doUseConstraints, bool,
+        "whether to restrict steps to the feasible region declared by the objective (see "
+        "OptimizerObjective::getConstraints); if false, constraints are only enforced through the prior"
+    );
+
     LSST_CONTROL_FIELD(
         maxInnerIterations, int,
         "maximum number of iterations (i.e. function evaluations and trust region subproblems) per step"
@@ -268,7 +387,8 @@ public:
 
     LSST_CONTROL_FIELD(
         maxOuterIterations, int,
-        "maximum number of steps"
+        "maximum number of steps taken by a single call to run() (after restoreState(), the restored steps "
+        "count toward the next run()'s limit)"
     );
 
     LSST_CONTROL_FIELD(
@@ -289,6 +409,11 @@ public:
         trustRegionShrinkReductionRatio(0.25),
         trustRegionShrinkFactor(1.0/3.0),
         trustRegionSolverTolerance(1E-8),
+        trustRegionSolver("AUTO"),
+        truncatedCGThreshold(50),
+        nTrialSteps(1),
+        doUseNormalEquations(true),
+        doUseConstraints(false),
         maxInnerIterations(20),
         maxOuterIterations(500),
         doSaveIterations(false)
@@ -395,6 +520,13 @@ public:
  *  dog-leg approach to the trust region problem.  As a result, we should require fewer steps to
  *  converge, but spend more time computing each step; this is ideal when we expect the time spent
  *  in function evaluation to dominate the time per step anyway.
+ *
+ *  If OptimizerControl::doUseConstraints is set and the objective provides hard constraints (see
+ *  OptimizerObjective::getConstraints), each trust region step is restricted to the feasible region
+ *  with a simple active-set approach: constraints crossed by the step are held as equalities and the
+ *  trust region subproblem is re-solved in the remaining subspace.  Convergence is then tested using
+ *  the gradient projected onto the directions not blocked by active constraints, and a step that is
+ *  completely blocked by active constraints is also considered converged.
  */
 class Optimizer {
 public:
@@ -423,6 +555,10 @@ public:
         STATUS = STATUS_STEP | STATUS_TR,
     };
 
+    /// Callable invoked by run() after each successful step, e.g. to checkpoint it with saveState();
+    /// as with the objective, an exception it throws stops the optimizer with FAILED_EXCEPTION.
+    typedef std::function<void(Optimizer const &)> StepCallback;
+
     Optimizer(
         PTR(Objective const) objective,
         ndarray::Array<Scalar const,1,1> const & parameters,
@@ -433,25 +569,46 @@ public:
 
     Control const & getControl() const { return _ctrl; }
 
-    bool step() { return _stepImpl(0); }
+    bool step() { return _nextStep(); }
 
     bool step(HistoryRecorder const & recorder, afw::table::BaseCatalog & history) {
-        return _stepImpl(0, &recorder, &history);
+        return _nextStep(&recorder, &history);
     }
 
+    /**
+     *  Take steps until the optimizer converges or fails, and return the total number of successful steps
+     *  (see getOuterIterCount()).
+     *
+     *  The optimizer fails with FAILED_MAX_OUTER_ITERATIONS after Control::maxOuterIterations steps in
+     *  this call, or (after restoreState()) in this call and before the state was saved.
+     */
     int run() { return _runImpl(); }
 
     int run(HistoryRecorder const & recorder, afw::table::BaseCatalog & history) {
         return _runImpl(&recorder, &history);
     }
 
+    /// Run the optimizer as run() does, calling onStep after each successful step.
+    int run(StepCallback const & onStep) { return _runImpl(NULL, NULL, &onStep); }
+
+    int run(HistoryRecorder const & recorder, afw::table::BaseCatalog & history,
+            StepCallback const & onStep) {
+        return _runImpl(&recorder, &history, &onStep);
+    }
+
     int getState() const { return _state; }
 
     Scalar getObjectiveValue() const { return _current.objectiveValue; }
 
     ndarray::Array<Scalar const,1,1> getParameters() const { return _current.parameters; }
 
-    ndarray::Array<Scalar const,1,1> getResiduals() const { return _current.residuals; }
+    /**
+     *  Return the residuals at the current parameters.
+     *
+     *  @throw pex::exceptions::LogicError if the optimizer uses the objective's normal equations (see
+     *         Control::doUseNormalEquations), as the residuals are then never materialized.
+     */
+    ndarray::Array<Scalar const,1,1> getResiduals() const;
 
     ndarray::Array<Scalar const,1,1> getGradient() const { return _gradient; }
 
@@ -460,6 +617,36 @@ public:
     /// Remove the symmetric-rank-1 secant term from the Hessian, making it just (J^T J)
     void removeSR1Term();
 
+    /// Return the number of successful steps taken, including those before restoreState().
+    int getOuterIterCount() const { return _outerIterCount; }
+
+    /**
+     *  Serialize the optimizer's state to a compact binary blob.
+     *
+     *  The blob holds everything that changes as the optimizer runs: the current parameters, trust
+     *  radius, gradient, Hessian, symmetric-rank-1 secant term, outer iteration count and state flags.
+     *  It does not hold the objective or the Control, which must be provided again to restore it.
+     *  States saved between steps can be restored exactly; run() on the restored optimizer then makes
+     *  the same steps the original would have.
+     */
+    std::string saveState() const;
+
+    /**
+     *  Restore a state saved by saveState(), replacing this optimizer's own.
+     *
+     *  The optimizer must have been constructed with the same objective (or an equivalent one) and
+     *  Control as the one that was saved; the residuals (or normal equations) and prior at the saved
+     *  parameters are recomputed, at the cost of one objective evaluation.
+     *
+     *  The restored step count counts toward the Control::maxOuterIterations limit of the next call to
+     *  run(), so a fit that is checkpointed from a run() and resumed takes no more steps in total than
+     *  it would have if it had not been interrupted.
+     *
+     *  @throw pex::exceptions::InvalidParameterError if the blob is not a saved Optimizer state.
+     *  @throw pex::exceptions::LengthError if the blob's parameter count does not match the objective.
+     */
+    void restoreState(std::string const & state);
+
 private:
 
     struct IterationData {
@@ -467,8 +654,10 @@ private:
         Scalar priorValue;
         ndarray::Array<Scalar,1,1> parameters;
         ndarray::Array<Scalar,1,1> residuals;
+        ndarray::Array<Scalar,1,1> jtr;  // only used when the objective has normal equations
+        ndarray::Array<Scalar,2,2> jtj;  // only used when the objective has normal equations
 
-        IterationData(int dataSize, int parameterSize);
+        IterationData(int dataSize, int parameterSize, bool useNormalEquations);
 
         void swap(IterationData & other);
     };
@@ -481,13 +670,40 @@ private:
         afw::table::BaseCatalog * history=NULL
     );
 
-    int _runImpl(HistoryRecorder const * recorder=NULL, afw::table::BaseCatalog * history=NULL);
+    bool _nextStep(HistoryRecorder const * recorder=NULL, afw::table::BaseCatalog * history=NULL);
+
+    int _runImpl(
+        HistoryRecorder const * recorder=NULL,
+        afw::table::BaseCatalog * history=NULL,
+        StepCallback const * onStep=NULL
+    );
 
     void _computeDerivatives();
 
+    Scalar _evaluate(IterationData & data) const;
+
+    void _solveTrustRegion(
+        ndarray::Array<Scalar,1,1> const & x,
+        ndarray::Array<Scalar const,2,1> const & F, ndarray::Array<Scalar const,1,1> const & g,
+        double r
+    ) const;
+
+    void _constrainStep(ndarray::Array<Scalar,1,1> const & trialStep, double trustRadius) const;
+
+    void _computeTrialSteps(int maxTrials);
+
+    Scalar _computeProjectedGradientNorm() const;
+
     int _state;
+    int _outerIterCount;  // number of successful steps, which is saved with the rest of the state
+    bool _isRestored;     // whether the next run() should count the steps restored by restoreState()
     PTR(Objective const) _objective;
     Control _ctrl;
+    bool _useNormalEquations;
+    bool _useTruncatedCG;
+    bool _isSpeculative;  // whether to evaluate batches of trial steps concurrently
+    int _nTrials;         // number of trial steps in the current batch
+    int _nextTrial;       // index of the next trial step to consider in the current batch
     double _trustRadius;
     IterationData _current;
     IterationData _next;
@@ -498,6 +714,10 @@ private:
     Matrix _sr1b;
     Vector _sr1v;
     Vector _sr1jtr;
+    std::vector<IterationData> _trials;
+    std::vector<ndarray::Array<Scalar,1,1>> _trialSteps;
+    Matrix _constraintMatrix;  // all constraints (bounds included) as rows of A in A x >= b
+    Vector _constraintVector;  // b in A x >= b
 };
 
 /**
@@ -521,6 +741,26 @@ void solveTrustRegion(
     double r, double tolerance
 );
 
+/**
+ *  @brief Approximately solve the trust region subproblem with the Steihaug-Toint truncated conjugate
+ *         gradient method.
+ *
+ *  This minimizes the same quadratic model as solveTrustRegion, but uses only matrix-vector products
+ *  with @f$F@f$, making each iteration @f$O(N^2)@f$ instead of requiring an @f$O(N^3)@f$
+ *  eigendecomposition.  Iteration stops when the residual norm falls below tolerance times
+ *  @f$||g||@f$, when the iterate reaches the ball constraint, or when a direction of nonpositive
+ *  curvature is found (in which case we follow it to the boundary).  The result is never worse than
+ *  the Cauchy point, but it is only an approximation to the exact solution when the constraint is
+ *  active.
+ *
+ *  This implementation is based on Algorithm 7.2 of "Numerical Optimization" by Nocedal and Wright.
+ */
+void solveTrustRegionCG(
+    ndarray::Array<Scalar,1,1> const & x,
+    ndarray::Array<Scalar const,2,1> const & F, ndarray::Array<Scalar const,1,1> const & g,
+    double r, double tolerance
+);
+
 }}} // namespace lsst::meas::modelfit
 
 #endif // !LSST_MEAS_MODELFIT_optimizer_h_INCLUDED
@@ -29,6 +29,7 @@ from .multiModel import *
 from .likelihood import *
 from .sampler import *
 from .adaptiveImportanceSampler import *
+from .ensembleSampler import *
 from .optimizer import *
 from .pixelFitRegion import *
 from .psf import *
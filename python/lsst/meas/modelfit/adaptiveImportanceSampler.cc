@@ -22,6 +22,7 @@
  */
 
 #include "pybind11/pybind11.h"
+#include "pybind11/stl.h"
 
 #include "lsst/pex/config/python.h"
 #include "lsst/meas/modelfit/AdaptiveImportanceSampler.h"
@@ -58,11 +59,17 @@ PYBIND11_PLUGIN(adaptiveImportanceSampler) {
     LSST_DECLARE_CONTROL_FIELD(clsImportanceSamplerControl, ImportanceSamplerControl, tau2);
     LSST_DECLARE_CONTROL_FIELD(clsImportanceSamplerControl, ImportanceSamplerControl, targetPerplexity);
     LSST_DECLARE_CONTROL_FIELD(clsImportanceSamplerControl, ImportanceSamplerControl, maxRepeat);
+    LSST_DECLARE_CONTROL_FIELD(clsImportanceSamplerControl, ImportanceSamplerControl, doQuasiRandom);
+    LSST_DECLARE_CONTROL_FIELD(clsImportanceSamplerControl, ImportanceSamplerControl, nBlockSamples);
+    LSST_DECLARE_CONTROL_FIELD(clsImportanceSamplerControl, ImportanceSamplerControl,
+                               targetEffectiveSampleSize);
 
     PyAdaptiveImportanceSampler clsAdaptiveImportanceSampler(mod, "AdaptiveImportanceSampler");
     clsAdaptiveImportanceSampler.def(py::init<afw::table::Schema &, std::shared_ptr<afw::math::Random>,
-                                              std::map<int, ImportanceSamplerControl> const &, bool>(),
-                                     "sampleSchema"_a, "rng"_a, "ctrls"_a, "doSaveIteration"_a = false);
+                                              std::map<int, ImportanceSamplerControl> const &, bool,
+                                              bool>(),
+                                     "sampleSchema"_a, "rng"_a, "ctrls"_a, "doSaveIteration"_a = false,
+                                     "doRecycleSamples"_a = false);
     // virtual run method already wrapped by Sampler base class
     clsAdaptiveImportanceSampler.def("computeNormalizedPerplexity",
                                      &AdaptiveImportanceSampler::computeNormalizedPerplexity);
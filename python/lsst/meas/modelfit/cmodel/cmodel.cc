@@ -22,6 +22,8 @@
  */
 
 #include "pybind11/pybind11.h"
+#include "pybind11/stl.h"
+#include "pybind11/functional.h"
 
 #include "numpy/arrayobject.h"
 #include "ndarray/pybind11.h"
@@ -41,6 +43,8 @@ using PyCModelStageControl = py::class_<CModelStageControl, std::shared_ptr<CMod
 using PyCModelControl = py::class_<CModelControl, std::shared_ptr<CModelControl>>;
 using PyCModelStageResult = py::class_<CModelStageResult, std::shared_ptr<CModelStageResult>>;
 using PyCModelResult = py::class_<CModelResult, std::shared_ptr<CModelResult>>;
+using PyCModelResultBatch = py::class_<CModelResultBatch, std::shared_ptr<CModelResultBatch>>;
+using PyPerfCounters = py::class_<PerfCounters>;
 using PyCModelAlgorithm = py::class_<CModelAlgorithm, std::shared_ptr<CModelAlgorithm>>;
 
 static PyCModelStageControl declareCModelStageControl(py::module &mod) {
@@ -48,6 +52,7 @@ static PyCModelStageControl declareCModelStageControl(py::module &mod) {
     cls.def(py::init<>());
     cls.def("getProfile", &CModelStageControl::getProfile);
     cls.def("getModel", &CModelStageControl::getModel);
+    cls.def("getAdaptiveModels", &CModelStageControl::getAdaptiveModels);
     cls.def("getPrior", &CModelStageControl::getPrior);
     LSST_DECLARE_CONTROL_FIELD(cls, CModelStageControl, profileName);
     LSST_DECLARE_CONTROL_FIELD(cls, CModelStageControl, priorSource);
@@ -56,6 +61,8 @@ static PyCModelStageControl declareCModelStageControl(py::module &mod) {
     LSST_DECLARE_NESTED_CONTROL_FIELD(cls, CModelStageControl, empiricalPriorConfig);
     LSST_DECLARE_CONTROL_FIELD(cls, CModelStageControl, nComponents);
     LSST_DECLARE_CONTROL_FIELD(cls, CModelStageControl, maxRadius);
+    LSST_DECLARE_CONTROL_FIELD(cls, CModelStageControl, adaptiveSnThresholds);
+    LSST_DECLARE_CONTROL_FIELD(cls, CModelStageControl, adaptiveComponents);
     LSST_DECLARE_CONTROL_FIELD(cls, CModelStageControl, usePixelWeights);
     LSST_DECLARE_CONTROL_FIELD(cls, CModelStageControl, weightsMultiplier);
     LSST_DECLARE_NESTED_CONTROL_FIELD(cls, CModelStageControl, optimizer);
@@ -74,6 +81,10 @@ static PyCModelControl declareCModelControl(py::module &mod) {
     LSST_DECLARE_NESTED_CONTROL_FIELD(cls, CModelControl, dev);
     LSST_DECLARE_CONTROL_FIELD(cls, CModelControl, minInitialRadius);
     LSST_DECLARE_CONTROL_FIELD(cls, CModelControl, fallbackInitialMomentsPsfFactor);
+    LSST_DECLARE_CONTROL_FIELD(cls, CModelControl, precomputeInverseSigma);
+    LSST_DECLARE_CONTROL_FIELD(cls, CModelControl, doFluxInner);
+    LSST_DECLARE_CONTROL_FIELD(cls, CModelControl, doFluxSigma);
+    LSST_DECLARE_CONTROL_FIELD(cls, CModelControl, doEllipses);
     return cls;
 }
 
@@ -98,6 +109,46 @@ private:
     std::bitset<N> const *_target;
 };
 
+static PyPerfCounters declarePerfCounters(py::module &mod) {
+    PyPerfCounters cls(mod, "PerfCounters");
+
+    cls.attr("CMODEL_INITIAL") = py::cast(int(PerfCounters::CMODEL_INITIAL));
+    cls.attr("CMODEL_EXP") = py::cast(int(PerfCounters::CMODEL_EXP));
+    cls.attr("CMODEL_DEV") = py::cast(int(PerfCounters::CMODEL_DEV));
+    cls.attr("OPTIMIZER_STEP") = py::cast(int(PerfCounters::OPTIMIZER_STEP));
+    cls.attr("MODEL_MATRIX") = py::cast(int(PerfCounters::MODEL_MATRIX));
+    cls.attr("N_REGIONS") = py::cast(int(PerfCounters::N_REGIONS));
+    cls.attr("CYCLES") = py::cast(int(PerfCounters::CYCLES));
+    cls.attr("INSTRUCTIONS") = py::cast(int(PerfCounters::INSTRUCTIONS));
+    cls.attr("CACHE_MISSES") = py::cast(int(PerfCounters::CACHE_MISSES));
+    cls.attr("BRANCH_MISSES") = py::cast(int(PerfCounters::BRANCH_MISSES));
+    cls.attr("N_EVENTS") = py::cast(int(PerfCounters::N_EVENTS));
+
+    py::class_<PerfCounters::Counts> clsCounts(cls, "Counts");
+    clsCounts.def(py::init<>());
+    clsCounts.def_readonly("events", &PerfCounters::Counts::events);
+    clsCounts.def_readonly("calls", &PerfCounters::Counts::calls);
+    clsCounts.def("getInstructionsPerCycle", &PerfCounters::Counts::getInstructionsPerCycle);
+
+    py::class_<PerfCounters::ThreadReport> clsThreadReport(cls, "ThreadReport");
+    clsThreadReport.def_readonly("thread", &PerfCounters::ThreadReport::thread);
+    clsThreadReport.def_readonly("regions", &PerfCounters::ThreadReport::regions);
+
+    cls.def_static("enable", &PerfCounters::enable);
+    cls.def_static("disable", &PerfCounters::disable);
+    cls.def_static("isEnabled", &PerfCounters::isEnabled);
+    cls.def_static("reset", &PerfCounters::reset);
+    cls.def_static("getReport", &PerfCounters::getReport);
+    cls.def_static("formatReport", &PerfCounters::formatReport);
+    cls.def_static("getRegionName",
+                   [](int region) { return PerfCounters::getRegionName(PerfCounters::Region(region)); },
+                   "region"_a);
+    cls.def_static("getEventName",
+                   [](int event) { return PerfCounters::getEventName(PerfCounters::Event(event)); },
+                   "event"_a);
+    return cls;
+}
+
 static PyCModelStageResult declareCModelStageResult(py::module &mod) {
     PyCModelStageResult cls(mod, "CModelStageResult");
 
@@ -122,6 +173,7 @@ static PyCModelStageResult declareCModelStageResult(py::module &mod) {
     cls.def_readonly("fluxInner", &CModelStageResult::fluxInner);
     cls.def_readonly("objective", &CModelStageResult::objective);
     cls.def_readonly("time", &CModelStageResult::time);
+    cls.def_readonly("counters", &CModelStageResult::counters);
     cls.def_readonly("ellipse", &CModelStageResult::ellipse);
     cls.def_readonly("nonlinear", &CModelStageResult::nonlinear);
     cls.def_readonly("amplitudes", &CModelStageResult::amplitudes);
@@ -178,6 +230,40 @@ static PyCModelResult declareCModelResult(py::module &mod) {
     return cls;
 }
 
+static PyCModelResultBatch declareCModelResultBatch(py::module &mod) {
+    PyCModelResultBatch cls(mod, "CModelResultBatch");
+
+    py::class_<CModelResultBatch::Field> clsField(cls, "Field");
+    clsField.def_readonly("name", &CModelResultBatch::Field::name);
+    clsField.def_readonly("offset", &CModelResultBatch::Field::offset);
+    clsField.def_readonly("size", &CModelResultBatch::Field::size);
+    clsField.def_readonly("isFlags", &CModelResultBatch::Field::isFlags);
+
+    cls.def(py::init<CModelControl const &, int>(), "ctrl"_a, "size"_a);
+    cls.def(py::init<CModelControl const &, ndarray::Array<Scalar, 2, 2> const &>(), "ctrl"_a, "buffer"_a);
+    cls.def("getSize", &CModelResultBatch::getSize);
+    cls.def("__len__", &CModelResultBatch::getSize);
+    cls.def("getRowSize", &CModelResultBatch::getRowSize);
+    cls.def("getFields", &CModelResultBatch::getFields);
+    cls.def("getBuffer", &CModelResultBatch::getBuffer);
+    cls.def("set", &CModelResultBatch::set, "index"_a, "result"_a);
+    cls.def("isDone", &CModelResultBatch::isDone, "index"_a);
+    cls.def("countDone", &CModelResultBatch::countDone);
+    // In-flight states are binary blobs, so they're passed to Python as bytes rather than str.
+    cls.def("getInFlightState",
+            [](CModelResultBatch const &self, int index) { return py::bytes(self.getInFlightState(index)); },
+            "index"_a);
+    cls.def("setInFlightState", &CModelResultBatch::setInFlightState, "index"_a, "state"_a);
+    cls.def("getInFlightStates", [](CModelResultBatch const &self) {
+        py::dict result;
+        for (auto const &item : self.getInFlightStates()) {
+            result[py::int_(item.first)] = py::bytes(item.second);
+        }
+        return result;
+    });
+    return cls;
+}
+
 static PyCModelAlgorithm declareCModelAlgorithm(py::module &mod) {
     PyCModelAlgorithm cls(mod, "CModelAlgorithm");
     cls.def(py::init<std::string const &, CModelControl const &, afw::table::Schema &>(), "name"_a, "ctrl"_a,
@@ -200,7 +286,22 @@ static PyCModelAlgorithm declareCModelAlgorithm(py::module &mod) {
                     CModelAlgorithm::measure,
             "measRecord"_a, "exposure"_a, "refRecord"_a);
     cls.def("fail", &CModelAlgorithm::fail, "measRecord"_a, "error"_a);
+    cls.def("applyCatalog",
+            [](CModelAlgorithm const &self, afw::table::SourceCatalog const &catalog,
+               afw::image::Exposure<Pixel> const &exposure, CModelResultBatch &output, int nThreads,
+               bool resume, std::function<void(CModelResultBatch const &)> const &checkpoint,
+               int checkpointInterval, int checkpointStepInterval) {
+                // The checkpoint callable reacquires the GIL when it's called.
+                py::gil_scoped_release release;
+                self.applyCatalog(catalog, exposure, output, nThreads, resume, checkpoint,
+                                  checkpointInterval, checkpointStepInterval);
+            },
+            "catalog"_a, "exposure"_a, "output"_a, "nThreads"_a = 0, "resume"_a = false,
+            "checkpoint"_a = nullptr, "checkpointInterval"_a = 1000, "checkpointStepInterval"_a = 0);
     cls.def("writeResultToRecord", &CModelAlgorithm::writeResultToRecord, "result"_a, "record"_a);
+    cls.def("renderModels", &CModelAlgorithm::renderModels, "catalog"_a, "exposure"_a,
+            "name"_a = "modelfit_CModel", "nSigma"_a = 6.0, "tileSize"_a = 256, "nThreads"_a = 0,
+            py::call_guard<py::gil_scoped_release>());
     return cls;
 }
 
@@ -222,8 +323,10 @@ PYBIND11_PLUGIN(cmodel) {
 
     declareCModelStageControl(mod);
     auto clsControl = declareCModelControl(mod);
+    declarePerfCounters(mod);
     declareCModelStageResult(mod);
     auto clsResult = declareCModelResult(mod);
+    declareCModelResultBatch(mod);
     auto clsAlgorithm = declareCModelAlgorithm(mod);
     clsAlgorithm.attr("Control") = clsControl;
     clsAlgorithm.attr("Result") = clsResult;
@@ -24,15 +24,64 @@ from __future__ import absolute_import, division, print_function
 # The Plugin classes here are accessed via registries, not direct imports.
 __all__ = ("CModelStageConfig", "CModelConfig")
 
-from .cmodel import CModelStageControl, CModelControl, CModelAlgorithm
+import numpy
+
+from .cmodel import CModelStageControl, CModelControl, CModelAlgorithm, CModelResultBatch
 
 from lsst.pex.config import makeConfigClass
+from lsst.utils import continueClass
 import lsst.meas.base
 
 
 CModelStageConfig = makeConfigClass(CModelStageControl)
 CModelConfig = makeConfigClass(CModelControl)
 
+
+@continueClass
+class CModelResultBatch:
+
+    def getDtype(self):
+        """Return the NumPy structured dtype of a row of the buffer.
+
+        Flag fields are unsigned 64-bit integers, with bit ``i`` set when flag ``i`` (e.g.
+        ``CModelResult.FAILED``) is; all other fields are 64-bit floats.
+        """
+        names = []
+        formats = []
+        offsets = []
+        for field in self.getFields():
+            base = numpy.uint64 if field.isFlags else numpy.float64
+            names.append(field.name)
+            formats.append(base if field.size == 1 else (base, (field.size,)))
+            offsets.append(8*field.offset)
+        return numpy.dtype(dict(names=names, formats=formats, offsets=offsets,
+                                itemsize=8*self.getRowSize()))
+
+    def getArray(self):
+        """Return a structured array that views the buffer without copying it.
+
+        The array remains valid (and keeps the buffer alive) after the batch is destroyed.
+        """
+        return self.getBuffer().view(self.getDtype())[:, 0]
+
+    @classmethod
+    def fromArray(cls, ctrl, array):
+        """Construct a batch that writes directly to a preallocated structured array.
+
+        Parameters
+        ----------
+        ctrl : `CModelControl`
+            Control object the results will be produced with.
+        array : `numpy.ndarray`
+            One-dimensional, C-contiguous array with the dtype returned by ``getDtype`` for a batch
+            with the same control, such as one created by
+            ``numpy.empty(n, dtype=CModelResultBatch(ctrl, 0).getDtype())``.
+        """
+        if array.ndim != 1 or not array.flags.c_contiguous or array.dtype.itemsize % 8 != 0:
+            raise ValueError("array must be one-dimensional and C-contiguous with 8-byte fields")
+        buffer = array.view(numpy.float64).reshape(len(array), array.dtype.itemsize//8)
+        return cls(ctrl, buffer)
+
 apCorrList = ("modelfit_CModel", "modelfit_CModel_initial", "modelfit_CModel_exp", "modelfit_CModel_dev")
 
 
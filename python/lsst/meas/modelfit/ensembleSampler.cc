@@ -0,0 +1,73 @@
+// -*- lsst-c++ -*-
+/*
+ * LSST Data Management System
+ * Copyright 2016 LSST/AURA.
+ *
+ * This product includes software developed by the
+ * LSST Project (http://www.lsst.org/).
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the LSST License Statement and
+ * the GNU General Public License along with this program.  If not,
+ * see <http://www.lsstcorp.org/LegalNotices/>.
+ */
+
+#include "pybind11/pybind11.h"
+
+#include "lsst/pex/config/python.h"
+#include "lsst/meas/modelfit/EnsembleSampler.h"
+#include "lsst/afw/table/BaseRecord.h"
+#include "lsst/afw/table/BaseTable.h"
+#include "lsst/afw/table/Catalog.h"
+
+namespace py = pybind11;
+using namespace pybind11::literals;
+
+namespace lsst {
+namespace meas {
+namespace modelfit {
+namespace {
+
+using PyEnsembleSamplerControl = py::class_<EnsembleSamplerControl, std::shared_ptr<EnsembleSamplerControl>>;
+using PyEnsembleSampler = py::class_<EnsembleSampler, std::shared_ptr<EnsembleSampler>, Sampler>;
+
+PYBIND11_PLUGIN(ensembleSampler) {
+    py::module mod("ensembleSampler");
+
+    py::module::import("lsst.afw.table");
+    py::module::import("lsst.afw.math");
+    py::module::import("lsst.meas.modelfit.sampler");
+    py::module::import("lsst.meas.modelfit.mixture");
+
+    PyEnsembleSamplerControl clsEnsembleSamplerControl(mod, "EnsembleSamplerControl");
+    clsEnsembleSamplerControl.def(py::init<>());
+    clsEnsembleSamplerControl.def("validate", &EnsembleSamplerControl::validate);
+    LSST_DECLARE_CONTROL_FIELD(clsEnsembleSamplerControl, EnsembleSamplerControl, nWalkers);
+    LSST_DECLARE_CONTROL_FIELD(clsEnsembleSamplerControl, EnsembleSamplerControl, nBurnIn);
+    LSST_DECLARE_CONTROL_FIELD(clsEnsembleSamplerControl, EnsembleSamplerControl, nSteps);
+    LSST_DECLARE_CONTROL_FIELD(clsEnsembleSamplerControl, EnsembleSamplerControl, stretch);
+    LSST_DECLARE_CONTROL_FIELD(clsEnsembleSamplerControl, EnsembleSamplerControl, maxInitAttempts);
+    LSST_DECLARE_CONTROL_FIELD(clsEnsembleSamplerControl, EnsembleSamplerControl, nThreads);
+
+    PyEnsembleSampler clsEnsembleSampler(mod, "EnsembleSampler");
+    clsEnsembleSampler.def(py::init<afw::table::Schema &, std::shared_ptr<afw::math::Random>,
+                                    EnsembleSamplerControl const &>(),
+                           "sampleSchema"_a, "rng"_a, "ctrl"_a);
+    // virtual run method already wrapped by Sampler base class
+    clsEnsembleSampler.def("getAcceptanceFraction", &EnsembleSampler::getAcceptanceFraction);
+
+    return mod.ptr();
+}
+}
+}
+}
+}  // namespace lsst::meas::modelfit::anonymous
@@ -23,7 +23,13 @@
 
 #include "pybind11/pybind11.h"
 
+#include <memory>
+
+#include "numpy/arrayobject.h"
+#include "ndarray/pybind11.h"
+
 #include "lsst/meas/modelfit/integrals.h"
+#include "lsst/meas/modelfit/detail/Arena.h"
 
 namespace py = pybind11;
 using namespace pybind11::literals;
@@ -33,10 +39,60 @@ namespace meas {
 namespace modelfit {
 namespace {
 
+// Python context manager for detail::ArenaScope, which is otherwise an RAII-only class.
+class ArenaScopeContext {
+public:
+
+    void enter() { _scope.reset(new detail::ArenaScope()); }
+
+    void exit() { _scope.reset(); }
+
+private:
+    std::unique_ptr<detail::ArenaScope> _scope;
+};
+
+using PyArena = py::class_<detail::Arena>;
+using PyArenaScope = py::class_<ArenaScopeContext>;
+
 PYBIND11_PLUGIN(integrals) {
     py::module mod("integrals");
+
+    if (_import_array() < 0) {
+        PyErr_SetString(PyExc_ImportError, "numpy.core.multiarray failed to import");
+        return nullptr;
+    }
+
     mod.def("phid", &detail::phid);
     mod.def("bvnu", &detail::bvnu);
+
+    PyArena clsArena(mod, "Arena");
+    clsArena.def(py::init<std::size_t>(), "blockSize"_a = detail::Arena::DEFAULT_BLOCK_SIZE);
+    clsArena.attr("ALIGNMENT") = py::cast(int(detail::Arena::ALIGNMENT));
+    clsArena.attr("DEFAULT_BLOCK_SIZE") = py::cast(int(detail::Arena::DEFAULT_BLOCK_SIZE));
+    clsArena.def("allocate",
+                 (ndarray::Array<double,1,1> (detail::Arena::*)(int)) &detail::Arena::allocate<double>,
+                 "n"_a);
+    clsArena.def("allocate",
+                 (ndarray::Array<double,2,2> (detail::Arena::*)(int, int)) &detail::Arena::allocate<double>,
+                 "rows"_a, "cols"_a);
+    clsArena.def("reset", &detail::Arena::reset);
+    clsArena.def("getBytesUsed", &detail::Arena::getBytesUsed);
+    clsArena.def("getBytesReserved", &detail::Arena::getBytesReserved);
+    clsArena.def_static("getActive", &detail::Arena::getActive, py::return_value_policy::reference);
+
+    PyArenaScope clsArenaScope(mod, "ArenaScope");
+    clsArenaScope.def(py::init<>());
+    clsArenaScope.def("__enter__", [](ArenaScopeContext & self) { self.enter(); });
+    clsArenaScope.def("__exit__", [](ArenaScopeContext & self, py::object, py::object, py::object) {
+        self.exit();
+    });
+
+    mod.def("allocateTemporary", (ndarray::Array<double,1,1> (*)(int)) &detail::allocateTemporary<double>,
+            "n"_a);
+    mod.def("allocateTemporary",
+            (ndarray::Array<double,2,2> (*)(int, int)) &detail::allocateTemporary<double>,
+            "rows"_a, "cols"_a);
+
     return mod.ptr();
 }
 }
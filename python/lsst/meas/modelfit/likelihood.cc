@@ -61,6 +61,7 @@ PYBIND11_PLUGIN(likelihood) {
     cls.def("getModel", &Likelihood::getModel);
     cls.def("computeModelMatrix", &Likelihood::computeModelMatrix, "modelMatrix"_a, "nonlinear"_a,
             "doApplyWeights"_a = true);
+    cls.def("supportsConcurrentEvaluation", &Likelihood::supportsConcurrentEvaluation);
 
     return mod.ptr();
 }
@@ -117,6 +117,7 @@ static PyMixture declareMixture(py::module &mod) {
     cls.def("evaluateComponents", &Mixture::evaluateComponents, "x"_a, "p"_a);
     cls.def("evaluateDerivatives", &Mixture::evaluateDerivatives, "x"_a, "gradient"_a, "hessian"_a);
     cls.def("draw", &Mixture::draw, "rng"_a, "x"_a);
+    cls.def("drawQuasiRandom", &Mixture::drawQuasiRandom, "rng"_a, "x"_a);
     cls.def("updateEM", (void (Mixture::*)(ndarray::Array<Scalar const, 2, 1> const &,
                                            ndarray::Array<Scalar const, 1, 0> const &, Scalar, Scalar)) &
                                 Mixture::updateEM,
@@ -130,6 +131,21 @@ static PyMixture declareMixture(py::module &mod) {
                                            MixtureUpdateRestriction const &restriction, Scalar, Scalar)) &
                                 Mixture::updateEM,
             "x"_a, "restriction"_a, "tau1"_a = 0.0, "tau2"_a = 0.5);
+    cls.def_static("makeFromKMeans",
+                   (std::shared_ptr<Mixture>(*)(ndarray::Array<Scalar const, 2, 1> const &,
+                                                ndarray::Array<Scalar const, 1, 0> const &, int,
+                                                afw::math::Random &, MixtureUpdateRestriction const &, int,
+                                                Scalar, int)) &
+                           Mixture::makeFromKMeans,
+                   "x"_a, "w"_a, "nComponents"_a, "rng"_a, "restriction"_a, "nIterations"_a = 5,
+                   "df"_a = std::numeric_limits<Scalar>::infinity(), "nThreads"_a = 1);
+    cls.def_static("makeFromKMeans",
+                   (std::shared_ptr<Mixture>(*)(ndarray::Array<Scalar const, 2, 1> const &,
+                                                ndarray::Array<Scalar const, 1, 0> const &, int,
+                                                afw::math::Random &, int, Scalar, int)) &
+                           Mixture::makeFromKMeans,
+                   "x"_a, "w"_a, "nComponents"_a, "rng"_a, "nIterations"_a = 5,
+                   "df"_a = std::numeric_limits<Scalar>::infinity(), "nThreads"_a = 1);
     cls.def("clone", &Mixture::clone);
     cls.def(py::init<int, Mixture::ComponentList &, Scalar>(), "dim"_a, "components"_a,
             "df"_a = std::numeric_limits<Scalar>::infinity());
@@ -42,25 +42,80 @@ namespace meas {
 namespace modelfit {
 namespace {
 
-using PyOptimizerObjective = py::class_<OptimizerObjective, std::shared_ptr<OptimizerObjective>>;
+using PyOptimizerConstraints = py::class_<OptimizerConstraints, std::shared_ptr<OptimizerConstraints>>;
+// Trampoline that lets OptimizerObjective be subclassed in Python (mostly for testing the Optimizer
+// on simple analytic problems).  Only the methods needed for that are overridable.
+class OptimizerObjectiveOverride : public OptimizerObjective {
+public:
+
+    using OptimizerObjective::OptimizerObjective;
+
+    void computeResiduals(
+        ndarray::Array<Scalar const,1,1> const & parameters,
+        ndarray::Array<Scalar,1,1> const & residuals
+    ) const override {
+        PYBIND11_OVERLOAD_PURE(void, OptimizerObjective, computeResiduals, parameters, residuals);
+    }
+
+    bool differentiateResiduals(
+        ndarray::Array<Scalar const,1,1> const & parameters,
+        ndarray::Array<Scalar,2,-2> const & derivatives
+    ) const override {
+        PYBIND11_OVERLOAD(bool, OptimizerObjective, differentiateResiduals, parameters, derivatives);
+    }
+
+    PTR(OptimizerConstraints const) getConstraints() const override {
+        py::gil_scoped_acquire gil;
+        py::function override = py::get_overload(static_cast<OptimizerObjective const *>(this),
+                                                 "getConstraints");
+        if (!override) {
+            return OptimizerObjective::getConstraints();
+        }
+        py::object result = override();
+        if (result.is_none()) {
+            return PTR(OptimizerConstraints const)();
+        }
+        return result.cast<PTR(OptimizerConstraints)>();
+    }
+
+};
+
+using PyOptimizerObjective = py::class_<OptimizerObjective, OptimizerObjectiveOverride,
+                                        std::shared_ptr<OptimizerObjective>>;
 using PyOptimizerControl = py::class_<OptimizerControl, std::shared_ptr<OptimizerControl>>;
 using PyOptimizerHistoryRecorder =
         py::class_<OptimizerHistoryRecorder, std::shared_ptr<OptimizerHistoryRecorder>>;
 using PyOptimizer = py::class_<Optimizer, std::shared_ptr<Optimizer>>;
 
+static PyOptimizerConstraints declareOptimizerConstraints(py::module &mod) {
+    PyOptimizerConstraints cls(mod, "OptimizerConstraints");
+    cls.def(py::init<int, int>(), "parameterSize"_a, "nInequalities"_a = 0);
+    cls.def_readwrite("lower", &OptimizerConstraints::lower);
+    cls.def_readwrite("upper", &OptimizerConstraints::upper);
+    cls.def_readwrite("inequalityMatrix", &OptimizerConstraints::inequalityMatrix);
+    cls.def_readwrite("inequalityVector", &OptimizerConstraints::inequalityVector);
+    cls.def("isFeasible", &OptimizerConstraints::isFeasible, "parameters"_a);
+    return cls;
+}
+
 static PyOptimizerObjective declareOptimizerObjective(py::module &mod) {
     PyOptimizerObjective cls(mod, "OptimizerObjective");
-    // Class is abstract, so no constructor.
+    // Class is abstract, so this constructs the trampoline; it is only useful for Python subclasses.
+    cls.def(py::init<int, int>(), "dataSize"_a, "parameterSize"_a);
     cls.def_readonly("dataSize", &OptimizerObjective::dataSize);
     cls.def_readonly("parameterSize", &OptimizerObjective::parameterSize);
     cls.def_static("makeFromLikelihood", &OptimizerObjective::makeFromLikelihood, "likelihood"_a,
                    "prior"_a = nullptr);
-    // class is abstract and not subclassable in Python, so we don't wrap the ctor
     cls.def("fillObjectiveValueGrid", &OptimizerObjective::fillObjectiveValueGrid, "parameters"_a,
             "output"_a);
     cls.def("computeResiduals", &OptimizerObjective::computeResiduals, "parameters"_a, "residuals"_a);
     cls.def("differentiateResiduals", &OptimizerObjective::differentiateResiduals, "parameters"_a,
             "derivatives"_a);
+    cls.def("hasNormalEquations", &OptimizerObjective::hasNormalEquations);
+    cls.def("computeNormalEquations", &OptimizerObjective::computeNormalEquations, "parameters"_a, "jtr"_a,
+            "jtj"_a);
+    cls.def("supportsConcurrentEvaluation", &OptimizerObjective::supportsConcurrentEvaluation);
+    cls.def("getConstraints", &OptimizerObjective::getConstraints);
     cls.def("hasPrior", &OptimizerObjective::hasPrior);
     cls.def("computePrior", &OptimizerObjective::computePrior, "parameters"_a);
     cls.def("differentiatePrior", &OptimizerObjective::differentiatePrior, "parameters"_a, "gradient"_a,
@@ -85,6 +140,11 @@ static PyOptimizerControl declareOptimizerControl(py::module &mod) {
     LSST_DECLARE_CONTROL_FIELD(cls, OptimizerControl, trustRegionShrinkReductionRatio);
     LSST_DECLARE_CONTROL_FIELD(cls, OptimizerControl, trustRegionShrinkFactor);
     LSST_DECLARE_CONTROL_FIELD(cls, OptimizerControl, trustRegionSolverTolerance);
+    LSST_DECLARE_CONTROL_FIELD(cls, OptimizerControl, trustRegionSolver);
+    LSST_DECLARE_CONTROL_FIELD(cls, OptimizerControl, truncatedCGThreshold);
+    LSST_DECLARE_CONTROL_FIELD(cls, OptimizerControl, nTrialSteps);
+    LSST_DECLARE_CONTROL_FIELD(cls, OptimizerControl, doUseNormalEquations);
+    LSST_DECLARE_CONTROL_FIELD(cls, OptimizerControl, doUseConstraints);
     LSST_DECLARE_CONTROL_FIELD(cls, OptimizerControl, maxInnerIterations);
     LSST_DECLARE_CONTROL_FIELD(cls, OptimizerControl, maxOuterIterations);
     LSST_DECLARE_CONTROL_FIELD(cls, OptimizerControl, doSaveIterations);
@@ -158,6 +218,14 @@ static PyOptimizer declareOptimizer(py::module &mod) {
     cls.def("run", (int (Optimizer::*)(Optimizer::HistoryRecorder const &, afw::table::BaseCatalog &)) &
                            Optimizer::run,
             "recorder"_a, "history"_a);
+    cls.def("run",
+            [](Optimizer &self, py::function const &onStep) {
+                // Pass the optimizer by reference; it can't be copied into a new Python object.
+                return self.run([&onStep](Optimizer const &optimizer) {
+                    onStep(py::cast(optimizer, py::return_value_policy::reference));
+                });
+            },
+            "onStep"_a);
     cls.def("getState", &Optimizer::getState);
     cls.def("getObjectiveValue", &Optimizer::getObjectiveValue);
     cls.def("getParameters", &Optimizer::getParameters);
@@ -165,6 +233,9 @@ static PyOptimizer declareOptimizer(py::module &mod) {
     cls.def("getGradient", &Optimizer::getGradient);
     cls.def("getHessian", &Optimizer::getHessian);
     cls.def("removeSR1Term", &Optimizer::removeSR1Term);
+    cls.def("getOuterIterCount", &Optimizer::getOuterIterCount);
+    cls.def("saveState", [](Optimizer const &self) { return py::bytes(self.saveState()); });
+    cls.def("restoreState", &Optimizer::restoreState, "state"_a);
     return cls;
 }
 
@@ -180,15 +251,18 @@ PYBIND11_PLUGIN(optimizer) {
         return nullptr;
     }
 
+    auto clsConstraints = declareOptimizerConstraints(mod);
     auto clsObjective = declareOptimizerObjective(mod);
     auto clsControl = declareOptimizerControl(mod);
     auto clsHistoryRecorder = declareOptimizerHistoryRecorder(mod);
     auto cls = declareOptimizer(mod);
+    cls.attr("Constraints") = clsConstraints;
     cls.attr("Objective") = clsObjective;
     cls.attr("Control") = clsControl;
     cls.attr("HistoryRecorder") = clsHistoryRecorder;
 
     mod.def("solveTrustRegion", &solveTrustRegion, "x"_a, "F"_a, "g"_a, "r"_a, "tolerance"_a);
+    mod.def("solveTrustRegionCG", &solveTrustRegionCG, "x"_a, "F"_a, "g"_a, "r"_a, "tolerance"_a);
 
     return mod.ptr();
 }
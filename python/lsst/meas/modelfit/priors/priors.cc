@@ -40,6 +40,17 @@ namespace meas {
 namespace modelfit {
 namespace {
 
+static void declareAmplitudePosterior(py::module &mod) {
+    using PyAmplitudePosterior = py::class_<AmplitudePosterior, std::shared_ptr<AmplitudePosterior>>;
+    PyAmplitudePosterior cls(mod, "AmplitudePosterior");
+    cls.def(py::init<Vector const &, Matrix const &, Scalar>(), "gradient"_a, "hessian"_a,
+            "nonlinearDensity"_a);
+    cls.def("marginalize", &AmplitudePosterior::marginalize);
+    cls.def("maximize", &AmplitudePosterior::maximize, "amplitudes"_a);
+    cls.def("drawAmplitudes", &AmplitudePosterior::drawAmplitudes, "rng"_a, "amplitudes"_a, "weights"_a,
+            "multiplyWeights"_a = false);
+}
+
 static void declarePrior(py::module &mod) {
     using PyPrior = py::class_<Prior, std::shared_ptr<Prior>>;
     PyPrior cls(mod, "Prior");
@@ -52,6 +63,10 @@ static void declarePrior(py::module &mod) {
     cls.def("maximize", &Prior::maximize, "gradient"_a, "hessian"_a, "nonlinear"_a, "amplitudes"_a);
     cls.def("drawAmplitudes", &Prior::drawAmplitudes, "gradient"_a, "hessian"_a, "nonlinear"_a, "rng"_a,
             "amplitudes"_a, "weights"_a, "multiplyWeights"_a = false);
+    cls.def("makeAmplitudePosterior", &Prior::makeAmplitudePosterior, "gradient"_a, "hessian"_a,
+            "nonlinear"_a);
+    cls.def("fillBounds", &Prior::fillBounds, "nonlinearLower"_a, "nonlinearUpper"_a, "amplitudeLower"_a,
+            "amplitudeUpper"_a);
 }
 
 static void declareMixturePrior(py::module &mod) {
@@ -121,6 +136,7 @@ PYBIND11_PLUGIN(priors) {
         return nullptr;
     }
 
+    declareAmplitudePosterior(mod);
     declarePrior(mod);
     declareMixturePrior(mod);
     declareSemiEmpiricalPrior(mod);
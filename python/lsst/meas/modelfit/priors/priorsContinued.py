@@ -30,6 +30,7 @@ from builtins import range
 
 import numpy as np
 
+import lsst.afw.math
 from lsst.pex.config import makeConfigClass
 from lsst.utils import continueClass
 
@@ -57,7 +58,8 @@ class SoftenedLinearPrior:
 
 
 def fitMixture(data, nComponents, minFactor=0.25, maxFactor=4.0,
-               nIterations=20, df=float("inf")):
+               nIterations=20, df=float("inf"), initialize="kmeans",
+               rng=None, nThreads=1, tolerance=1E-6):
     """Fit a ``Mixture`` distribution to a set of (e1, e2, r) data points,
     returing a ``MixturePrior`` object.
 
@@ -69,15 +71,86 @@ def fitMixture(data, nComponents, minFactor=0.25, maxFactor=4.0,
         number of components in the mixture distribution
     minFactor : float
         ellipticity variance of the smallest component in the initial mixture,
-        relative to the measured variance
+        relative to the measured variance (only used if initialize="scaled")
     maxFactor : float
         ellipticity variance of the largest component in the initial mixture,
-        relative to the measured variance
+        relative to the measured variance (only used if initialize="scaled")
     nIterations : int
-        number of expectation-maximization update iterations
+        maximum number of expectation-maximization update iterations; a
+        k-means initialization usually converges in considerably fewer than
+        a scaled one
     df : float
         number of degrees of freedom for component Student's T distributions
         (inf=Gaussian).
+    initialize : str
+        how to initialize the mixture before the EM iterations: "kmeans" to
+        use ``Mixture.makeFromKMeans``, or "scaled" to start from concentric
+        components with ellipticity variances between minFactor and maxFactor
+        times the measured variance
+    rng : lsst.afw.math.Random
+        random number generator used to seed the k-means clustering; a
+        default-seeded one is used if None
+    nThreads : int
+        number of threads to use for the k-means clustering (<= 0 for one per
+        hardware thread)
+    tolerance : float
+        stop the EM iterations when the mean log likelihood of the data
+        changes by less than this in an iteration; 0 to always do
+        nIterations iterations
+    """
+    restriction = MixturePrior.getUpdateRestriction()
+    if initialize == "kmeans":
+        mixture = _makeKMeansMixture(data, nComponents, df, rng, nThreads)
+    elif initialize == "scaled":
+        mixture = _makeScaledMixture(data, nComponents, minFactor, maxFactor, df)
+    else:
+        raise ValueError("Unknown initialization %r" % (initialize,))
+    if tolerance <= 0.0:
+        for i in range(nIterations):
+            mixture.updateEM(data, restriction)
+        return mixture
+    p = np.zeros(data.shape[0], dtype=float)
+    mixture.evaluate(data, p)
+    logLikelihood = np.log(p).mean()
+    for i in range(nIterations):
+        mixture.updateEM(data, restriction)
+        mixture.evaluate(data, p)
+        previous, logLikelihood = logLikelihood, np.log(p).mean()
+        if abs(logLikelihood - previous) < tolerance:
+            break
+    return mixture
+
+
+def _makeKMeansMixture(data, nComponents, df, rng, nThreads):
+    """Return a mixture initialized by k-means clustering of (e1, e2, r) data,
+    as an initial guess for fitMixture.
+
+    The MixturePrior update restriction makes every component isotropic in
+    ellipticity, so we cluster on (|e|, 0, r) instead of the raw data (which
+    would split the ellipticity plane into wedges that all restrict to nearly
+    the same component).  The restricted ellipticity variances computed from
+    those points are the same as those of the raw data, and we drop the
+    ellipticity-radius covariance terms, which are zero for isotropic data.
+    """
+    if rng is None:
+        rng = lsst.afw.math.Random()
+    clusterData = np.zeros(data.shape, dtype=float)
+    clusterData[:, 0] = np.hypot(data[:, 0], data[:, 1])
+    clusterData[:, 2] = data[:, 2]
+    weights = np.ones(data.shape[0], dtype=float)
+    mixture = Mixture.makeFromKMeans(clusterData, weights, nComponents, rng,
+                                     MixturePrior.getUpdateRestriction(), df=df, nThreads=nThreads)
+    for component in mixture:
+        sigma = component.getSigma()
+        sigma[:2, 2] = 0.0
+        sigma[2, :2] = 0.0
+        component.setSigma(sigma)
+    return mixture
+
+
+def _makeScaledMixture(data, nComponents, minFactor, maxFactor, df):
+    """Return a mixture of concentric (e1, e2, r) components with a range of
+    ellipticity variances, as an initial guess for fitMixture.
     """
     components = Mixture.ComponentList()
     rMu = data[:, 2].mean()
@@ -91,8 +164,4 @@ def fitMixture(data, nComponents, minFactor=0.25, maxFactor=4.0,
         sigma = baseSigma.copy()
         sigma[:2, :2] *= factor
         components.append(Mixture.Component(1.0, mu, sigma))
-    mixture = Mixture(3, components, df)
-    restriction = MixturePrior.getUpdateRestriction()
-    for i in range(nIterations):
-        mixture.updateEM(data, restriction)
-    return mixture
+    return Mixture(3, components, df)
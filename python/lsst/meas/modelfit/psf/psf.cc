@@ -22,11 +22,13 @@
  */
 
 #include "pybind11/pybind11.h"
+#include "pybind11/stl.h"
 
 #include "lsst/pex/config/python.h"
 
 #include "lsst/meas/modelfit/DoubleShapeletPsfApprox.h"
 #include "lsst/meas/modelfit/GeneralPsfFitter.h"
+#include "lsst/meas/modelfit/SpatialSeedIndex.h"
 
 namespace py = pybind11;
 using namespace pybind11::literals;
@@ -52,6 +54,7 @@ void declareDoubleShapelet(py::module &mod) {
     LSST_DECLARE_CONTROL_FIELD(clsControl, Control, minRadius);
     LSST_DECLARE_CONTROL_FIELD(clsControl, Control, minRadiusDiff);
     LSST_DECLARE_CONTROL_FIELD(clsControl, Control, maxRadiusBoxFraction);
+    LSST_DECLARE_CONTROL_FIELD(clsControl, Control, maxSeedDistance);
     LSST_DECLARE_NESTED_CONTROL_FIELD(clsControl, Control, optimizer);
 
     PyAlgorithm clsAlgorithm(mod, "DoubleShapeletPsfApproxAlgorithm");
@@ -64,15 +67,39 @@ void declareDoubleShapelet(py::module &mod) {
 
     clsAlgorithm.def(py::init<Control const &, std::string const &, afw::table::Schema &>(), "ctrl"_a,
                      "name"_a, "schema"_a);
-    clsAlgorithm.def_static("initializeResult", &Algorithm::initializeResult, "ctrl"_a);
+    clsAlgorithm.def_static(
+            "initializeResult",
+            (shapelet::MultiShapeletFunction(*)(Control const &)) & Algorithm::initializeResult,
+            "ctrl"_a);
+    clsAlgorithm.def_static("initializeResult",
+                            (shapelet::MultiShapeletFunction(*)(
+                                    Control const &, shapelet::MultiShapeletFunction const &)) &
+                                    Algorithm::initializeResult,
+                            "ctrl"_a, "seed"_a);
     clsAlgorithm.def_static("fitMoments", &Algorithm::fitMoments, "result"_a, "ctrl"_a, "psfImage"_a);
     clsAlgorithm.def_static("makeObjective", &Algorithm::makeObjective, "moments"_a, "ctrl"_a, "psfImage"_a);
     clsAlgorithm.def_static("fitProfile", &Algorithm::fitProfile, "result"_a, "ctrl"_a, "psfImage"_a);
     clsAlgorithm.def_static("fitShapelets", &Algorithm::fitShapelets, "result"_a, "ctrl"_a, "psfImage"_a);
     clsAlgorithm.def("measure", &Algorithm::measure, "measRecord"_a, "exposure"_a);
+    clsAlgorithm.def("measureCatalog",
+                     [](Algorithm const &self, afw::table::SourceCatalog &catalog,
+                        afw::image::Exposure<float> const &exposure, int nThreads) {
+                         py::gil_scoped_release release;
+                         self.measureCatalog(catalog, exposure, nThreads);
+                     },
+                     "catalog"_a, "exposure"_a, "nThreads"_a = 1);
     clsAlgorithm.def("fail", &Algorithm::fail, "measRecord"_a, "error"_a = nullptr);
 }
 
+void declareSpatialSeedIndex(py::module &mod) {
+    py::class_<SpatialSeedIndex, std::shared_ptr<SpatialSeedIndex>> cls(mod, "SpatialSeedIndex");
+    cls.def(py::init<std::vector<afw::geom::Point2D> const &, double>(), "positions"_a, "maxDistance"_a);
+    cls.def("getOrder", &SpatialSeedIndex::getOrder);
+    cls.def("getMaxDistance", &SpatialSeedIndex::getMaxDistance);
+    cls.def("findNearest", &SpatialSeedIndex::findNearest, "i"_a);
+    cls.def("markFitted", &SpatialSeedIndex::markFitted, "i"_a);
+}
+
 void declareGeneral(py::module &mod) {
     using ComponentControl = GeneralPsfFitterComponentControl;
     using Control = GeneralPsfFitterControl;
@@ -146,12 +173,30 @@ void declareGeneral(py::module &mod) {
                                           afw::geom::ellipses::Quadrupole const &) const) &
                              Algorithm::measure,
                      "measRecord"_a, "image"_a, "moments"_a);
+    clsAlgorithm.def("measureCatalog",
+                     [](Algorithm const &self, afw::table::SourceCatalog &catalog,
+                        afw::detection::Psf const &psf, double maxSeedDistance, int nThreads,
+                        Algorithm const *previous) {
+                         py::gil_scoped_release release;
+                         self.measureCatalog(catalog, psf, maxSeedDistance, nThreads, previous);
+                     },
+                     "catalog"_a, "psf"_a, "maxSeedDistance"_a = 0.0, "nThreads"_a = 1,
+                     "previous"_a = nullptr);
+    clsAlgorithm.def("measureCatalog",
+                     [](Algorithm const &self, afw::table::SourceCatalog &catalog,
+                        afw::detection::Psf const &psf, double maxSeedDistance, int nThreads,
+                        std::vector<Algorithm const *> const &previous) {
+                         py::gil_scoped_release release;
+                         self.measureCatalog(catalog, psf, maxSeedDistance, nThreads, previous);
+                     },
+                     "catalog"_a, "psf"_a, "maxSeedDistance"_a, "nThreads"_a, "previous"_a);
     clsAlgorithm.def("fail", &Algorithm::fail, "measRecord"_a, "error"_a = nullptr);
 
     // MultiShapeletPsfLikelihood intentionally not exposed to Python.
 }
 
 PYBIND11_PLUGIN(psf) {
+    py::module::import("lsst.afw.detection");
     py::module::import("lsst.afw.image");
     py::module::import("lsst.afw.geom.ellipses");
     py::module::import("lsst.meas.base");
@@ -160,6 +205,7 @@ PYBIND11_PLUGIN(psf) {
 
     py::module mod("psf");
 
+    declareSpatialSeedIndex(mod);
     declareDoubleShapelet(mod);
     declareGeneral(mod);
 
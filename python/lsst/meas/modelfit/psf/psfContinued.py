@@ -71,6 +71,12 @@ class GeneralShapeletPsfApproxConfig(lsst.pex.config.Config):
              " and their order"),
         default=["DoubleShapelet"]
     )
+    maxSeedDistance = lsst.pex.config.Field(
+        dtype=float,
+        doc=("maximum distance (pixels) to a previously-fit source whose results are used to"
+             " initialize each fit in measureCatalog(); <= 0 disables seeding"),
+        default=200.0
+    )
 
     def setDefaults(self):
         super(GeneralShapeletPsfApproxConfig, self).setDefaults()
@@ -139,16 +145,14 @@ class GeneralShapeletPsfApproxMixin(object):
                 schema[name][m].getPrefix()
             )
             self.sequence.append((fitter, schema[name][m].getPrefix()))
+        self.maxSeedDistance = config.maxSeedDistance
 
     def measure(self, measRecord, exposure):
         """Fit the configured sequence of models the given Exposure's Psf, as
         evaluated at measRecord.getCentroid(), then save the results to
         measRecord.
         """
-        if not exposure.hasPsf():
-            raise lsst.meas.base.FatalAlgorithmError(
-                "GeneralShapeletPsfApprox requires Exposure to have a Psf")
-        psf = exposure.getPsf()
+        psf = self._getPsf(exposure)
         psfImage = psf.computeKernelImage(measRecord.getCentroid())
         psfShape = psf.computeShape(measRecord.getCentroid())
         lastError = None
@@ -179,6 +183,31 @@ class GeneralShapeletPsfApproxMixin(object):
         if not lastError is None:
             raise lastError
 
+    def measureCatalog(self, catalog, exposure, nThreads=1):
+        """Fit the configured sequence of models at the position of every
+        record in a catalog, using nThreads threads.
+
+        Each model in the sequence is fit to the whole catalog by
+        GeneralPsfFitterAlgorithm.measureCatalog, which processes records in
+        spatial order and initializes each fit from the same model's result
+        for the nearest successfully-fit record within config.maxSeedDistance.
+        Fits without a usable seed (or whose seeded fit fails) start from the
+        last earlier model in the sequence that succeeded for that record, and
+        from the PSF moments if none did, as in measure().  Failures set each fitter's flags, as in measure().
+        """
+        psf = self._getPsf(exposure)
+        previous = []
+        for fitter, name in self.sequence:
+            fitter.measureCatalog(catalog, psf, maxSeedDistance=self.maxSeedDistance,
+                                  nThreads=nThreads, previous=previous)
+            previous.append(fitter)
+
+    def _getPsf(self, exposure):
+        if not exposure.hasPsf():
+            raise lsst.meas.base.FatalAlgorithmError(
+                "GeneralShapeletPsfApprox requires Exposure to have a Psf")
+        return exposure.getPsf()
+
     # This plugin doesn't need to set a flag on fail, because it should have
     # been done already by the individual fitters in the sequence
     def fail(self, measRecord, error=None):
@@ -39,7 +39,30 @@ namespace meas {
 namespace modelfit {
 namespace {
 
-using PySamplingObjective = py::class_<SamplingObjective, std::shared_ptr<SamplingObjective>>;
+// Trampoline that lets SamplingObjective be subclassed in Python (mostly for testing Samplers against
+// analytic target densities).  Samplers may call the objective from several threads, so Sampler.run
+// releases the GIL and these reacquire it.
+class SamplingObjectiveOverride : public SamplingObjective {
+public:
+
+    SamplingObjectiveOverride() : SamplingObjective() {}
+
+    int getParameterDim() const override {
+        PYBIND11_OVERLOAD_PURE(int, SamplingObjective, getParameterDim, );
+    }
+
+    Scalar operator()(
+        ndarray::Array<Scalar const,1,1> const & parameters,
+        afw::table::BaseRecord & sample
+    ) const override {
+        // pass the record by pointer so it is not copied
+        PYBIND11_OVERLOAD_PURE_NAME(Scalar, SamplingObjective, "__call__", operator(), parameters, &sample);
+    }
+
+};
+
+using PySamplingObjective = py::class_<SamplingObjective, SamplingObjectiveOverride,
+                                       std::shared_ptr<SamplingObjective>>;
 using PySampler = py::class_<Sampler, std::shared_ptr<Sampler>>;
 
 PYBIND11_PLUGIN(sampler) {
@@ -55,11 +78,18 @@ PYBIND11_PLUGIN(sampler) {
     }
 
     PySamplingObjective clsSamplingObjective(mod, "SamplingObjective");
+    clsSamplingObjective.def(py::init<>());
     clsSamplingObjective.def("getParameterDim", &SamplingObjective::getParameterDim);
     clsSamplingObjective.def("__call__", &SamplingObjective::operator(), "parameters"_a, "sample"_a);
 
     PySampler clsSampler(mod, "Sampler");
-    clsSampler.def("run", &Sampler::run, "objective"_a, "proposal"_a, "samples"_a);
+    clsSampler.def("run",
+                   [](Sampler const & self, SamplingObjective const & objective, PTR(Mixture) proposal,
+                      afw::table::BaseCatalog & samples) {
+                       py::gil_scoped_release release;
+                       self.run(objective, proposal, samples);
+                   },
+                   "objective"_a, "proposal"_a, "samples"_a);
 
     return mod.ptr();
 }
@@ -92,7 +92,11 @@ PYBIND11_PLUGIN(truncatedGaussian) {
     cls.def("evaluateLog", &TruncatedGaussian::evaluateLog);
     cls.def("evaluate", &TruncatedGaussian::evaluate);
     cls.def("getDim", &TruncatedGaussian::getDim);
-    cls.def("maximize", &TruncatedGaussian::maximize);
+    cls.def("maximize", (Vector (TruncatedGaussian::*)() const) & TruncatedGaussian::maximize);
+    cls.def("maximize",
+            (void (TruncatedGaussian::*)(ndarray::Array<Scalar, 1, 1> const &) const) &
+                    TruncatedGaussian::maximize,
+            "alpha"_a);
     cls.def("getUntruncatedFraction", &TruncatedGaussian::getUntruncatedFraction);
     cls.def("getLogPeakAmplitude", &TruncatedGaussian::getLogPeakAmplitude);
     cls.def("getLogIntegral", &TruncatedGaussian::getLogIntegral);
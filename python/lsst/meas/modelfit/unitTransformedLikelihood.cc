@@ -41,6 +41,8 @@ namespace {
 using PyUnitTransformedLikelihoodControl =
         py::class_<UnitTransformedLikelihoodControl, std::shared_ptr<UnitTransformedLikelihoodControl>>;
 
+using PyInverseSigmaImage = py::class_<InverseSigmaImage, std::shared_ptr<InverseSigmaImage>>;
+
 using PyEpochFootprint = py::class_<EpochFootprint, std::shared_ptr<EpochFootprint>>;
 
 using PyUnitTransformedLikelihood =
@@ -64,28 +66,39 @@ PYBIND11_PLUGIN(unitTransformedLikelihood) {
     PyUnitTransformedLikelihoodControl clsControl(mod, "UnitTransformedLikelihoodControl");
     LSST_DECLARE_CONTROL_FIELD(clsControl, UnitTransformedLikelihoodControl, usePixelWeights);
     LSST_DECLARE_CONTROL_FIELD(clsControl, UnitTransformedLikelihoodControl, weightsMultiplier);
+    LSST_DECLARE_CONTROL_FIELD(clsControl, UnitTransformedLikelihoodControl, minEpochInformationFraction);
     clsControl.def(py::init<bool>(), "usePixelWeights"_a = false);
 
+    PyInverseSigmaImage clsInverseSigmaImage(mod, "InverseSigmaImage");
+    clsInverseSigmaImage.def(py::init<std::shared_ptr<afw::image::Image<Pixel> const>>(), "variance"_a);
+    clsInverseSigmaImage.def("get", &InverseSigmaImage::get, py::return_value_policy::reference_internal);
+    clsInverseSigmaImage.def("isFor", &InverseSigmaImage::isFor, "variance"_a);
+
     PyEpochFootprint clsEpochFootprint(mod, "EpochFootprint");
     clsEpochFootprint.def(py::init<afw::detection::Footprint const &, afw::image::Exposure<Pixel> const &,
-                                   shapelet::MultiShapeletFunction const &>(),
-                          "footprint"_a, "exposure"_a, "psf"_a);
+                                   shapelet::MultiShapeletFunction const &,
+                                   std::shared_ptr<InverseSigmaImage const>>(),
+                          "footprint"_a, "exposure"_a, "psf"_a, "inverseSigma"_a = nullptr);
     clsEpochFootprint.def_readonly("footprint", &EpochFootprint::footprint);
     clsEpochFootprint.def_readonly("exposure", &EpochFootprint::exposure);
     clsEpochFootprint.def_readonly("psf", &EpochFootprint::psf);
+    clsEpochFootprint.def_readonly("inverseSigma", &EpochFootprint::inverseSigma);
 
     PyUnitTransformedLikelihood clsUnitTransformedLikelihood(mod, "UnitTransformedLikelihood");
     clsUnitTransformedLikelihood.def(
             py::init<std::shared_ptr<Model>, ndarray::Array<Scalar const, 1, 1> const &, UnitSystem const &,
                      afw::coord::Coord const &, afw::image::Exposure<Pixel> const &,
                      afw::detection::Footprint const &, shapelet::MultiShapeletFunction const &,
-                     UnitTransformedLikelihoodControl const &>(),
-            "model"_a, "fixed"_a, "fitSys"_a, "position"_a, "exposure"_a, "footprint"_a, "psf"_a, "ctrl"_a);
+                     UnitTransformedLikelihoodControl const &, std::shared_ptr<InverseSigmaImage const>>(),
+            "model"_a, "fixed"_a, "fitSys"_a, "position"_a, "exposure"_a, "footprint"_a, "psf"_a, "ctrl"_a,
+            "inverseSigma"_a = nullptr);
     clsUnitTransformedLikelihood.def(
             py::init<std::shared_ptr<Model>, ndarray::Array<Scalar const, 1, 1> const &, UnitSystem const &,
                      afw::coord::Coord const &, std::vector<std::shared_ptr<EpochFootprint>> const &,
                      UnitTransformedLikelihoodControl const &>(),
             "model"_a, "fixed"_a, "fitSys"_a, "position"_a, "epochFootprintList"_a, "ctrl"_a);
+    clsUnitTransformedLikelihood.def("getDroppedEpochs", &UnitTransformedLikelihood::getDroppedEpochs);
+    clsUnitTransformedLikelihood.def("getEpochInformation", &UnitTransformedLikelihood::getEpochInformation);
 
     return mod.ptr();
 }
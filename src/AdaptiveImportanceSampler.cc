@@ -21,6 +21,9 @@
  * see <http://www.lsstcorp.org/LegalNotices/>.
  */
 #include <cmath>
+#include <limits>
+#include <utility>
+#include <vector>
 
 #include "ndarray/eigen.h"
 
@@ -60,15 +63,90 @@ Scalar computeRobustWeights(afw::table::BaseCatalog & samples, afw::table::Key<S
     return - uMax - std::log(wSum / samples.size());
 }
 
+// Streaming version of computeNormalizedPerplexity and computeEffectiveSampleSizeFraction, operating
+// on log unnormalized weights; sums are kept relative to the running maximum for numerical stability.
+class WeightAccumulator {
+public:
+
+    WeightAccumulator() :
+        _count(0), _uMax(-std::numeric_limits<Scalar>::infinity()), _sum(0.0), _sumSq(0.0), _sumLog(0.0)
+    {}
+
+    void add(Scalar u) {
+        if (u > _uMax) {
+            if (_count > 0) {
+                // rescale the sums to be relative to the new maximum
+                Scalar const delta = _uMax - u;
+                Scalar const f = std::exp(delta);
+                _sumLog = f * (_sumLog + delta * _sum);
+                _sum *= f;
+                _sumSq *= f * f;
+            }
+            _uMax = u;
+        }
+        Scalar const v = u - _uMax;
+        Scalar const w = std::exp(v);
+        _sum += w;
+        _sumSq += w * w;
+        _sumLog += w * v;
+        ++_count;
+    }
+
+    // Perplexity of the normalized weights, divided by the number of samples.
+    Scalar getNormalizedPerplexity() const {
+        if (_count == 0) return 0.0;
+        // H = -\sum_i w_i ln w_i with w_i = e^{v_i}/S  =>  H = ln S - (\sum_i e^{v_i} v_i) / S
+        return std::exp(std::log(_sum) - _sumLog / _sum) / _count;
+    }
+
+    Scalar getEffectiveSampleSize() const {
+        if (_count == 0) return 0.0;
+        return _sum * _sum / _sumSq;
+    }
+
+private:
+    int _count;
+    Scalar _uMax;
+    Scalar _sum;
+    Scalar _sumSq;
+    Scalar _sumLog;
+};
+
+// Accumulates ln(\sum_i e^{x_i}) relative to the largest term, so it neither overflows nor underflows.
+class LogSumExp {
+public:
+
+    LogSumExp() : _max(-std::numeric_limits<Scalar>::infinity()), _sum(0.0) {}
+
+    void add(Scalar x) {
+        if (x == -std::numeric_limits<Scalar>::infinity()) return;
+        if (x > _max) {
+            _sum = _sum * std::exp(_max - x) + 1.0;
+            _max = x;
+        } else {
+            _sum += std::exp(x - _max);
+        }
+    }
+
+    // Returns -infinity if no finite terms were added.
+    Scalar get() const { return _max + std::log(_sum); }
+
+private:
+    Scalar _max;
+    Scalar _sum;
+};
+
 } // anonymous
 
 AdaptiveImportanceSampler::AdaptiveImportanceSampler(
     afw::table::Schema & sampleSchema,
     PTR(afw::math::Random) rng,
     std::map<int,ImportanceSamplerControl> const & ctrls,
-    bool doSaveIterations
+    bool doSaveIterations,
+    bool doRecycleSamples
 ) :
     _doSaveIterations(doSaveIterations),
+    _doRecycleSamples(doRecycleSamples),
     _rng(rng),
     _ctrls(ctrls),
     _weightKey(sampleSchema["weight"]),
@@ -112,6 +190,14 @@ void AdaptiveImportanceSampler::run(
     LOG_LOGGER trace3Logger = LOG_GET("TRACE3.meas.modelfit.AdaptiveImportanceSampler");
     double perplexity = 0.0;
     int parameterDim = objective.getParameterDim();
+    // When recycling samples, we need every proposal used so far (with the number of points drawn
+    // from it) to evaluate the deterministic mixture proposal at newly-drawn points.
+    std::vector< std::pair<PTR(Mixture),int> > pastProposals;
+    int nDrawn = 0;
+    if (_doRecycleSamples && !_doSaveIterations) {
+        samples.clear();
+    }
+    std::size_t const runStart = samples.size();
     for (std::map<int,ImportanceSamplerControl>::const_iterator i = _ctrls.begin(); i != _ctrls.end(); ++i) {
         ImportanceSamplerControl const & ctrl = i->second;
         int nRepeat = 0;
@@ -121,22 +207,38 @@ void AdaptiveImportanceSampler::run(
                 nRepeat, ctrl.nSamples, ctrl.nUpdateSteps, ctrl.targetPerplexity
             );
             ++nRepeat;
-            if (!_doSaveIterations) {
+            if (!_doSaveIterations && !_doRecycleSamples) {
                 samples.clear();
             }
+            std::size_t const repeatStart = samples.size();
             afw::table::BaseCatalog subSamples(samples.getTable());
             ndarray::Array<Scalar,2,2> parameters = ndarray::allocate(ctrl.nSamples, parameterDim);
-            proposal->draw(*_rng, parameters);
+            if (ctrl.doQuasiRandom) {
+                proposal->drawQuasiRandom(*_rng, parameters);
+            } else {
+                proposal->draw(*_rng, parameters);
+            }
             ndarray::Array<Scalar,1,1> probability = ndarray::allocate(ctrl.nSamples);
             proposal->evaluate(parameters, probability);
-            for (int k = 0; k < ctrl.nSamples; ++k) {
+            WeightAccumulator accumulator;
+            int nUsed = 0;
+            for (; nUsed < ctrl.nSamples; ++nUsed) {
+                if (ctrl.nBlockSamples > 0 && nUsed > 0 && nUsed % ctrl.nBlockSamples == 0
+                    && accumulator.getEffectiveSampleSize() >= ctrl.targetEffectiveSampleSize) {
+                    LOGL_DEBUG(trace3Logger,
+                        "Effective sample size %g meets target %g after %d samples (perplexity=%g)",
+                        accumulator.getEffectiveSampleSize(), ctrl.targetEffectiveSampleSize, nUsed,
+                        accumulator.getNormalizedPerplexity()
+                    );
+                    break;
+                }
                 PTR(afw::table::BaseRecord) record = samples.addNew();
-                double objectiveValue = objective(parameters[k], *record);
+                double objectiveValue = objective(parameters[nUsed], *record);
                 if (std::isfinite(objectiveValue)) {
                     subSamples.push_back(record);
-                    record->set(_parametersKey, parameters[k]);
+                    record->set(_parametersKey, parameters[nUsed]);
                     record->set(_objectiveKey, objectiveValue);
-                    record->set(_proposalKey, -std::log(probability[k]));
+                    record->set(_proposalKey, -std::log(probability[nUsed]));
                     if (_doSaveIterations) {
                         record->set(_iterCtrlKey, i->first);
                         record->set(_iterRepeatKey, nRepeat-1);
@@ -144,6 +246,7 @@ void AdaptiveImportanceSampler::run(
                     // for numerical reasons, in the first pass, we set w_i = ln(p_i/q_i);
                     // note that proposal[i] == -ln(q_i) and objective[i] == -ln(p_i)
                     record->set(_weightKey, record->get(_proposalKey) - record->get(_objectiveKey));
+                    accumulator.add(record->get(_weightKey));
                 } else {
                     samples.pop_back();
                 }
@@ -154,6 +257,41 @@ void AdaptiveImportanceSampler::run(
                     "No finite objective values in entire sample set"
                 );
             }
+            if (_doRecycleSamples) {
+                // Deterministic mixture weighting: each sample's proposal density is that of the
+                // mixture of all proposals used so far, weighted by the number of points drawn from each.
+                // The sum is done in log space, as the individual proposal densities can underflow.
+                Scalar const logTotal = std::log(static_cast<Scalar>(nDrawn + nUsed));
+                Scalar const logDrawn = std::log(static_cast<Scalar>(nDrawn));
+                Scalar const logUsed = std::log(static_cast<Scalar>(nUsed));
+                for (std::size_t k = runStart; k < repeatStart; ++k) {
+                    // the stored proposal value is already the mixture over all previous proposals
+                    afw::table::BaseRecord & record = samples[k];
+                    LogSumExp logQ;
+                    logQ.add(logDrawn - record.get(_proposalKey));
+                    logQ.add(logUsed + std::log(proposal->evaluate(record.get(_parametersKey).asEigen())));
+                    record.set(_proposalKey, logTotal - logQ.get());
+                }
+                for (std::size_t k = repeatStart; k < samples.size(); ++k) {
+                    afw::table::BaseRecord & record = samples[k];
+                    ndarray::Array<Scalar const,1,1> x = record.get(_parametersKey);
+                    LogSumExp logQ;
+                    logQ.add(logUsed - record.get(_proposalKey));
+                    for (std::size_t j = 0; j < pastProposals.size(); ++j) {
+                        logQ.add(
+                            std::log(static_cast<Scalar>(pastProposals[j].second))
+                            + std::log(pastProposals[j].first->evaluate(x.asEigen()))
+                        );
+                    }
+                    record.set(_proposalKey, logTotal - logQ.get());
+                }
+                pastProposals.push_back(std::make_pair(proposal->clone(), nUsed));
+                nDrawn += nUsed;
+                subSamples.assign(samples.begin() + runStart, samples.end());
+                for (afw::table::BaseCatalog::iterator s = subSamples.begin(); s != subSamples.end(); ++s) {
+                    s->set(_weightKey, s->get(_proposalKey) - s->get(_objectiveKey));
+                }
+            }
             computeRobustWeights(subSamples, _weightKey);
             perplexity = computeNormalizedPerplexity(subSamples);
             if (!std::isfinite(perplexity)) {
@@ -167,6 +305,11 @@ void AdaptiveImportanceSampler::run(
                 perplexity, ctrl.targetPerplexity
             );
             if (ctrl.nUpdateSteps > 0) {
+                if (subSamples.size() > parameters.getSize<0>()) {
+                    // only possible when recycling samples from previous iterations
+                    parameters = ndarray::allocate(subSamples.size(), parameterDim);
+                    probability = ndarray::allocate(subSamples.size());
+                }
                 for (std::size_t k = 0; k < subSamples.size(); ++k) {
                     parameters[k] = subSamples[k].get(_parametersKey);
                     probability[k] = subSamples[k].get(_weightKey);
@@ -20,8 +20,17 @@
  * the GNU General Public License along with this program.  If not,
  * see <http://www.lsstcorp.org/LegalNotices/>.
  */
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdint>
 #include <cstdlib>
+#include <cstring>
+#include <exception>
+#include <limits>
 #include <memory>
+#include <mutex>
+#include <vector>
 
 #include "boost/filesystem/path.hpp"
 
@@ -34,6 +43,8 @@
 #include "lsst/meas/modelfit/TruncatedGaussian.h"
 #include "lsst/meas/modelfit/MultiModel.h"
 #include "lsst/meas/modelfit/CModel.h"
+#include "lsst/meas/modelfit/detail/Arena.h"
+#include "lsst/meas/modelfit/detail/parallel.h"
 #include "lsst/meas/base/constants.h"
 
 namespace lsst { namespace meas { namespace modelfit {
@@ -64,6 +75,33 @@ PTR(Model) CModelStageControl::getModel() const {
     return Model::make(getProfile().getBasis(nComponents, maxRadius), Model::FIXED_CENTER);
 }
 
+std::vector<std::pair<Scalar,PTR(Model)>> CModelStageControl::getAdaptiveModels() const {
+    if (adaptiveSnThresholds.size() != adaptiveComponents.size()) {
+        throw LSST_EXCEPT(
+            meas::base::FatalAlgorithmError,
+            (boost::format("adaptiveSnThresholds (%d) and adaptiveComponents (%d) must have the same size")
+             % adaptiveSnThresholds.size() % adaptiveComponents.size()).str()
+        );
+    }
+    std::vector<std::pair<Scalar,PTR(Model)>> result;
+    result.reserve(adaptiveSnThresholds.size());
+    for (std::size_t i = 0; i < adaptiveSnThresholds.size(); ++i) {
+        if (i > 0 && !(adaptiveSnThresholds[i] > adaptiveSnThresholds[i - 1])) {
+            throw LSST_EXCEPT(
+                meas::base::FatalAlgorithmError,
+                "adaptiveSnThresholds must be strictly increasing"
+            );
+        }
+        result.push_back(
+            std::make_pair(
+                adaptiveSnThresholds[i],
+                Model::make(getProfile().getBasis(adaptiveComponents[i], maxRadius), Model::FIXED_CENTER)
+            )
+        );
+    }
+    return result;
+}
+
 PTR(Prior) CModelStageControl::getPrior() const {
     if (priorSource == "NONE") {
         return PTR(Prior)();
@@ -116,6 +154,196 @@ CModelResult::CModelResult() :
     flags[FAILED] = true;
 }
 
+// ------------------- Batch Result Buffers -----------------------------------------------------------------
+
+namespace {
+
+static_assert(sizeof(Scalar) == sizeof(std::uint64_t), "CModelResultBatch fields must be 8 bytes");
+
+// Appends the fields of a CModelResultBatch row, in the order CModelResultBatch::_initialize defines them.
+class RowWriter {
+public:
+
+    explicit RowWriter(Scalar * row) : _current(row) {}
+
+    void put(Scalar value) { *_current++ = value; }
+
+    void put(Scalar xx, Scalar yy, Scalar xy) {
+        put(xx);
+        put(yy);
+        put(xy);
+    }
+
+    void put(afw::geom::ellipses::Quadrupole const & ellipse) {
+        put(ellipse.getIxx(), ellipse.getIyy(), ellipse.getIxy());
+    }
+
+    void put(ndarray::Array<Scalar const,1,1> const & array, int size) {
+        if (array.getSize<0>() == size) {
+            std::copy(array.begin(), array.end(), _current);
+        } else {
+            std::fill(_current, _current + size, std::numeric_limits<Scalar>::quiet_NaN());
+        }
+        _current += size;
+    }
+
+    template <std::size_t N>
+    void put(std::bitset<N> const & flags) {
+        std::uint64_t const bits = flags.to_ullong();
+        std::memcpy(_current++, &bits, sizeof(bits));
+    }
+
+    Scalar const * get() const { return _current; }
+
+private:
+    Scalar * _current;
+};
+
+} // anonymous
+
+CModelResultBatch::CModelResultBatch(CModelControl const & ctrl, int size) : _rowSize(0), _doneOffset(0) {
+    if (size < 0) {
+        throw LSST_EXCEPT(
+            pex::exceptions::InvalidParameterError,
+            (boost::format("Batch size must be nonnegative (got %d)") % size).str()
+        );
+    }
+    _initialize(ctrl);
+    _buffer = ndarray::allocate(size, _rowSize);
+    _buffer.deep() = std::numeric_limits<Scalar>::quiet_NaN();
+    // A Scalar zero has all bits clear, so it's also an empty set of flags.
+    for (auto const & field : _fields) {
+        if (field.isFlags || field.offset == _doneOffset) {
+            for (int i = 0; i < size; ++i) {
+                _buffer[i][field.offset] = 0.0;
+            }
+        }
+    }
+}
+
+CModelResultBatch::CModelResultBatch(CModelControl const & ctrl, ndarray::Array<Scalar,2,2> const & buffer) :
+    _rowSize(0), _doneOffset(0), _buffer(buffer)
+{
+    _initialize(ctrl);
+    LSST_THROW_IF_NE(
+        buffer.getSize<1>(), _rowSize,
+        pex::exceptions::LengthError,
+        "Buffer row size (%d) does not match the CModel batch row size (%d)"
+    );
+}
+
+void CModelResultBatch::_addField(std::string const & name, int size, bool isFlags) {
+    Field field = {name, _rowSize, size, isFlags};
+    _fields.push_back(field);
+    _rowSize += size;
+}
+
+void CModelResultBatch::_initialize(CModelControl const & ctrl) {
+    _addField("flux", 1);
+    _addField("fluxSigma", 1);
+    _addField("fluxInner", 1);
+    _addField("fracDev", 1);
+    _addField("objective", 1);
+    _addField("ellipse", 3);
+    _addField("initialFitRegion", 3);
+    _addField("finalFitRegion", 3);
+    _addField("flags", 1, true);
+    _doneOffset = _rowSize;
+    _addField("done", 1);
+    CModelStageControl const * stageCtrls[3] = {&ctrl.initial, &ctrl.exp, &ctrl.dev};
+    std::string const stageNames[3] = {"initial", "exp", "dev"};
+    for (int s = 0; s < 3; ++s) {
+        PTR(Model) model = stageCtrls[s]->getModel();
+        _stages[s].nonlinear = model->getNonlinearDim();
+        _stages[s].amplitudes = model->getAmplitudeDim();
+        _stages[s].fixed = model->getFixedDim();
+        _addField(stageNames[s] + "_flux", 1);
+        _addField(stageNames[s] + "_fluxSigma", 1);
+        _addField(stageNames[s] + "_fluxInner", 1);
+        _addField(stageNames[s] + "_objective", 1);
+        _addField(stageNames[s] + "_ellipse", 3);
+        _addField(stageNames[s] + "_nonlinear", _stages[s].nonlinear);
+        _addField(stageNames[s] + "_amplitudes", _stages[s].amplitudes);
+        _addField(stageNames[s] + "_fixed", _stages[s].fixed);
+        _addField(stageNames[s] + "_flags", 1, true);
+    }
+}
+
+void CModelResultBatch::_checkIndex(int index) const {
+    if (index < 0 || index >= getSize()) {
+        throw LSST_EXCEPT(
+            pex::exceptions::LengthError,
+            (boost::format("Index %d out of range for batch of size %d") % index % getSize()).str()
+        );
+    }
+}
+
+bool CModelResultBatch::isDone(int index) const {
+    _checkIndex(index);
+    return _buffer[index][_doneOffset] == 1.0;
+}
+
+int CModelResultBatch::countDone() const {
+    int count = 0;
+    for (int i = 0; i < getSize(); ++i) {
+        if (_buffer[i][_doneOffset] == 1.0) {
+            ++count;
+        }
+    }
+    return count;
+}
+
+void CModelResultBatch::set(int index, CModelResult const & result) {
+    _checkIndex(index);
+    _inFlight.erase(index);
+    Scalar * row = _buffer.getData() + static_cast<std::ptrdiff_t>(index)*_rowSize;
+    RowWriter writer(row);
+    writer.put(result.flux);
+    writer.put(result.fluxSigma);
+    writer.put(result.fluxInner);
+    writer.put(result.fracDev);
+    writer.put(result.objective);
+    Scalar const u = 1.0 - result.fracDev;
+    Scalar const v = result.fracDev;
+    writer.put(
+        u*result.exp.ellipse.getIxx() + v*result.dev.ellipse.getIxx(),
+        u*result.exp.ellipse.getIyy() + v*result.dev.ellipse.getIyy(),
+        u*result.exp.ellipse.getIxy() + v*result.dev.ellipse.getIxy()
+    );
+    writer.put(result.initialFitRegion);
+    writer.put(result.finalFitRegion);
+    writer.put(result.flags);
+    writer.put(1.0);  // done
+    CModelStageResult const * stages[3] = {&result.initial, &result.exp, &result.dev};
+    for (int s = 0; s < 3; ++s) {
+        writer.put(stages[s]->flux);
+        writer.put(stages[s]->fluxSigma);
+        writer.put(stages[s]->fluxInner);
+        writer.put(stages[s]->objective);
+        writer.put(stages[s]->ellipse);
+        writer.put(stages[s]->nonlinear, _stages[s].nonlinear);
+        writer.put(stages[s]->amplitudes, _stages[s].amplitudes);
+        writer.put(stages[s]->fixed, _stages[s].fixed);
+        writer.put(stages[s]->flags);
+    }
+    assert(writer.get() == row + _rowSize);
+}
+
+std::string CModelResultBatch::getInFlightState(int index) const {
+    _checkIndex(index);
+    std::map<int,std::string>::const_iterator i = _inFlight.find(index);
+    return (i == _inFlight.end()) ? std::string() : i->second;
+}
+
+void CModelResultBatch::setInFlightState(int index, std::string const & state) {
+    _checkIndex(index);
+    if (state.empty()) {
+        _inFlight.erase(index);
+    } else {
+        _inFlight[index] = state;
+    }
+}
+
 
 // ------------------- Key Objects for transferring to/from afw::table Records ------------------------------
 
@@ -131,7 +359,8 @@ struct CModelStageKeys {
         std::string const & prefix,
         std::string const & stage,
         bool isForced,
-        CModelStageControl const & ctrl
+        CModelStageControl const & ctrl,
+        CModelControl const & topCtrl
     ) :
         flux(
             schema.addField<meas::base::Flux>(
@@ -152,21 +381,23 @@ struct CModelStageKeys {
                 schema.join(prefix, "flag"),
                 "flag set when the flux for the " + stage + " flux failed"
             )
-        ),
-        fluxInner(
-            schema.addField<Scalar>(
-                schema.join(prefix, "flux", "inner"),
-                "flux within the fit region, with no extrapolation"
-            )
         )
     {
-        if (!isForced) {
-            ellipse = afw::table::QuadrupoleKey::addFields(
-                schema,
-                schema.join(prefix, "ellipse"),
-                "half-light ellipse of the " + stage + " fit",
-                afw::table::CoordinateType::PIXEL
+        if (topCtrl.doFluxInner) {
+            fluxInner = schema.addField<Scalar>(
+                schema.join(prefix, "flux", "inner"),
+                "flux within the fit region, with no extrapolation"
             );
+        }
+        if (!isForced) {
+            if (topCtrl.doEllipses) {
+                ellipse = afw::table::QuadrupoleKey::addFields(
+                    schema,
+                    schema.join(prefix, "ellipse"),
+                    "half-light ellipse of the " + stage + " fit",
+                    afw::table::CoordinateType::PIXEL
+                );
+            }
             objective = schema.addField<Scalar>(
                 schema.join(prefix, "objective"),
                 "-ln(likelihood*prior) at best-fit point for the " + stage + " fit"
@@ -247,7 +478,9 @@ struct CModelStageKeys {
         record.set(flux, result.flux);
         record.set(fluxSigma, result.fluxSigma);
         record.set(fluxFlag, result.flags[CModelStageResult::FAILED]);
-        record.set(fluxInner, result.fluxInner);
+        if (fluxInner.isValid()) {
+            record.set(fluxInner, result.fluxInner);
+        }
         if (objective.isValid()) {
             record.set(objective, result.objective);
         }
@@ -277,6 +510,8 @@ struct CModelStageKeys {
         // this is only used when reading reference records, so we only transfer the fields we need for that
         CModelStageResult result;
         result.flags[CModelStageResult::FAILED] = record.get(flags[CModelStageResult::FAILED]);
+        result.flux = record.get(flux);
+        result.fluxSigma = record.get(fluxSigma);
         result.nonlinear = record.get(nonlinear);
         result.fixed = record.get(fixed);
         return result;
@@ -317,9 +552,9 @@ struct CModelKeys {
         CModelControl const & ctrl
     ) :
         initial(initialModel, schema, schema.join(prefix, "initial"), "initial",
-                isForced, ctrl.initial),
-        exp(expModel, schema, schema.join(prefix, "exp"), "exponential", isForced, ctrl.exp),
-        dev(devModel, schema, schema.join(prefix, "dev"), "de Vaucouleur", isForced, ctrl.dev),
+                isForced, ctrl.initial, ctrl),
+        exp(expModel, schema, schema.join(prefix, "exp"), "exponential", isForced, ctrl.exp, ctrl),
+        dev(devModel, schema, schema.join(prefix, "dev"), "de Vaucouleur", isForced, ctrl.dev, ctrl),
         // Unlike all the other keys, we expect the psf keys to already be present in the schema,
         // and we just retrieve them, because they're created and filled by another plugin.
         psf(schema[ctrl.psfName]),
@@ -341,12 +576,6 @@ struct CModelKeys {
                 "flag set if the final cmodel fit (or any previous fit) failed"
             )
         ),
-        fluxInner(
-            schema.addField<Scalar>(
-                schema.join(prefix, "flux", "inner"),
-                "flux within the fit region, with no extrapolation"
-            )
-        ),
         fracDev(
             schema.addField<Scalar>(
                 schema.join(prefix, "fracDev"),
@@ -360,6 +589,12 @@ struct CModelKeys {
             )
         )
     {
+        if (ctrl.doFluxInner) {
+            fluxInner = schema.addField<Scalar>(
+                schema.join(prefix, "flux", "inner"),
+                "flux within the fit region, with no extrapolation"
+            );
+        }
         try {
             kronRadius = schema["ext_photometryKron_KronFlux_radius"];
         } catch (pex::exceptions::NotFoundError &) {
@@ -401,12 +636,14 @@ struct CModelKeys {
                     "initial parameter guess resulted in negative radius; used minimum of %f pixels instead."
                 ) % ctrl.minInitialRadius).str()
             );
-            ellipse = afw::table::QuadrupoleKey::addFields(
-                schema,
-                schema.join(prefix, "ellipse"),
-                "fracDev-weighted average of exp.ellipse and dev.ellipse",
-                afw::table::CoordinateType::PIXEL
-            );
+            if (ctrl.doEllipses) {
+                ellipse = afw::table::QuadrupoleKey::addFields(
+                    schema,
+                    schema.join(prefix, "ellipse"),
+                    "fracDev-weighted average of exp.ellipse and dev.ellipse",
+                    afw::table::CoordinateType::PIXEL
+                );
+            }
             initialFitRegion = afw::table::QuadrupoleKey::addFields(
                 schema,
                 schema.join(prefix, "region", "initial", "ellipse"),
@@ -463,7 +700,9 @@ struct CModelKeys {
             record.set(ellipse.getIyy(), u*result.exp.ellipse.getIyy() + v*result.dev.ellipse.getIyy());
             record.set(ellipse.getIxy(), u*result.exp.ellipse.getIxy() + v*result.dev.ellipse.getIxy());
         }
-        record.set(fluxInner, result.fluxInner);
+        if (fluxInner.isValid()) {
+            record.set(fluxInner, result.fluxInner);
+        }
         record.set(fracDev, result.fracDev);
         record.set(objective, result.objective);
         if (initialFitRegion.isValid()) {
@@ -545,7 +784,10 @@ struct CModelStageData {
     ndarray::Array<Scalar,1,1> nonlinear;   // nonlinear parameters (a view into parameters array)
     ndarray::Array<Scalar,1,1> amplitudes;  // linear parameters (a view into parameters array)
     ndarray::Array<Scalar,1,1> fixed;       // fixed parameters (not being fit, still needed to eval model)
+    ndarray::Array<Pixel,2,-1> modelMatrix; // unweighted model matrix at the best-fit nonlinear parameters
+                                            // (empty until this stage has been fit)
     shapelet::MultiShapeletFunction psf;    // multi-shapelet approximation to PSF
+    PTR(InverseSigmaImage const) inverseSigma; // shared 1/sigma plane for the exposure (may be null)
 
     CModelStageData(
         afw::image::Exposure<Pixel> const & exposure,
@@ -556,10 +798,10 @@ struct CModelStageData {
         measSysCenter(center), position(exposure.getWcs()->pixelToSky(center)),
         measSys(exposure), fitSys(*position, exposure.getCalib(), approxFlux),
         fitSysToMeasSys(*position, fitSys, measSys),
-        parameters(ndarray::allocate(model.getNonlinearDim() + model.getAmplitudeDim())),
+        parameters(detail::allocateTemporary<Scalar>(model.getNonlinearDim() + model.getAmplitudeDim())),
         nonlinear(parameters[ndarray::view(0, model.getNonlinearDim())]),
         amplitudes(parameters[ndarray::view(model.getNonlinearDim(), parameters.getSize<0>())]),
-        fixed(ndarray::allocate(model.getFixedDim())),
+        fixed(detail::allocateTemporary<Scalar>(model.getFixedDim())),
         psf(psf_)
     {}
 
@@ -574,10 +816,12 @@ struct CModelStageData {
         assert(model.getAmplitudeDim() == amplitudes.getSize<0>());
         assert(model.getFixedDim() == fixed.getSize<0>());
         CModelStageData r(*this);
-        r.parameters = ndarray::copy(parameters);
+        r.parameters = detail::allocateTemporary<Scalar>(parameters.getSize<0>());
+        r.parameters.deep() = parameters;
         r.nonlinear = r.parameters[ndarray::view(0, model.getNonlinearDim())];
         r.amplitudes = r.parameters[ndarray::view(model.getNonlinearDim(), parameters.getSize<0>())];
         // don't need to deep-copy fixed parameters because they're, well, fixed
+        r.modelMatrix = ndarray::Array<Pixel,2,-1>(); // belongs to the old model
         return r;
     }
 
@@ -587,6 +831,21 @@ struct CModelStageData {
 
 // ------------------- Private Implementation objects -------------------------------------------------------
 
+namespace detail {
+
+// Connects the stage fits of a single source to its in-flight state in a CModelResultBatch (see
+// CModelAlgorithm::applyCatalog).
+struct CModelFitCheckpoint {
+    int stage;          // index of the stage to resume (0=initial, 1=exp, 2=dev), or -1 for none
+    std::string state;  // Optimizer state to resume that stage from
+    std::function<void(int stage, std::string const & state)> save;  // called after every Optimizer step
+                                                                     // with its state; may be empty
+    std::exception_ptr error;  // exception thrown by save, to be rethrown after the fit
+    CModelFitCheckpoint() : stage(-1) {}
+};
+
+} // namespace detail
+
 namespace {
 
 // utility function to create a model matrix: just allocates space for the matrix and calls the likelihood
@@ -596,7 +855,7 @@ ndarray::Array<Pixel,2,-1> makeModelMatrix(
     ndarray::Array<Scalar const,1,1> const & nonlinear
 ) {
     ndarray::Array<Pixel,2,2> modelMatrixT
-        = ndarray::allocate(likelihood.getAmplitudeDim(), likelihood.getDataDim());
+        = detail::allocateTemporary<Pixel>(likelihood.getAmplitudeDim(), likelihood.getDataDim());
     ndarray::Array<Pixel,2,-1> modelMatrix = modelMatrixT.transpose();
     likelihood.computeModelMatrix(modelMatrix, nonlinear, false);
     return modelMatrix;
@@ -648,6 +907,20 @@ struct WeightSums {
 };
 
 
+// The optional outputs a single stage fit computes; anything that isn't needed, including the model
+// evaluations that would only feed it, is skipped.
+struct StageOutputs {
+
+    StageOutputs() : fluxInner(true), fluxSigma(true), ellipse(true), modelMatrix(true) {}
+
+    bool needsWeightSums() const { return fluxInner || fluxSigma; }
+
+    bool fluxInner;    // CModelStageResult::fluxInner
+    bool fluxSigma;    // CModelStageResult::fluxSigma
+    bool ellipse;      // CModelStageResult::ellipse
+    bool modelMatrix;  // CModelStageData::modelMatrix, for use after the stage fit
+};
+
 // Implementation object for a single nonlinear stage (one of "initial", "exp", "dev")
 // Note that this doesn't hold its own CModelStageControl; that's held by the CModelControl
 // in the main CModelAlgorithm class (for historical and compatibility-with-HSC-fork reasons),
@@ -656,16 +929,22 @@ class CModelStageImpl {
 public:
     shapelet::RadialProfile const * profile; // what profile we're trying to fit (ref to singleton)
     PTR(Model) model;                        // defition of parameters, and how to map to Gaussians
+    std::vector<std::pair<Scalar,PTR(Model)>> adaptiveModels; // lower-complexity Models for faint sources,
+                                                              // with the S/N thresholds they're used below
     PTR(Prior) prior;                        // Bayesian prior on parameters
-    mutable Model::EllipseVector ellipses;   // workspace for asking Model to turn parameters into ellipses
     PTR(afw::table::BaseTable) historyTable;       // optimizer trace Table object
     PTR(OptimizerHistoryRecorder) historyRecorder; // optimizer trace keys/handler
+    StageOutputs outputs;                          // optional outputs to compute (all by default)
+    PerfCounters::Region perfRegion;               // region hardware counters are attributed to
+    int index;                                     // 0 for initial, 1 for exp, 2 for dev
 
-    explicit CModelStageImpl(CModelStageControl const & ctrl) :
+    CModelStageImpl(CModelStageControl const & ctrl, PerfCounters::Region perfRegion_, int index_) :
         profile(&ctrl.getProfile()),
         model(ctrl.getModel()),
+        adaptiveModels(ctrl.getAdaptiveModels()),
         prior(ctrl.getPrior()),
-        ellipses(model->makeEllipseVector())
+        perfRegion(perfRegion_),
+        index(index_)
     {
         if (ctrl.doRecordHistory) {
             afw::table::Schema historySchema;
@@ -682,12 +961,22 @@ public:
         return result;
     }
 
+    // Return the Model to fit for a source with the given signal-to-noise: the lowest-complexity one
+    // whose threshold it's below, or the full Model if there is none (or the signal-to-noise is NaN).
+    PTR(Model) selectModel(Scalar sn) const {
+        for (auto const & adaptive : adaptiveModels) {
+            if (sn < adaptive.first) {
+                return adaptive.second;
+            }
+        }
+        return model;
+    }
+
     // Use a CModelStageData containing the results of a fit to fill in the higher-level outputs
-    // that are part of a CModelStageResult
+    // that are part of a CModelStageResult.  data.modelMatrix must be set if outputs.needsWeightSums().
     void fillResult(
         CModelStageResult & result,
-        CModelStageData const & data,
-        WeightSums const & sums
+        CModelStageData const & data
     ) const {
         // these are shallow assignments
         result.nonlinear = data.nonlinear;
@@ -695,37 +984,77 @@ public:
         result.fixed = data.fixed;
         // flux is just the amplitude converted from fitSys to measSys
         result.flux = data.amplitudes[0] * data.fitSysToMeasSys.flux;
-        result.fluxInner = sums.fluxInner;
-        result.fluxSigma = std::sqrt(sums.fluxVar)*result.flux/result.fluxInner;
-        // to compute the ellipse, we need to first read the nonlinear parameters into the workspace
-        // ellipse vector, then transform from fitSys to measSys.
-        model->writeEllipses(data.nonlinear.begin(), data.fixed.begin(), ellipses.begin());
-        result.ellipse = ellipses.front().getCore().transform(data.fitSysToMeasSys.geometric.getLinear());
+        if (outputs.needsWeightSums()) {
+            // This flux uncertainty is computed holding all the nonlinear parameters fixed, and treating
+            // the best-fit model as a continuous aperture.  That's likely what we'd want for colors, but
+            // it underestimates the statistical uncertainty on the total flux (though that's probably
+            // dominated by systematic errors anyway).
+            WeightSums sums(
+                data.modelMatrix,
+                result.likelihood->getUnweightedData(),
+                result.likelihood->getVariance()
+            );
+            if (outputs.fluxInner) {
+                result.fluxInner = sums.fluxInner;
+            }
+            if (outputs.fluxSigma) {
+                result.fluxSigma = std::sqrt(sums.fluxVar)*result.flux/sums.fluxInner;
+            }
+        }
+        if (outputs.ellipse) {
+            // to compute the ellipse, we need to first read the nonlinear parameters into the workspace
+            // ellipse vector, then transform from fitSys to measSys.
+            // (the ellipse vector is a local workspace, so concurrent fits don't share it)
+            Model::EllipseVector ellipses = result.model->makeEllipseVector();
+            result.model->writeEllipses(data.nonlinear.begin(), data.fixed.begin(), ellipses.begin());
+            result.ellipse = ellipses.front().getCore().transform(
+                data.fitSysToMeasSys.geometric.getLinear()
+            );
+        }
     }
 
-    // Do the full nonlinear fit for this stage
+    // Do the full nonlinear fit for this stage, using the Model in result.model
     void fit(
-        CModelStageControl const & ctrl, CModelStageResult & result, CModelStageData const & data,
-        afw::image::Exposure<Pixel> const & exposure, afw::detection::Footprint const & footprint
+        CModelStageControl const & ctrl, CModelStageResult & result, CModelStageData & data,
+        afw::image::Exposure<Pixel> const & exposure, afw::detection::Footprint const & footprint,
+        detail::CModelFitCheckpoint * checkpoint=nullptr
     ) const {
+        PerfScope perfScope(perfRegion);
         long long startTime = 0;
         if (ctrl.doRecordTime) {
             startTime = daf::base::DateTime::now().nsecs();
         }
         result.likelihood = std::make_shared<UnitTransformedLikelihood>(
-            model, data.fixed, data.fitSys, *data.position,
+            result.model, data.fixed, data.fitSys, *data.position,
             exposure, footprint, data.psf,
-            UnitTransformedLikelihoodControl(ctrl.usePixelWeights, ctrl.weightsMultiplier)
+            UnitTransformedLikelihoodControl(ctrl.usePixelWeights, ctrl.weightsMultiplier),
+            data.inverseSigma
         );
         PTR(OptimizerObjective) objective = OptimizerObjective::makeFromLikelihood(result.likelihood, prior);
         result.objfunc = objective;
         Optimizer optimizer(objective, data.parameters, ctrl.optimizer);
+        Optimizer::StepCallback onStep;
+        if (checkpoint) {
+            if (checkpoint->stage == index) {
+                try {
+                    optimizer.restoreState(checkpoint->state);
+                } catch (pex::exceptions::Exception &) {
+                    // The state was saved for a different Model or Control; just start from scratch.
+                }
+            }
+            if (checkpoint->save) {
+                int const stage = index;
+                onStep = [checkpoint, stage](Optimizer const & current) {
+                    checkpoint->save(stage, current.saveState());
+                };
+            }
+        }
         try {
             if (ctrl.doRecordHistory) {
-                result.history = afw::table::BaseCatalog(historyTable);
-                optimizer.run(*historyRecorder, result.history);
+                result.history = afw::table::BaseCatalog(historyTable->clone()); // tables aren't thread-safe
+                optimizer.run(*historyRecorder, result.history, onStep);
             } else {
-                optimizer.run();
+                optimizer.run(onStep);
             }
         } catch (std::overflow_error &) {
             result.flags[CModelStageResult::NUMERIC_ERROR] = true;
@@ -761,60 +1090,58 @@ public:
         // amplitudes, then shallow-assign these to the result object.
         data.parameters.deep() = optimizer.getParameters(); // sets nonlinear and amplitudes - they are views
 
-        // This flux uncertainty is computed holding all the nonlinear parameters fixed, and treating
-        // the best-fit model as a continuous aperture.  That's likely what we'd want for colors, but it
-        // underestimates the statistical uncertainty on the total flux (though that's probably dominated by
-        // systematic errors anyway).
-        ndarray::Array<Pixel,2,-1> modelMatrix = makeModelMatrix(*result.likelihood, data.nonlinear);
-        WeightSums sums(
-            modelMatrix,
-            result.likelihood->getUnweightedData(),
-            result.likelihood->getVariance()
-        );
+        // We keep the model matrix on the data object so the final linear fit and the flux uncertainty
+        // can reuse it, but we don't evaluate it at all if nothing needs it.  When the optimizer's last
+        // model evaluation was at the best-fit nonlinear parameters (as it is when it converges on the
+        // gradient, after differentiating with respect to the amplitudes), the likelihood just copies
+        // that matrix instead of evaluating the model again.
+        if (ctrl.usePixelWeights || outputs.modelMatrix || outputs.needsWeightSums()) {
+            data.modelMatrix = makeModelMatrix(*result.likelihood, data.nonlinear);
+        }
 
         // If we're using per-pixel variances, we need to do another linear fit without them, since
         // using per-pixel variances there can cause magnitude-dependent biases in the flux.
         // (We're not sure if using per-pixel variances in the nonlinear fit can do that).
         if (ctrl.usePixelWeights) {
             afw::math::LeastSquares lstsq = afw::math::LeastSquares::fromDesignMatrix(
-                modelMatrix,
+                data.modelMatrix,
                 result.likelihood->getUnweightedData()
             );
             data.amplitudes.deep() = lstsq.getSolution();
         }
 
         // Set parameter vectors, flux values, ellipse on result.
-        fillResult(result, data, sums);
+        fillResult(result, data);
 
         if (ctrl.doRecordTime) {
             result.time = (daf::base::DateTime::now().nsecs() - startTime)/1E9;
         }
+        result.counters = perfScope.stop();
     }
 
-    // Do a linear-only fit for this stage (used only in forced mode)
+    // Do a linear-only fit for this stage, using the Model in result.model (used only in forced mode)
     void fitLinear(
-        CModelStageControl const & ctrl, CModelStageResult & result, CModelStageData const & data,
+        CModelStageControl const & ctrl, CModelStageResult & result, CModelStageData & data,
         afw::image::Exposure<Pixel> const & exposure, afw::detection::Footprint const & footprint
     ) const {
         result.likelihood = std::make_shared<UnitTransformedLikelihood>(
-            model, data.fixed, data.fitSys, *data.position,
-            exposure, footprint, data.psf, UnitTransformedLikelihoodControl(ctrl.usePixelWeights)
+            result.model, data.fixed, data.fitSys, *data.position,
+            exposure, footprint, data.psf, UnitTransformedLikelihoodControl(ctrl.usePixelWeights),
+            data.inverseSigma
         );
-        ndarray::Array<Pixel,2,-1> modelMatrix = makeModelMatrix(*result.likelihood, data.nonlinear);
+        data.modelMatrix = makeModelMatrix(*result.likelihood, data.nonlinear);
         afw::math::LeastSquares lstsq = afw::math::LeastSquares::fromDesignMatrix(
-            modelMatrix,
+            data.modelMatrix,
             result.likelihood->getUnweightedData()
         );
         data.amplitudes.deep() = lstsq.getSolution();
         result.objective
             = 0.5*(
                 result.likelihood->getUnweightedData().asEigen().cast<Scalar>()
-                - modelMatrix.asEigen().cast<Scalar>() * lstsq.getSolution().asEigen()
+                - data.modelMatrix.asEigen().cast<Scalar>() * lstsq.getSolution().asEigen()
             ).squaredNorm();
 
-        WeightSums sums(modelMatrix, result.likelihood->getUnweightedData(), result.likelihood->getVariance());
-
-        fillResult(result, data, sums);
+        fillResult(result, data);
         result.flags[CModelStageResult::FAILED] = false;
     }
 
@@ -837,9 +1164,13 @@ public:
                               // and extract shapelet PSF approximation.  May be null, depending
                               // on the CModelAlgorithm ctor called
     PTR(CModelKeys) refKeys;  // Key object used to retreive reference ellipses in forced mode
+    mutable PTR(InverseSigmaImage const) inverseSigma;  // 1/sigma plane for the last exposure measured,
+    mutable std::mutex inverseSigmaMutex;               // if ctrl.precomputeInverseSigma, and its guard
 
     explicit Impl(CModelControl const & ctrl) :
-        initial(ctrl.initial), exp(ctrl.exp), dev(ctrl.dev)
+        initial(ctrl.initial, PerfCounters::CMODEL_INITIAL, 0),
+        exp(ctrl.exp, PerfCounters::CMODEL_EXP, 1),
+        dev(ctrl.dev, PerfCounters::CMODEL_DEV, 2)
     {
         // construct linear combination model
         ModelVector components(2);
@@ -849,6 +1180,40 @@ public:
         prefixes[0] = "exp";
         prefixes[1] = "dev";
         model = std::make_shared<MultiModel>(components, prefixes);
+        // Adaptive models are selected using the initial fit's signal-to-noise, both here and (from the
+        // output catalog) in forced mode and renderModels, so they need its flux uncertainty.
+        if (!ctrl.doFluxSigma && (!exp.adaptiveModels.empty() || !dev.adaptiveModels.empty())) {
+            throw LSST_EXCEPT(
+                meas::base::FatalAlgorithmError,
+                "doFluxSigma must be True when exp or dev use adaptiveSnThresholds"
+            );
+        }
+        // Only compute the optional outputs the Control asks for, plus the exp and dev model
+        // matrices the final linear fit needs.
+        for (CModelStageImpl * stage : {&initial, &exp, &dev}) {
+            stage->outputs.fluxInner = ctrl.doFluxInner;
+            stage->outputs.fluxSigma = ctrl.doFluxSigma;
+            stage->outputs.ellipse = ctrl.doEllipses;
+        }
+        initial.outputs.modelMatrix = false;
+    }
+
+    // Return the shared inverse-sigma plane for the given exposure (or null if we're not using one),
+    // replacing the one we have if this is a different exposure.  The plane itself is computed lazily,
+    // the first time a likelihood needs it.
+    PTR(InverseSigmaImage const) getInverseSigma(
+        CModelControl const & ctrl,
+        afw::image::Exposure<Pixel> const & exposure
+    ) const {
+        if (!ctrl.precomputeInverseSigma) {
+            return PTR(InverseSigmaImage const)();
+        }
+        std::lock_guard<std::mutex> lock(inverseSigmaMutex);
+        PTR(afw::image::Image<Pixel> const) variance = exposure.getMaskedImage().getVariance();
+        if (!inverseSigma || !inverseSigma->isFor(*variance)) {
+            inverseSigma = std::make_shared<InverseSigmaImage>(variance);
+        }
+        return inverseSigma;
     }
 
     // Create a blank result object, filling in only the things that don't change
@@ -863,25 +1228,36 @@ public:
     // Do the final two-component linear fit.
     void fitLinear(
         CModelControl const & ctrl, CModelResult & result,
-        CModelStageData const & expData, CModelStageData const & devData,
-        afw::image::Exposure<Pixel> const & exposure, afw::detection::Footprint const & footprint
+        CModelStageData const & expData, CModelStageData const & devData
     ) const {
-        // concatenate exp and dev parameter arrays to make parameter arrays for combined model
-        ndarray::Array<Scalar,1,1> nonlinear = ndarray::allocate(model->getNonlinearDim());
-        nonlinear[ndarray::view(0, exp.model->getNonlinearDim())] = expData.nonlinear;
-        nonlinear[ndarray::view(exp.model->getNonlinearDim(), model->getNonlinearDim())] = devData.nonlinear;
-        ndarray::Array<Scalar,1,1> fixed = ndarray::allocate(model->getFixedDim());
-        fixed[ndarray::view(0, exp.model->getFixedDim())] = expData.fixed;
-        fixed[ndarray::view(exp.model->getFixedDim(), model->getFixedDim())] = devData.fixed;
-
-        UnitTransformedLikelihood likelihood(
-            model, fixed, expData.fitSys, *expData.position,
-            exposure, footprint, expData.psf, UnitTransformedLikelihoodControl(false)
-        );
-        ndarray::Array<Pixel,2,-1> modelMatrix = makeModelMatrix(likelihood, nonlinear);
+        // The exp and dev fits used the same pixels and the same fit coordinate system as this one, so
+        // the combined model matrix is just their (unweighted) model matrices side by side, and the
+        // data and variance arrays are the same as theirs.
+        if (expData.modelMatrix.isEmpty() || devData.modelMatrix.isEmpty()) {
+            throw LSST_EXCEPT(
+                pex::exceptions::LogicError,
+                "The exp and dev model matrices must be computed before the final linear fit"
+            );
+        }
+        if (expData.modelMatrix.getSize<0>() != devData.modelMatrix.getSize<0>()) {
+            throw LSST_EXCEPT(
+                pex::exceptions::LogicError,
+                (boost::format("exp and dev model matrices have different numbers of pixels (%d, %d)")
+                 % expData.modelMatrix.getSize<0>() % devData.modelMatrix.getSize<0>()).str()
+            );
+        }
+        int const nData = expData.modelMatrix.getSize<0>();
+        int const nExpAmplitudes = result.exp.model->getAmplitudeDim();
+        int const nAmplitudes = nExpAmplitudes + result.dev.model->getAmplitudeDim();
+        ndarray::Array<Pixel,2,2> modelMatrixT = detail::allocateTemporary<Pixel>(nAmplitudes, nData);
+        ndarray::Array<Pixel,2,-1> modelMatrix = modelMatrixT.transpose();
+        modelMatrix[ndarray::view()(0, nExpAmplitudes)] = expData.modelMatrix;
+        modelMatrix[ndarray::view()(nExpAmplitudes, nAmplitudes)] = devData.modelMatrix;
+        UnitTransformedLikelihood const & likelihood = *result.exp.likelihood;
+
         Vector gradient = -(modelMatrix.asEigen().adjoint() *
             likelihood.getUnweightedData().asEigen()).cast<Scalar>();
-        Matrix hessian = Matrix::Zero(likelihood.getAmplitudeDim(), likelihood.getAmplitudeDim());
+        Matrix hessian = Matrix::Zero(nAmplitudes, nAmplitudes);
         hessian.selfadjointView<Eigen::Lower>().rankUpdate(modelMatrix.asEigen().adjoint().cast<Scalar>());
         Scalar q0 = 0.5*likelihood.getUnweightedData().asEigen().squaredNorm();
 
@@ -903,11 +1279,17 @@ public:
         // Doing a better job would involve taking into account that we have positivity constraints
         // on the two components, which means the actual uncertainty is neither Gaussian nor symmetric,
         // which is a lot harder to compute and a lot harder to use.
-        ndarray::Array<Pixel,1,1> model = ndarray::allocate(likelihood.getDataDim());
-        model.asEigen() = modelMatrix.asEigen() * amplitudes.cast<Pixel>();
-        WeightSums sums(model, likelihood.getUnweightedData(), likelihood.getVariance());
-        result.fluxInner = sums.fluxInner;
-        result.fluxSigma = std::sqrt(sums.fluxVar)*result.flux/result.fluxInner;
+        if (ctrl.doFluxInner || ctrl.doFluxSigma) {
+            ndarray::Array<Pixel,1,1> model = detail::allocateTemporary<Pixel>(likelihood.getDataDim());
+            model.asEigen() = modelMatrix.asEigen() * amplitudes.cast<Pixel>();
+            WeightSums sums(model, likelihood.getUnweightedData(), likelihood.getVariance());
+            if (ctrl.doFluxInner) {
+                result.fluxInner = sums.fluxInner;
+            }
+            if (ctrl.doFluxSigma) {
+                result.fluxSigma = std::sqrt(sums.fluxVar)*result.flux/sums.fluxInner;
+            }
+        }
         result.flags[CModelResult::FAILED] = false;
         result.fracDev = amplitudes[1] / amplitudes.sum();
         result.objective = tg.evaluateLog()(amplitudes);
@@ -954,11 +1336,12 @@ public:
         deconvolvedEllipse.transform(data.fitSysToMeasSys.geometric.invert()).inPlace();
         // Convert to the ellipse parametrization used by the Model (assigning to an ellipse converts
         // between parametrizations)
-        assert(initial.ellipses.size() == 1u); // should be true of all Models that come from RadialProfiles
-        initial.ellipses.front() = deconvolvedEllipse;
+        Model::EllipseVector ellipses = initial.model->makeEllipseVector();
+        assert(ellipses.size() == 1u); // should be true of all Models that come from RadialProfiles
+        ellipses.front() = deconvolvedEllipse;
 
         // Read the ellipse into the nonlinear and fixed parameters.
-        initial.model->readEllipses(initial.ellipses.begin(), data.nonlinear.begin(), data.fixed.begin());
+        initial.model->readEllipses(ellipses.begin(), data.nonlinear.begin(), data.fixed.begin());
 
         // Set the initial amplitude (a.k.a. flux) to 1: recall that in FitSys, this is approximately correct
         assert(data.amplitudes.getSize<0>() == 1); // should be true of all Models from RadialProfiles
@@ -966,8 +1349,8 @@ public:
 
         // Ensure the initial parameters are compatible with the prior
         if (initial.prior && initial.prior->evaluate(data.nonlinear, data.amplitudes) == 0.0) {
-            initial.ellipses.front().setCore(afw::geom::ellipses::Quadrupole(mir2, mir2, 0.0));
-            initial.model->readEllipses(initial.ellipses.begin(), data.nonlinear.begin(), data.fixed.begin());
+            ellipses.front().setCore(afw::geom::ellipses::Quadrupole(mir2, mir2, 0.0));
+            initial.model->readEllipses(ellipses.begin(), data.nonlinear.begin(), data.fixed.begin());
             if (initial.prior->evaluate(data.nonlinear, data.amplitudes) == 0.0) {
                 throw LSST_EXCEPT(
                     meas::base::FatalAlgorithmError,
@@ -1055,7 +1438,8 @@ void CModelAlgorithm::_applyImpl(
     afw::geom::ellipses::Quadrupole const & moments,
     Scalar approxFlux,
     Scalar kronRadius,
-    int footprintArea
+    int footprintArea,
+    detail::CModelFitCheckpoint * checkpoint
 ) const {
 
     afw::geom::ellipses::Quadrupole psfMoments;
@@ -1101,22 +1485,25 @@ void CModelAlgorithm::_applyImpl(
     // Set up coordinate systems and empty parameter vectors
     CModelStageData initialData(exposure, approxFlux, center, psf, *_impl->initial.model);
     result.fitSysToMeasSys = initialData.fitSysToMeasSys;
+    initialData.inverseSigma = _impl->getInverseSigma(getControl(), exposure);
 
     // Initialize the parameter vectors by doing deconvolving the moments
     _impl->guessParametersFromMoments(getControl(), initialData, moments, result);
 
     // Do the initial fit
     // TODO: use only 0th-order terms in psf
-    _impl->initial.fit(getControl().initial, result.initial, initialData, exposure, *region.footprint);
+    _impl->initial.fit(getControl().initial, result.initial, initialData, exposure, *region.footprint,
+                       checkpoint);
     if (result.initial.flags[CModelStageResult::FAILED]) return;
 
     // Include a multiple of the initial-fit ellipse in the footprint, re-do clipping
+    Model::EllipseVector initialEllipses = result.initial.model->makeEllipseVector();
     result.initial.model->writeEllipses(initialData.nonlinear.begin(), initialData.fixed.begin(),
-                                        _impl->initial.ellipses.begin());
-    _impl->initial.ellipses.front().transform(initialData.fitSysToMeasSys.geometric).inPlace();
+                                        initialEllipses.begin());
+    initialEllipses.front().transform(initialData.fitSysToMeasSys.geometric).inPlace();
 
     // Revisit the pixel region to use in the fit, taking into account the initial ellipse
-    region.applyEllipse(_impl->initial.ellipses.front().getCore(), psfMoments);
+    region.applyEllipse(initialEllipses.front().getCore(), psfMoments);
     result.finalFitRegion = region.ellipse;
     region.applyMask(*exposure.getMaskedImage().getMask(), center);
     // It's okay to "override" these flags, because we'd have already returned early if they were set above.
@@ -1126,20 +1513,26 @@ void CModelAlgorithm::_applyImpl(
     result.flags[CModelResult::REGION_USED_INITIAL_ELLIPSE_MAX] = region.usedMaxEllipse;
     if (!region.footprint) return;
 
+    // Faint sources don't need the full profile bases, so pick the exp and dev Models using the
+    // signal-to-noise of the initial fit.
+    Scalar const initialSn = result.initial.flux / result.initial.fluxSigma;
+    result.exp.model = _impl->exp.selectModel(initialSn);
+    result.dev.model = _impl->dev.selectModel(initialSn);
+
     // Do the exponential fit
-    CModelStageData expData = initialData.changeModel(*_impl->exp.model);
-    _impl->exp.fit(getControl().exp, result.exp, expData, exposure, *region.footprint);
+    CModelStageData expData = initialData.changeModel(*result.exp.model);
+    _impl->exp.fit(getControl().exp, result.exp, expData, exposure, *region.footprint, checkpoint);
 
     // Do the de Vaucouleur fit
-    CModelStageData devData = initialData.changeModel(*_impl->dev.model);
-    _impl->dev.fit(getControl().dev, result.dev, devData, exposure, *region.footprint);
+    CModelStageData devData = initialData.changeModel(*result.dev.model);
+    _impl->dev.fit(getControl().dev, result.dev, devData, exposure, *region.footprint, checkpoint);
 
     if (result.exp.flags[CModelStageResult::FAILED] ||result.dev.flags[CModelStageResult::FAILED])
         return;
 
     // Do the linear combination fit
     try {
-        _impl->fitLinear(getControl(), result, expData, devData, exposure, *region.footprint);
+        _impl->fitLinear(getControl(), result, expData, devData);
     } catch (...) {
         result.flags[CModelResult::FAILED] = true;
         throw;
@@ -1235,6 +1628,7 @@ void CModelAlgorithm::_applyForcedImpl(
     // Set up coordinate systems and empty parameter vectors
     CModelStageData initialData(exposure, approxFlux, center, psf, *_impl->initial.model);
     result.fitSysToMeasSys = initialData.fitSysToMeasSys;
+    initialData.inverseSigma = _impl->getInverseSigma(getControl(), exposure);
 
     // Initialize the parameter vectors from the reference values.  Because these are
     // in fitSys units, we don't need to transform them, as fitSys (or at least its
@@ -1251,8 +1645,14 @@ void CModelAlgorithm::_applyForcedImpl(
         result.initial.flags[CModelStageResult::FAILED] = true;
     }
 
+    // Use the same exp and dev Models the reference fit did, which were selected using the
+    // signal-to-noise of its initial fit.
+    Scalar const referenceSn = reference.initial.flux / reference.initial.fluxSigma;
+    result.exp.model = _impl->exp.selectModel(referenceSn);
+    result.dev.model = _impl->dev.selectModel(referenceSn);
+
     // Do the exponential fit (amplitudes only)
-    CModelStageData expData = initialData.changeModel(*_impl->exp.model);
+    CModelStageData expData = initialData.changeModel(*result.exp.model);
     if (!reference.exp.flags[CModelStageResult::FAILED]) {
         expData.nonlinear.deep() = reference.exp.nonlinear;
         expData.fixed.deep() = reference.exp.fixed;
@@ -1263,7 +1663,7 @@ void CModelAlgorithm::_applyForcedImpl(
     }
 
     // Do the de Vaucouleur fit (amplitudes only)
-    CModelStageData devData = initialData.changeModel(*_impl->dev.model);
+    CModelStageData devData = initialData.changeModel(*result.dev.model);
     if (!reference.dev.flags[CModelStageResult::FAILED]) {
         devData.nonlinear.deep() = reference.dev.nonlinear;
         devData.fixed.deep() = reference.dev.fixed;
@@ -1278,29 +1678,18 @@ void CModelAlgorithm::_applyForcedImpl(
 
     // Do the linear combination fit
     try {
-        _impl->fitLinear(getControl(), result, expData, devData, exposure, *region.footprint);
+        _impl->fitLinear(getControl(), result, expData, devData);
     } catch (...) {
         result.flags[CModelResult::FAILED] = true;
         throw;
     }
 }
 
+namespace {
+
+// Checks for the Exposure components every CModel fit needs, shared by measure() and applyCatalog().
 template <typename PixelT>
-shapelet::MultiShapeletFunction CModelAlgorithm::_processInputs(
-    afw::table::SourceRecord & source,
-    afw::image::Exposure<PixelT> const & exposure
-) const {
-    // Set all failure flags so that's the result if we throw.
-    source.set(_impl->keys->flags[Result::FAILED], true);
-    source.set(_impl->keys->initial.flags[CModelStageResult::FAILED], true);
-    source.set(_impl->keys->exp.flags[CModelStageResult::FAILED], true);
-    source.set(_impl->keys->dev.flags[CModelStageResult::FAILED], true);
-    if (!_impl->keys) {
-        throw LSST_EXCEPT(
-            meas::base::FatalAlgorithmError,
-            "Algorithm was not initialized with a schema; cannot run in plugin mode"
-        );
-    }
+void checkExposure(afw::image::Exposure<PixelT> const & exposure) {
     if (!exposure.getWcs()) {
         throw LSST_EXCEPT(
             meas::base::FatalAlgorithmError,
@@ -1319,6 +1708,69 @@ shapelet::MultiShapeletFunction CModelAlgorithm::_processInputs(
             "Exposure has no Psf"
         );
     }
+}
+
+// Return the moments used to initialize a non-forced fit: the shape slot if it succeeded, or the
+// PSF moments scaled by ctrl.fallbackInitialMomentsPsfFactor (setting NO_SHAPE) if it did not.
+afw::geom::ellipses::Quadrupole getInitialMoments(
+    CModelControl const & ctrl,
+    afw::table::SourceRecord const & record,
+    shapelet::MultiShapeletFunction const & psf,
+    CModelResult & result
+) {
+    if (record.getTable()->getShapeKey().isValid() &&
+        !(record.getTable()->getShapeFlagKey().isValid() && record.getShapeFlag())) {
+        return record.getShape();
+    }
+    if (!(ctrl.fallbackInitialMomentsPsfFactor > 0.0)) {
+        throw LSST_EXCEPT(
+            meas::base::MeasurementError,
+            "Shape slot algorithm failed or was not run, and fallbackInitialMomentsPsfFactor < 0",
+            CModelResult::NO_SHAPE
+        );
+    }
+    result.flags[CModelResult::NO_SHAPE] = true;
+    afw::geom::ellipses::Quadrupole moments;
+    try {
+        moments = psf.evaluate().computeMoments().getCore();
+    } catch (afw::geom::SingularTransformException const& exc) {
+        throw LSST_EXCEPT(
+            meas::base::MeasurementError,
+            std::string("Singular transform in shapelets: ") + exc.what(),
+            CModelResult::NO_SHAPELET_PSF
+        );
+    }
+    moments.scale(ctrl.fallbackInitialMomentsPsfFactor);
+    return moments;
+}
+
+// If PsfFlux has been run, use that for approx flux; otherwise we'll compute it ourselves.
+Scalar getApproxFlux(afw::table::SourceRecord const & record) {
+    if (record.getTable()->getPsfFluxKey().isValid() && !record.getPsfFluxFlag()) {
+        return record.getPsfFlux();
+    }
+    return -1.0;
+}
+
+} // anonymous
+
+template <typename PixelT>
+shapelet::MultiShapeletFunction CModelAlgorithm::_processInputs(
+    afw::table::SourceRecord & source,
+    afw::image::Exposure<PixelT> const & exposure
+) const {
+    // Set all failure flags so that's the result if we throw.
+    source.set(_impl->keys->flags[Result::FAILED], true);
+    source.set(_impl->keys->initial.flags[CModelStageResult::FAILED], true);
+    source.set(_impl->keys->exp.flags[CModelStageResult::FAILED], true);
+    source.set(_impl->keys->dev.flags[CModelStageResult::FAILED], true);
+    if (!_impl->keys) {
+        throw LSST_EXCEPT(
+            meas::base::FatalAlgorithmError,
+            "Algorithm was not initialized with a schema; cannot run in plugin mode"
+        );
+    }
+    checkExposure(exposure);
     return source.get(_impl->keys->psf);
 }
 
@@ -1326,39 +1778,14 @@ void CModelAlgorithm::measure(
     afw::table::SourceRecord & measRecord,
     afw::image::Exposure<Pixel> const & exposure
 ) const {
+    // Draw per-source workspace from this thread's arena; declared before the result so the result
+    // (which holds views into that workspace) is destroyed first, letting the arena recycle it.
+    detail::ArenaScope arenaScope;
     Result result = _impl->makeResult();
     // Read the shapelet approximation to the PSF, load/verify other inputs from the SourceRecord
     shapelet::MultiShapeletFunction psf = _processInputs(measRecord, exposure);
-    afw::geom::ellipses::Quadrupole moments;
-    if (!measRecord.getTable()->getShapeKey().isValid() ||
-        (measRecord.getTable()->getShapeFlagKey().isValid() && measRecord.getShapeFlag())) {
-        if (getControl().fallbackInitialMomentsPsfFactor > 0.0) {
-            result.flags[Result::NO_SHAPE] = true;
-            try {
-                moments = psf.evaluate().computeMoments().getCore();
-            } catch (afw::geom::SingularTransformException const& exc) {
-                throw LSST_EXCEPT(
-                    meas::base::MeasurementError,
-                    std::string("Singular transform in shapelets: ") + exc.what(),
-                    CModelResult::NO_SHAPELET_PSF
-                );
-            }
-            moments.scale(getControl().fallbackInitialMomentsPsfFactor);
-        } else {
-            throw LSST_EXCEPT(
-                meas::base::MeasurementError,
-                "Shape slot algorithm failed or was not run, and fallbackInitialMomentsPsfFactor < 0",
-                CModelResult::NO_SHAPE
-            );
-        }
-    } else {
-        moments = measRecord.getShape();
-    }
-    // If PsfFlux has been run, use that for approx flux; otherwise we'll compute it ourselves.
-    Scalar approxFlux = -1.0;
-    if (measRecord.getTable()->getPsfFluxKey().isValid() && !measRecord.getPsfFluxFlag()) {
-        approxFlux = measRecord.getPsfFlux();
-    }
+    afw::geom::ellipses::Quadrupole moments = getInitialMoments(getControl(), measRecord, psf, result);
+    Scalar approxFlux = getApproxFlux(measRecord);
     // If KronFlux has been run, use the Kron radius to initialize the fit region.
     Scalar kronRadius = -1.0;
     if (_impl->keys->kronRadius.isValid() && measRecord.get(_impl->keys->kronRadius) > 0) {
@@ -1381,14 +1808,11 @@ void CModelAlgorithm::measure(
     afw::image::Exposure<Pixel> const & exposure,
     afw::table::SourceRecord const & refRecord
 ) const {
+    detail::ArenaScope arenaScope;  // see comment in non-forced measure()
     Result result = _impl->makeResult();
     // Read the shapelet approximation to the PSF, load/verify other inputs from the SourceRecord
     shapelet::MultiShapeletFunction psf = _processInputs(measRecord, exposure);
-    // If PsfFlux has been run, use that for approx flux; otherwise we'll compute it ourselves.
-    Scalar approxFlux = -1.0;
-    if (measRecord.getTable()->getPsfFluxKey().isValid() && !measRecord.getPsfFluxFlag()) {
-        approxFlux = measRecord.getPsfFlux();
-    }
+    Scalar approxFlux = getApproxFlux(measRecord);
     try {
         Result refResult = _impl->refKeys->copyRecordToResult(refRecord);
         _applyForcedImpl(result, exposure, psf, measRecord.getCentroid(), refResult, approxFlux);
@@ -1401,4 +1825,329 @@ void CModelAlgorithm::measure(
     _impl->checkFlagDetails(measRecord);
 }
 
+// ------------------- Batch processing of whole catalogs -------------------------------------------------
+
+namespace {
+
+// An in-flight state in a CModelResultBatch is the index of the stage being fit, as a single byte,
+// followed by the Optimizer state of that stage.
+std::string packInFlightState(int stage, std::string const & optimizerState) {
+    return std::string(1, static_cast<char>(stage)) + optimizerState;
+}
+
+// Set the stage and Optimizer state to resume from, or leave them unset if there is no (valid) state.
+void unpackInFlightState(std::string const & state, detail::CModelFitCheckpoint & checkpoint) {
+    if (state.size() > 1 && static_cast<unsigned char>(state[0]) < 3) {
+        checkpoint.stage = static_cast<unsigned char>(state[0]);
+        checkpoint.state = state.substr(1);
+    }
+}
+
+// The latest in-flight state of the source a thread in applyCatalog is fitting.  Only that thread
+// writes it (after every Optimizer step), and it is only read when a checkpoint is taken, so the lock
+// is almost never contended.
+struct InFlightSlot {
+    std::mutex mutex;
+    int row;            // index of the source being fit, or -1 for none
+    std::string state;  // packed in-flight state of that source; empty if it has not taken a step yet
+    InFlightSlot() : row(-1) {}
+};
+
+} // anonymous
+
+void CModelAlgorithm::applyCatalog(
+    afw::table::SourceCatalog const & catalog,
+    afw::image::Exposure<Pixel> const & exposure,
+    CModelResultBatch & output,
+    int nThreads,
+    bool resume,
+    std::function<void(CModelResultBatch const &)> const & checkpoint,
+    int checkpointInterval,
+    int checkpointStepInterval
+) const {
+    LSST_THROW_IF_NE(
+        static_cast<int>(catalog.size()), output.getSize(),
+        pex::exceptions::LengthError,
+        "Catalog size (%d) does not match batch size (%d)"
+    );
+    checkExposure(exposure);
+    afw::table::Schema const schema = catalog.getSchema();
+    shapelet::MultiShapeletFunctionKey psfKey(schema[getControl().psfName]);
+    afw::table::Key<float> kronRadiusKey;
+    try {
+        kronRadiusKey = schema["ext_photometryKron_KronFlux_radius"];
+    } catch (pex::exceptions::NotFoundError &) {
+        // we'll fall back to other options if Kron radius is not available.
+    }
+    // Psf and Wcs objects cache intermediate results, so each thread gets its own copies; the pixels
+    // are shared.
+    nThreads = std::min(detail::resolveThreadCount(nThreads), std::max(1, output.getSize()));
+    std::vector<afw::image::Exposure<Pixel>> threadExposures;
+    threadExposures.reserve(nThreads);
+    for (int t = 0; t < nThreads; ++t) {
+        threadExposures.push_back(afw::image::Exposure<Pixel>(exposure, false));
+        threadExposures.back().setPsf(exposure.getPsf()->clone());
+        threadExposures.back().setWcs(exposure.getWcs()->clone());
+    }
+    // Rows are written and checkpoints taken while holding this lock, so checkpoints only ever see
+    // complete rows.  In-flight states are kept in per-thread slots, and only copied to the batch when
+    // a checkpoint is taken.
+    std::mutex outputMutex;
+    std::vector<InFlightSlot> slots(nThreads);
+    int nSinceCheckpoint = 0;
+    std::atomic<int> nStepsSinceCheckpoint(0);
+    // Copy the in-flight states to the batch and pass it to the checkpoint callback; outputMutex must be
+    // held.
+    auto takeCheckpoint = [&]() {
+        for (std::vector<InFlightSlot>::iterator s = slots.begin(); s != slots.end(); ++s) {
+            std::lock_guard<std::mutex> slotLock(s->mutex);
+            if (s->row >= 0 && !s->state.empty()) {
+                output.setInFlightState(s->row, s->state);
+            }
+        }
+        checkpoint(output);
+        nSinceCheckpoint = 0;
+        nStepsSinceCheckpoint = 0;
+    };
+    detail::parallelFor(
+        output.getSize(), nThreads,
+        [&](int i, int thread) {
+            detail::CModelFitCheckpoint fitCheckpoint;
+            if (resume) {
+                std::lock_guard<std::mutex> lock(outputMutex);
+                if (output.isDone(i)) {
+                    return;
+                }
+                unpackInFlightState(output.getInFlightState(i), fitCheckpoint);
+            }
+            InFlightSlot & slot = slots[thread];
+            if (checkpoint) {
+                {
+                    std::lock_guard<std::mutex> lock(slot.mutex);
+                    slot.row = i;
+                    slot.state.clear();
+                }
+                // Saving the state after every step is cheap next to the step itself, and lets an
+                // interrupted run resume long fits close to where they stopped.
+                fitCheckpoint.save = [&](int stage, std::string const & state) {
+                    if (fitCheckpoint.error) {
+                        return;  // the fit is about to be abandoned anyway
+                    }
+                    std::string packed = packInFlightState(stage, state);
+                    {
+                        std::lock_guard<std::mutex> lock(slot.mutex);
+                        slot.state.swap(packed);
+                    }
+                    if (checkpointStepInterval > 0 && ++nStepsSinceCheckpoint >= checkpointStepInterval) {
+                        std::lock_guard<std::mutex> lock(outputMutex);
+                        if (nStepsSinceCheckpoint >= checkpointStepInterval) {  // not already taken
+                            try {
+                                takeCheckpoint();
+                            } catch (...) {
+                                // Exceptions thrown here would just make the Optimizer fail; we
+                                // rethrow this one once the fit returns instead.
+                                fitCheckpoint.error = std::current_exception();
+                                throw;
+                            }
+                        }
+                    }
+                };
+            }
+            detail::ArenaScope arenaScope;  // see comment in non-forced measure()
+            afw::table::SourceRecord const & record = catalog[i];
+            Result result = _impl->makeResult();
+            try {
+                shapelet::MultiShapeletFunction psf = record.get(psfKey);
+                afw::geom::ellipses::Quadrupole moments
+                    = getInitialMoments(getControl(), record, psf, result);
+                Scalar kronRadius = -1.0;
+                if (kronRadiusKey.isValid() && record.get(kronRadiusKey) > 0) {
+                    kronRadius = record.get(kronRadiusKey);
+                }
+                int const footprintArea = record.getFootprint() ? record.getFootprint()->getArea() : -1;
+                _applyImpl(result, threadExposures[thread], psf, record.getCentroid(), moments,
+                           getApproxFlux(record), kronRadius, footprintArea, &fitCheckpoint);
+            } catch (meas::base::FatalAlgorithmError &) {
+                throw;
+            } catch (meas::base::MeasurementError & error) {
+                result.flags[Result::FAILED] = true;
+                result.flags[error.getFlagBit()] = true;
+            } catch (pex::exceptions::Exception &) {
+                result.flags[Result::FAILED] = true;
+            }
+            if (fitCheckpoint.error) {
+                std::rethrow_exception(fitCheckpoint.error);
+            }
+            if (checkpoint) {
+                std::lock_guard<std::mutex> lock(slot.mutex);
+                slot.row = -1;
+            }
+            std::lock_guard<std::mutex> lock(outputMutex);
+            output.set(i, result);
+            if (checkpoint && ++nSinceCheckpoint >= checkpointInterval) {
+                takeCheckpoint();
+            }
+        }
+    );
+}
+
+// ------------------- Rendering models for whole catalogs ------------------------------------------------
+
+namespace {
+
+// A single source's PSF-convolved model in image coordinates, and the box we evaluate it in.
+struct RenderedModel {
+    shapelet::MultiShapeletFunction msf;
+    afw::geom::Box2I bbox;
+};
+
+} // anonymous
+
+void CModelAlgorithm::renderModels(
+    afw::table::SourceCatalog const & catalog,
+    afw::image::Exposure<Pixel> & exposure,
+    std::string const & name,
+    double nSigma,
+    int tileSize,
+    int nThreads
+) const {
+    if (!exposure.getWcs()) {
+        throw LSST_EXCEPT(
+            pex::exceptions::InvalidParameterError,
+            "Exposure has no Wcs"
+        );
+    }
+    if (tileSize <= 0) {
+        throw LSST_EXCEPT(
+            pex::exceptions::InvalidParameterError,
+            (boost::format("tileSize must be positive (got %d)") % tileSize).str()
+        );
+    }
+    if (_impl->exp.model->getAmplitudeDim() != 1 || _impl->dev.model->getAmplitudeDim() != 1) {
+        throw LSST_EXCEPT(
+            pex::exceptions::LogicError,
+            "Cannot render models with more than one amplitude per component"
+        );
+    }
+    afw::table::Schema const schema = catalog.getSchema();
+    afw::table::ArrayKey<Scalar> expNonlinear = schema[schema.join(name, "exp")]["nonlinear"];
+    afw::table::ArrayKey<Scalar> expFixed = schema[schema.join(name, "exp")]["fixed"];
+    afw::table::ArrayKey<Scalar> devNonlinear = schema[schema.join(name, "dev")]["nonlinear"];
+    afw::table::ArrayKey<Scalar> devFixed = schema[schema.join(name, "dev")]["fixed"];
+    afw::table::Key<meas::base::Flux> fluxKey = schema[name]["flux"];
+    afw::table::Key<meas::base::Flux> initialFluxKey = schema[schema.join(name, "initial")]["flux"];
+    afw::table::Key<meas::base::FluxErrElement> initialFluxSigmaKey
+        = schema[schema.join(name, "initial")]["fluxSigma"];
+    afw::table::Key<afw::table::Flag> flagKey = schema[name]["flag"];
+    afw::table::Key<Scalar> fracDevKey = schema[name]["fracDev"];
+    afw::table::Key<Scalar> apCorrKey;
+    try {
+        apCorrKey = schema[name]["apCorr"];
+    } catch (pex::exceptions::NotFoundError &) {
+        // fluxes have not been aperture-corrected
+    }
+    shapelet::MultiShapeletFunctionKey psfKey(schema[getControl().psfName]);
+
+    // Build the PSF-convolved model for each source.  This is cheap compared to evaluating the models,
+    // and it involves Wcs transforms we don't want to do concurrently, so we do it serially.
+    afw::geom::Box2I const imageBBox = exposure.getBBox();
+    UnitSystem measSys(exposure);
+    std::vector<RenderedModel> models;
+    models.reserve(catalog.size());
+    ndarray::Array<Scalar,1,1> expAmplitudes = ndarray::allocate(1);
+    ndarray::Array<Scalar,1,1> devAmplitudes = ndarray::allocate(1);
+    for (afw::table::SourceCatalog::const_iterator record = catalog.begin(); record != catalog.end();
+         ++record) {
+        Scalar flux = record->get(fluxKey);
+        Scalar fracDev = record->get(fracDevKey);
+        if (apCorrKey.isValid()) {
+            flux /= record->get(apCorrKey);
+        }
+        afw::geom::Point2D center = record->getCentroid();
+        if (record->get(flagKey) || !std::isfinite(flux) || !std::isfinite(fracDev)
+            || !std::isfinite(center.getX()) || !std::isfinite(center.getY())) {
+            continue;
+        }
+        PTR(afw::coord::Coord) position = exposure.getWcs()->pixelToSky(center);
+        UnitSystem fitSys(*position, 0.0);  // only the Wcs matters: we use measSys fluxes directly
+        LocalUnitTransform fitSysToMeasSys(*position, fitSys, measSys);
+        // Profile models are normalized to unit flux, and geometric transforms preserve flux, so the
+        // amplitudes are just the measured fluxes of each component.
+        expAmplitudes[0] = flux * (1.0 - fracDev);
+        devAmplitudes[0] = flux * fracDev;
+        // Use the same Models the fit did, which depend on the signal-to-noise of the initial fit.
+        Scalar const initialSn = record->get(initialFluxKey) / record->get(initialFluxSigmaKey);
+        shapelet::MultiShapeletFunction msf = _impl->exp.selectModel(initialSn)->makeShapeletFunction(
+            record->get(expNonlinear), expAmplitudes, record->get(expFixed)
+        );
+        shapelet::MultiShapeletFunction dev = _impl->dev.selectModel(initialSn)->makeShapeletFunction(
+            record->get(devNonlinear), devAmplitudes, record->get(devFixed)
+        );
+        msf.getComponents().insert(msf.getComponents().end(),
+                                   dev.getComponents().begin(), dev.getComponents().end());
+        msf.transformInPlace(fitSysToMeasSys.geometric);
+        RenderedModel model = {msf.convolve(record->get(psfKey)), afw::geom::Box2I()};
+        for (shapelet::MultiShapeletFunction::ComponentList::const_iterator i
+                 = model.msf.getComponents().begin();
+             i != model.msf.getComponents().end();
+             ++i
+        ) {
+            afw::geom::ellipses::Ellipse support(i->getEllipse());
+            support.getCore().scale(nSigma);
+            model.bbox.include(afw::geom::Box2I(support.computeBBox(), afw::geom::Box2I::EXPAND));
+        }
+        model.bbox.clip(imageBBox);
+        if (!model.bbox.isEmpty()) {
+            models.push_back(model);
+        }
+    }
+
+    // Assign models to the tiles their boxes overlap, so each tile only visits nearby sources.
+    int const nTilesX = (imageBBox.getWidth() + tileSize - 1) / tileSize;
+    int const nTilesY = (imageBBox.getHeight() + tileSize - 1) / tileSize;
+    std::vector<std::vector<int>> tileModels(nTilesX*nTilesY);
+    for (int n = 0; n < static_cast<int>(models.size()); ++n) {
+        afw::geom::Box2I const & bbox = models[n].bbox;
+        for (int ty = (bbox.getMinY() - imageBBox.getMinY()) / tileSize;
+             ty <= (bbox.getMaxY() - imageBBox.getMinY()) / tileSize; ++ty) {
+            for (int tx = (bbox.getMinX() - imageBBox.getMinX()) / tileSize;
+                 tx <= (bbox.getMaxX() - imageBBox.getMinX()) / tileSize; ++tx) {
+                tileModels[ty*nTilesX + tx].push_back(n);
+            }
+        }
+    }
+
+    // Render tiles in parallel; they don't overlap, so each thread writes to a distinct part of the image.
+    afw::image::Image<Pixel> & image = *exposure.getMaskedImage().getImage();
+    detail::parallelFor(
+        nTilesX*nTilesY, nThreads,
+        [&](int t, int) {
+            if (tileModels[t].empty()) return;
+            afw::geom::Point2I const tileMin(
+                imageBBox.getMinX() + (t % nTilesX)*tileSize,
+                imageBBox.getMinY() + (t / nTilesX)*tileSize
+            );
+            afw::geom::Box2I tileBBox(tileMin, afw::geom::Extent2I(tileSize, tileSize));
+            tileBBox.clip(imageBBox);
+            ndarray::Array<double,2,2> buffer = ndarray::allocate(tileBBox.getHeight(), tileBBox.getWidth());
+            buffer.deep() = 0.0;
+            for (std::vector<int>::const_iterator n = tileModels[t].begin(); n != tileModels[t].end(); ++n) {
+                afw::geom::Box2I bbox(models[*n].bbox);
+                bbox.clip(tileBBox);
+                afw::geom::Extent2I const offset = bbox.getMin() - tileMin;
+                models[*n].msf.evaluate().addToImage(
+                    buffer[ndarray::view(offset.getY(), offset.getY() + bbox.getHeight())
+                                        (offset.getX(), offset.getX() + bbox.getWidth())],
+                    bbox.getMin()
+                );
+            }
+            ndarray::Array<Pixel,2,1> target = image.getArray()[
+                ndarray::view(tileBBox.getMinY() - image.getY0(), tileBBox.getMaxY() + 1 - image.getY0())
+                             (tileBBox.getMinX() - image.getX0(), tileBBox.getMaxX() + 1 - image.getX0())
+            ];
+            target.asEigen<Eigen::ArrayXpr>() += buffer.asEigen<Eigen::ArrayXpr>().cast<Pixel>();
+        }
+    );
+}
+
 }}} // namespace lsst::meas::modelfit
@@ -20,6 +20,7 @@
  * the GNU General Public License along with this program.  If not,
  * see <http://www.lsstcorp.org/LegalNotices/>.
  */
+#include <algorithm>
 #include <array>
 
 #include "lsst/shapelet/MatrixBuilder.h"
@@ -28,6 +29,8 @@
 #include "lsst/afw/table/Source.h"
 #include "lsst/afw/geom/ellipses/GridTransform.h"
 #include "lsst/meas/modelfit/DoubleShapeletPsfApprox.h"
+#include "lsst/meas/modelfit/detail/Arena.h"
+#include "lsst/meas/modelfit/detail/parallelSeeded.h"
 
 namespace lsst { namespace meas { namespace modelfit {
 namespace {
@@ -190,6 +193,32 @@ shapelet::MultiShapeletFunction DoubleShapeletPsfApproxAlgorithm::initializeResu
     return result;
 }
 
+shapelet::MultiShapeletFunction DoubleShapeletPsfApproxAlgorithm::initializeResult(
+    Control const & ctrl,
+    shapelet::MultiShapeletFunction const & seed
+) {
+    if (seed.getComponents().size() != 2u) {
+        throw LSST_EXCEPT(
+            pex::exceptions::InvalidParameterError,
+            (boost::format("Seed MultiShapeletFunction must have exactly 2 components, not %d.")
+             % seed.getComponents().size()).str()
+        );
+    }
+    // Copy only the zeroth-order terms, to match the state fitProfile() expects.
+    shapelet::ShapeletFunction inner(ctrl.innerOrder, shapelet::HERMITE,
+                                     seed.getComponents()[0].getEllipse());
+    inner.getCoefficients()[0] = seed.getComponents()[0].getCoefficients()[0];
+    shapelet::ShapeletFunction outer(ctrl.outerOrder, shapelet::HERMITE,
+                                     seed.getComponents()[1].getEllipse());
+    outer.getCoefficients()[0] = seed.getComponents()[1].getCoefficients()[0];
+    shapelet::MultiShapeletFunction result;
+    result.getComponents().push_back(std::move(inner));
+    result.getComponents().push_back(std::move(outer));
+    result.normalize();
+    result.transformInPlace(result.evaluate().computeMoments().getGridTransform());
+    return result;
+}
+
 void DoubleShapeletPsfApproxAlgorithm::fitMoments(
     shapelet::MultiShapeletFunction & result,
     Control const & ctrl,
@@ -256,8 +285,8 @@ public:
         _minRadius(ctrl.minRadius),
         _maxRadius(ctrl.maxRadiusBoxFraction * std::sqrt(this->dataSize)),
         _minRadiusDiff(ctrl.minRadiusDiff),
-        _data(ndarray::Array<Scalar,1,1>(ndarray::allocate(this->dataSize))),
-        _arg(ndarray::Array<Scalar,1,1>(ndarray::allocate(this->dataSize)))
+        _data(ndarray::Array<Scalar,1,1>(detail::allocateTemporary<Scalar>(this->dataSize))),
+        _arg(ndarray::Array<Scalar,1,1>(detail::allocateTemporary<Scalar>(this->dataSize)))
     {
         // Radius parameters are defined as factors of the moments ellipse, so
         // we have to scale the constraints the same way.
@@ -302,6 +331,57 @@ public:
         return true;
     }
 
+    virtual bool hasNormalEquations() const { return true; }
+
+    virtual Scalar computeNormalEquations(
+        ndarray::Array<Scalar const,1,1> const & parameters,
+        ndarray::Array<Scalar,1,1> const & jtr,
+        ndarray::Array<Scalar,2,1> const & jtj
+    ) const {
+        // Same math as computeResiduals and differentiateResiduals, but evaluated over small blocks
+        // of pixels that are immediately reduced into J^T r and J^T J, so neither r nor J ever has
+        // to be stored in full.
+        static int const BLOCK_SIZE = 256;
+        Scalar iR2 = parameters[2] * parameters[2];
+        Scalar oR2 = parameters[3] * parameters[3];
+        Eigen::Array<Scalar,Eigen::Dynamic,1> r(BLOCK_SIZE);
+        Eigen::Array<Scalar,Eigen::Dynamic,4> d(BLOCK_SIZE, 4);
+        Eigen::Matrix<Scalar,4,1> gradient = Eigen::Matrix<Scalar,4,1>::Zero();
+        Eigen::Matrix<Scalar,4,4> hessian = Eigen::Matrix<Scalar,4,4>::Zero();
+        Scalar chiSq = 0.0;
+        for (int begin = 0; begin < dataSize; begin += BLOCK_SIZE) {
+            int const n = std::min(BLOCK_SIZE, dataSize - begin);
+            auto arg = _arg.segment(begin, n);
+            auto dBlock = d.topRows(n);
+            auto rBlock = r.head(n);
+            dBlock.col(0) = - (_normalization/iR2)*(arg/iR2).exp();
+            dBlock.col(1) = - (_normalization/oR2)*(arg/oR2).exp();
+            rBlock = _data.segment(begin, n) + parameters[0]*dBlock.col(0) + parameters[1]*dBlock.col(1);
+            dBlock.col(2) = -2.0*dBlock.col(0)*(arg/iR2 + 1.0)*parameters[0]/parameters[2];
+            dBlock.col(3) = -2.0*dBlock.col(1)*(arg/oR2 + 1.0)*parameters[1]/parameters[3];
+            chiSq += rBlock.matrix().squaredNorm();
+            gradient.noalias() += dBlock.matrix().adjoint() * rBlock.matrix();
+            hessian.selfadjointView<Eigen::Lower>().rankUpdate(dBlock.matrix().adjoint(), 1.0);
+        }
+        jtr.asEigen() = gradient;
+        jtj.asEigen() = hessian;
+        return 0.5*chiSq;
+    }
+
+    virtual bool supportsConcurrentEvaluation() const { return true; }
+
+    virtual PTR(OptimizerConstraints const) getConstraints() const {
+        // The same feasible region as computePrior, expressed directly so the optimizer can step
+        // along its edges instead of just rejecting steps that cross them.
+        PTR(OptimizerConstraints) constraints = std::make_shared<OptimizerConstraints>(parameterSize, 1);
+        constraints->lower[2] = _minRadius;
+        constraints->upper[3] = _maxRadius;
+        constraints->inequalityMatrix[0][2] = -1.0;
+        constraints->inequalityMatrix[0][3] = 1.0;
+        constraints->inequalityVector[0] = _minRadiusDiff;
+        return constraints;
+    }
+
     virtual bool hasPrior() const { return true; }
 
     virtual Scalar computePrior(ndarray::Array<Scalar const,1,1> const & parameters) const {
@@ -347,7 +427,7 @@ void DoubleShapeletPsfApproxAlgorithm::fitProfile(
     afw::geom::ellipses::Ellipse moments = result.evaluate().computeMoments();
     Scalar momentsRadius = moments.getCore().getDeterminantRadius();
     auto objective = makeObjective(moments, ctrl, psfImage);
-    ndarray::Array<Scalar,1,1> parameters = ndarray::allocate(objective->parameterSize);
+    ndarray::Array<Scalar,1,1> parameters = detail::allocateTemporary<Scalar>(objective->parameterSize);
     parameters[0] = result.getComponents()[0].getCoefficients()[0];
     parameters[1] = result.getComponents()[1].getCoefficients()[0];
     parameters[2] = result.getComponents()[0].getEllipse().getCore().getDeterminantRadius() / momentsRadius;
@@ -397,9 +477,9 @@ void DoubleShapeletPsfApproxAlgorithm::fitShapelets(
     // Create flattened coordinate arrays to pass to MatrixBuilders, while copying pixel values into
     // another flattened array.
     int area = psfImage.getBBox().getArea();
-    ndarray::Array<Scalar,1,1> xArray = ndarray::allocate(area);
-    ndarray::Array<Scalar,1,1> yArray = ndarray::allocate(area);
-    ndarray::Array<Scalar,1,1> data = ndarray::allocate(area);
+    ndarray::Array<Scalar,1,1> xArray = detail::allocateTemporary<Scalar>(area);
+    ndarray::Array<Scalar,1,1> yArray = detail::allocateTemporary<Scalar>(area);
+    ndarray::Array<Scalar,1,1> data = detail::allocateTemporary<Scalar>(area);
     FlattenFunctor func(xArray, yArray, data);
     applyPixelFunctor(psfImage, func);
     // Construct two MatrixBuilders, using the pattern that lets them share workspace.
@@ -412,7 +492,7 @@ void DoubleShapeletPsfApproxAlgorithm::fitShapelets(
     // Build the full matrix we'll need to solve: the combination of the two basis, without
     // zeroth-order terms.
     int fitBasisSize = n1 + n2 - 2;
-    ndarray::Array<Scalar,2,-2> fitMatrix = ndarray::allocate(data.size(), fitBasisSize);
+    ndarray::Array<Scalar,2,-2> fitMatrix = detail::allocateTemporary<Scalar>(data.size(), fitBasisSize);
     if (n1 > 1) {
         fitMatrix[ndarray::view()(0, n1 - 1)] = innerMatrix[ndarray::view()(1, n1)];
     }
@@ -434,21 +514,14 @@ void DoubleShapeletPsfApproxAlgorithm::fitShapelets(
     }
 }
 
-void DoubleShapeletPsfApproxAlgorithm::measure(
+PTR(afw::detection::Psf::Image) DoubleShapeletPsfApproxAlgorithm::_computePsfImage(
     afw::table::SourceRecord & measRecord,
-    afw::image::Exposure<float> const & exposure
+    afw::detection::Psf const & psf
 ) const {
-    auto psf = exposure.getPsf();
-    if (!psf) {
-        throw LSST_EXCEPT(
-            meas::base::FatalAlgorithmError,
-            "No Psf attached to Exposure for DoubleShapeletPsfApprox."
-        );
-    }
     auto position = _centroidExtractor(measRecord, _flagHandler);
-    PTR(afw::detection::Psf::Image) psfImage;
     try {
-        psfImage = psf->computeKernelImage(position);
+        // We never modify the image, so there's no need for the Psf to copy its cached result.
+        return psf.computeKernelImage(position, afw::image::Color(), afw::detection::Psf::INTERNAL);
     } catch (pex::exceptions::Exception & err) {
         throw LSST_EXCEPT(
             meas::base::MeasurementError,
@@ -456,6 +529,21 @@ void DoubleShapeletPsfApproxAlgorithm::measure(
             INVALID_POINT_FOR_PSF.number
         );
     }
+}
+
+void DoubleShapeletPsfApproxAlgorithm::measure(
+    afw::table::SourceRecord & measRecord,
+    afw::image::Exposure<float> const & exposure
+) const {
+    auto psf = exposure.getPsf();
+    if (!psf) {
+        throw LSST_EXCEPT(
+            meas::base::FatalAlgorithmError,
+            "No Psf attached to Exposure for DoubleShapeletPsfApprox."
+        );
+    }
+    detail::ArenaScope arenaScope;
+    auto psfImage = _computePsfImage(measRecord, *psf);
     auto result = initializeResult(_ctrl);
     fitMoments(result, _ctrl, *psfImage);
     fitProfile(result, _ctrl, *psfImage);
@@ -463,6 +551,67 @@ void DoubleShapeletPsfApproxAlgorithm::measure(
     measRecord.set(_key, result);
 }
 
+void DoubleShapeletPsfApproxAlgorithm::measureCatalog(
+    afw::table::SourceCatalog & catalog,
+    afw::image::Exposure<float> const & exposure,
+    int nThreads
+) const {
+    auto psf = exposure.getPsf();
+    if (!psf) {
+        throw LSST_EXCEPT(
+            meas::base::FatalAlgorithmError,
+            "No Psf attached to Exposure for DoubleShapeletPsfApprox."
+        );
+    }
+    std::vector<afw::geom::Point2D> positions;
+    positions.reserve(catalog.size());
+    for (auto const & record : catalog) {
+        positions.push_back(record.getCentroid());
+    }
+    // Psfs cache their most recent image, so every thread but the first gets its own copy.
+    nThreads = std::min(detail::resolveThreadCount(nThreads),
+                        std::max(1, static_cast<int>(catalog.size())));
+    std::vector<PTR(afw::detection::Psf const)> threadPsfs(nThreads, psf);
+    for (int t = 1; t < nThreads; ++t) {
+        threadPsfs[t] = psf->clone();
+    }
+    detail::parallelSeededFor(
+        positions, _ctrl.maxSeedDistance, nThreads,
+        [&](int i, int seed, int thread) -> bool {
+            detail::ArenaScope arenaScope;
+            afw::table::SourceRecord & measRecord = catalog[i];
+            try {
+                auto psfImage = _computePsfImage(measRecord, *threadPsfs[thread]);
+                auto fitFrom = [&](shapelet::MultiShapeletFunction result) {
+                    fitMoments(result, _ctrl, *psfImage);
+                    fitProfile(result, _ctrl, *psfImage);
+                    fitShapelets(result, _ctrl, *psfImage);
+                    measRecord.set(_key, result);
+                };
+                if (seed >= 0) {
+                    try {
+                        fitFrom(initializeResult(_ctrl, catalog[seed].get(_key)));
+                        return true;
+                    } catch (meas::base::FatalAlgorithmError &) {
+                        throw;
+                    } catch (pex::exceptions::Exception &) {
+                        // Fall back to the default starting point below.
+                    }
+                }
+                fitFrom(initializeResult(_ctrl));
+                return true;
+            } catch (meas::base::FatalAlgorithmError &) {
+                throw;
+            } catch (meas::base::MeasurementError & err) {
+                fail(measRecord, &err);
+            } catch (pex::exceptions::Exception &) {
+                fail(measRecord);
+            }
+            return false;
+        }
+    );
+}
+
 
 void DoubleShapeletPsfApproxAlgorithm::fail(
     afw::table::SourceRecord & measRecord,
@@ -0,0 +1,219 @@
+// -*- lsst-c++ -*-
+/*
+ * LSST Data Management System
+ * Copyright 2016 LSST/AURA
+ *
+ * This product includes software developed by the
+ * LSST Project (http://www.lsst.org/).
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the LSST License Statement and
+ * the GNU General Public License along with this program.  If not,
+ * see <http://www.lsstcorp.org/LegalNotices/>.
+ */
+
+#include <cmath>
+#include <limits>
+#include <numeric>
+#include <vector>
+
+#include "boost/format.hpp"
+
+#include "ndarray/eigen.h"
+
+#include "lsst/log/Log.h"
+#include "lsst/pex/exceptions.h"
+#include "lsst/afw/table/BaseRecord.h"
+#include "lsst/afw/table/Catalog.h"
+#include "lsst/meas/modelfit/EnsembleSampler.h"
+#include "lsst/meas/modelfit/detail/parallel.h"
+
+namespace lsst { namespace meas { namespace modelfit {
+
+void EnsembleSamplerControl::validate() const {
+    if (nWalkers < 4 || nWalkers % 2 != 0) {
+        throw LSST_EXCEPT(
+            pex::exceptions::InvalidParameterError,
+            (boost::format("nWalkers must be even and >= 4; got %d") % nWalkers).str()
+        );
+    }
+    if (nBurnIn < 0) {
+        throw LSST_EXCEPT(
+            pex::exceptions::InvalidParameterError,
+            (boost::format("nBurnIn must be >= 0; got %d") % nBurnIn).str()
+        );
+    }
+    if (nSteps <= 0) {
+        throw LSST_EXCEPT(
+            pex::exceptions::InvalidParameterError,
+            (boost::format("nSteps must be > 0; got %d") % nSteps).str()
+        );
+    }
+    if (stretch <= 1.0) {
+        throw LSST_EXCEPT(
+            pex::exceptions::InvalidParameterError,
+            (boost::format("stretch must be > 1; got %f") % stretch).str()
+        );
+    }
+    if (maxInitAttempts <= 0) {
+        throw LSST_EXCEPT(
+            pex::exceptions::InvalidParameterError,
+            (boost::format("maxInitAttempts must be > 0; got %d") % maxInitAttempts).str()
+        );
+    }
+}
+
+EnsembleSampler::EnsembleSampler(
+    afw::table::Schema & sampleSchema,
+    PTR(afw::math::Random) rng,
+    EnsembleSamplerControl const & ctrl
+) :
+    _ctrl(ctrl),
+    _rng(rng),
+    _weightKey(sampleSchema["weight"]),
+    _objectiveKey(
+        sampleSchema.addField(
+            afw::table::Field<Scalar>(
+                "objective", "value of the objective function (usually -log posterior)"
+            ),
+            true // doReplace
+        )
+    ),
+    _proposalKey(
+        sampleSchema.addField(
+            afw::table::Field<Scalar>("proposal", "-log value of the proposal function"),
+            true // doReplace
+        )
+    ),
+    _parametersKey(sampleSchema["parameters"]),
+    _acceptanceFraction(0.0)
+{
+    _ctrl.validate();
+}
+
+void EnsembleSampler::run(
+    SamplingObjective const & objective,
+    PTR(Mixture) proposal,
+    afw::table::BaseCatalog & samples
+) const {
+    LOG_LOGGER trace3Logger = LOG_GET("TRACE3.meas.modelfit.EnsembleSampler");
+    int const nWalkers = _ctrl.nWalkers;
+    int const nHalf = nWalkers / 2;
+    int const parameterDim = objective.getParameterDim();
+    PTR(afw::table::BaseTable) table = samples.getTable();
+
+    // Current state of each walker; we keep a record for each so any additional fields the
+    // objective sets are carried along with the walker when it doesn't move.
+    ndarray::Array<Scalar,2,2> positions = ndarray::allocate(nWalkers, parameterDim);
+    std::vector<Scalar> currentObjective(nWalkers);
+    std::vector<PTR(afw::table::BaseRecord)> currentRecords(nWalkers);
+
+    // Draw initial positions from the proposal, redrawing any with non-finite objective values.
+    std::vector<int> pending(nWalkers);
+    std::iota(pending.begin(), pending.end(), 0);
+    for (int attempt = 0; !pending.empty(); ++attempt) {
+        if (attempt == _ctrl.maxInitAttempts) {
+            throw LSST_EXCEPT(
+                pex::exceptions::LogicError,
+                (boost::format("No finite objective value for %d of %d walkers after %d attempts")
+                 % pending.size() % nWalkers % attempt).str()
+            );
+        }
+        ndarray::Array<Scalar,2,2> draws = ndarray::allocate(pending.size(), parameterDim);
+        proposal->draw(*_rng, draws);
+        for (std::size_t n = 0; n < pending.size(); ++n) {
+            positions[pending[n]] = draws[n];
+            currentRecords[pending[n]] = table->makeRecord();
+        }
+        detail::parallelFor(
+            pending.size(), _ctrl.nThreads,
+            [&](int n, int) {
+                int const k = pending[n];
+                currentObjective[k] = objective(positions[k], *currentRecords[k]);
+            }
+        );
+        std::vector<int> failed;
+        for (std::vector<int>::const_iterator k = pending.begin(); k != pending.end(); ++k) {
+            if (std::isfinite(currentObjective[*k])) {
+                currentRecords[*k]->set(_parametersKey, positions[*k]);
+                currentRecords[*k]->set(_objectiveKey, currentObjective[*k]);
+            } else {
+                failed.push_back(*k);
+            }
+        }
+        pending.swap(failed);
+    }
+
+    Scalar const weight = 1.0 / (static_cast<Scalar>(nWalkers) * _ctrl.nSteps);
+    Scalar const a = _ctrl.stretch;
+    ndarray::Array<Scalar,2,2> trial = ndarray::allocate(nHalf, parameterDim);
+    std::vector<Scalar> trialObjective(nHalf);
+    std::vector<PTR(afw::table::BaseRecord)> trialRecords(nHalf);
+    std::vector<Scalar> z(nHalf);
+    std::vector<Scalar> logU(nHalf);
+    int nAccepted = 0;
+    int nProposed = 0;
+    samples.reserve(samples.size() + nWalkers * _ctrl.nSteps);
+    for (int step = 0; step < _ctrl.nBurnIn + _ctrl.nSteps; ++step) {
+        for (int half = 0; half < 2; ++half) {
+            int const offset = half * nHalf;
+            int const otherOffset = (1 - half) * nHalf;
+            // Draw all random numbers for this half-step up front, so the result doesn't depend on
+            // how the objective evaluations are distributed over threads.
+            for (int n = 0; n < nHalf; ++n) {
+                Scalar u = (a - 1.0) * _rng->uniform() + 1.0;
+                z[n] = u * u / a;
+                int const partner = otherOffset + _rng->uniformInt(nHalf);
+                logU[n] = std::log(_rng->uniform());
+                trial[n].asEigen() = positions[partner].asEigen()
+                    + z[n] * (positions[offset + n].asEigen() - positions[partner].asEigen());
+                trialRecords[n] = table->makeRecord();
+            }
+            detail::parallelFor(
+                nHalf, _ctrl.nThreads,
+                [&](int n, int) {
+                    trialObjective[n] = objective(trial[n], *trialRecords[n]);
+                }
+            );
+            for (int n = 0; n < nHalf; ++n) {
+                int const k = offset + n;
+                ++nProposed;
+                if (!std::isfinite(trialObjective[n])) {
+                    continue;
+                }
+                // objective values are -ln(p), so this is ln(z^{d-1} p(y) / p(x))
+                Scalar logRatio = (parameterDim - 1) * std::log(z[n]) + currentObjective[k]
+                    - trialObjective[n];
+                if (logU[n] <= logRatio) {
+                    ++nAccepted;
+                    positions[k] = trial[n];
+                    currentObjective[k] = trialObjective[n];
+                    currentRecords[k] = trialRecords[n];
+                    currentRecords[k]->set(_parametersKey, positions[k]);
+                    currentRecords[k]->set(_objectiveKey, currentObjective[k]);
+                }
+            }
+        }
+        if (step >= _ctrl.nBurnIn) {
+            for (int k = 0; k < nWalkers; ++k) {
+                PTR(afw::table::BaseRecord) record = samples.addNew();
+                record->assign(*currentRecords[k]);
+                record->set(_weightKey, weight);
+                record->set(_proposalKey, std::numeric_limits<Scalar>::quiet_NaN());
+            }
+        }
+    }
+    _acceptanceFraction = static_cast<double>(nAccepted) / nProposed;
+    LOGL_DEBUG(trace3Logger, "Ensemble sampling finished with acceptance fraction %g", _acceptanceFraction);
+}
+
+}}} // namespace lsst::meas::modelfit
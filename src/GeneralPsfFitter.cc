@@ -28,6 +28,8 @@
 #include "lsst/shapelet/MatrixBuilder.h"
 #include "lsst/shapelet/MultiShapeletBasis.h"
 #include "lsst/meas/modelfit/GeneralPsfFitter.h"
+#include "lsst/meas/modelfit/detail/Arena.h"
+#include "lsst/meas/modelfit/detail/parallelSeeded.h"
 
 namespace lsst { namespace meas { namespace modelfit {
 namespace {
@@ -576,6 +578,84 @@ void GeneralPsfFitterAlgorithm::measure(
     }
 }
 
+void GeneralPsfFitterAlgorithm::measureCatalog(
+    afw::table::SourceCatalog & catalog,
+    afw::detection::Psf const & psf,
+    double maxSeedDistance,
+    int nThreads,
+    GeneralPsfFitterAlgorithm const * previous
+) const {
+    std::vector<GeneralPsfFitterAlgorithm const *> sequence;
+    if (previous) {
+        sequence.push_back(previous);
+    }
+    measureCatalog(catalog, psf, maxSeedDistance, nThreads, sequence);
+}
+
+void GeneralPsfFitterAlgorithm::measureCatalog(
+    afw::table::SourceCatalog & catalog,
+    afw::detection::Psf const & psf,
+    double maxSeedDistance,
+    int nThreads,
+    std::vector<GeneralPsfFitterAlgorithm const *> const & previous
+) const {
+    std::vector<afw::geom::Point2D> positions;
+    positions.reserve(catalog.size());
+    for (auto const & record : catalog) {
+        positions.push_back(record.getCentroid());
+    }
+    // Psfs cache their most recent image, so each thread gets its own copy.
+    nThreads = std::min(detail::resolveThreadCount(nThreads),
+                        std::max(1, static_cast<int>(catalog.size())));
+    std::vector<PTR(afw::detection::Psf const)> threadPsfs;
+    threadPsfs.reserve(nThreads);
+    for (int t = 0; t < nThreads; ++t) {
+        threadPsfs.push_back(psf.clone());
+    }
+    detail::parallelSeededFor(
+        positions, maxSeedDistance, nThreads,
+        [&](int i, int seed, int thread) -> bool {
+            detail::ArenaScope arenaScope;
+            afw::table::SourceRecord & measRecord = catalog[i];
+            try {
+                afw::detection::Psf const & threadPsf = *threadPsfs[thread];
+                afw::geom::Point2D const position = measRecord.getCentroid();
+                // We never modify the image, so there's no need for the Psf to copy its cached result.
+                auto image = threadPsf.computeKernelImage(position, afw::image::Color(),
+                                                          afw::detection::Psf::INTERNAL);
+                if (seed >= 0) {
+                    try {
+                        measure(measRecord, *image, catalog[seed].get(_key));
+                        return true;
+                    } catch (meas::base::FatalAlgorithmError &) {
+                        throw;
+                    } catch (pex::exceptions::Exception &) {
+                        // Fall back to the unseeded starting point below.
+                    }
+                }
+                // Start from the last earlier fitter that succeeded for this record, as measure() does
+                // when fitting a sequence one record at a time.
+                for (auto fitter = previous.rbegin(); fitter != previous.rend(); ++fitter) {
+                    if (!(*fitter)->_flagHandler.getValue(measRecord, FAILURE.number)) {
+                        measure(measRecord, *image,
+                                adapt(measRecord.get((*fitter)->_key), (*fitter)->getModel()));
+                        return true;
+                    }
+                }
+                measure(measRecord, *image, threadPsf.computeShape(position));
+                return true;
+            } catch (meas::base::FatalAlgorithmError &) {
+                throw;
+            } catch (meas::base::MeasurementError & err) {
+                fail(measRecord, &err);
+            } catch (pex::exceptions::Exception &) {
+                fail(measRecord);
+            }
+            return false;
+        }
+    );
+}
+
 void GeneralPsfFitterAlgorithm::fail(
     afw::table::SourceRecord & measRecord,
     lsst::meas::base::MeasurementError * error
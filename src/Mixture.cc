@@ -21,7 +21,13 @@
  * see <http://www.lsstcorp.org/LegalNotices/>.
  */
 
+#include <algorithm>
+#include <limits>
+#include <numeric>
+
+#include "boost/format.hpp"
 #include "boost/math/special_functions/gamma.hpp"
+#include "boost/math/special_functions/erf.hpp"
 
 #include "ndarray/eigen.h"
 
@@ -30,6 +36,7 @@
 #include "lsst/afw/table/io/InputArchive.h"
 #include "lsst/afw/table/io/CatalogVector.h"
 #include "lsst/meas/modelfit/Mixture.h"
+#include "lsst/meas/modelfit/detail/parallel.h"
 
 namespace tbl = lsst::afw::table;
 
@@ -37,7 +44,22 @@ namespace lsst { namespace meas { namespace modelfit {
 
 void MixtureComponent::setSigma(Matrix const & sigma) {
     _sigmaLLT.compute(sigma);
+    _updateFactors();
+}
+
+void MixtureComponent::_updateFactors() {
     _sqrtDet = _sigmaLLT.matrixLLT().diagonal().prod();
+    int const dim = getDimension();
+    if (dim <= MAX_FIXED_DIM) {
+        Matrix inverseL = Matrix::Identity(dim, dim);
+        _sigmaLLT.matrixL().solveInPlace(inverseL);
+        int k = 0;
+        for (int i = 0; i < dim; ++i) {
+            for (int j = 0; j <= i; ++j, ++k) {
+                _packedInverseL[k] = inverseL(i, j);
+            }
+        }
+    }
 }
 
 MixtureComponent MixtureComponent::project(int dim) const {
@@ -60,7 +82,10 @@ MixtureComponent MixtureComponent::project(int dim1, int dim2) const {
 }
 
 MixtureComponent::MixtureComponent(int dim) :
-    weight(1.0), _sqrtDet(1.0), _mu(Vector::Zero(dim)), _sigmaLLT(Matrix::Identity(dim,dim)) {}
+    weight(1.0), _sqrtDet(1.0), _mu(Vector::Zero(dim)), _sigmaLLT(Matrix::Identity(dim,dim))
+{
+    _updateFactors();
+}
 
 
 MixtureComponent::MixtureComponent(Scalar weight_, Vector const & mu, Matrix const & sigma) :
@@ -77,7 +102,7 @@ MixtureComponent::MixtureComponent(Scalar weight_, Vector const & mu, Matrix con
         "Number of columns of sigma matrix (%d) does not match size of mu vector (%d)"
     );
     _sigmaLLT.compute(sigma);
-    _sqrtDet = _sigmaLLT.matrixLLT().diagonal().prod();
+    _updateFactors();
 }
 
 MixtureComponent & MixtureComponent::operator=(MixtureComponent const & other) {
@@ -90,6 +115,7 @@ MixtureComponent & MixtureComponent::operator=(MixtureComponent const & other) {
         _sqrtDet = other._sqrtDet;
         _mu = other._mu;
         _sigmaLLT = other._sigmaLLT;
+        _packedInverseL = other._packedInverseL;
     }
     return *this;
 }
@@ -238,6 +264,16 @@ void Mixture::evaluateDerivatives(
         pex::exceptions::LengthError,
         "Number of columns of hessian array (%d) does not dimension of mixture (%d)"
     );
+    switch (_dim) {
+    case 1:
+        return _evaluateDerivativesFixed<1>(x, gradient, hessian);
+    case 2:
+        return _evaluateDerivativesFixed<2>(x, gradient, hessian);
+    case 3:
+        return _evaluateDerivativesFixed<3>(x, gradient, hessian);
+    case 4:
+        return _evaluateDerivativesFixed<4>(x, gradient, hessian);
+    }
     gradient.deep() = 0.0;
     hessian.deep() = 0.0;
     Eigen::MatrixXd sigmaInv(_dim, _dim);
@@ -262,6 +298,45 @@ void Mixture::evaluateDerivatives(
     }
 }
 
+template <int N>
+void Mixture::_evaluateDerivativesFixed(
+    ndarray::Array<Scalar const,1,1> const & x,
+    ndarray::Array<Scalar,1,1> const & gradient,
+    ndarray::Array<Scalar,2,1> const & hessian
+) const {
+    typedef Eigen::Matrix<Scalar,N,1> FixedVector;
+    typedef Eigen::Matrix<Scalar,N,N> FixedMatrix;
+    FixedVector const xFixed = x.asEigen();
+    FixedVector gradientSum = FixedVector::Zero();
+    FixedMatrix hessianSum = FixedMatrix::Zero();
+    for (ComponentList::const_iterator i = _components.begin(); i != _components.end(); ++i) {
+        // Unpack L^{-1}; then L^{-1}(x - mu) gives z, and sigma^{-1} = L^{-T} L^{-1}.
+        FixedMatrix inverseL = FixedMatrix::Zero();
+        Scalar const * l = i->_packedInverseL.data();
+        for (int r = 0; r < N; ++r) {
+            for (int c = 0; c <= r; ++c, ++l) {
+                inverseL(r, c) = *l;
+            }
+        }
+        FixedVector const whitened = inverseL * (xFixed - i->_mu);
+        Scalar const z = whitened.squaredNorm();
+        FixedVector const sigmaInvDx = inverseL.adjoint() * whitened;
+        FixedMatrix const sigmaInv = inverseL.adjoint() * inverseL;
+        Scalar const f = _evaluate(z) / i->_sqrtDet;
+        if (_isGaussian) {
+            gradientSum -= i->weight * f * sigmaInvDx;
+            hessianSum += i->weight * f * (sigmaInvDx * sigmaInvDx.adjoint() - sigmaInv);
+        } else {
+            double v = (_dim + _df) / (_df + z);
+            double u = v*v*(1.0 + 2.0/(_dim + _df));
+            gradientSum -= i->weight * f * v * sigmaInvDx;
+            hessianSum += i->weight * f * (u * sigmaInvDx * sigmaInvDx.adjoint() - v * sigmaInv);
+        }
+    }
+    gradient.asEigen() = gradientSum;
+    hessian.asEigen() = hessianSum;
+}
+
 void Mixture::draw(afw::math::Random & rng, ndarray::Array<Scalar,2,1> const & x) const {
     ndarray::Array<Scalar,2,1>::Iterator ix = x.begin(), xEnd = x.end();
     std::vector<Scalar> cumulative;
@@ -290,6 +365,95 @@ void Mixture::draw(afw::math::Random & rng, ndarray::Array<Scalar,2,1> const & x
     }
 }
 
+namespace {
+
+// A Halton sequence with an independent random permutation applied to the digits in each dimension.
+// Because the permutation is applied to every digit (including the infinite trail of leading zeros),
+// every coordinate of every point with index >= 1 lies strictly within (0, 1), which lets us map them
+// through inverse distribution functions without clipping.
+class ScrambledHaltonSequence {
+public:
+
+    ScrambledHaltonSequence(afw::math::Random & rng, int dim) : _bases(), _permutations(dim) {
+        _bases.reserve(dim);
+        for (int candidate = 2; static_cast<int>(_bases.size()) < dim; ++candidate) {
+            bool isPrime = true;
+            for (std::vector<int>::const_iterator b = _bases.begin(); b != _bases.end(); ++b) {
+                if (candidate % *b == 0) {
+                    isPrime = false;
+                    break;
+                }
+            }
+            if (isPrime) {
+                _bases.push_back(candidate);
+            }
+        }
+        for (int j = 0; j < dim; ++j) {
+            std::vector<int> & permutation = _permutations[j];
+            permutation.resize(_bases[j]);
+            std::iota(permutation.begin(), permutation.end(), 0);
+            // Fisher-Yates shuffle, driven by the afw RNG so results are reproducible from its seed.
+            for (int n = _bases[j] - 1; n > 0; --n) {
+                std::swap(permutation[n], permutation[rng.uniformInt(n + 1)]);
+            }
+        }
+    }
+
+    // Return coordinate j of point i; i must be >= 1.
+    Scalar operator()(std::size_t i, int j) const {
+        int const base = _bases[j];
+        std::vector<int> const & permutation = _permutations[j];
+        Scalar const invBase = 1.0 / base;
+        Scalar scale = invBase;
+        Scalar result = 0.0;
+        for (; i > 0; i /= base) {
+            result += permutation[i % base] * scale;
+            scale *= invBase;
+        }
+        // All remaining digits are zero, which all map to permutation[0]; sum that geometric series.
+        result += permutation[0] * scale * base / (base - 1);
+        return result;
+    }
+
+private:
+    std::vector<int> _bases;
+    std::vector< std::vector<int> > _permutations;
+};
+
+} // anonymous
+
+void Mixture::drawQuasiRandom(afw::math::Random & rng, ndarray::Array<Scalar,2,1> const & x) const {
+    // The first coordinate of the sequence selects the component, the next _dim are transformed
+    // into unit Gaussian deviates, and (for Student's T only) the last sets the chi-squared deviate.
+    ScrambledHaltonSequence sequence(rng, _dim + (_isGaussian ? 1 : 2));
+    std::vector<Scalar> cumulative;
+    cumulative.reserve(_components.size());
+    Scalar sum = 0.0;
+    for (const_iterator k = begin(); k != end(); ++k) {
+        sum += k->weight;
+        cumulative.push_back(sum);
+    }
+    cumulative.back() = 1.0;
+    ndarray::Array<Scalar,2,1>::Iterator ix = x.begin(), xEnd = x.end();
+    for (std::size_t n = 1; ix != xEnd; ++ix, ++n) {
+        Scalar target = sequence(n, 0);
+        std::size_t k = std::lower_bound(cumulative.begin(), cumulative.end(), target)
+            - cumulative.begin();
+        assert(k != cumulative.size());
+        Component const & component = _components[k];
+        for (int j = 0; j < _dim; ++j) {
+            _workspace[j] = -M_SQRT2 * boost::math::erfc_inv(2.0 * sequence(n, j + 1));
+        }
+        if (_isGaussian) {
+            ix->asEigen() = component._mu + (component._sigmaLLT.matrixL() * _workspace);
+        } else {
+            Scalar chisq = 2.0 * boost::math::gamma_p_inv(0.5*_df, sequence(n, _dim + 1));
+            ix->asEigen() = component._mu
+                + std::sqrt(_df/chisq) * (component._sigmaLLT.matrixL() * _workspace);
+        }
+    }
+}
+
 void Mixture::updateEM(
     ndarray::Array<Scalar const,2,1> const & x,
     ndarray::Array<Scalar const,1,0> const & w,
@@ -376,6 +540,258 @@ void Mixture::updateEM(
     updateEM(x, w, restriction, tau1, tau2);
 }
 
+namespace {
+
+typedef Eigen::Matrix<Scalar,Eigen::Dynamic,Eigen::Dynamic,Eigen::RowMajor> RowMajorMatrix;
+
+// makeFromKMeans processes samples in blocks of this size, combining per-block results in block order,
+// so its results don't depend on how the blocks are distributed over threads.
+int const KMEANS_BLOCK_SIZE = 1024;
+
+// Fraction of the overall variance in each dimension that makeFromKMeans adds to each component's sigma,
+// so clusters with very few samples don't produce singular matrices.
+Scalar const KMEANS_MIN_VARIANCE_FRACTION = 1E-3;
+
+// Draw an index with probability proportional to p[i], given the sums of p over each block.
+int drawFromBlocks(afw::math::Random & rng, Vector const & p, Vector const & blockSums) {
+    int const nBlocks = blockSums.size();
+    Scalar target = rng.uniform() * blockSums.sum();
+    int block = 0;
+    int lastBlock = 0;
+    for (; block < nBlocks; ++block) {
+        if (blockSums[block] > 0.0) {
+            lastBlock = block;
+            if (target < blockSums[block]) {
+                break;
+            }
+            target -= blockSums[block];
+        }
+    }
+    if (block == nBlocks) { // only possible through round-off error
+        block = lastBlock;
+        target = blockSums[block];
+    }
+    int const begin = block*KMEANS_BLOCK_SIZE;
+    int const end = std::min(begin + KMEANS_BLOCK_SIZE, static_cast<int>(p.size()));
+    int last = begin;
+    for (int i = begin; i < end; ++i) {
+        if (p[i] > 0.0) {
+            last = i;
+            if (target < p[i]) {
+                break;
+            }
+            target -= p[i];
+        }
+    }
+    return last;
+}
+
+} // anonymous
+
+PTR(Mixture) Mixture::makeFromKMeans(
+    ndarray::Array<Scalar const,2,1> const & x,
+    ndarray::Array<Scalar const,1,0> const & w,
+    int nComponents,
+    afw::math::Random & rng,
+    UpdateRestriction const & restriction,
+    int nIterations,
+    Scalar df,
+    int nThreads
+) {
+    LSST_THROW_IF_NE(
+        x.getSize<0>(), w.getSize<0>(),
+        pex::exceptions::LengthError,
+        "First dimension of x array (%d) does not match size of w array (%d)"
+    );
+    LSST_THROW_IF_NE(
+        x.getSize<1>(), restriction.getDimension(),
+        pex::exceptions::LengthError,
+        "Second dimension of x array (%d) does not match dimension of restriction (%d)"
+    );
+    int const nSamples = x.getSize<0>();
+    int const dim = x.getSize<1>();
+    if (nComponents < 1 || nComponents > nSamples) {
+        throw LSST_EXCEPT(
+            pex::exceptions::InvalidParameterError,
+            (boost::format("Number of components (%d) must be between 1 and the number of samples (%d)")
+             % nComponents % nSamples).str()
+        );
+    }
+    Vector weights(nSamples);
+    for (int i = 0; i < nSamples; ++i) {
+        weights[i] = w[i];
+    }
+    Scalar const weightSum = weights.sum();
+    if (!((weights.array() >= 0.0).all() && weightSum > 0.0)) {
+        throw LSST_EXCEPT(
+            pex::exceptions::InvalidParameterError,
+            "Weights must be nonnegative, with a positive sum"
+        );
+    }
+    int const nBlocks = (nSamples + KMEANS_BLOCK_SIZE - 1) / KMEANS_BLOCK_SIZE;
+    // All of the parallel loops below are short and there are many of them (one per seed and one per
+    // Lloyd iteration), so we start the threads once instead of in each loop.
+    detail::ThreadPool pool(
+        detail::ParallelRegionScope::isActive() ? 1 : std::min(detail::resolveThreadCount(nThreads), nBlocks)
+    );
+
+    // Weighted variance in each dimension, used to scale distances and to regularize sigma.
+    Vector const mean = (weights.adjoint() * x.asEigen()).adjoint() / weightSum;
+    Vector variance = Vector::Zero(dim);
+    for (int i = 0; i < nSamples; ++i) {
+        variance += weights[i] * (x[i].asEigen() - mean).array().square().matrix();
+    }
+    variance /= weightSum;
+    Vector const scale = (variance.array() > 0.0).select(variance.array().sqrt().inverse(), 1.0).matrix();
+    RowMajorMatrix const scaled = x.asEigen() * scale.asDiagonal();
+
+    // k-means++ seeding: the first center is drawn with probability proportional to weight, and each
+    // later one with probability proportional to weight times squared distance to the nearest center.
+    Vector weightBlockSums(nBlocks);
+    for (int block = 0; block < nBlocks; ++block) {
+        int const begin = block*KMEANS_BLOCK_SIZE;
+        weightBlockSums[block] = weights.segment(begin, std::min(KMEANS_BLOCK_SIZE, nSamples - begin)).sum();
+    }
+    RowMajorMatrix centers(nComponents, dim);
+    centers.row(0) = scaled.row(drawFromBlocks(rng, weights, weightBlockSums));
+    Vector d2 = Vector::Constant(nSamples, std::numeric_limits<Scalar>::infinity());
+    Vector p(nSamples);
+    Vector pBlockSums(nBlocks);
+    for (int k = 1; k < nComponents; ++k) {
+        pool.parallelFor(
+            nBlocks,
+            [&](int block, int thread) {
+                int const begin = block*KMEANS_BLOCK_SIZE;
+                int const end = std::min(begin + KMEANS_BLOCK_SIZE, nSamples);
+                Scalar sum = 0.0;
+                for (int i = begin; i < end; ++i) {
+                    d2[i] = std::min(d2[i], (scaled.row(i) - centers.row(k - 1)).squaredNorm());
+                    sum += p[i] = weights[i]*d2[i];
+                }
+                pBlockSums[block] = sum;
+            }
+        );
+        if (pBlockSums.sum() > 0.0) {
+            centers.row(k) = scaled.row(drawFromBlocks(rng, p, pBlockSums));
+        } else {
+            // Every sample with nonzero weight coincides with an existing center.
+            centers.row(k) = scaled.row(drawFromBlocks(rng, weights, weightBlockSums));
+        }
+    }
+
+    // Lloyd iterations: assign each sample to its nearest center, then move each center to the
+    // weighted mean of its samples.  The last pass just computes the final assignment.
+    std::vector<int> assignment(nSamples, -1);
+    std::vector<RowMajorMatrix> blockSums(nBlocks, RowMajorMatrix::Zero(nComponents, dim));
+    Matrix blockWeights(nBlocks, nComponents);
+    std::vector<int> blockChanges(nBlocks);
+    RowMajorMatrix sums(nComponents, dim);
+    Vector clusterWeights(nComponents);
+    for (int iteration = 0; ; ++iteration) {
+        pool.parallelFor(
+            nBlocks,
+            [&](int block, int thread) {
+                int const begin = block*KMEANS_BLOCK_SIZE;
+                int const end = std::min(begin + KMEANS_BLOCK_SIZE, nSamples);
+                blockSums[block].setZero();
+                blockWeights.row(block).setZero();
+                blockChanges[block] = 0;
+                for (int i = begin; i < end; ++i) {
+                    int best = 0;
+                    Scalar bestDistance = std::numeric_limits<Scalar>::infinity();
+                    for (int k = 0; k < nComponents; ++k) {
+                        Scalar distance = (scaled.row(i) - centers.row(k)).squaredNorm();
+                        if (distance < bestDistance) {
+                            best = k;
+                            bestDistance = distance;
+                        }
+                    }
+                    if (assignment[i] != best) {
+                        assignment[i] = best;
+                        ++blockChanges[block];
+                    }
+                    blockSums[block].row(best) += weights[i]*scaled.row(i);
+                    blockWeights(block, best) += weights[i];
+                }
+            }
+        );
+        sums.setZero();
+        for (int block = 0; block < nBlocks; ++block) {
+            sums += blockSums[block];
+        }
+        clusterWeights = blockWeights.colwise().sum().adjoint();
+        int const nChanges = std::accumulate(blockChanges.begin(), blockChanges.end(), 0);
+        if (iteration == nIterations || (iteration > 0 && nChanges == 0)) {
+            break;
+        }
+        for (int k = 0; k < nComponents; ++k) {
+            if (clusterWeights[k] > 0.0) {
+                centers.row(k) = sums.row(k) / clusterWeights[k];
+            }
+        }
+    }
+
+    // Set the component parameters from the samples assigned to them, restricting mu before computing
+    // sigma about it, as in updateEM.
+    std::vector<Vector> mus(nComponents);
+    for (int k = 0; k < nComponents; ++k) {
+        if (clusterWeights[k] > 0.0) {
+            mus[k] = (sums.row(k).adjoint() / clusterWeights[k]).cwiseQuotient(scale);
+        } else {
+            mus[k] = centers.row(k).adjoint().cwiseQuotient(scale);
+        }
+        restriction.restrictMu(mus[k]);
+    }
+    std::vector<Matrix> blockSigmas(nBlocks*nComponents, Matrix::Zero(dim, dim));
+    pool.parallelFor(
+        nBlocks,
+        [&](int block, int thread) {
+            int const begin = block*KMEANS_BLOCK_SIZE;
+            int const end = std::min(begin + KMEANS_BLOCK_SIZE, nSamples);
+            Vector dx(dim);
+            for (int i = begin; i < end; ++i) {
+                int const k = assignment[i];
+                dx = x[i].asEigen() - mus[k];
+                blockSigmas[block*nComponents + k].selfadjointView<Eigen::Lower>().rankUpdate(dx, weights[i]);
+            }
+        }
+    );
+    ComponentList components;
+    components.reserve(nComponents);
+    for (int k = 0; k < nComponents; ++k) {
+        Scalar weight = clusterWeights[k];
+        Matrix sigma = Matrix::Zero(dim, dim);
+        if (weight > 0.0) {
+            for (int block = 0; block < nBlocks; ++block) {
+                sigma += blockSigmas[block*nComponents + k];
+            }
+            sigma = sigma.selfadjointView<Eigen::Lower>();
+            sigma /= weight;
+        } else {
+            // An empty cluster; give it the overall variance and the weight of an average sample.
+            weight = weightSum / nSamples;
+            sigma.diagonal() = variance;
+        }
+        sigma.diagonal() += KMEANS_MIN_VARIANCE_FRACTION * variance;
+        restriction.restrictSigma(sigma);
+        components.push_back(Component(weight, mus[k], sigma));
+    }
+    return std::make_shared<Mixture>(dim, components, df);
+}
+
+PTR(Mixture) Mixture::makeFromKMeans(
+    ndarray::Array<Scalar const,2,1> const & x,
+    ndarray::Array<Scalar const,1,0> const & w,
+    int nComponents,
+    afw::math::Random & rng,
+    int nIterations,
+    Scalar df,
+    int nThreads
+) {
+    return makeFromKMeans(x, w, nComponents, rng, UpdateRestriction(x.getSize<1>()), nIterations, df,
+                          nThreads);
+}
+
 PTR(Mixture) Mixture::clone() const {
     return std::make_shared<Mixture>(*this);
 }
@@ -399,7 +815,7 @@ void Mixture::updateDampedSigma(int k, Matrix const & sigma, double tau1, double
         _components[k].setSigma(alpha*sigma + (1.0 - alpha)*_components[k].getSigma());
     } else {
         _components[k]._sigmaLLT = sigmaLLT;
-        _components[k]._sqrtDet = sqrtDet;
+        _components[k]._updateFactors();
     }
 }
 
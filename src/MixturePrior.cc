@@ -41,8 +41,7 @@ Scalar MixturePrior::marginalize(
     Vector const & gradient, Matrix const & hessian,
     ndarray::Array<Scalar const,1,1> const & parameters
 ) const {
-    return TruncatedGaussian::fromSeriesParameters(0.0, gradient, hessian).getLogIntegral()
-        - std::log(_mixture->evaluate(parameters.asEigen()));
+    return makeAmplitudePosterior(gradient, hessian, parameters).marginalize();
 }
 
 Scalar MixturePrior::maximize(
@@ -50,9 +49,7 @@ Scalar MixturePrior::maximize(
     ndarray::Array<Scalar const,1,1> const & nonlinear,
     ndarray::Array<Scalar,1,1> const & amplitudes
 ) const {
-    TruncatedGaussian tg = TruncatedGaussian::fromSeriesParameters(0.0, gradient, hessian);
-    amplitudes.asEigen() = tg.maximize();
-    return tg.evaluateLog()(amplitudes.asEigen());
+    return makeAmplitudePosterior(gradient, hessian, nonlinear).maximize(amplitudes);
 }
 
 Scalar MixturePrior::evaluate(
@@ -89,9 +86,16 @@ void MixturePrior::drawAmplitudes(
     ndarray::Array<Scalar,1,1> const & weights,
     bool multiplyWeights
 ) const {
-    TruncatedGaussian::Sampler sampler
-        = TruncatedGaussian::fromSeriesParameters(0.0, gradient, hessian).sample();
-    sampler(rng, amplitudes, weights, multiplyWeights);
+    makeAmplitudePosterior(gradient, hessian, nonlinear).drawAmplitudes(
+        rng, amplitudes, weights, multiplyWeights
+    );
+}
+
+AmplitudePosterior MixturePrior::makeAmplitudePosterior(
+    Vector const & gradient, Matrix const & hessian,
+    ndarray::Array<Scalar const,1,1> const & nonlinear
+) const {
+    return AmplitudePosterior(gradient, hessian, _mixture->evaluate(nonlinear.asEigen()));
 }
 
 namespace {
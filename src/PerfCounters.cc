@@ -0,0 +1,345 @@
+// -*- lsst-c++ -*-
+/*
+ * LSST Data Management System
+ * Copyright 2008-2017 LSST Corporation.
+ *
+ * This product includes software developed by the
+ * LSST Project (http://www.lsst.org/).
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the LSST License Statement and
+ * the GNU General Public License along with this program.  If not,
+ * see <http://www.lsstcorp.org/LegalNotices/>.
+ */
+
+#include <algorithm>
+#include <cstring>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <sstream>
+
+#include "boost/format.hpp"
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+#include "lsst/meas/modelfit/PerfCounters.h"
+
+namespace lsst { namespace meas { namespace modelfit {
+
+namespace detail {
+
+// Counters and accumulated counts for a single thread.  The counters are opened by the thread itself
+// (perf_event counters with pid=0 only count the thread that opened them) and closed when it exits;
+// the counts outlive the thread so they can still be reported.
+struct ThreadPerfCounters {
+
+    explicit ThreadPerfCounters(int thread_) : thread(thread_), nOpen(0) {
+        fds.fill(-1);
+        open();
+    }
+
+    ThreadPerfCounters(ThreadPerfCounters const &) = delete;
+    ThreadPerfCounters & operator=(ThreadPerfCounters const &) = delete;
+
+    ~ThreadPerfCounters() { close(); }
+
+    bool isOpen() const { return nOpen > 0; }
+
+    // Open the counters as a single group led by the cycle counter, so they're all scheduled together
+    // and can be read with one system call.  Events the hardware doesn't support are skipped (and
+    // always read as zero); if cycles can't be counted, nothing is.
+    void open();
+
+    void close();
+
+    // Read the current values of all events; unavailable events are zero.
+    void read(std::array<std::uint64_t,PerfCounters::N_EVENTS> & values) const;
+
+    int thread;
+    int nOpen;
+    std::array<int,PerfCounters::N_EVENTS> fds;
+    std::array<int,PerfCounters::N_EVENTS> events;  // Event for each of the first nOpen group members
+    std::array<PerfCounters::Counts,PerfCounters::N_REGIONS> regions;
+};
+
+#ifdef __linux__
+
+namespace {
+
+int openEvent(std::uint64_t config, int groupFd) {
+    perf_event_attr attr;
+    std::memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = PERF_TYPE_HARDWARE;
+    attr.config = config;
+    attr.read_format = PERF_FORMAT_GROUP;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    return ::syscall(__NR_perf_event_open, &attr, 0, -1, groupFd, 0);
+}
+
+} // anonymous
+
+void ThreadPerfCounters::open() {
+    static std::uint64_t const configs[PerfCounters::N_EVENTS] = {
+        PERF_COUNT_HW_CPU_CYCLES,
+        PERF_COUNT_HW_INSTRUCTIONS,
+        PERF_COUNT_HW_CACHE_MISSES,
+        PERF_COUNT_HW_BRANCH_MISSES
+    };
+    for (int e = 0; e < PerfCounters::N_EVENTS; ++e) {
+        int const fd = openEvent(configs[e], nOpen ? fds[0] : -1);
+        if (fd < 0) {
+            if (nOpen == 0) {
+                return;
+            }
+            continue;
+        }
+        fds[nOpen] = fd;
+        events[nOpen] = e;
+        ++nOpen;
+    }
+}
+
+void ThreadPerfCounters::close() {
+    for (int i = nOpen - 1; i >= 0; --i) {
+        ::close(fds[i]);
+        fds[i] = -1;
+    }
+    nOpen = 0;
+}
+
+void ThreadPerfCounters::read(std::array<std::uint64_t,PerfCounters::N_EVENTS> & values) const {
+    values.fill(0);
+    // Layout of a PERF_FORMAT_GROUP read: the number of events, then their values in group order.
+    std::uint64_t buffer[1 + PerfCounters::N_EVENTS];
+    if (nOpen == 0) {
+        return;
+    }
+    ssize_t const nRead = ::read(fds[0], buffer, sizeof(buffer));
+    if (nRead < static_cast<ssize_t>(sizeof(std::uint64_t))) {
+        return;
+    }
+    int const n = std::min(static_cast<int>(buffer[0]), nOpen);
+    for (int i = 0; i < n; ++i) {
+        values[events[i]] = buffer[1 + i];
+    }
+}
+
+#else
+
+void ThreadPerfCounters::open() {}
+
+void ThreadPerfCounters::close() {}
+
+void ThreadPerfCounters::read(std::array<std::uint64_t,PerfCounters::N_EVENTS> & values) const {
+    values.fill(0);
+}
+
+#endif
+
+} // namespace detail
+
+namespace {
+
+// All threads' counters, in the order they were created.  Function-local statics so they're safe
+// to use from other static initializers.
+std::mutex & getRegistryMutex() {
+    static std::mutex mutex;
+    return mutex;
+}
+
+std::vector<std::shared_ptr<detail::ThreadPerfCounters>> & getRegistry() {
+    static std::vector<std::shared_ptr<detail::ThreadPerfCounters>> registry;
+    return registry;
+}
+
+// Closes a thread's counters when it exits; the registry keeps the counts.
+struct ThreadPerfCountersHandle {
+    std::shared_ptr<detail::ThreadPerfCounters> counters;
+
+    ~ThreadPerfCountersHandle() {
+        if (counters) {
+            counters->close();
+        }
+    }
+};
+
+detail::ThreadPerfCounters * getThreadCounters() {
+    static thread_local ThreadPerfCountersHandle handle;
+    if (!handle.counters) {
+        std::lock_guard<std::mutex> lock(getRegistryMutex());
+        static int nextThread = 0;
+        handle.counters = std::make_shared<detail::ThreadPerfCounters>(nextThread++);
+        getRegistry().push_back(handle.counters);
+    }
+    return handle.counters.get();
+}
+
+} // anonymous
+
+// ----------------- PerfCounters ---------------------------------------------------------------------------
+
+std::atomic<bool> PerfCounters::_enabled(false);
+
+PerfCounters::Counts & PerfCounters::Counts::operator+=(Counts const & other) {
+    for (int e = 0; e < N_EVENTS; ++e) {
+        events[e] += other.events[e];
+    }
+    calls += other.calls;
+    return *this;
+}
+
+double PerfCounters::Counts::getInstructionsPerCycle() const {
+    if (events[CYCLES] == 0) {
+        return std::numeric_limits<double>::quiet_NaN();
+    }
+    return static_cast<double>(events[INSTRUCTIONS]) / events[CYCLES];
+}
+
+bool PerfCounters::enable() {
+    // If this thread can open counters, the others will be able to as well.
+    bool const available = getThreadCounters()->isOpen();
+    _enabled = available;
+    return available;
+}
+
+void PerfCounters::disable() {
+    _enabled = false;
+}
+
+void PerfCounters::reset() {
+    std::lock_guard<std::mutex> lock(getRegistryMutex());
+    auto & registry = getRegistry();
+    registry.erase(
+        std::remove_if(
+            registry.begin(), registry.end(),
+            [](std::shared_ptr<detail::ThreadPerfCounters> const & counters) {
+                return !counters->isOpen();
+            }
+        ),
+        registry.end()
+    );
+    for (auto const & counters : registry) {
+        counters->regions.fill(Counts());
+    }
+}
+
+std::vector<PerfCounters::ThreadReport> PerfCounters::getReport() {
+    std::lock_guard<std::mutex> lock(getRegistryMutex());
+    std::vector<ThreadReport> report;
+    for (auto const & counters : getRegistry()) {
+        ThreadReport thread = {counters->thread, counters->regions};
+        std::uint64_t calls = 0;
+        for (auto const & region : thread.regions) {
+            calls += region.calls;
+        }
+        if (calls > 0) {
+            report.push_back(thread);
+        }
+    }
+    return report;
+}
+
+std::string PerfCounters::formatReport() {
+    std::vector<ThreadReport> const report = getReport();
+    ThreadReport total = {-1, std::array<Counts,N_REGIONS>()};
+    std::ostringstream os;
+    boost::format header("%-8s %-16s %10s %14s %14s %6s %12s %12s\n");
+    boost::format row("%-8s %-16s %10d %14d %14d %6.2f %12d %12d\n");
+    os << header % "thread" % "region" % "calls" % getEventName(CYCLES) % getEventName(INSTRUCTIONS)
+        % "IPC" % getEventName(CACHE_MISSES) % getEventName(BRANCH_MISSES);
+    auto writeRows = [&](std::string const & thread, std::array<Counts,N_REGIONS> const & regions) {
+        for (int r = 0; r < N_REGIONS; ++r) {
+            Counts const & counts = regions[r];
+            if (counts.calls == 0) {
+                continue;
+            }
+            os << row % thread % getRegionName(Region(r)) % counts.calls % counts.events[CYCLES]
+                % counts.events[INSTRUCTIONS] % counts.getInstructionsPerCycle()
+                % counts.events[CACHE_MISSES] % counts.events[BRANCH_MISSES];
+        }
+    };
+    for (auto const & thread : report) {
+        writeRows(std::to_string(thread.thread), thread.regions);
+        for (int r = 0; r < N_REGIONS; ++r) {
+            total.regions[r] += thread.regions[r];
+        }
+    }
+    writeRows("total", total.regions);
+    return os.str();
+}
+
+std::string PerfCounters::getRegionName(Region region) {
+    switch (region) {
+    case CMODEL_INITIAL:
+        return "CModel.initial";
+    case CMODEL_EXP:
+        return "CModel.exp";
+    case CMODEL_DEV:
+        return "CModel.dev";
+    case OPTIMIZER_STEP:
+        return "Optimizer.step";
+    case MODEL_MATRIX:
+        return "modelMatrix";
+    default:
+        return "unknown";
+    }
+}
+
+std::string PerfCounters::getEventName(Event event) {
+    switch (event) {
+    case CYCLES:
+        return "cycles";
+    case INSTRUCTIONS:
+        return "instructions";
+    case CACHE_MISSES:
+        return "cache-misses";
+    case BRANCH_MISSES:
+        return "branch-misses";
+    default:
+        return "unknown";
+    }
+}
+
+// ----------------- PerfScope ------------------------------------------------------------------------------
+
+void PerfScope::_start() {
+    detail::ThreadPerfCounters * counters = getThreadCounters();
+    if (counters->isOpen()) {
+        _counters = counters;
+        _counters->read(_begin);
+    }
+}
+
+PerfCounters::Counts PerfScope::stop() {
+    PerfCounters::Counts counts;
+    if (!_counters) {
+        return counts;
+    }
+    std::array<std::uint64_t,PerfCounters::N_EVENTS> end;
+    _counters->read(end);
+    for (int e = 0; e < PerfCounters::N_EVENTS; ++e) {
+        counts.events[e] = end[e] - _begin[e];
+    }
+    counts.calls = 1;
+    _counters->regions[_region] += counts;
+    _counters = nullptr;
+    return counts;
+}
+
+}}} // namespace lsst::meas::modelfit
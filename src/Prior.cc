@@ -0,0 +1,65 @@
+// -*- lsst-c++ -*-
+/*
+ * LSST Data Management System
+ * Copyright 2008-2017 LSST Corporation.
+ *
+ * This product includes software developed by the
+ * LSST Project (http://www.lsstcorp.org/).
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the LSST License Statement and
+ * the GNU General Public License along with this program.  If not,
+ * see <http://www.lsstcorp.org/LegalNotices/>.
+ */
+
+
+#include <cmath>
+
+#include "ndarray/eigen.h"
+
+#include "lsst/pex/exceptions.h"
+#include "lsst/meas/modelfit/Prior.h"
+
+namespace lsst { namespace meas { namespace modelfit {
+
+AmplitudePosterior::AmplitudePosterior(
+    Vector const & gradient, Matrix const & hessian, Scalar nonlinearDensity
+) :
+    _tg(TruncatedGaussian::fromSeriesParameters(0.0, gradient, hessian)),
+    _nonlinearTerm(-std::log(nonlinearDensity))
+{}
+
+Scalar AmplitudePosterior::maximize(ndarray::Array<Scalar,1,1> const & amplitudes) const {
+    _tg.maximize(amplitudes);
+    return _tg.evaluateLog()(amplitudes.asEigen()) + _nonlinearTerm;
+}
+
+void AmplitudePosterior::drawAmplitudes(
+    afw::math::Random & rng,
+    ndarray::Array<Scalar,2,1> const & amplitudes,
+    ndarray::Array<Scalar,1,1> const & weights,
+    bool multiplyWeights
+) const {
+    _tg.sample()(rng, amplitudes, weights, multiplyWeights);
+}
+
+AmplitudePosterior Prior::makeAmplitudePosterior(
+    Vector const & gradient, Matrix const & hessian,
+    ndarray::Array<Scalar const,1,1> const & nonlinear
+) const {
+    throw LSST_EXCEPT(
+        pex::exceptions::LogicError,
+        "makeAmplitudePosterior not implemented for this Prior"
+    );
+}
+
+}}} // namespace lsst::meas::modelfit
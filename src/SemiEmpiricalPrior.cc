@@ -409,8 +409,7 @@ Scalar SemiEmpiricalPrior::marginalize(
     Vector const & gradient, Matrix const & hessian,
     ndarray::Array<Scalar const,1,1> const & nonlinear
 ) const {
-    return TruncatedGaussian::fromSeriesParameters(0.0, gradient, hessian).getLogIntegral()
-        - std::log(_impl->eta.p(nonlinear[0], nonlinear[1]) * _impl->lnR.p(nonlinear[2]));
+    return makeAmplitudePosterior(gradient, hessian, nonlinear).marginalize();
 }
 
 Scalar SemiEmpiricalPrior::maximize(
@@ -418,10 +417,7 @@ Scalar SemiEmpiricalPrior::maximize(
     ndarray::Array<Scalar const,1,1> const & nonlinear,
     ndarray::Array<Scalar,1,1> const & amplitudes
 ) const {
-    TruncatedGaussian tg = TruncatedGaussian::fromSeriesParameters(0.0, gradient, hessian);
-    amplitudes.asEigen() = tg.maximize();
-    return tg.evaluateLog()(amplitudes.asEigen()) -
-        std::log(_impl->eta.p(nonlinear[0], nonlinear[1]) * _impl->lnR.p(nonlinear[2]));
+    return makeAmplitudePosterior(gradient, hessian, nonlinear).maximize(amplitudes);
 }
 
 void SemiEmpiricalPrior::drawAmplitudes(
@@ -432,9 +428,18 @@ void SemiEmpiricalPrior::drawAmplitudes(
     ndarray::Array<Scalar,1,1> const & weights,
     bool multiplyWeights
 ) const {
-    throw LSST_EXCEPT(
-        pex::exceptions::LogicError,
-        "drawAmplitudes not yet implemented for SemiEmpiricalPrior"
+    makeAmplitudePosterior(gradient, fisher, nonlinear).drawAmplitudes(
+        rng, amplitudes, weights, multiplyWeights
+    );
+}
+
+AmplitudePosterior SemiEmpiricalPrior::makeAmplitudePosterior(
+    Vector const & gradient, Matrix const & hessian,
+    ndarray::Array<Scalar const,1,1> const & nonlinear
+) const {
+    return AmplitudePosterior(
+        gradient, hessian,
+        _impl->eta.p(nonlinear[0], nonlinear[1]) * _impl->lnR.p(nonlinear[2])
     );
 }
 
@@ -21,6 +21,9 @@
  * see <http://www.lsstcorp.org/LegalNotices/>.
  */
 
+#include <cmath>
+#include <limits>
+
 #include "ndarray/eigen.h"
 
 #include "lsst/log/Log.h"
@@ -223,8 +226,7 @@ Scalar SoftenedLinearPrior::marginalize(
     Vector const & gradient, Matrix const & hessian,
     ndarray::Array<Scalar const,1,1> const & nonlinear
 ) const {
-    return TruncatedGaussian::fromSeriesParameters(0.0, gradient, hessian).getLogIntegral()
-        - std::log(_evaluate(nonlinear));
+    return makeAmplitudePosterior(gradient, hessian, nonlinear).marginalize();
 }
 
 Scalar SoftenedLinearPrior::maximize(
@@ -232,9 +234,7 @@ Scalar SoftenedLinearPrior::maximize(
     ndarray::Array<Scalar const,1,1> const & nonlinear,
     ndarray::Array<Scalar,1,1> const & amplitudes
 ) const {
-    TruncatedGaussian tg = TruncatedGaussian::fromSeriesParameters(0.0, gradient, hessian);
-    amplitudes.asEigen() = tg.maximize();
-    return tg.evaluateLog()(amplitudes.asEigen()) - std::log(_evaluate(nonlinear));
+    return makeAmplitudePosterior(gradient, hessian, nonlinear).maximize(amplitudes);
 }
 
 void SoftenedLinearPrior::drawAmplitudes(
@@ -245,13 +245,32 @@ void SoftenedLinearPrior::drawAmplitudes(
     ndarray::Array<Scalar,1,1> const & weights,
     bool multiplyWeights
 ) const {
-    // TODO
-    throw LSST_EXCEPT(
-        pex::exceptions::LogicError,
-        "drawAmplitudes not yet implemented for SoftenedLinearPrior"
+    makeAmplitudePosterior(gradient, fisher, nonlinear).drawAmplitudes(
+        rng, amplitudes, weights, multiplyWeights
     );
 }
 
+AmplitudePosterior SoftenedLinearPrior::makeAmplitudePosterior(
+    Vector const & gradient, Matrix const & hessian,
+    ndarray::Array<Scalar const,1,1> const & nonlinear
+) const {
+    return AmplitudePosterior(gradient, hessian, _evaluate(nonlinear));
+}
+
+bool SoftenedLinearPrior::fillBounds(
+    ndarray::Array<Scalar,1,1> const & nonlinearLower,
+    ndarray::Array<Scalar,1,1> const & nonlinearUpper,
+    ndarray::Array<Scalar,1,1> const & amplitudeLower,
+    ndarray::Array<Scalar,1,1> const & amplitudeUpper
+) const {
+    amplitudeLower.deep() = 0.0;
+    // The prior is zero at the outer logRadius limits themselves, so the bounds are just inside them.
+    // The ellipticity limit is a circle, not a bound, so we leave that to evaluate().
+    nonlinearLower[2] = std::nextafter(_ctrl.logRadiusMinOuter, std::numeric_limits<Scalar>::infinity());
+    nonlinearUpper[2] = std::nextafter(_ctrl.logRadiusMaxOuter, -std::numeric_limits<Scalar>::infinity());
+    return true;
+}
+
 Scalar SoftenedLinearPrior::_evaluate(
     ndarray::Array<Scalar const,1,1> const & nonlinear
 ) const {
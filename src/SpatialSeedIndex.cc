@@ -0,0 +1,147 @@
+// -*- lsst-c++ -*-
+/*
+ * LSST Data Management System
+ * Copyright 2008-2017 LSST Corporation.
+ *
+ * This product includes software developed by the
+ * LSST Project (http://www.lsstcorp.org/).
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the LSST License Statement and
+ * the GNU General Public License along with this program.  If not,
+ * see <http://www.lsstcorp.org/LegalNotices/>.
+ */
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <tuple>
+
+#include "lsst/meas/modelfit/SpatialSeedIndex.h"
+
+namespace lsst { namespace meas { namespace modelfit {
+
+SpatialSeedIndex::SpatialSeedIndex(std::vector<afw::geom::Point2D> const & positions, double maxDistance) :
+    _maxDistance(maxDistance), _cellSize(1.0), _nCellsX(0), _nCellsY(0),
+    _positions(positions), _cells(positions.size(), -1)
+{
+    int const n = positions.size();
+    _order.reserve(n);
+    if (!(maxDistance > 0.0)) {
+        for (int i = 0; i < n; ++i) {
+            _order.push_back(i);
+        }
+        return;
+    }
+    std::vector<int> finite;
+    std::vector<int> nonFinite;
+    double xMin = std::numeric_limits<double>::infinity();
+    double yMin = std::numeric_limits<double>::infinity();
+    double xMax = -std::numeric_limits<double>::infinity();
+    double yMax = -std::numeric_limits<double>::infinity();
+    for (int i = 0; i < n; ++i) {
+        double const x = positions[i].getX();
+        double const y = positions[i].getY();
+        if (std::isfinite(x) && std::isfinite(y)) {
+            finite.push_back(i);
+            xMin = std::min(xMin, x);
+            xMax = std::max(xMax, x);
+            yMin = std::min(yMin, y);
+            yMax = std::max(yMax, y);
+        } else {
+            nonFinite.push_back(i);
+        }
+    }
+    if (!finite.empty()) {
+        // Cells are sized from the mean source density (a few sources per cell), not from maxDistance,
+        // so the number of cells stays proportional to the number of sources; the extent-based
+        // lower bound handles sources that lie (nearly) along a line.
+        double const width = xMax - xMin;
+        double const height = yMax - yMin;
+        double const nFinite = finite.size();
+        _cellSize = std::max(2.0*std::sqrt(width*height/nFinite), std::max(width, height)/nFinite);
+        if (!(_cellSize > 0.0)) {
+            _cellSize = 1.0;
+        }
+        _nCellsX = static_cast<int>(width/_cellSize) + 1;
+        _nCellsY = static_cast<int>(height/_cellSize) + 1;
+        _fitted.resize(_nCellsX*_nCellsY);
+        // Sort by cell row, then along the row in alternating directions.
+        std::vector<std::tuple<int,double,int>> sortKeys;
+        sortKeys.reserve(finite.size());
+        for (int i : finite) {
+            int const cellX = static_cast<int>((positions[i].getX() - xMin)/_cellSize);
+            int const cellY = static_cast<int>((positions[i].getY() - yMin)/_cellSize);
+            _cells[i] = cellY*_nCellsX + cellX;
+            double const along = (cellY % 2) ? -positions[i].getX() : positions[i].getX();
+            sortKeys.emplace_back(cellY, along, i);
+        }
+        std::sort(sortKeys.begin(), sortKeys.end());
+        for (auto const & key : sortKeys) {
+            _order.push_back(std::get<2>(key));
+        }
+    }
+    _order.insert(_order.end(), nonFinite.begin(), nonFinite.end());
+}
+
+int SpatialSeedIndex::findNearest(int i) const {
+    if (!_isIndexed(i)) {
+        return -1;
+    }
+    int const cellX = _cells[i] % _nCellsX;
+    int const cellY = _cells[i] / _nCellsX;
+    afw::geom::Point2D const & position = _positions[i];
+    double const maxDistanceSquared = _maxDistance*_maxDistance;
+    int best = -1;
+    double bestDistanceSquared = maxDistanceSquared;
+    int const maxRing = std::max(_nCellsX, _nCellsY);
+    for (int ring = 0; ring <= maxRing; ++ring) {
+        // Everything in this ring (and beyond) is at least (ring - 1) cells away.
+        double const bound = (ring - 1)*_cellSize;
+        if (bound > 0.0 && bound*bound > bestDistanceSquared) {
+            break;
+        }
+        for (int dy = -ring; dy <= ring; ++dy) {
+            int const y = cellY + dy;
+            if (y < 0 || y >= _nCellsY) {
+                continue;
+            }
+            int const step = (std::abs(dy) == ring) ? 1 : 2*ring;
+            for (int dx = -ring; dx <= ring; dx += step) {
+                int const x = cellX + dx;
+                if (x < 0 || x >= _nCellsX) {
+                    continue;
+                }
+                for (int j : _getFitted(x, y)) {
+                    if (j == i) {
+                        continue;
+                    }
+                    double const distanceSquared = (_positions[j] - position).computeSquaredNorm();
+                    if (distanceSquared <= maxDistanceSquared &&
+                        (best < 0 || distanceSquared < bestDistanceSquared)) {
+                        best = j;
+                        bestDistanceSquared = distanceSquared;
+                    }
+                }
+            }
+        }
+    }
+    return best;
+}
+
+void SpatialSeedIndex::markFitted(int i) {
+    if (_isIndexed(i)) {
+        _fitted[_cells[i]].push_back(i);
+    }
+}
+
+}}} // namespace lsst::meas::modelfit
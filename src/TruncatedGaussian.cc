@@ -53,22 +53,6 @@ static double const SLN_THRESHOLD = 1E-5;
 
 // -------- Main TruncatedGaussian class --------------------------------------------------------------------
 
-class TruncatedGaussian::Impl {
-public:
-
-    explicit Impl(int n) :
-        untruncatedFraction(1.0), logPeakAmplitude(1.0), logIntegral(1.0),
-        mu(n), s(n), v(n,n)
-        {}
-
-    Scalar untruncatedFraction;
-    Scalar logPeakAmplitude;
-    Scalar logIntegral;
-    Vector mu;
-    Vector s;  // H = Sigma^{-1} = V S V^T
-    Matrix v;
-};
-
 TruncatedGaussian TruncatedGaussian::fromSeriesParameters(
     Scalar q0, Vector const & gradient, Matrix const & hessian
 ) {
@@ -83,20 +67,26 @@ TruncatedGaussian TruncatedGaussian::fromSeriesParameters(
              % n % hessian.rows() % hessian.cols()).str()
         );
     }
-    PTR(Impl) impl = std::make_shared<Impl>(n);
+    if (n < 1 || n > MAX_DIM) {
+        throw LSST_EXCEPT(
+            pex::exceptions::LogicError,
+            "Greater than 2 dimensions not yet supported"
+        );
+    }
+    TruncatedGaussian result(n);
     if (n == 1) {
         Scalar g = gradient[0];
         Scalar H = hessian(0,0);
         Scalar mu = -g / H;
         LOGL_DEBUG(trace4Logger, "fromSeriesParameters: 1d with H=[%g], mu=[%g]", H, mu);
-        impl->mu[0] = mu;
-        impl->s(0,0) = H;
-        impl->v.setIdentity();
-        impl->logPeakAmplitude = q0 + 0.5*g*mu;
-        impl->untruncatedFraction = 0.5*boost::math::erfc(-mu*std::sqrt(H/2.0));
-        impl->logIntegral = impl->logPeakAmplitude + 0.5*std::log(H) - 0.5*LN_2PI
-            - std::log(impl->untruncatedFraction);
-    } else if (n == 2) {
+        result._mu[0] = mu;
+        result._s(0,0) = H;
+        result._v.setIdentity();
+        result._logPeakAmplitude = q0 + 0.5*g*mu;
+        result._untruncatedFraction = 0.5*boost::math::erfc(-mu*std::sqrt(H/2.0));
+        result._logIntegral = result._logPeakAmplitude + 0.5*std::log(H) - 0.5*LN_2PI
+            - std::log(result._untruncatedFraction);
+    } else {
         // There are some unnecessary copies here, but they help keep the notation clean;
         // someday we'll be able to use auto and make them mostly references, but for now
         // it's too tricky to figure out the Eigen return types.
@@ -146,15 +136,15 @@ TruncatedGaussian TruncatedGaussian::fromSeriesParameters(
             Scalar z = v.col(1).dot(g) / std::sqrt(2.0 * s[1]);
             // we use abs() here because we know we want a positive integral, but we don't know which of
             // v(0,0) and v(0,1) is positive and which is negative
-            impl->logIntegral = q0 - std::log(
+            result._logIntegral = q0 - std::log(
                 std::abs(
                     (v(0,1)/v(0,0) - v(1,1)/v(1,0))
                     * (1.0 - z*SQRT_PI*std::exp(z*z)*boost::math::erfc(z))
                     / s[1]
                 )
             );
-            impl->untruncatedFraction = 0.0; // untruncated integral diverges, so ratio is 0
-            impl->logPeakAmplitude = q0 + 0.5*g.dot(mu);
+            result._untruncatedFraction = 0.0; // untruncated integral diverges, so ratio is 0
+            result._logPeakAmplitude = q0 + 0.5*g.dot(mu);
         } else {
             mu = -v * ((v.adjoint() * g).array() / s.array()).matrix();
             LOGL_DEBUG(trace4Logger, "fromSeriesParameters: full-rank matrix with s=[%g, %g], mu=[%g, %g]",
@@ -163,27 +153,22 @@ TruncatedGaussian TruncatedGaussian::fromSeriesParameters(
             Scalar detH = s[0] * s[1];
             Scalar sigma00 = H(1,1) / detH;
             Scalar sigma11 = H(0,0) / detH;
-            impl->logPeakAmplitude = q0 + 0.5*g.dot(mu);
-            impl->untruncatedFraction = detail::bvnu(
+            result._logPeakAmplitude = q0 + 0.5*g.dot(mu);
+            result._untruncatedFraction = detail::bvnu(
                 -mu[0]/std::sqrt(sigma00), -mu[1]/std::sqrt(sigma11), rho
             );
-            impl->logIntegral = impl->logPeakAmplitude + 0.5*std::log(detH) - LN_2PI
-                - std::log(impl->untruncatedFraction);
+            result._logIntegral = result._logPeakAmplitude + 0.5*std::log(detH) - LN_2PI
+                - std::log(result._untruncatedFraction);
         }
         LOGL_DEBUG(trace4Logger, "fromSeriesParameters: v=[[%g, %g], [%g, %g]]",
                           v(0,0), v(0,1), v(1,0), v(1,1));
-        impl->mu.head<2>() = mu;
-        impl->s.head<2>() = s;
-        impl->v.block<2,2>(0,0) = v;
-    } else {
-        throw LSST_EXCEPT(
-            pex::exceptions::LogicError,
-            "Greater than 2 dimensions not yet supported"
-        );
+        result._mu.head<2>() = mu;
+        result._s.head<2>() = s;
+        result._v.block<2,2>(0,0) = v;
     }
     LOGL_DEBUG(trace4Logger, "fromSeriesParameters: logPeakAmplitude=%g, logIntegral=%g, untruncatedFraction=%g",
-                      impl->logPeakAmplitude, impl->logIntegral, impl->untruncatedFraction);
-    return TruncatedGaussian(impl);
+                      result._logPeakAmplitude, result._logIntegral, result._untruncatedFraction);
+    return result;
 }
 
 TruncatedGaussian TruncatedGaussian::fromStandardParameters(
@@ -199,18 +184,24 @@ TruncatedGaussian TruncatedGaussian::fromStandardParameters(
              % n % covariance.rows() % covariance.cols()).str()
         );
     }
-    PTR(Impl) impl = std::make_shared<Impl>(n);
+    if (n < 1 || n > MAX_DIM) {
+        throw LSST_EXCEPT(
+            pex::exceptions::LogicError,
+            "Greater than 2 dimensions not yet supported"
+        );
+    }
+    TruncatedGaussian result(n);
     if (n == 1) {
         Scalar mu = mean[0];
         Scalar Sigma = covariance(0,0);
         LOGL_DEBUG(trace4Logger, "fromStandardParameters: 1d with Sigma=[%g], mu=[%g]", Sigma, mu);
-        impl->mu[0] = mu;
-        impl->s(0,0) = 1.0/Sigma;
-        impl->v.setIdentity();
-        impl->untruncatedFraction = 0.5*boost::math::erfc(-mu/std::sqrt(2.0*Sigma));
-        impl->logPeakAmplitude = std::log(impl->untruncatedFraction) + 0.5*std::log(Sigma) + 0.5*LN_2PI;
-        impl->logIntegral = 0.0;
-    } else if (n == 2) {
+        result._mu[0] = mu;
+        result._s(0,0) = 1.0/Sigma;
+        result._v.setIdentity();
+        result._untruncatedFraction = 0.5*boost::math::erfc(-mu/std::sqrt(2.0*Sigma));
+        result._logPeakAmplitude = std::log(result._untruncatedFraction) + 0.5*std::log(Sigma) + 0.5*LN_2PI;
+        result._logIntegral = 0.0;
+    } else {
         // There are some unnecessary copies here, but they help keep the notation clean;
         // someday we'll be able to use auto and make them mostly references, but for now
         // it's too tricky to figure out the Eigen return types.
@@ -230,32 +221,40 @@ TruncatedGaussian TruncatedGaussian::fromStandardParameters(
                           s[0], s[1], mu[0], mu[1]);
         Scalar rho = Sigma(0,1) / std::sqrt(Sigma(0,0) * Sigma(1,1));
         Scalar detSigma = 1.0 / (s[0] * s[1]);
-        impl->untruncatedFraction = detail::bvnu(
+        result._untruncatedFraction = detail::bvnu(
             -mu[0]/std::sqrt(Sigma(0,0)), -mu[1]/std::sqrt(Sigma(1,1)), rho
         );
-        impl->logPeakAmplitude = std::log(impl->untruncatedFraction) + 0.5*std::log(detSigma) + LN_2PI;
-        impl->logIntegral = 0.0;
-        impl->mu.head<2>() = mu;
-        impl->s.head<2>() = s;
-        impl->v.block<2,2>(0,0) = v;
-    } else {
-        throw LSST_EXCEPT(
-            pex::exceptions::LogicError,
-            "Greater than 2 dimensions not yet supported"
-        );
+        result._logPeakAmplitude = std::log(result._untruncatedFraction) + 0.5*std::log(detSigma) + LN_2PI;
+        result._logIntegral = 0.0;
+        result._mu.head<2>() = mu;
+        result._s.head<2>() = s;
+        result._v.block<2,2>(0,0) = v;
     }
     LOGL_DEBUG(trace4Logger, "fromStandardParameters: logPeakAmplitude=%g, logIntegral=%g, untruncatedFraction=%g",
-                      impl->logPeakAmplitude, impl->logIntegral, impl->untruncatedFraction);
-    return TruncatedGaussian(impl);
+                      result._logPeakAmplitude, result._logIntegral, result._untruncatedFraction);
+    return result;
 }
 
 int TruncatedGaussian::getDim() const {
-    return _impl->mu.size();
+    return _mu.size();
 }
 
 Vector TruncatedGaussian::maximize() const {
-    Vector result(_impl->mu);
-    int const n = _impl->mu.size();
+    return _maximize();
+}
+
+void TruncatedGaussian::maximize(ndarray::Array<Scalar,1,1> const & alpha) const {
+    LSST_THROW_IF_NE(
+        alpha.getSize<0>(), getDim(),
+        pex::exceptions::LengthError,
+        "Size of alpha array (%d) does not match dimension of TruncatedGaussian (%d)"
+    );
+    alpha.asEigen() = _maximize();
+}
+
+TruncatedGaussian::SmallVector TruncatedGaussian::_maximize() const {
+    SmallVector result(_mu);
+    int const n = _mu.size();
     int k = 0;
     for (int i = 0; i < n; ++i) {
         if (result[i] < 0.0) {
@@ -263,7 +262,7 @@ Vector TruncatedGaussian::maximize() const {
         }
     }
     if (k > 0) {
-        Eigen::VectorXi indices(n);
+        Eigen::Matrix<int,Eigen::Dynamic,1,Eigen::DontAlign,MAX_DIM,1> indices(n);
         for (int i = 0, j1 = 0, j2 = n - k; i < n; ++i) {
             if (result[i] < 0.0) {
                 indices[i] = j2;
@@ -273,13 +272,13 @@ Vector TruncatedGaussian::maximize() const {
                 ++j1;
             }
         }
-        Eigen::PermutationMatrix<Eigen::Dynamic> p(indices);
+        Eigen::PermutationMatrix<Eigen::Dynamic,MAX_DIM> p(indices);
         // beta, G, nu: permuted versions of alpha, H, mu
-        Matrix pv = p * _impl->v;
-        Matrix G = pv * _impl->s.asDiagonal() * pv.adjoint();
-        Vector nu = p * _impl->mu;
-        Vector beta = Vector::Zero(n);
-        Eigen::FullPivLU<Matrix> solver(G.topLeftCorner(n - k, n - k));
+        SmallMatrix pv = p * _v;
+        SmallMatrix G = pv * _s.asDiagonal() * pv.adjoint();
+        SmallVector nu = p * _mu;
+        SmallVector beta = SmallVector::Zero(n);
+        Eigen::FullPivLU<SmallMatrix> solver(G.topLeftCorner(n - k, n - k));
         beta.head(n - k) = solver.solve(G.topRightCorner(n - k, k) * nu.tail(k)) + nu.head(n - k);
         result = p.transpose() * beta;
     }
@@ -287,24 +286,22 @@ Vector TruncatedGaussian::maximize() const {
 }
 
 Scalar TruncatedGaussian::getUntruncatedFraction() const {
-    return _impl->untruncatedFraction;
+    return _untruncatedFraction;
 }
 
 Scalar TruncatedGaussian::getLogPeakAmplitude() const {
-    return _impl->logPeakAmplitude;
+    return _logPeakAmplitude;
 }
 
 Scalar TruncatedGaussian::getLogIntegral() const {
-    return _impl->logIntegral;
+    return _logIntegral;
 }
 
-TruncatedGaussian::~TruncatedGaussian() {}
-
 // -------- LogEvaluator class ------------------------------------------------------------------------------
 
 TruncatedGaussianLogEvaluator::TruncatedGaussianLogEvaluator(TruncatedGaussian const & parent) :
-    _norm(parent._impl->logPeakAmplitude), _mu(parent._impl->mu), _workspace(_mu.size()),
-    _rootH(parent._impl->s.array().sqrt().matrix().asDiagonal() * parent._impl->v.adjoint())
+    _norm(parent._logPeakAmplitude), _mu(parent._mu), _workspace(_mu.size()),
+    _rootH(parent._s.array().sqrt().matrix().asDiagonal() * parent._v.adjoint())
 {}
 
 Scalar TruncatedGaussianLogEvaluator::operator()(ndarray::Array<Scalar const,1,1> const & alpha) const {
@@ -357,10 +354,15 @@ public:
 
 namespace {
 
+typedef TruncatedGaussian::SmallVector SmallVector;
+typedef TruncatedGaussian::SmallMatrix SmallMatrix;
+
 class SamplerImplDWR1 : public TruncatedGaussianSampler::Impl {
 public:
 
-    SamplerImplDWR1(TruncatedGaussian const & parent, Vector const & mu, Matrix const & v, Vector const & s) :
+    SamplerImplDWR1(
+        TruncatedGaussian const & parent, SmallVector const & mu, SmallMatrix const & v, SmallVector const & s
+    ) :
         _mu(mu[0]), _rootSigma(std::sqrt(1.0/s[0]) * v(0,0))
         {}
 
@@ -379,7 +381,9 @@ private:
 class SamplerImplDWR : public TruncatedGaussianSampler::Impl {
 public:
 
-    SamplerImplDWR(TruncatedGaussian const & parent, Vector const & mu, Matrix const & v, Vector const & s) :
+    SamplerImplDWR(
+        TruncatedGaussian const & parent, SmallVector const & mu, SmallMatrix const & v, SmallVector const & s
+    ) :
         _mu(mu), _workspace(mu.size()),
         _rootSigma(v * s.array().inverse().sqrt().matrix().asDiagonal() * v.adjoint())
         {}
@@ -395,9 +399,9 @@ public:
     }
 
 private:
-    Vector _mu;
-    Vector _workspace;
-    Matrix _rootSigma;
+    SmallVector _mu;
+    SmallVector _workspace;
+    SmallMatrix _rootSigma;
 };
 
 Scalar draw1d(afw::math::Random & rng, Scalar Ap) {
@@ -408,7 +412,7 @@ class SamplerImplAAW1 : public TruncatedGaussianSampler::Impl {
 public:
 
     SamplerImplAAW1(
-        TruncatedGaussian const & parent, Vector const & mu, Matrix const & v, Vector const & s
+        TruncatedGaussian const & parent, SmallVector const & mu, SmallMatrix const & v, SmallVector const & s
     ) :
         _mu(mu[0]), _rootD(std::sqrt(1.0/s[0])),
         _A(0.5*boost::math::erfc(-_mu/(M_SQRT2*_rootD)))
@@ -432,7 +436,7 @@ class SamplerImplAAW : public TruncatedGaussianSampler::Impl, private TruncatedG
 public:
 
     SamplerImplAAW(
-        TruncatedGaussian const & parent, Vector const & mu, Matrix const & v, Vector const & s
+        TruncatedGaussian const & parent, SmallVector const & mu, SmallMatrix const & v, SmallVector const & s
     ) :
         TruncatedGaussianLogEvaluator(parent),
         _pNorm(1.0),
@@ -480,8 +484,8 @@ public:
 private:
     Scalar _pNorm; // normalization factor for full N-d importance distribution
     Scalar _lnAf; // log integral of the true N-d distribution
-    Vector _Ap; // untruncated fractions for each 1-d importance distribution
-    Vector _rootD; // sqrt of variances for importance distribution
+    SmallVector _Ap; // untruncated fractions for each 1-d importance distribution
+    SmallVector _rootD; // sqrt of variances for importance distribution
 };
 
 } // anonymous
@@ -495,13 +499,13 @@ TruncatedGaussianSampler::TruncatedGaussianSampler(
         switch (strategy) {
         case TruncatedGaussian::DIRECT_WITH_REJECTION:
             _impl = std::make_shared<SamplerImplDWR1>(
-                parent, parent._impl->mu, parent._impl->v, parent._impl->s
+                parent, parent._mu, parent._v, parent._s
             );
             LOGL_DEBUG(trace4Logger, "Sampler: using DWR1");
             break;
         case TruncatedGaussian::ALIGN_AND_WEIGHT:
             _impl = std::make_shared<SamplerImplAAW1>(
-                parent, parent._impl->mu, parent._impl->v, parent._impl->s
+                parent, parent._mu, parent._v, parent._s
             );
             LOGL_DEBUG(trace4Logger, "Sampler: using AAW1");
             break;
@@ -510,13 +514,13 @@ TruncatedGaussianSampler::TruncatedGaussianSampler(
         switch (strategy) {
         case TruncatedGaussian::DIRECT_WITH_REJECTION:
             _impl = std::make_shared<SamplerImplDWR>(
-                parent, parent._impl->mu, parent._impl->v, parent._impl->s
+                parent, parent._mu, parent._v, parent._s
             );
             LOGL_DEBUG(trace4Logger, "Sampler: using DWR");
             break;
         case TruncatedGaussian::ALIGN_AND_WEIGHT:
             _impl = std::make_shared<SamplerImplAAW>(
-                parent, parent._impl->mu, parent._impl->v, parent._impl->s
+                parent, parent._mu, parent._v, parent._s
             );
             LOGL_DEBUG(trace4Logger, "Sampler: using AAW");
             break;
@@ -22,15 +22,20 @@
  */
 #include <algorithm>
 #include <limits>
+#include <cmath>
 #include <numeric>
 
 #include "boost/format.hpp"
 #include <memory>
 #include "ndarray/eigen.h"
 
+#include "lsst/afw/geom/ellipses/Quadrupole.h"
 #include "lsst/afw/image/Calib.h"
 #include "lsst/shapelet/MatrixBuilder.h"
 #include "lsst/meas/modelfit/UnitTransformedLikelihood.h"
+#include "lsst/meas/modelfit/PerfCounters.h"
+#include "lsst/meas/modelfit/detail/Arena.h"
+#include "lsst/meas/modelfit/detail/parallel.h"
 
 namespace lsst { namespace meas { namespace modelfit {
 
@@ -48,24 +53,22 @@ int componentPixelSum(int partialNumPixels, CONST_PTR(EpochFootprint) const &epo
 }
 
 /*
- * Return a vector of MatrixBuilders, with one for each MultiShapeletBasis in the input vector,
+ * Return a vector of MatrixBuilderFactories, with one for each MultiShapeletBasis in the input vector,
  * using the pixel region defined by the given Footprint and the given shapelet PSF approximation.
  *
- * basisVector - vector of MultiShapeletBasis objects; will produce one MatrixBuilder for each.
+ * basisVector - vector of MultiShapeletBasis objects; will produce one MatrixBuilderFactory for each.
  * psf - MultiShapeletFunction representation of the PSF
  * footprint - Footprint that defines the region of pixels that will be used in the fit.
  */
-BuilderVector makeMatrixBuilders(
+FactoryVector makeMatrixBuilderFactories(
     Model::BasisVector const & basisVector,
     shapelet::MultiShapeletFunction const & psf,
     afw::detection::Footprint const & footprint
 ) {
-    BuilderVector builders;
     FactoryVector factories;
-    builders.reserve(basisVector.size());
     factories.reserve(basisVector.size());
-    ndarray::Array<Pixel,1,1> x = ndarray::allocate(footprint.getArea());
-    ndarray::Array<Pixel,1,1> y = ndarray::allocate(footprint.getArea());
+    ndarray::Array<Pixel,1,1> x = detail::allocateTemporary<Pixel>(footprint.getArea());
+    ndarray::Array<Pixel,1,1> y = detail::allocateTemporary<Pixel>(footprint.getArea());
     int n = 0;
     for (
         auto i = footprint.getSpans()->begin();
@@ -77,10 +80,22 @@ BuilderVector makeMatrixBuilders(
             y[n] = j->getY();
         }
     }
-    int workspaceSize = 0;
     for (Model::BasisVector::const_iterator k = basisVector.begin(); k != basisVector.end(); ++k) {
         factories.push_back(shapelet::MatrixBuilderFactory<Pixel>(x, y, **k, psf));
-        workspaceSize = std::max(workspaceSize, factories.back().computeWorkspace());
+    }
+    return factories;
+}
+
+/*
+ * Return a vector of MatrixBuilders, with one for each of the given factories.  The builders share a
+ * single workspace, so they must not be used concurrently.
+ */
+BuilderVector makeMatrixBuilders(FactoryVector const & factories) {
+    BuilderVector builders;
+    builders.reserve(factories.size());
+    int workspaceSize = 0;
+    for (FactoryVector::const_iterator i = factories.begin(); i != factories.end(); ++i) {
+        workspaceSize = std::max(workspaceSize, i->computeWorkspace());
     }
     shapelet::MatrixBuilderWorkspace<Pixel> workspace(workspaceSize);
     for (FactoryVector::const_iterator i = factories.begin(); i != factories.end(); ++i) {
@@ -100,6 +115,8 @@ BuilderVector makeMatrixBuilders(
  *  weights - array to be filled with flattened values computed from the MaskedImage's variance plane
  *  usePixelWeights - if true, weights will be per-pixel inverse sqrt(variance); if false, a constant
  *                    average value will be used
+ *  inverseSigma - optional precomputed inverse-sigma plane to flatten into weights instead of
+ *                 computing them from the variance (may be null)
  */
 void setupArrays(
     afw::image::MaskedImage<Pixel> const & image,
@@ -109,15 +126,28 @@ void setupArrays(
     ndarray::Array<Pixel,1,1> const & weights,
     ndarray::Array<Pixel,1,1> const & unweightedData,
     bool usePixelWeights,
-    double weightsMultiplier
+    double weightsMultiplier,
+    InverseSigmaImage const * inverseSigma
 ) {
     footprint.getSpans()->flatten(data, image.getImage()->getArray(), image.getXY0());
     footprint.getSpans()->flatten(variance, image.getVariance()->getArray(), image.getXY0());
     unweightedData.deep() = data;
     // Convert from variance to weights (1/sigma); this is actually the usual inverse-variance
     // weighting, because we implicitly square it later.
-    weights.asEigen<Eigen::ArrayXpr>() =
-        variance.asEigen<Eigen::ArrayXpr>().sqrt().inverse() * weightsMultiplier;
+    if (inverseSigma) {
+        afw::image::Image<Pixel> const & plane = inverseSigma->get();
+        if (!plane.getBBox().contains(footprint.getBBox())) {
+            throw LSST_EXCEPT(
+                pex::exceptions::InvalidParameterError,
+                "Precomputed inverse-sigma image does not cover the fit region"
+            );
+        }
+        footprint.getSpans()->flatten(weights, plane.getArray(), plane.getXY0());
+        weights.asEigen<Eigen::ArrayXpr>() *= weightsMultiplier;
+    } else {
+        weights.asEigen<Eigen::ArrayXpr>() =
+            variance.asEigen<Eigen::ArrayXpr>().sqrt().inverse() * weightsMultiplier;
+    }
     if (!usePixelWeights) {
         // If we're not using per-pixel weights, we need to use a constant non-unit weight instead,
         // which we compute as the geometric mean of the per-pixel weights.  The choice of geometric
@@ -130,16 +160,80 @@ void setupArrays(
     data.asEigen<Eigen::ArrayXpr>() *= weights.asEigen<Eigen::ArrayXpr>();
 }
 
+/*
+ *  Estimate the Fisher information an epoch carries about the flux of the source being fit, in fit-system
+ *  units.  We treat the source as compact, with the PSF's moments, so this accounts for the epoch's
+ *  pixel weights, its seeing, and how much of the source falls inside its footprint, without needing
+ *  the (not yet known) nonlinear parameters.
+ *
+ *  epoch - the epoch's data, footprint, and PSF
+ *  position - sky position of the source
+ *  transform - transform from the fit system to the epoch's system
+ *  ctrl - control object; used for the weighting options
+ */
+Scalar estimateEpochInformation(
+    EpochFootprint const & epoch,
+    afw::coord::Coord const & position,
+    LocalUnitTransform const & transform,
+    UnitTransformedLikelihoodControl const & ctrl
+) {
+    afw::image::MaskedImage<Pixel> const & image = epoch.exposure.getMaskedImage();
+    ndarray::Array<Pixel,1,1> weights2 = detail::allocateTemporary<Pixel>(epoch.footprint.getArea());
+    epoch.footprint.getSpans()->flatten(weights2, image.getVariance()->getArray(), image.getXY0());
+    weights2.asEigen<Eigen::ArrayXpr>()
+        = weights2.asEigen<Eigen::ArrayXpr>().inverse() * (ctrl.weightsMultiplier * ctrl.weightsMultiplier);
+    if (!ctrl.usePixelWeights) {
+        // same geometric-mean weight as setupArrays uses
+        weights2.deep() = std::exp(weights2.asEigen<Eigen::ArrayXpr>().log().sum() / weights2.getSize<0>());
+    }
+    afw::geom::ellipses::Ellipse psfEllipse = epoch.psf.evaluate().computeMoments();
+    // include the pixel response (a unit box) so a delta-function PSF still has finite size
+    Eigen::Matrix2d moments = afw::geom::ellipses::Quadrupole(psfEllipse.getCore()).getMatrix();
+    moments.diagonal().array() += 1.0 / 12.0;
+    Eigen::Matrix2d fisher = moments.inverse();
+    Scalar const norm = 1.0 / (2.0 * afw::geom::PI * std::sqrt(moments.determinant()));
+    afw::geom::Point2D center = epoch.exposure.getWcs()->skyToPixel(position)
+        + afw::geom::Extent2D(psfEllipse.getCenter());
+    Scalar sum = 0.0;
+    int n = 0;
+    for (auto i = epoch.footprint.getSpans()->begin(); i != epoch.footprint.getSpans()->end(); ++i) {
+        for (afw::geom::Span::Iterator j = (*i).begin(); j != (*i).end(); ++j, ++n) {
+            Eigen::Vector2d d(j->getX() - center.getX(), j->getY() - center.getY());
+            Scalar g = norm * std::exp(-0.5 * d.dot(fisher * d));
+            sum += g * g * weights2[n];
+        }
+    }
+    return transform.flux * transform.flux * sum;
+}
+
 } // anonymous
 
+InverseSigmaImage::InverseSigmaImage(PTR(afw::image::Image<Pixel> const) variance) :
+    _variance(variance)
+{}
+
+afw::image::Image<Pixel> const & InverseSigmaImage::get() const {
+    std::call_once(_once, [this]() {
+        PTR(afw::image::Image<Pixel>) result = std::make_shared<afw::image::Image<Pixel>>(
+            _variance->getBBox()
+        );
+        result->getArray().asEigen<Eigen::ArrayXpr>()
+            = _variance->getArray().asEigen<Eigen::ArrayXpr>().sqrt().inverse();
+        _inverseSigma = result;
+    });
+    return *_inverseSigma;
+}
+
 EpochFootprint::EpochFootprint(
     afw::detection::Footprint const &footprint_,
     afw::image::Exposure<Pixel> const &exposure_,
-    shapelet::MultiShapeletFunction const & psf_
+    shapelet::MultiShapeletFunction const & psf_,
+    PTR(InverseSigmaImage const) inverseSigma_
 ) :
     footprint(footprint_),
     exposure(afw::image::Exposure<Pixel>(exposure_, false)),
-    psf(psf_)
+    psf(psf_),
+    inverseSigma(inverseSigma_)
 {}
 
 class UnitTransformedLikelihood::Impl {
@@ -148,19 +242,53 @@ public:
     class Epoch {
     public:
 
-        Epoch(int nPix_, LocalUnitTransform const & transform_, BuilderVector const & builders_) :
-            nPix(nPix_), transform(transform_), builders(builders_) {}
+        Epoch(int nPix_, LocalUnitTransform const & transform_, FactoryVector const & factories_) :
+            nPix(nPix_), transform(transform_), factories(factories_) {}
 
         int nPix;
         LocalUnitTransform transform;
-        BuilderVector builders;
+        FactoryVector factories;
+    };
+
+    // Mutable state used by computeModelMatrix; each concurrent call gets its own.
+    class Workspace {
+    public:
+
+        Workspace(Model::EllipseVector const & ellipses_, int nonlinearDim, int amplitudeDim, int dataDim) :
+            ellipses(ellipses_), scratch(afw::geom::ellipses::Quadrupole(), afw::geom::Point2D()),
+            hasLast(false),
+            lastNonlinear(ndarray::allocate(nonlinearDim)),
+            lastMatrix(ndarray::Array<Pixel,2,2>(ndarray::allocate(amplitudeDim, dataDim)).transpose())
+        {}
+
+        Model::EllipseVector ellipses;
+        afw::geom::ellipses::Ellipse scratch;
+        std::vector<BuilderVector> builders;  // indexed by epoch, then basis
+        bool hasLast;                          // whether lastNonlinear and lastMatrix have been set
+        ndarray::Array<Scalar,1,1> lastNonlinear;  // nonlinear parameters of the last evaluation
+        ndarray::Array<Pixel,2,-1> lastMatrix;     // unweighted model matrix of the last evaluation
     };
 
-    Impl() : scratch(afw::geom::ellipses::Quadrupole(), afw::geom::Point2D()) {}
+    Impl(PTR(Model) model, UnitTransformedLikelihood const * likelihood) :
+        workspaces([this, model, likelihood]() {
+            std::unique_ptr<Workspace> workspace(
+                new Workspace(
+                    model->makeEllipseVector(), model->getNonlinearDim(), model->getAmplitudeDim(),
+                    likelihood->getDataDim()
+                )
+            );
+            workspace->builders.reserve(epochs.size());
+            for (std::vector<Epoch>::const_iterator i = epochs.begin(); i != epochs.end(); ++i) {
+                workspace->builders.push_back(makeMatrixBuilders(i->factories));
+            }
+            return workspace;
+        })
+    {}
 
     std::vector<Epoch> epochs;
-    Model::EllipseVector ellipses;
-    afw::geom::ellipses::Ellipse scratch;
+    std::vector<int> droppedEpochs;
+    ndarray::Array<Scalar,1,1> epochInformation;
+    detail::WorkspacePool<Workspace> workspaces;
 };
 
 UnitTransformedLikelihood::UnitTransformedLikelihood(
@@ -170,27 +298,67 @@ UnitTransformedLikelihood::UnitTransformedLikelihood(
     afw::coord::Coord const & position,
     std::vector<PTR(EpochFootprint)> const & epochFootprintList,
     UnitTransformedLikelihoodControl const & ctrl
-) : Likelihood(model, fixed), _impl(new Impl()) {
-    int totPixels = std::accumulate(epochFootprintList.begin(), epochFootprintList.end(),
-                                    0, componentPixelSum);
-    _data = ndarray::allocate(totPixels);
-    _variance = ndarray::allocate(totPixels);
-    _weights = ndarray::allocate(totPixels);
-    _unweightedData = ndarray::allocate(totPixels);
-    _impl->epochs.reserve(epochFootprintList.size());
-    _impl->ellipses = model->makeEllipseVector();
+) : Likelihood(model, fixed), _impl(new Impl(model, this)) {
+    if (!(ctrl.minEpochInformationFraction >= 0.0 && ctrl.minEpochInformationFraction < 1.0)) {
+        throw LSST_EXCEPT(
+            pex::exceptions::InvalidParameterError,
+            (boost::format("minEpochInformationFraction must be in [0, 1) (got %g)")
+             % ctrl.minEpochInformationFraction).str()
+        );
+    }
+    int const nEpochs = epochFootprintList.size();
+    std::vector<LocalUnitTransform> transforms;
+    transforms.reserve(nEpochs);
+    for (int i = 0; i < nEpochs; ++i) {
+        transforms.push_back(LocalUnitTransform(position, fitSys, epochFootprintList[i]->exposure));
+    }
+    // Cull epochs that contribute little information before we do any real work on them.
+    std::vector<PTR(EpochFootprint)> keptEpochs;
+    std::vector<LocalUnitTransform> keptTransforms;
+    if (ctrl.minEpochInformationFraction > 0.0 && nEpochs > 1) {
+        _impl->epochInformation = ndarray::allocate(nEpochs);
+        for (int i = 0; i < nEpochs; ++i) {
+            _impl->epochInformation[i] = estimateEpochInformation(
+                *epochFootprintList[i], position, transforms[i], ctrl
+            );
+        }
+        auto information = _impl->epochInformation.asEigen();
+        int best = 0;
+        information.maxCoeff(&best);
+        Scalar const threshold = information.sum() * ctrl.minEpochInformationFraction;
+        for (int i = 0; i < nEpochs; ++i) {
+            if (i != best && !(information[i] >= threshold)) {
+                _impl->droppedEpochs.push_back(i);
+            } else {
+                keptEpochs.push_back(epochFootprintList[i]);
+                keptTransforms.push_back(transforms[i]);
+            }
+        }
+    } else {
+        keptEpochs = epochFootprintList;
+        keptTransforms = transforms;
+    }
+    int totPixels = std::accumulate(keptEpochs.begin(), keptEpochs.end(), 0, componentPixelSum);
+    _data = detail::allocateTemporary<Pixel>(totPixels);
+    _variance = detail::allocateTemporary<Pixel>(totPixels);
+    _weights = detail::allocateTemporary<Pixel>(totPixels);
+    _unweightedData = detail::allocateTemporary<Pixel>(totPixels);
+    _impl->epochs.reserve(keptEpochs.size());
     int dataOffset = 0;
+    std::vector<LocalUnitTransform>::const_iterator transformIter = keptTransforms.begin();
     for (
-        std::vector<PTR(EpochFootprint)>::const_iterator imPtrIter = epochFootprintList.begin();
-        imPtrIter != epochFootprintList.end();
-        ++imPtrIter
+        std::vector<PTR(EpochFootprint)>::const_iterator imPtrIter = keptEpochs.begin();
+        imPtrIter != keptEpochs.end();
+        ++imPtrIter, ++transformIter
     ) {
         int nPix = (**imPtrIter).footprint.getArea();
         int dataEnd = dataOffset + nPix;
         _impl->epochs.push_back(
             Impl::Epoch(
-                nPix, LocalUnitTransform(position, fitSys, (**imPtrIter).exposure),
-                makeMatrixBuilders(model->getBasisVector(), (**imPtrIter).psf, (**imPtrIter).footprint)
+                nPix, *transformIter,
+                makeMatrixBuilderFactories(
+                    model->getBasisVector(), (**imPtrIter).psf, (**imPtrIter).footprint
+                )
             )
         );
         setupArrays(
@@ -201,7 +369,8 @@ UnitTransformedLikelihood::UnitTransformedLikelihood(
             _weights[ndarray::view(dataOffset, dataEnd)],
             _unweightedData[ndarray::view(dataOffset, dataEnd)],
             ctrl.usePixelWeights,
-            ctrl.weightsMultiplier
+            ctrl.weightsMultiplier,
+            (**imPtrIter).inverseSigma.get()
         );
     }
 }
@@ -214,22 +383,30 @@ UnitTransformedLikelihood::UnitTransformedLikelihood(
     afw::image::Exposure<Pixel> const & exposure,
     afw::detection::Footprint const & footprint,
     shapelet::MultiShapeletFunction const & psf,
-    UnitTransformedLikelihoodControl const & ctrl
-) : Likelihood(model, fixed), _impl(new Impl()) {
+    UnitTransformedLikelihoodControl const & ctrl,
+    PTR(InverseSigmaImage const) inverseSigma
+) : Likelihood(model, fixed), _impl(new Impl(model, this)) {
     int totPixels = footprint.getArea();
-    _data = ndarray::allocate(totPixels);
-    _variance = ndarray::allocate(totPixels);
-    _weights = ndarray::allocate(totPixels);
-    _unweightedData = ndarray::allocate(totPixels);
-    _impl->ellipses = model->makeEllipseVector();
+    _data = detail::allocateTemporary<Pixel>(totPixels);
+    _variance = detail::allocateTemporary<Pixel>(totPixels);
+    _weights = detail::allocateTemporary<Pixel>(totPixels);
+    _unweightedData = detail::allocateTemporary<Pixel>(totPixels);
     _impl->epochs.push_back(
         Impl::Epoch(
             totPixels, LocalUnitTransform(position, fitSys, exposure),
-            makeMatrixBuilders(model->getBasisVector(), psf, footprint)
+            makeMatrixBuilderFactories(model->getBasisVector(), psf, footprint)
         )
     );
     setupArrays(exposure.getMaskedImage(), footprint, _data, _variance, _weights, _unweightedData,
-                ctrl.usePixelWeights, ctrl.weightsMultiplier);
+                ctrl.usePixelWeights, ctrl.weightsMultiplier, inverseSigma.get());
+}
+
+std::vector<int> const & UnitTransformedLikelihood::getDroppedEpochs() const {
+    return _impl->droppedEpochs;
+}
+
+ndarray::Array<Scalar const,1,1> UnitTransformedLikelihood::getEpochInformation() const {
+    return _impl->epochInformation;
 }
 
 UnitTransformedLikelihood::~UnitTransformedLikelihood() {}
@@ -239,28 +416,41 @@ void UnitTransformedLikelihood::computeModelMatrix(
     ndarray::Array<Scalar const,1,1> const & nonlinear,
     bool doApplyWeights
 ) const {
-    getModel()->writeEllipses(nonlinear.begin(), _fixed.begin(), _impl->ellipses.begin());
+    PerfScope perfScope(PerfCounters::MODEL_MATRIX);
+    detail::WorkspacePool<Impl::Workspace>::Lease workspace = _impl->workspaces.acquire();
+    // Optimizers often evaluate the model more than once at the same nonlinear parameters (e.g. when
+    // differentiating with respect to the amplitudes, and then again for the best-fit model once they're
+    // done), so we reuse the last matrix this workspace computed if we can.
+    if (workspace->hasLast && workspace->lastNonlinear.asEigen() == nonlinear.asEigen()) {
+        modelMatrix.deep() = workspace->lastMatrix;
+        if (doApplyWeights) {
+            modelMatrix.asEigen<Eigen::ArrayXpr>().colwise() *= _weights.asEigen<Eigen::ArrayXpr>();
+        }
+        return;
+    }
+    getModel()->writeEllipses(nonlinear.begin(), _fixed.begin(), workspace->ellipses.begin());
     int dataOffset = 0;
     modelMatrix.deep() = 0.0;
-    for (
-        std::vector<Impl::Epoch>::const_iterator i = _impl->epochs.begin();
-        i != _impl->epochs.end();
-        ++i
-    ) {
-        int dataEnd = dataOffset + i->nPix;
+    for (std::size_t e = 0; e < _impl->epochs.size(); ++e) {
+        Impl::Epoch const & epoch = _impl->epochs[e];
+        BuilderVector & builders = workspace->builders[e];
+        int dataEnd = dataOffset + epoch.nPix;
         int amplitudeOffset = 0;
-        for (std::size_t j = 0; j < _impl->ellipses.size(); ++j) {
-            _impl->scratch = _impl->ellipses[j].transform(i->transform.geometric);
-            int amplitudeEnd = amplitudeOffset + i->builders[j].getBasisSize();
-            i->builders[j](
+        for (std::size_t j = 0; j < workspace->ellipses.size(); ++j) {
+            workspace->scratch = workspace->ellipses[j].transform(epoch.transform.geometric);
+            int amplitudeEnd = amplitudeOffset + builders[j].getBasisSize();
+            builders[j](
                 modelMatrix[ndarray::view(dataOffset, dataEnd)(amplitudeOffset, amplitudeEnd)],
-                _impl->scratch
+                workspace->scratch
             );
             amplitudeOffset = amplitudeEnd;
         }
-        modelMatrix[ndarray::view(dataOffset, dataEnd)()] *= i->transform.flux;
+        modelMatrix[ndarray::view(dataOffset, dataEnd)()] *= epoch.transform.flux;
         dataOffset = dataEnd;
     }
+    workspace->lastMatrix.deep() = modelMatrix;
+    workspace->lastNonlinear.deep() = nonlinear;
+    workspace->hasLast = true;
     if (doApplyWeights) {
         modelMatrix.asEigen<Eigen::ArrayXpr>().colwise() *= _weights.asEigen<Eigen::ArrayXpr>();
     }
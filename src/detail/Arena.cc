@@ -0,0 +1,114 @@
+// -*- lsst-c++ -*-
+/*
+ * LSST Data Management System
+ * Copyright 2016 LSST/AURA
+ *
+ * This product includes software developed by the
+ * LSST Project (http://www.lsst.org/).
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the LSST License Statement and
+ * the GNU General Public License along with this program.  If not,
+ * see <http://www.lsstcorp.org/LegalNotices/>.
+ */
+
+#include <algorithm>
+#include <cstdint>
+
+#include "lsst/meas/modelfit/detail/Arena.h"
+
+namespace lsst { namespace meas { namespace modelfit { namespace detail {
+
+namespace {
+
+thread_local Arena * activeArena = nullptr;
+
+Arena & getThreadArena() {
+    static thread_local Arena arena;
+    return arena;
+}
+
+} // anonymous
+
+std::size_t const Arena::ALIGNMENT;
+std::size_t const Arena::DEFAULT_BLOCK_SIZE;
+
+Arena::Arena(std::size_t blockSize) :
+    _blockSize(blockSize), _bytesUsed(0), _current(0), _offset(0)
+{}
+
+void * Arena::_allocateBytes(std::size_t size, std::shared_ptr<char> & owner) {
+    // Pad the request so we can always align the start of the array, and never return a
+    // zero-size region (which would make distinct arrays alias each other).
+    std::size_t const padded = std::max(size, std::size_t(1)) + ALIGNMENT;
+    while (_current < _blocks.size() && _offset + padded > _blocks[_current].size) {
+        ++_current;
+        _offset = 0;
+    }
+    if (_current == _blocks.size()) {
+        Block block;
+        block.size = std::max(_blockSize, padded);
+        block.data.reset(new char[block.size], std::default_delete<char[]>());
+        _blocks.push_back(block);
+        _offset = 0;
+    }
+    Block & block = _blocks[_current];
+    char * begin = block.data.get() + _offset;
+    std::uintptr_t address = reinterpret_cast<std::uintptr_t>(begin);
+    std::size_t const shift = (ALIGNMENT - address % ALIGNMENT) % ALIGNMENT;
+    _offset += shift + size;
+    _bytesUsed += shift + size;
+    owner = block.data;
+    return begin + shift;
+}
+
+void Arena::reset() {
+    // Blocks still referenced by an array can't be recycled; we hand them over to those arrays
+    // by dropping our reference.
+    _blocks.erase(
+        std::remove_if(
+            _blocks.begin(), _blocks.end(),
+            [](Block const & block) { return block.data.use_count() > 1; }
+        ),
+        _blocks.end()
+    );
+    _current = 0;
+    _offset = 0;
+    _bytesUsed = 0;
+}
+
+std::size_t Arena::getBytesReserved() const {
+    std::size_t total = 0;
+    for (std::vector<Block>::const_iterator i = _blocks.begin(); i != _blocks.end(); ++i) {
+        total += i->size;
+    }
+    return total;
+}
+
+Arena * Arena::getActive() {
+    return activeArena;
+}
+
+ArenaScope::ArenaScope() : _isOuter(activeArena == nullptr) {
+    if (_isOuter) {
+        activeArena = &getThreadArena();
+    }
+}
+
+ArenaScope::~ArenaScope() {
+    if (_isOuter) {
+        activeArena->reset();
+        activeArena = nullptr;
+    }
+}
+
+}}}} // namespace lsst::meas::modelfit::detail
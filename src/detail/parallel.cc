@@ -0,0 +1,113 @@
+// -*- lsst-c++ -*-
+/*
+ * LSST Data Management System
+ * Copyright 2016 LSST/AURA
+ *
+ * This product includes software developed by the
+ * LSST Project (http://www.lsst.org/).
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the LSST License Statement and
+ * the GNU General Public License along with this program.  If not,
+ * see <http://www.lsstcorp.org/LegalNotices/>.
+ */
+
+#include "lsst/meas/modelfit/detail/parallel.h"
+
+namespace lsst { namespace meas { namespace modelfit { namespace detail {
+
+namespace {
+
+thread_local bool inParallelRegion = false;
+
+} // anonymous
+
+ParallelRegionScope::ParallelRegionScope() : _previous(inParallelRegion) {
+    inParallelRegion = true;
+}
+
+ParallelRegionScope::~ParallelRegionScope() {
+    inParallelRegion = _previous;
+}
+
+bool ParallelRegionScope::isActive() {
+    return inParallelRegion;
+}
+
+ThreadPool::ThreadPool(int nThreads) :
+    _task(nullptr), _nThreads(0), _nRunning(0), _generation(0), _stop(false)
+{
+    nThreads = resolveThreadCount(nThreads);
+    _workers.reserve(nThreads - 1);
+    for (int t = 1; t < nThreads; ++t) {
+        _workers.emplace_back(&ThreadPool::_work, this, t);
+    }
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _stop = true;
+    }
+    _wake.notify_all();
+    for (std::vector<std::thread>::iterator t = _workers.begin(); t != _workers.end(); ++t) {
+        t->join();
+    }
+}
+
+ThreadPool & ThreadPool::getShared() {
+    static ThreadPool pool(0);
+    return pool;
+}
+
+void ThreadPool::_run(std::function<void(int)> const & task, int nThreads) {
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _task = &task;
+        _nThreads = nThreads;
+        _nRunning = nThreads - 1;
+        ++_generation;
+    }
+    _wake.notify_all();
+    {
+        ParallelRegionScope scope;
+        task(0);
+    }
+    std::unique_lock<std::mutex> lock(_mutex);
+    _done.wait(lock, [this]() { return _nRunning == 0; });
+    _task = nullptr;
+}
+
+void ThreadPool::_work(int thread) {
+    ParallelRegionScope scope;  // workers only ever run parts of parallel loops
+    unsigned long seen = 0;
+    std::unique_lock<std::mutex> lock(_mutex);
+    while (true) {
+        _wake.wait(lock, [this, seen]() { return _stop || _generation != seen; });
+        if (_stop) {
+            return;
+        }
+        seen = _generation;
+        if (thread >= _nThreads) {
+            continue;  // not needed for this task
+        }
+        std::function<void(int)> const & task = *_task;
+        lock.unlock();
+        task(thread);
+        lock.lock();
+        if (--_nRunning == 0) {
+            _done.notify_one();
+        }
+    }
+}
+
+}}}} // namespace lsst::meas::modelfit::detail
@@ -20,9 +20,16 @@
  * the GNU General Public License along with this program.  If not,
  * see <http://www.lsstcorp.org/LegalNotices/>.
  */
+#include <algorithm>
 #include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <string>
+#include <vector>
 
 #include "Eigen/Eigenvalues"
+#include "Eigen/QR"
 #include "boost/math/special_functions/erf.hpp"
 
 #include "ndarray/eigen.h"
@@ -34,9 +41,42 @@
 #include "lsst/meas/modelfit/optimizer.h"
 #include "lsst/meas/modelfit/Likelihood.h"
 #include "lsst/meas/modelfit/Prior.h"
+#include "lsst/meas/modelfit/PerfCounters.h"
+#include "lsst/meas/modelfit/detail/Arena.h"
+#include "lsst/meas/modelfit/detail/parallel.h"
 
 namespace lsst { namespace meas { namespace modelfit {
 
+// ----------------- OptimizerConstraints -------------------------------------------------------------------
+
+OptimizerConstraints::OptimizerConstraints(int parameterSize, int nInequalities) :
+    lower(ndarray::allocate(parameterSize)),
+    upper(ndarray::allocate(parameterSize)),
+    inequalityMatrix(ndarray::allocate(nInequalities, parameterSize)),
+    inequalityVector(ndarray::allocate(nInequalities))
+{
+    lower.deep() = -std::numeric_limits<Scalar>::infinity();
+    upper.deep() = std::numeric_limits<Scalar>::infinity();
+    inequalityMatrix.deep() = 0.0;
+    inequalityVector.deep() = 0.0;
+}
+
+bool OptimizerConstraints::isFeasible(ndarray::Array<Scalar const,1,1> const & parameters) const {
+    if ((parameters.asEigen<Eigen::ArrayXpr>() < lower.asEigen<Eigen::ArrayXpr>()).any()) {
+        return false;
+    }
+    if ((parameters.asEigen<Eigen::ArrayXpr>() > upper.asEigen<Eigen::ArrayXpr>()).any()) {
+        return false;
+    }
+    if (inequalityVector.getSize<0>() > 0u) {
+        Vector values = inequalityMatrix.asEigen() * parameters.asEigen();
+        if ((values.array() < inequalityVector.asEigen<Eigen::ArrayXpr>()).any()) {
+            return false;
+        }
+    }
+    return true;
+}
+
 // ----------------- OptimizerObjective ---------------------------------------------------------------------
 
 void OptimizerObjective::fillObjectiveValueGrid(
@@ -57,6 +97,17 @@ void OptimizerObjective::fillObjectiveValueGrid(
     }
 }
 
+Scalar OptimizerObjective::computeNormalEquations(
+    ndarray::Array<Scalar const,1,1> const & parameters,
+    ndarray::Array<Scalar,1,1> const & jtr,
+    ndarray::Array<Scalar,2,1> const & jtj
+) const {
+    throw LSST_EXCEPT(
+        pex::exceptions::LogicError,
+        "Objective does not implement computeNormalEquations"
+    );
+}
+
 namespace {
 
 class LikelihoodOptimizerObjective : public OptimizerObjective {
@@ -67,7 +118,15 @@ public:
             likelihood->getDataDim(), likelihood->getNonlinearDim() + likelihood->getAmplitudeDim()
         ),
         _likelihood(likelihood), _prior(prior),
-        _modelMatrix(ndarray::allocate(likelihood->getDataDim(), likelihood->getAmplitudeDim()))
+        _modelMatrices([likelihood]() {
+            return std::unique_ptr<ModelMatrix>(
+                new ModelMatrix(
+                    detail::allocateTemporary<Pixel>(
+                        likelihood->getAmplitudeDim(), likelihood->getDataDim()
+                    ).transpose()
+                )
+            );
+        })
     {}
 
     void computeResiduals(
@@ -76,12 +135,33 @@ public:
     ) const override {
         int nlDim = _likelihood->getNonlinearDim();
         int ampDim = _likelihood->getAmplitudeDim();
-        _likelihood->computeModelMatrix(_modelMatrix, parameters[ndarray::view(0, nlDim)]);
-        residuals.asEigen() = _modelMatrix.asEigen().cast<Scalar>()
+        detail::WorkspacePool<ModelMatrix>::Lease modelMatrix = _modelMatrices.acquire();
+        _likelihood->computeModelMatrix(*modelMatrix, parameters[ndarray::view(0, nlDim)]);
+        residuals.asEigen() = modelMatrix->asEigen().cast<Scalar>()
             * parameters[ndarray::view(nlDim, nlDim+ampDim)].asEigen();
         residuals.asEigen() -= _likelihood->getData().asEigen().cast<Scalar>();
     }
 
+    bool supportsConcurrentEvaluation() const override {
+        return _likelihood->supportsConcurrentEvaluation();
+    }
+
+    PTR(OptimizerConstraints const) getConstraints() const override {
+        if (!_prior) {
+            return PTR(OptimizerConstraints const)();
+        }
+        int nlDim = _likelihood->getNonlinearDim();
+        int totDim = nlDim + _likelihood->getAmplitudeDim();
+        PTR(OptimizerConstraints) constraints = std::make_shared<OptimizerConstraints>(totDim);
+        bool hasBounds = _prior->fillBounds(
+            constraints->lower[ndarray::view(0, nlDim)],
+            constraints->upper[ndarray::view(0, nlDim)],
+            constraints->lower[ndarray::view(nlDim, totDim)],
+            constraints->upper[ndarray::view(nlDim, totDim)]
+        );
+        return hasBounds ? constraints : PTR(OptimizerConstraints const)();
+    }
+
     bool hasPrior() const override { return static_cast<bool>(_prior); }
 
     Scalar computePrior(ndarray::Array<Scalar const,1,1> const & parameters) const override {
@@ -111,9 +191,11 @@ public:
     }
 
 private:
+    typedef ndarray::Array<Pixel,2,-1> ModelMatrix;
+
     PTR(Likelihood) _likelihood;
     PTR(Prior) _prior;
-    ndarray::Array<Pixel,2,-1> _modelMatrix;
+    detail::WorkspacePool<ModelMatrix> _modelMatrices;  // one per concurrent computeResiduals call
 };
 
 } // anonymous
@@ -127,17 +209,25 @@ PTR(OptimizerObjective) OptimizerObjective::makeFromLikelihood(
 
 // ----------------- Optimizer::IterationData -----------------------------------------------------------------
 
-Optimizer::IterationData::IterationData(int dataSize, int parameterSize) :
+Optimizer::IterationData::IterationData(int dataSize, int parameterSize, bool useNormalEquations) :
     objectiveValue(0.0), priorValue(0.0),
-    parameters(ndarray::allocate(parameterSize)),
-    residuals(ndarray::allocate(dataSize))
-{}
+    parameters(detail::allocateTemporary<Scalar>(parameterSize))
+{
+    if (useNormalEquations) {
+        jtr = detail::allocateTemporary<Scalar>(parameterSize);
+        jtj = detail::allocateTemporary<Scalar>(parameterSize, parameterSize);
+    } else {
+        residuals = detail::allocateTemporary<Scalar>(dataSize);
+    }
+}
 
 void Optimizer::IterationData::swap(IterationData & other) {
     std::swap(objectiveValue, other.objectiveValue);
     std::swap(priorValue, other.priorValue);
     parameters.swap(other.parameters);
     residuals.swap(other.residuals);
+    jtr.swap(other.jtr);
+    jtj.swap(other.jtj);
 }
 
 // ----------------- OptimizerHistoryRecorder ---------------------------------------------------------------
@@ -320,21 +410,48 @@ void OptimizerHistoryRecorder::fillObjectiveModelGrid(
 
 // ----------------- Optimizer ------------------------------------------------------------------------------
 
+namespace {
+
+// Relative tolerance used to decide whether a constraint is active or violated.
+double const CONSTRAINT_TOLERANCE = 1E-10;
+
+bool useTruncatedCG(OptimizerControl const & ctrl, int parameterSize) {
+    if (ctrl.trustRegionSolver == "EIGEN") {
+        return false;
+    } else if (ctrl.trustRegionSolver == "CG") {
+        return true;
+    } else if (ctrl.trustRegionSolver == "AUTO") {
+        return parameterSize >= ctrl.truncatedCGThreshold;
+    }
+    throw LSST_EXCEPT(
+        pex::exceptions::InvalidParameterError,
+        "trustRegionSolver must be one of 'EIGEN', 'CG', or 'AUTO'"
+    );
+}
+
+} // anonymous
+
 Optimizer::Optimizer(
     PTR(Objective const) objective,
     ndarray::Array<Scalar const,1,1> const & parameters,
     Control const & ctrl
 ) :
     _state(0x0),
+    _outerIterCount(0),
+    _isRestored(false),
     _objective(objective),
     _ctrl(ctrl),
+    _useNormalEquations(ctrl.doUseNormalEquations && objective->hasNormalEquations()),
+    _useTruncatedCG(useTruncatedCG(ctrl, objective->parameterSize)),
+    _isSpeculative(ctrl.nTrialSteps > 1 && objective->supportsConcurrentEvaluation()),
+    _nTrials(0),
+    _nextTrial(0),
     _trustRadius(ctrl.trustRegionInitialSize),
-    _current(objective->dataSize, objective->parameterSize),
-    _next(objective->dataSize, objective->parameterSize),
-    _step(ndarray::allocate(objective->parameterSize)),
-    _gradient(ndarray::allocate(objective->parameterSize)),
-    _hessian(ndarray::allocate(objective->parameterSize, objective->parameterSize)),
-    _residualDerivative(ndarray::allocate(objective->dataSize, objective->parameterSize)),
+    _current(objective->dataSize, objective->parameterSize, _useNormalEquations),
+    _next(objective->dataSize, objective->parameterSize, _useNormalEquations),
+    _step(detail::allocateTemporary<Scalar>(objective->parameterSize)),
+    _gradient(detail::allocateTemporary<Scalar>(objective->parameterSize)),
+    _hessian(detail::allocateTemporary<Scalar>(objective->parameterSize, objective->parameterSize)),
     _sr1b(objective->parameterSize, objective->parameterSize),
     _sr1v(objective->parameterSize),
     _sr1jtr(objective->parameterSize)
@@ -348,9 +465,60 @@ Optimizer::Optimizer(
         );
     }
     _current.parameters.deep() = parameters;
-    _next.parameters.deep() = parameters;
-    _objective->computeResiduals(_current.parameters, _current.residuals);
-    _current.objectiveValue = 0.5*_current.residuals.asEigen().squaredNorm();
+    PTR(OptimizerConstraints const) constraints;
+    if (_ctrl.doUseConstraints) {
+        constraints = _objective->getConstraints();
+    }
+    if (constraints) {
+        int const n = _objective->parameterSize;
+        int const nInequalities = constraints->inequalityVector.getSize<0>();
+        if (constraints->lower.getSize<0>() != static_cast<std::size_t>(n)
+            || constraints->upper.getSize<0>() != static_cast<std::size_t>(n)
+            || constraints->inequalityMatrix.getSize<0>() != static_cast<std::size_t>(nInequalities)
+            || (nInequalities > 0
+                && constraints->inequalityMatrix.getSize<1>() != static_cast<std::size_t>(n))
+        ) {
+            throw LSST_EXCEPT(
+                pex::exceptions::LengthError,
+                "Constraint array sizes do not match objective"
+            );
+        }
+        // Gather bounds and inequalities into a single set of constraints A x >= b.
+        std::vector<int> lowerIndices;
+        std::vector<int> upperIndices;
+        for (int i = 0; i < n; ++i) {
+            if (std::isfinite(constraints->lower[i])) lowerIndices.push_back(i);
+            if (std::isfinite(constraints->upper[i])) upperIndices.push_back(i);
+        }
+        int const m = lowerIndices.size() + upperIndices.size() + nInequalities;
+        _constraintMatrix = Matrix::Zero(m, n);
+        _constraintVector = Vector::Zero(m);
+        int j = 0;
+        for (std::vector<int>::const_iterator i = lowerIndices.begin(); i != lowerIndices.end(); ++i, ++j) {
+            _constraintMatrix(j, *i) = 1.0;
+            _constraintVector[j] = constraints->lower[*i];
+        }
+        for (std::vector<int>::const_iterator i = upperIndices.begin(); i != upperIndices.end(); ++i, ++j) {
+            _constraintMatrix(j, *i) = -1.0;
+            _constraintVector[j] = -constraints->upper[*i];
+        }
+        if (nInequalities > 0) {
+            _constraintMatrix.bottomRows(nInequalities) = constraints->inequalityMatrix.asEigen();
+            _constraintVector.tail(nInequalities) = constraints->inequalityVector.asEigen();
+        }
+        // We can't do much about starting points that violate the inequalities (steps will just
+        // move towards them), but we can start within the bounds.
+        _current.parameters.asEigen<Eigen::ArrayXpr>() = _current.parameters.asEigen<Eigen::ArrayXpr>()
+            .max(constraints->lower.asEigen<Eigen::ArrayXpr>())
+            .min(constraints->upper.asEigen<Eigen::ArrayXpr>());
+    }
+    _next.parameters.deep() = _current.parameters;
+    if (!_useNormalEquations) {
+        // The Jacobian is only materialized when the objective can't accumulate J^T J itself.
+        _residualDerivative =
+            detail::allocateTemporary<Scalar>(objective->parameterSize, objective->dataSize).transpose();
+    }
+    _current.objectiveValue = _evaluate(_current);
     if (_objective->hasPrior()) {
         _current.priorValue = _objective->computePrior(_current.parameters);
         _current.objectiveValue -= std::log(_current.priorValue);
@@ -361,7 +529,34 @@ Optimizer::Optimizer(
     _hessian.asEigen() = _hessian.asEigen().selfadjointView<Eigen::Lower>();
 }
 
+Scalar Optimizer::_evaluate(IterationData & data) const {
+    if (_useNormalEquations) {
+        return _objective->computeNormalEquations(data.parameters, data.jtr, data.jtj);
+    }
+    _objective->computeResiduals(data.parameters, data.residuals);
+    return 0.5*data.residuals.asEigen().squaredNorm();
+}
+
 void Optimizer::_computeDerivatives() {
+    _gradient.deep() = 0.0;
+    _hessian.deep() = 0.0;
+    if (_objective->hasPrior()) {
+        _objective->differentiatePrior(_current.parameters, _gradient, _hessian);
+        // objective evaluates P(x); we want -ln P(x) and associated derivatives
+        _gradient.asEigen() /= -_current.priorValue;
+        _hessian.asEigen() /= -_current.priorValue;
+        _hessian.asEigen().selfadjointView<Eigen::Lower>().rankUpdate(_gradient.asEigen(), 1.0);
+    }
+    if (_useNormalEquations) {
+        // J^T r and J^T J were accumulated along with the objective value when the current
+        // parameters were evaluated, so there's no need to form J here.
+        if (!_ctrl.noSR1Term) {
+            _sr1jtr = _current.jtr.asEigen();
+        }
+        _gradient.asEigen() += _current.jtr.asEigen();
+        _hessian.asEigen().triangularView<Eigen::Lower>() += _current.jtj.asEigen();
+        return;
+    }
     ndarray::EigenView<Scalar,2,-2> resDer(_residualDerivative);
     resDer.setZero();
     _next.parameters.deep() = _current.parameters;
@@ -376,15 +571,6 @@ void Optimizer::_computeDerivatives() {
             _next.parameters[n] = _current.parameters[n];
         }
     }
-    _gradient.deep() = 0.0;
-    _hessian.deep() = 0.0;
-    if (_objective->hasPrior()) {
-        _objective->differentiatePrior(_current.parameters, _gradient, _hessian);
-        // objective evaluates P(x); we want -ln P(x) and associated derivatives
-        _gradient.asEigen() /= -_current.priorValue;
-        _hessian.asEigen() /= -_current.priorValue;
-        _hessian.asEigen().selfadjointView<Eigen::Lower>().rankUpdate(_gradient.asEigen(), 1.0);
-    }
     if (!_ctrl.noSR1Term) {
         _sr1jtr = resDer.adjoint() * _current.residuals.asEigen();
         _gradient.asEigen() += _sr1jtr;
@@ -394,43 +580,375 @@ void Optimizer::_computeDerivatives() {
     _hessian.asEigen().selfadjointView<Eigen::Lower>().rankUpdate(resDer.adjoint(), 1.0);
 }
 
+void Optimizer::_solveTrustRegion(
+    ndarray::Array<Scalar,1,1> const & x,
+    ndarray::Array<Scalar const,2,1> const & F, ndarray::Array<Scalar const,1,1> const & g,
+    double r
+) const {
+    if (_useTruncatedCG) {
+        // Standard inexact-Newton forcing sequence: solve loosely far from the solution, and more
+        // tightly as the gradient goes to zero (but never more tightly than the exact solver would).
+        double const tolerance = std::max(
+            std::min(0.5, std::sqrt(g.asEigen().norm())),
+            _ctrl.trustRegionSolverTolerance
+        );
+        solveTrustRegionCG(x, F, g, r, tolerance);
+    } else {
+        solveTrustRegion(x, F, g, r, _ctrl.trustRegionSolverTolerance);
+    }
+}
+
+void Optimizer::_constrainStep(ndarray::Array<Scalar,1,1> const & trialStep, double trustRadius) const {
+    // This is an active-set method: we repeatedly find the first constraint the step crosses, add it
+    // to the working set as an equality constraint, and re-solve the trust region subproblem on the
+    // subspace that leaves all working-set constraints satisfied exactly.  That lets the optimizer
+    // slide along bounds rather than shrinking the trust region until it can no longer reach them.
+    int const n = _objective->parameterSize;
+    int const m = _constraintMatrix.rows();
+    Vector const slack = _constraintMatrix * _current.parameters.asEigen() - _constraintVector;
+    Vector step = trialStep.asEigen();
+    std::vector<int> working;
+    while (static_cast<int>(working.size()) < n) {
+        Vector value = slack + _constraintMatrix * step;
+        int blocking = -1;
+        double minFraction = std::numeric_limits<double>::infinity();
+        for (int j = 0; j < m; ++j) {
+            if (value[j] >= -CONSTRAINT_TOLERANCE*(1.0 + std::abs(_constraintVector[j]))) continue;
+            if (std::find(working.begin(), working.end(), j) != working.end()) continue;
+            // fraction of the step at which we hit this constraint (zero if it's already violated)
+            double fraction = (slack[j] > 0.0) ? slack[j] / (slack[j] - value[j]) : 0.0;
+            if (fraction < minFraction) {
+                minFraction = fraction;
+                blocking = j;
+            }
+        }
+        if (blocking < 0) break;
+        working.push_back(blocking);
+        int const k = working.size();
+        Matrix wt(n, k);
+        Vector target(k);
+        for (int i = 0; i < k; ++i) {
+            wt.col(i) = _constraintMatrix.row(working[i]).adjoint();
+            target[i] = -slack[working[i]];
+        }
+        Eigen::HouseholderQR<Matrix> qr(wt);
+        if (std::abs(qr.matrixQR()(k - 1, k - 1)) <= CONSTRAINT_TOLERANCE*wt.col(k - 1).norm()) {
+            // new constraint is degenerate with the existing working set; fall back to shortening
+            working.pop_back();
+            break;
+        }
+        Matrix q = qr.householderQ();
+        // minimum-norm step that satisfies all working-set constraints exactly
+        Vector s0 = q.leftCols(k)
+            * qr.matrixQR().topRows(k).triangularView<Eigen::Upper>().transpose().solve(target);
+        double radius2 = trustRadius*trustRadius - s0.squaredNorm();
+        if (k == n || radius2 <= 0.0) {
+            step = s0;
+            continue;
+        }
+        // solve the trust region subproblem in the null space of the working set
+        Matrix z = q.rightCols(n - k);
+        ndarray::Array<Scalar,1,1> y = ndarray::allocate(n - k);
+        ndarray::Array<Scalar,1,1> gz = ndarray::allocate(n - k);
+        ndarray::Array<Scalar,2,2> hz = ndarray::allocate(n - k, n - k);
+        gz.asEigen() = z.adjoint() * (_gradient.asEigen() + _hessian.asEigen() * s0);
+        hz.asEigen() = z.adjoint() * _hessian.asEigen() * z;
+        _solveTrustRegion(y, hz, gz, std::sqrt(radius2));
+        step = s0 + z * y.asEigen();
+    }
+    // If anything is still violated (degenerate constraints, or running out of dimensions), shorten
+    // the step until it's feasible.
+    Vector value = slack + _constraintMatrix * step;
+    double fraction = 1.0;
+    for (int j = 0; j < m; ++j) {
+        if (value[j] < 0.0 && slack[j] > 0.0) {
+            fraction = std::min(fraction, slack[j] / (slack[j] - value[j]));
+        }
+    }
+    trialStep.asEigen() = fraction * step;
+}
+
+void Optimizer::_computeTrialSteps(int maxTrials) {
+    // Compute the sequence of steps the serial algorithm would try if each one were rejected in turn
+    // (see the trust radius updates for rejected steps in _stepImpl), then evaluate them concurrently.
+    // We never try more steps than the shared pool can evaluate at once; inside another parallel loop
+    // (e.g. CModelAlgorithm::applyCatalog) that means one at a time, which keeps the number of threads
+    // bounded by the outer loop's.
+    detail::ThreadPool & pool = detail::ThreadPool::getShared();
+    int const nTrials = std::min({_ctrl.nTrialSteps, maxTrials, pool.getAvailableThreadCount()});
+    while (static_cast<int>(_trials.size()) < nTrials) {
+        _trials.push_back(
+            IterationData(_objective->dataSize, _objective->parameterSize, _useNormalEquations)
+        );
+        _trialSteps.push_back(detail::allocateTemporary<Scalar>(_objective->parameterSize));
+    }
+    double radius = _trustRadius;
+    for (int k = 0; k < nTrials; ++k) {
+        _solveTrustRegion(_trialSteps[k], _hessian, _gradient, radius);
+        if (_constraintMatrix.rows() > 0) {
+            _constrainStep(_trialSteps[k], radius);
+        }
+        _trials[k].parameters.asEigen() = _current.parameters.asEigen() + _trialSteps[k].asEigen();
+        radius = std::min(radius, _trialSteps[k].asEigen().norm()) * _ctrl.trustRegionShrinkFactor;
+    }
+    // Priors are evaluated serially, because only the residual evaluation is required to be safe to
+    // call concurrently (see OptimizerObjective::supportsConcurrentEvaluation).
+    for (int k = 0; k < nTrials; ++k) {
+        IterationData & trial = _trials[k];
+        trial.objectiveValue = 0.0;
+        trial.priorValue = 1.0;
+        if (_objective->hasPrior()) {
+            trial.priorValue = _objective->computePrior(trial.parameters);
+            trial.objectiveValue = -std::log(trial.priorValue);
+        }
+    }
+    pool.parallelFor(
+        nTrials,
+        [this](int k, int) {
+            IterationData & trial = _trials[k];
+            if (trial.priorValue <= 0.0 || std::isnan(trial.objectiveValue)) {
+                return;  // will be rejected without looking at the residuals
+            }
+            trial.objectiveValue += _evaluate(trial);
+        }
+    );
+    _nTrials = nTrials;
+    _nextTrial = 0;
+}
+
+Scalar Optimizer::_computeProjectedGradientNorm() const {
+    int const n = _objective->parameterSize;
+    int const m = _constraintMatrix.rows();
+    Vector gradient = _gradient.asEigen();
+    // Remove the components of the gradient that are blocked by active constraints: the descent
+    // direction is -g, so an active constraint with a^T g > 0 prevents us from moving along it.
+    std::vector<int> blocking;
+    if (m > 0) {
+        Vector const slack = _constraintMatrix * _current.parameters.asEigen() - _constraintVector;
+        for (int j = 0; j < m; ++j) {
+            if (slack[j] <= CONSTRAINT_TOLERANCE*(1.0 + std::abs(_constraintVector[j]))
+                && _constraintMatrix.row(j).dot(gradient) > 0.0) {
+                blocking.push_back(j);
+            }
+        }
+    }
+    if (!blocking.empty()) {
+        Matrix wt(n, blocking.size());
+        for (std::size_t i = 0; i < blocking.size(); ++i) {
+            wt.col(i) = _constraintMatrix.row(blocking[i]).adjoint();
+        }
+        Eigen::ColPivHouseholderQR<Matrix> qr(wt);
+        int const rank = qr.rank();
+        if (rank >= n) {
+            return 0.0;
+        }
+        Matrix q = qr.householderQ();
+        gradient = q.rightCols(n - rank) * (q.rightCols(n - rank).adjoint() * gradient);
+    }
+    return gradient.lpNorm<Eigen::Infinity>();
+}
+
 void Optimizer::removeSR1Term() {
    _hessian.asEigen() -= _sr1b;
 }
 
+ndarray::Array<Scalar const,1,1> Optimizer::getResiduals() const {
+    if (_useNormalEquations) {
+        throw LSST_EXCEPT(
+            pex::exceptions::LogicError,
+            "Residuals are not available when the objective's normal equations are used; "
+            "set OptimizerControl.doUseNormalEquations=False to compute them"
+        );
+    }
+    return _current.residuals;
+}
+
+// ----------------- Optimizer checkpoints ------------------------------------------------------------------
+
+namespace {
+
+// Identifies (and versions) the blobs written by Optimizer::saveState.
+std::uint32_t const OPTIMIZER_STATE_MAGIC = 0x4d4f5331;  // "MOS1"
+
+// Appends fixed-size values and arrays of Scalars to a binary blob.
+class StateWriter {
+public:
+
+    template <typename T>
+    void put(T const & value) { _put(&value, sizeof(T)); }
+
+    void put(Scalar const * data, int size) { _put(data, sizeof(Scalar)*size); }
+
+    std::string const & get() const { return _blob; }
+
+private:
+
+    void _put(void const * data, std::size_t size) {
+        _blob.append(reinterpret_cast<char const *>(data), size);
+    }
+
+    std::string _blob;
+};
+
+// Reads back the values written by a StateWriter, in the same order.
+class StateReader {
+public:
+
+    explicit StateReader(std::string const & blob) : _blob(blob), _position(0) {}
+
+    template <typename T>
+    T get() {
+        T value;
+        _get(&value, sizeof(T));
+        return value;
+    }
+
+    void get(Scalar * data, int size) { _get(data, sizeof(Scalar)*size); }
+
+    bool atEnd() const { return _position == _blob.size(); }
+
+private:
+
+    void _get(void * data, std::size_t size) {
+        if (_position + size > _blob.size()) {
+            throw LSST_EXCEPT(
+                pex::exceptions::InvalidParameterError,
+                "Optimizer state blob is truncated"
+            );
+        }
+        std::memcpy(data, _blob.data() + _position, size);
+        _position += size;
+    }
+
+    std::string const & _blob;
+    std::size_t _position;
+};
+
+} // anonymous
+
+std::string Optimizer::saveState() const {
+    int const n = _objective->parameterSize;
+    StateWriter writer;
+    writer.put(OPTIMIZER_STATE_MAGIC);
+    writer.put(std::int32_t(n));
+    writer.put(std::int32_t(_state));
+    writer.put(std::int32_t(_outerIterCount));
+    writer.put(_trustRadius);
+    writer.put(_current.parameters.getData(), n);
+    writer.put(_gradient.getData(), n);
+    writer.put(_hessian.getData(), n*n);
+    writer.put(_sr1b.data(), n*n);
+    writer.put(_sr1jtr.data(), n);
+    return writer.get();
+}
+
+void Optimizer::restoreState(std::string const & state) {
+    int const n = _objective->parameterSize;
+    StateReader reader(state);
+    if (reader.get<std::uint32_t>() != OPTIMIZER_STATE_MAGIC) {
+        throw LSST_EXCEPT(
+            pex::exceptions::InvalidParameterError,
+            "Blob is not a saved Optimizer state"
+        );
+    }
+    int const savedSize = reader.get<std::int32_t>();
+    LSST_THROW_IF_NE(
+        savedSize, n,
+        pex::exceptions::LengthError,
+        "Saved Optimizer state has %d parameters; objective has %d"
+    );
+    int const savedState = reader.get<std::int32_t>();
+    int const outerIterCount = reader.get<std::int32_t>();
+    double const trustRadius = reader.get<double>();
+    // Read into temporaries, so a bad blob leaves this optimizer unchanged.
+    Vector parameters(n);
+    Vector gradient(n);
+    Matrix hessian(n, n);
+    Matrix sr1b(n, n);
+    Vector sr1jtr(n);
+    reader.get(parameters.data(), n);
+    reader.get(gradient.data(), n);
+    reader.get(hessian.data(), n*n);  // saved row-major, but it's symmetric
+    reader.get(sr1b.data(), n*n);
+    reader.get(sr1jtr.data(), n);
+    if (!reader.atEnd()) {
+        throw LSST_EXCEPT(
+            pex::exceptions::InvalidParameterError,
+            "Optimizer state blob has trailing data"
+        );
+    }
+    _state = savedState;
+    _outerIterCount = outerIterCount;
+    _isRestored = true;
+    _trustRadius = trustRadius;
+    _nTrials = _nextTrial = 0;
+    _current.parameters.asEigen() = parameters;
+    _gradient.asEigen() = gradient;
+    _hessian.asEigen() = hessian;
+    _sr1b = sr1b;
+    _sr1jtr = sr1jtr;
+    _current.objectiveValue = _evaluate(_current);
+    if (_objective->hasPrior()) {
+        _current.priorValue = _objective->computePrior(_current.parameters);
+        _current.objectiveValue -= std::log(_current.priorValue);
+    }
+    _next.parameters.deep() = _current.parameters;
+}
+
 bool Optimizer::_stepImpl(
     int outerIterCount,
     HistoryRecorder const * recorder,
     afw::table::BaseCatalog * history
 ) {
+    PerfScope perfScope(PerfCounters::OPTIMIZER_STEP);
     LOG_LOGGER trace5Logger = LOG_GET("TRACE5.meas.modelfit.optimizer.Optimizer");
     LOG_LOGGER trace3Logger = LOG_GET("TRACE3.meas.modelfit.optimizer.Optimizer");
     _state &= ~int(STATUS);
-    if (_gradient.asEigen().lpNorm<Eigen::Infinity>() <= _ctrl.gradientThreshold) {
-        LOGL_DEBUG(trace3Logger, "max(gradient)=%g below threshold; declaring convergence",
-                   _gradient.asEigen().lpNorm<Eigen::Infinity>());
+    _nTrials = _nextTrial = 0;
+    Scalar gradientNorm = _computeProjectedGradientNorm();
+    if (gradientNorm <= _ctrl.gradientThreshold) {
+        LOGL_DEBUG(trace3Logger, "max(gradient)=%g below threshold; declaring convergence", gradientNorm);
         _state |= CONVERGED_GRADZERO;
         return false;
     }
     for (int innerIterCount = 0; innerIterCount < _ctrl.maxInnerIterations; ++innerIterCount) {
         LOGL_DEBUG(trace5Logger, "Starting inner iteration %d", innerIterCount);
         _state &= ~int(STATUS);
-        _next.objectiveValue = 0.0;
-        _next.priorValue = 1.0;
-        solveTrustRegion(
-            _step, _hessian, _gradient, _trustRadius, _ctrl.trustRegionSolverTolerance
-        );
-        _next.parameters.asEigen() = _current.parameters.asEigen() + _step.asEigen();
+        if (_isSpeculative) {
+            // Trial steps (and their objective values) are computed in concurrent batches; we
+            // just take the next one in sequence.
+            if (_nextTrial == _nTrials) {
+                _computeTrialSteps(_ctrl.maxInnerIterations - innerIterCount);
+            }
+            _next.swap(_trials[_nextTrial]);
+            _step.deep() = _trialSteps[_nextTrial];
+            ++_nextTrial;
+        } else {
+            _next.objectiveValue = 0.0;
+            _next.priorValue = 1.0;
+            _solveTrustRegion(_step, _hessian, _gradient, _trustRadius);
+            if (_constraintMatrix.rows() > 0) {
+                _constrainStep(_step, _trustRadius);
+            }
+            _next.parameters.asEigen() = _current.parameters.asEigen() + _step.asEigen();
+        }
         double stepLength = _step.asEigen().norm();
         if (std::isnan(stepLength)) {
             LOGL_DEBUG(trace3Logger, "NaN encountered in step length");
             _state |= FAILED_NAN;
             return false;
         }
+        if (stepLength == 0.0 && _constraintMatrix.rows() > 0) {
+            LOGL_DEBUG(trace3Logger, "Step is completely blocked by constraints; declaring convergence");
+            _state |= CONVERGED_GRADZERO;
+            return false;
+        }
         LOGL_DEBUG(trace5Logger, "Step has length %g", stepLength);
         if (_objective->hasPrior()) {
-            _next.priorValue = _objective->computePrior(_next.parameters);
-            _next.objectiveValue = -std::log(_next.priorValue);
+            if (!_isSpeculative) {
+                _next.priorValue = _objective->computePrior(_next.parameters);
+                _next.objectiveValue = -std::log(_next.priorValue);
+            }
             if (_next.priorValue <= 0.0 || std::isnan(_next.objectiveValue)) {
                 _next.objectiveValue = std::numeric_limits<Scalar>::infinity();
                 LOGL_DEBUG(trace5Logger, "Rejecting step due to zero prior");
@@ -455,8 +973,9 @@ bool Optimizer::_stepImpl(
                 continue;
             }
         }
-        _objective->computeResiduals(_next.parameters, _next.residuals);
-        _next.objectiveValue += 0.5*_next.residuals.asEigen().squaredNorm();
+        if (!_isSpeculative) {
+            _next.objectiveValue += _evaluate(_next);
+        }
         double actualChange = _next.objectiveValue - _current.objectiveValue;
         double predictedChange = _step.asEigen().dot(
             _gradient.asEigen() + 0.5*_hessian.asEigen()*_step.asEigen()
@@ -473,6 +992,7 @@ bool Optimizer::_stepImpl(
                        _current.objectiveValue);
             _state |= STATUS_STEP_ACCEPTED;
             _current.swap(_next);
+            _nTrials = _nextTrial = 0;  // remaining trial steps were relative to the old parameters
             if (!_ctrl.noSR1Term) {
                 _sr1v = -_sr1jtr;
             }
@@ -533,22 +1053,34 @@ bool Optimizer::_stepImpl(
     return false;
 }
 
-int Optimizer::_runImpl(HistoryRecorder const * recorder, afw::table::BaseCatalog * history) {
+bool Optimizer::_nextStep(HistoryRecorder const * recorder, afw::table::BaseCatalog * history) {
+    if (!_stepImpl(_outerIterCount, recorder, history)) return false;
+    ++_outerIterCount;
+    return true;
+}
+
+int Optimizer::_runImpl(
+    HistoryRecorder const * recorder,
+    afw::table::BaseCatalog * history,
+    StepCallback const * onStep
+) {
     LOG_LOGGER trace5Logger = LOG_GET("TRACE5.meas.modelfit.optimizer.Optimizer");
     LOG_LOGGER trace3Logger = LOG_GET("TRACE3.meas.modelfit.optimizer.Optimizer");
-    if (recorder) recorder->apply(-1, -1, *history, *this);
-    int outerIterCount = 0;
+    if (recorder && _outerIterCount == 0) recorder->apply(-1, -1, *history, *this);
+    int const maxOuterIterCount = (_isRestored ? 0 : _outerIterCount) + _ctrl.maxOuterIterations;
+    _isRestored = false;
     try {
-        for (; outerIterCount < _ctrl.maxOuterIterations; ++outerIterCount) {
-            LOGL_DEBUG(trace5Logger, "Starting outer iteration %d", outerIterCount);
-            if (!_stepImpl(outerIterCount, recorder, history)) return outerIterCount;
+        while (_outerIterCount < maxOuterIterCount) {
+            LOGL_DEBUG(trace5Logger, "Starting outer iteration %d", _outerIterCount);
+            if (!_nextStep(recorder, history)) return _outerIterCount;
+            if (onStep && *onStep) (*onStep)(*this);
         }
         _state |= FAILED_MAX_OUTER_ITERATIONS;
         LOGL_DEBUG(trace3Logger, "Max outer iteration number exceeded");
     } catch (...) {
         _state |= FAILED_EXCEPTION;
     }
-    return outerIterCount;
+    return _outerIterCount;
 }
 
 
@@ -626,4 +1158,58 @@ void solveTrustRegion(
     return;
 }
 
+void solveTrustRegionCG(
+    ndarray::Array<Scalar,1,1> const & x,
+    ndarray::Array<Scalar const,2,1> const & F,
+    ndarray::Array<Scalar const,1,1> const & g,
+    double r, double tolerance
+) {
+    LOG_LOGGER trace5Logger = LOG_GET("TRACE5.meas.modelfit.optimizer.Optimizer");
+    int const d = g.getSize<0>();
+    auto z = x.asEigen();
+    z.setZero();
+    Vector res = g.asEigen();
+    double resNorm2 = res.squaredNorm();
+    double const threshold2 = tolerance * tolerance * resNorm2;
+    if (resNorm2 == 0.0) {
+        LOGL_DEBUG(trace5Logger, "Ending with zero gradient");
+        return;
+    }
+    Vector p = -res;
+    Vector fp(d);
+    // Return tau >= 0 such that ||z + tau p|| == r.
+    auto toBoundary = [&z, &p, r]() {
+        double const pp = p.squaredNorm();
+        double const zp = z.dot(p);
+        double const zz = z.squaredNorm();
+        return (-zp + std::sqrt(std::max(zp*zp + pp*(r*r - zz), 0.0))) / pp;
+    };
+    for (int nIter = 0; nIter < d; ++nIter) {
+        fp.noalias() = F.asEigen().selfadjointView<Eigen::Lower>() * p;
+        double const curvature = p.dot(fp);
+        if (curvature <= 0.0) {
+            LOGL_DEBUG(trace5Logger, "Ending at iteration %d; found direction of nonpositive curvature",
+                       nIter);
+            z += toBoundary() * p;
+            return;
+        }
+        double const alpha = resNorm2 / curvature;
+        if ((z + alpha*p).squaredNorm() >= r*r) {
+            LOGL_DEBUG(trace5Logger, "Ending at iteration %d; step reached trust radius %f", nIter, r);
+            z += toBoundary() * p;
+            return;
+        }
+        z += alpha * p;
+        res += alpha * fp;
+        double const newResNorm2 = res.squaredNorm();
+        if (newResNorm2 <= threshold2) {
+            LOGL_DEBUG(trace5Logger, "Ending at iteration %d; ||x||=%f, r=%f", nIter, z.norm(), r);
+            return;
+        }
+        p = -res + (newResNorm2 / resNorm2) * p;
+        resNorm2 = newResNorm2;
+    }
+    LOGL_DEBUG(trace5Logger, "Ending after %d iterations; ||x||=%f, r=%f", d, z.norm(), r);
+}
+
 }}} // namespace lsst::meas::modelfit
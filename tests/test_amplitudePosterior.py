@@ -0,0 +1,147 @@
+#
+# LSST Data Management System
+#
+# Copyright 2008-2016  AURA/LSST.
+#
+# This product includes software developed by the
+# LSST Project (http://www.lsst.org/).
+#
+# This program is free software: you can redistribute it and/or modify
+# it under the terms of the GNU General Public License as published by
+# the Free Software Foundation, either version 3 of the License, or
+# (at your option) any later version.
+#
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU General Public License for more details.
+#
+# You should have received a copy of the LSST License Statement and
+# the GNU General Public License along with this program.  If not,
+# see <https://www.lsstcorp.org/LegalNotices/>.
+#
+import unittest
+import numpy
+
+import lsst.utils.tests
+import lsst.afw.math
+import lsst.meas.modelfit
+
+Scalar = lsst.meas.modelfit.Scalar
+
+
+class AmplitudePosteriorTestCase(lsst.utils.tests.TestCase):
+
+    def setUp(self):
+        numpy.random.seed(500)
+        self.nonlinear = numpy.array([0.1, -0.2, 0.5], dtype=Scalar)
+        # A 1-d likelihood peaked at a positive amplitude, and a 2-d one whose unconstrained peak
+        # has a negative second amplitude, so the maximum is on the boundary.
+        self.likelihoods = [
+            (numpy.array([-2.0], dtype=Scalar), numpy.array([[1.5]], dtype=Scalar)),
+            (numpy.array([-1.0, 0.5], dtype=Scalar), numpy.array([[2.0, 0.3], [0.3, 1.0]], dtype=Scalar)),
+        ]
+        # A single unit Gaussian centered on self.nonlinear, so its density there is (2 pi)^(-3/2).
+        component = lsst.meas.modelfit.Mixture.Component(1.0, self.nonlinear, numpy.identity(3))
+        self.mixturePrior = lsst.meas.modelfit.MixturePrior(lsst.meas.modelfit.Mixture(3, [component]))
+        self.priors = [
+            self.mixturePrior,
+            lsst.meas.modelfit.SemiEmpiricalPrior(lsst.meas.modelfit.SemiEmpiricalPrior.Control()),
+            lsst.meas.modelfit.SoftenedLinearPrior(lsst.meas.modelfit.SoftenedLinearPrior.Control()),
+        ]
+
+    def tearDown(self):
+        del self.mixturePrior
+        del self.priors
+
+    def drawAmplitudes(self, draw, n, nSamples=50):
+        """Call draw(rng, amplitudes, weights) with a freshly-seeded random number generator, and
+        return the amplitudes and weights.
+        """
+        rng = lsst.afw.math.Random("MT19937", 500)
+        amplitudes = numpy.zeros((nSamples, n), dtype=Scalar)
+        weights = numpy.zeros(nSamples, dtype=Scalar)
+        draw(rng, amplitudes, weights)
+        return amplitudes, weights
+
+    def testPriorMethods(self):
+        """Test that an AmplitudePosterior gives the same results as the per-call Prior methods and
+        the TruncatedGaussian they are built on, in one and two dimensions.
+        """
+        for prior in self.priors:
+            for gradient, hessian in self.likelihoods:
+                n = gradient.size
+                nonlinearTerm = -numpy.log(prior.evaluate(self.nonlinear, numpy.ones(n, dtype=Scalar)))
+                self.assertTrue(numpy.isfinite(nonlinearTerm))
+                posterior = prior.makeAmplitudePosterior(gradient, hessian, self.nonlinear)
+                tg = lsst.meas.modelfit.TruncatedGaussian.fromSeriesParameters(0.0, gradient, hessian)
+
+                self.assertFloatsAlmostEqual(posterior.marginalize(),
+                                             prior.marginalize(gradient, hessian, self.nonlinear),
+                                             rtol=1E-14)
+                self.assertFloatsAlmostEqual(posterior.marginalize(), tg.getLogIntegral() + nonlinearTerm,
+                                             rtol=1E-14)
+
+                amplitudes1 = numpy.zeros(n, dtype=Scalar)
+                amplitudes2 = numpy.zeros(n, dtype=Scalar)
+                q1 = posterior.maximize(amplitudes1)
+                q2 = prior.maximize(gradient, hessian, self.nonlinear, amplitudes2)
+                self.assertFloatsAlmostEqual(amplitudes1, amplitudes2, rtol=1E-14)
+                self.assertFloatsAlmostEqual(amplitudes1, tg.maximize(), rtol=1E-14)
+                self.assertFloatsAlmostEqual(q1, q2, rtol=1E-14)
+                self.assertFloatsAlmostEqual(q1, tg.evaluateLog()(amplitudes1) + nonlinearTerm, rtol=1E-14)
+
+                # All three draw the same samples from the same random number sequence.
+                samples1, weights1 = self.drawAmplitudes(posterior.drawAmplitudes, n)
+                samples2, weights2 = self.drawAmplitudes(
+                    lambda rng, a, w: prior.drawAmplitudes(gradient, hessian, self.nonlinear, rng, a, w),
+                    n
+                )
+                samples3, weights3 = self.drawAmplitudes(tg.sample(), n)
+                self.assertFloatsEqual(samples1, samples2)
+                self.assertFloatsEqual(weights1, weights2)
+                self.assertFloatsEqual(samples1, samples3)
+                self.assertFloatsEqual(weights1, weights3)
+                self.assertTrue((samples1 >= 0.0).all())
+                self.assertTrue((weights1 > 0.0).all())
+                self.assertTrue(numpy.isfinite(weights1).all())
+
+    def testDirectConstruction(self):
+        """Test that constructing an AmplitudePosterior from the nonlinear prior density is equivalent
+        to asking the Prior for one.
+        """
+        density = self.mixturePrior.evaluate(self.nonlinear, numpy.ones(2, dtype=Scalar))
+        gradient, hessian = self.likelihoods[1]
+        direct = lsst.meas.modelfit.AmplitudePosterior(gradient, hessian, density)
+        posterior = self.mixturePrior.makeAmplitudePosterior(gradient, hessian, self.nonlinear)
+        self.assertFloatsAlmostEqual(direct.marginalize(), posterior.marginalize(), rtol=1E-14)
+
+    def testMixturePriorMaximize(self):
+        """Test the value returned by MixturePrior.maximize, which includes -log of the prior density
+        of the nonlinear parameters as well as the amplitude term.
+        """
+        nonlinearTerm = 1.5*numpy.log(2.0*numpy.pi)
+        # 1-d: the peak of q(a) = -2 a + 0.75 a^2 is at a = 4/3, where q = -4/3.
+        gradient, hessian = self.likelihoods[0]
+        amplitudes = numpy.zeros(1, dtype=Scalar)
+        q = self.mixturePrior.maximize(gradient, hessian, self.nonlinear, amplitudes)
+        self.assertFloatsAlmostEqual(amplitudes, numpy.array([4.0/3.0]), rtol=1E-12)
+        self.assertFloatsAlmostEqual(q, -4.0/3.0 + nonlinearTerm, rtol=1E-12)
+        # 2-d: the constrained peak is at (1/2, 0), where q = -1/2 + 1/4.
+        gradient, hessian = self.likelihoods[1]
+        amplitudes = numpy.zeros(2, dtype=Scalar)
+        q = self.mixturePrior.maximize(gradient, hessian, self.nonlinear, amplitudes)
+        self.assertFloatsAlmostEqual(amplitudes, numpy.array([0.5, 0.0]), rtol=1E-12, atol=1E-12)
+        self.assertFloatsAlmostEqual(q, -0.25 + nonlinearTerm, rtol=1E-12)
+
+
+class TestMemory(lsst.utils.tests.MemoryTestCase):
+    pass
+
+
+def setup_module(module):
+    lsst.utils.tests.init()
+
+if __name__ == "__main__":
+    lsst.utils.tests.init()
+    unittest.main()
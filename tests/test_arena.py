@@ -0,0 +1,135 @@
+#
+# LSST Data Management System
+#
+# Copyright 2008-2016  AURA/LSST.
+#
+# This product includes software developed by the
+# LSST Project (http://www.lsst.org/).
+#
+# This program is free software: you can redistribute it and/or modify
+# it under the terms of the GNU General Public License as published by
+# the Free Software Foundation, either version 3 of the License, or
+# (at your option) any later version.
+#
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU General Public License for more details.
+#
+# You should have received a copy of the LSST License Statement and
+# the GNU General Public License along with this program.  If not,
+# see <https://www.lsstcorp.org/LegalNotices/>.
+#
+import unittest
+import numpy
+
+import lsst.utils.tests
+import lsst.meas.modelfit
+
+Arena = lsst.meas.modelfit.detail.Arena
+ArenaScope = lsst.meas.modelfit.detail.ArenaScope
+allocateTemporary = lsst.meas.modelfit.detail.allocateTemporary
+
+
+def getAddress(array):
+    return array.__array_interface__["data"][0]
+
+
+class ArenaTestCase(lsst.utils.tests.TestCase):
+
+    def setUp(self):
+        numpy.random.seed(500)
+
+    def testAllocate(self):
+        """Test that arrays are aligned, distinct, and carved out of a single block.
+        """
+        arena = Arena(blockSize=1 << 16)
+        a = arena.allocate(10)
+        b = arena.allocate(3, 5)
+        self.assertEqual(a.shape, (10,))
+        self.assertEqual(b.shape, (3, 5))
+        self.assertEqual(getAddress(a) % Arena.ALIGNMENT, 0)
+        self.assertEqual(getAddress(b) % Arena.ALIGNMENT, 0)
+        self.assertGreaterEqual(getAddress(b), getAddress(a) + a.nbytes)
+        self.assertGreaterEqual(arena.getBytesUsed(), a.nbytes + b.nbytes)
+        self.assertEqual(arena.getBytesReserved(), 1 << 16)
+        # a request larger than the block size gets a block of its own
+        c = arena.allocate(1 << 14)
+        self.assertEqual(c.shape, (1 << 14,))
+        self.assertGreater(arena.getBytesReserved(), (1 << 16) + c.nbytes)
+
+    def testResetWithOutstandingArrays(self):
+        """Test that arrays allocated before a reset stay valid, and aren't overwritten by arrays
+        allocated after it.
+        """
+        arena = Arena(blockSize=1 << 16)
+        a = arena.allocate(100)
+        a[:] = numpy.random.randn(100)
+        expected = a.copy()
+        arena.reset()
+        self.assertEqual(arena.getBytesUsed(), 0)
+        # the block is still referenced by a, so the arena gives it up instead of recycling it
+        self.assertEqual(arena.getBytesReserved(), 0)
+        b = arena.allocate(100)
+        b[:] = -1.0
+        self.assertNotEqual(getAddress(a), getAddress(b))
+        self.assertFloatsEqual(a, expected)
+
+    def testReuse(self):
+        """Test that blocks no longer referenced by any array are reused after a reset.
+        """
+        arena = Arena(blockSize=1 << 16)
+        a = arena.allocate(100)
+        address = getAddress(a)
+        del a
+        arena.reset()
+        b = arena.allocate(100)
+        self.assertEqual(getAddress(b), address)
+        self.assertEqual(arena.getBytesReserved(), 1 << 16)
+
+    def testArenaScope(self):
+        """Test allocateTemporary inside and outside ArenaScope.
+        """
+        self.assertIsNone(Arena.getActive())
+        with ArenaScope():
+            arena = Arena.getActive()
+            self.assertIsNotNone(arena)
+            with ArenaScope():
+                # nested scopes use (and don't reset) the outer arena
+                a = allocateTemporary(100)
+                a[:] = numpy.random.randn(100)
+                expected = a.copy()
+            self.assertGreater(arena.getBytesUsed(), 0)
+            b = allocateTemporary(100)
+            address = getAddress(b)
+            del b
+        self.assertIsNone(Arena.getActive())
+        # a outlives the scope that allocated it
+        self.assertFloatsEqual(a, expected)
+        with ArenaScope():
+            # a's block was released to a, so this comes from a new (or recycled) block
+            c = allocateTemporary(100)
+            c[:] = 0.0
+            self.assertNotEqual(getAddress(c), address)
+            address = getAddress(c)
+            del c
+        with ArenaScope():
+            # ...which nothing referenced when the last scope ended, so it is reused
+            d = allocateTemporary(100)
+            self.assertEqual(getAddress(d), address)
+        self.assertFloatsEqual(a, expected)
+        # outside any scope, arrays come from the heap
+        e = allocateTemporary(3, 4)
+        self.assertEqual(e.shape, (3, 4))
+
+
+class TestMemory(lsst.utils.tests.MemoryTestCase):
+    pass
+
+
+def setup_module(module):
+    lsst.utils.tests.init()
+
+if __name__ == "__main__":
+    lsst.utils.tests.init()
+    unittest.main()
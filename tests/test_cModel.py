@@ -28,6 +28,7 @@ import lsst.utils.tests
 import lsst.shapelet
 import lsst.afw.geom.ellipses
 import lsst.afw.image
+import lsst.afw.table
 import lsst.log
 import lsst.log.utils
 import lsst.meas.modelfit
@@ -147,6 +148,113 @@ class CModelTestCase(lsst.utils.tests.TestCase):
             self.assertFloatsAlmostEqual(psfFlux, cmodel.flux, rtol=0.1/fluxFactor**0.5)
             self.assertFloatsAlmostEqual(psfFluxSigma, cmodel.fluxSigma, rtol=0.1/fluxFactor**0.5)
 
+    def testAdaptiveComponents(self):
+        """Test that faint sources are fit with the reduced-complexity bases, and that their fluxes
+        are close to those from the full bases.
+        """
+        exposure = self.exposure.Factory(self.exposure, True)
+        exposure.getMaskedImage().getVariance().getArray()[:] = 1.0
+        exposure.getMaskedImage().getImage().getArray()[:] += \
+            numpy.random.randn(exposure.getHeight(), exposure.getWidth())
+        psf = makeMultiShapeletCircularGaussian(self.psfSigma)
+        moments = self.exposure.getPsf().computeShape()
+        ctrl = lsst.meas.modelfit.CModelControl()
+        full = lsst.meas.modelfit.CModelAlgorithm(ctrl).apply(exposure, psf, self.xyPosition, moments)
+        for stageCtrl in (ctrl.exp, ctrl.dev):
+            stageCtrl.adaptiveSnThresholds = [1E6]
+            stageCtrl.adaptiveComponents = [3]
+        reduced = lsst.meas.modelfit.CModelAlgorithm(ctrl).apply(exposure, psf, self.xyPosition, moments)
+        for fullStage, reducedStage in ((full.exp, reduced.exp), (full.dev, reduced.dev)):
+            self.assertEqual(reducedStage.model.getBasisVector()[0].getComponentCount(), 3)
+            self.assertGreater(fullStage.model.getBasisVector()[0].getComponentCount(), 3)
+            self.assertFalse(reducedStage.flags[reducedStage.FAILED])
+        self.assertFalse(reduced.flags[reduced.FAILED])
+        self.assertFloatsAlmostEqual(reduced.flux, full.flux, atol=0.25*full.fluxSigma)
+        # Thresholds below the source's signal-to-noise leave the full bases in place.
+        for stageCtrl in (ctrl.exp, ctrl.dev):
+            stageCtrl.adaptiveSnThresholds = [1E-3]
+        bright = lsst.meas.modelfit.CModelAlgorithm(ctrl).apply(exposure, psf, self.xyPosition, moments)
+        self.assertEqual(bright.flux, full.flux)
+        # The initial fit's signal-to-noise isn't available without flux uncertainties.
+        ctrl.doFluxSigma = False
+        with self.assertRaises(lsst.meas.base.FatalAlgorithmError):
+            lsst.meas.modelfit.CModelAlgorithm(ctrl)
+        ctrl.doFluxSigma = True
+        # Mismatched lists are a configuration error.
+        ctrl.exp.adaptiveComponents = [3, 2]
+        with self.assertRaises(lsst.meas.base.FatalAlgorithmError):
+            lsst.meas.modelfit.CModelAlgorithm(ctrl)
+
+    def testOptionalOutputs(self):
+        """Test that disabling optional outputs leaves them unset (and out of the schema) without
+        changing the fluxes.
+        """
+        exposure = self.exposure.Factory(self.exposure, True)
+        exposure.getMaskedImage().getVariance().getArray()[:] = 1.0
+        exposure.getMaskedImage().getImage().getArray()[:] += \
+            numpy.random.randn(exposure.getHeight(), exposure.getWidth())
+        psf = makeMultiShapeletCircularGaussian(self.psfSigma)
+        moments = self.exposure.getPsf().computeShape()
+        ctrl = lsst.meas.modelfit.CModelControl()
+        full = lsst.meas.modelfit.CModelAlgorithm(ctrl).apply(exposure, psf, self.xyPosition, moments)
+        ctrl.doFluxInner = False
+        ctrl.doFluxSigma = False
+        ctrl.doEllipses = False
+        minimal = lsst.meas.modelfit.CModelAlgorithm(ctrl).apply(exposure, psf, self.xyPosition, moments)
+        self.assertFalse(minimal.flags[minimal.FAILED])
+        self.assertEqual(minimal.flux, full.flux)
+        self.assertEqual(minimal.fracDev, full.fracDev)
+        self.assertTrue(numpy.isnan(minimal.fluxSigma))
+        self.assertTrue(numpy.isnan(minimal.fluxInner))
+        for fullStage, minimalStage in ((full.initial, minimal.initial), (full.exp, minimal.exp),
+                                        (full.dev, minimal.dev)):
+            self.assertEqual(minimalStage.flux, fullStage.flux)
+            self.assertTrue(numpy.isnan(minimalStage.fluxSigma))
+            self.assertTrue(numpy.isnan(minimalStage.fluxInner))
+            self.assertTrue(numpy.isnan(minimalStage.ellipse.getIxx()))
+        schema = lsst.afw.table.SourceTable.makeMinimalSchema()
+        lsst.meas.modelfit.DoubleShapeletPsfApproxAlgorithm(
+            lsst.meas.modelfit.DoubleShapeletPsfApproxControl(), "modelfit_DoubleShapeletPsfApprox", schema
+        )
+        lsst.meas.modelfit.CModelAlgorithm("cmodel", ctrl, schema)
+        self.assertNotIn("cmodel_flux_inner", schema.getNames())
+        self.assertNotIn("cmodel_exp_ellipse_xx", schema.getNames())
+        self.assertIn("cmodel_flux", schema.getNames())
+        self.assertIn("cmodel_fluxSigma", schema.getNames())
+
+    def testPerfCounters(self):
+        """Test that hardware counters are attributed to each stage and to the regions it contains,
+        when they're available.
+        """
+        PerfCounters = lsst.meas.modelfit.PerfCounters
+        psf = makeMultiShapeletCircularGaussian(self.psfSigma)
+        moments = self.exposure.getPsf().computeShape()
+        algorithm = lsst.meas.modelfit.CModelAlgorithm(lsst.meas.modelfit.CModelControl())
+        self.assertFalse(PerfCounters.isEnabled())
+        result = algorithm.apply(self.exposure, psf, self.xyPosition, moments)
+        self.assertEqual(result.exp.counters.calls, 0)
+        if not PerfCounters.enable():
+            self.skipTest("hardware performance counters are not available")
+        try:
+            PerfCounters.reset()
+            result = algorithm.apply(self.exposure, psf, self.xyPosition, moments)
+        finally:
+            PerfCounters.disable()
+        for stage in (result.initial, result.exp, result.dev):
+            self.assertEqual(stage.counters.calls, 1)
+            self.assertGreater(stage.counters.events[PerfCounters.CYCLES], 0)
+        report = PerfCounters.getReport()
+        self.assertEqual(len(report), 1)
+        regions = report[0].regions
+        self.assertEqual(regions[PerfCounters.CMODEL_EXP].events, result.exp.counters.events)
+        self.assertGreater(regions[PerfCounters.OPTIMIZER_STEP].calls, 0)
+        self.assertGreater(regions[PerfCounters.MODEL_MATRIX].calls, 0)
+        self.assertLess(regions[PerfCounters.OPTIMIZER_STEP].events[PerfCounters.INSTRUCTIONS],
+                        sum(regions[r].events[PerfCounters.INSTRUCTIONS]
+                            for r in (PerfCounters.CMODEL_INITIAL, PerfCounters.CMODEL_EXP,
+                                      PerfCounters.CMODEL_DEV)))
+        self.assertIn("CModel.exp", PerfCounters.formatReport())
+
 
 class TestMemory(lsst.utils.tests.MemoryTestCase):
     pass
@@ -23,8 +23,11 @@ from builtins import zip
 #
 import unittest
 
+import numpy
+
 import lsst.afw.geom
 import lsst.afw.table
+import lsst.pex.exceptions
 import lsst.utils.tests
 import lsst.meas.modelfit
 
@@ -80,6 +83,19 @@ class CModelTestCase(lsst.meas.base.tests.AlgorithmTestCase, lsst.utils.tests.Te
             self.assertFloatsAlmostEqual(measRecord.get("modelfit_CModel_dev_flux"), trueFlux, rtol=0.5)
             self.assertGreater(measRecord.get("modelfit_CModel_dev_fluxSigma"), 0.0)
 
+    def measureWithPlugins(self):
+        """Run single-frame measurement with the CModel plugin on a realization of the test dataset.
+
+        Returns the exposure, the catalog of outputs (which also holds the truth values) and the
+        CModelControl the plugin was configured with.
+        """
+        plugin = "modelfit_CModel"
+        dependencies = ("modelfit_DoubleShapeletPsfApprox", "base_PsfFlux")
+        sfmTask = self.makeSingleFrameMeasurementTask(plugin, dependencies=dependencies)
+        exposure, catalog = self.dataset.realize(10.0, sfmTask.schema)
+        sfmTask.run(catalog, exposure)
+        return exposure, catalog, sfmTask.config.plugins[plugin].makeControl()
+
     def testPlugins(self):
         """Test that the plugin for single-frame measurement works, then use those outputs to test
         that the forced measurement plugin works."""
@@ -108,6 +124,137 @@ class CModelTestCase(lsst.meas.base.tests.AlgorithmTestCase, lsst.utils.tests.Te
         forcedTask.run(measCat, exposure2, refCat, refWcs)
         self.checkOutputs(measCat, catalog2)
 
+    def testRenderModels(self):
+        """Test that rendering all CModel fits into an image reproduces the measured fluxes, and that
+        the result does not depend on how the image is divided into tiles or threads.
+        """
+        exposure, catalog, ctrl = self.measureWithPlugins()
+        self.checkOutputs(catalog)
+        algorithm = lsst.meas.modelfit.CModelAlgorithm(ctrl)
+        model1 = exposure.clone()
+        model1.getMaskedImage().getImage().set(0.0)
+        model2 = model1.clone()
+        algorithm.renderModels(catalog, model1, nThreads=1)
+        algorithm.renderModels(catalog, model2, tileSize=17, nThreads=4)
+        self.assertFloatsAlmostEqual(model1.getMaskedImage().getImage().getArray(),
+                                     model2.getMaskedImage().getImage().getArray(),
+                                     rtol=1E-6, atol=1E-6)
+        array = model1.getMaskedImage().getImage().getArray()
+        total = sum(record.get("modelfit_CModel_flux") for record in catalog)
+        self.assertFloatsAlmostEqual(array.sum(), total, rtol=2E-2)
+        # Each model should be centered on its source: split the image between the two sources.
+        left = array[:, :100].sum()
+        self.assertFloatsAlmostEqual(left, catalog[0].get("modelfit_CModel_flux"), rtol=2E-2)
+
+    def testApplyCatalog(self):
+        """Test that running CModel on a whole catalog into a batch buffer reproduces the plugin outputs,
+        both in a buffer allocated in C++ and in a preallocated NumPy structured array.
+        """
+        exposure, catalog, ctrl = self.measureWithPlugins()
+        self.checkOutputs(catalog)
+        algorithm = lsst.meas.modelfit.CModelAlgorithm(ctrl)
+        batch = lsst.meas.modelfit.CModelResultBatch(ctrl, len(catalog))
+        algorithm.applyCatalog(catalog, exposure, batch, nThreads=2)
+        results = batch.getArray()
+        self.assertEqual(len(results), len(catalog))
+
+        def column(name):
+            return numpy.array([record.get("modelfit_CModel_" + name) for record in catalog])
+
+        for name in ("flux", "fluxSigma", "fracDev", "exp_flux", "dev_flux", "initial_flux"):
+            self.assertFloatsAlmostEqual(results[name], column(name), rtol=1E-3)
+        self.assertFloatsAlmostEqual(results["exp_nonlinear"][:, 0], column("exp_nonlinear_0"),
+                                     rtol=1E-3, atol=1E-6)
+        self.assertFloatsAlmostEqual(results["ellipse"][:, 0], column("ellipse_xx"), rtol=1E-3)
+        failed = 1 << lsst.meas.modelfit.CModelResult.FAILED
+        self.assertTrue(((results["flags"] & failed) == 0).all())
+        # The array is a view: changes to the buffer are visible through it.
+        batch.getBuffer()[0, 0] = -1.0
+        self.assertEqual(results["flux"][0], -1.0)
+
+        array = numpy.empty(len(catalog), dtype=batch.getDtype())
+        preallocated = lsst.meas.modelfit.CModelResultBatch.fromArray(ctrl, array)
+        algorithm.applyCatalog(catalog, exposure, preallocated, nThreads=1)
+        self.assertFloatsAlmostEqual(array["flux"], column("flux"), rtol=1E-3)
+        self.assertFloatsAlmostEqual(array["exp_fixed"], results["exp_fixed"], rtol=1E-12)
+        self.assertTrue((array["dev_flags"] == results["dev_flags"]).all())
+        with self.assertRaises(lsst.pex.exceptions.LengthError):
+            lsst.meas.modelfit.CModelResultBatch(ctrl, numpy.zeros((2, batch.getRowSize() + 1)))
+
+    def testApplyCatalogResume(self):
+        """Test that a batch run can be checkpointed and resumed from a checkpoint, fitting only the
+        sources that were not done, with the same results as an uninterrupted run.
+        """
+        exposure, catalog, ctrl = self.measureWithPlugins()
+        algorithm = lsst.meas.modelfit.CModelAlgorithm(ctrl)
+        checkpoints = []
+
+        def checkpoint(batch):
+            checkpoints.append(batch.getArray().copy())
+
+        complete = lsst.meas.modelfit.CModelResultBatch(ctrl, len(catalog))
+        self.assertEqual(complete.countDone(), 0)
+        algorithm.applyCatalog(catalog, exposure, complete, nThreads=1, checkpoint=checkpoint,
+                               checkpointInterval=1)
+        self.assertEqual(len(checkpoints), len(catalog))
+        self.assertEqual(complete.countDone(), len(catalog))
+        self.assertEqual(checkpoints[-1].tobytes(), complete.getArray().tobytes())
+        # Resume from the first checkpoint, in which only the first source is done.
+        resumed = lsst.meas.modelfit.CModelResultBatch.fromArray(ctrl, checkpoints[0])
+        self.assertTrue(resumed.isDone(0))
+        self.assertFalse(resumed.isDone(1))
+        checkpoints = []
+        algorithm.applyCatalog(catalog, exposure, resumed, nThreads=2, resume=True,
+                               checkpoint=checkpoint, checkpointInterval=1)
+        self.assertEqual(len(checkpoints), len(catalog) - 1)
+        self.assertEqual(resumed.countDone(), len(catalog))
+        for name in ("flux", "fluxSigma", "exp_nonlinear", "dev_amplitudes"):
+            self.assertFloatsAlmostEqual(resumed.getArray()[name], complete.getArray()[name], rtol=1E-10)
+
+    def testApplyCatalogResumeInFlight(self):
+        """Test that the optimizer states of sources in progress are checkpointed, and that resuming
+        their fits from those states gives the same results as an uninterrupted run.
+        """
+        exposure, catalog, ctrl = self.measureWithPlugins()
+        algorithm = lsst.meas.modelfit.CModelAlgorithm(ctrl)
+        checkpoints = []
+
+        def checkpoint(batch):
+            checkpoints.append((batch.getArray().copy(), batch.getInFlightStates()))
+
+        # With one thread and no checkpoints when sources complete, every checkpoint is taken after a
+        # step of the one source in progress.
+        complete = lsst.meas.modelfit.CModelResultBatch(ctrl, len(catalog))
+        algorithm.applyCatalog(catalog, exposure, complete, nThreads=1, checkpoint=checkpoint,
+                               checkpointInterval=len(catalog) + 1, checkpointStepInterval=3)
+        self.assertEqual(complete.countDone(), len(catalog))
+        self.assertEqual(complete.getInFlightStates(), {})
+        self.assertGreater(len(checkpoints), 1)
+        for array, states in checkpoints:
+            self.assertEqual(len(states), 1)
+            index, = states.keys()
+            self.assertFalse(array["done"][index])
+            self.assertEqual(array["done"].sum(), index)
+        # Resume from the first checkpoint (in the middle of the first source) and the last one (in the
+        # middle of the last source, after the others are done).
+        for array, states in (checkpoints[0], checkpoints[-1]):
+            resumed = lsst.meas.modelfit.CModelResultBatch.fromArray(ctrl, array.copy())
+            for index, state in states.items():
+                self.assertIsInstance(state, bytes)
+                resumed.setInFlightState(index, state)
+            self.assertEqual(resumed.getInFlightStates(), states)
+            # An unusable state is ignored, and that source is fit from the start.
+            garbage = [index for index in range(len(catalog))
+                       if not array["done"][index] and index not in states]
+            if garbage:
+                resumed.setInFlightState(garbage[0], b"\x01not an optimizer state")
+            algorithm.applyCatalog(catalog, exposure, resumed, nThreads=1, resume=True)
+            self.assertEqual(resumed.countDone(), len(catalog))
+            self.assertEqual(resumed.getInFlightStates(), {})
+            for name in ("flux", "fluxSigma", "exp_nonlinear", "dev_amplitudes"):
+                self.assertFloatsAlmostEqual(resumed.getArray()[name], complete.getArray()[name],
+                                             rtol=1E-10)
+
 
 class TestMemory(lsst.utils.tests.MemoryTestCase):
     pass
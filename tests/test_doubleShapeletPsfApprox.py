@@ -33,6 +33,8 @@ import lsst.afw.image
 import lsst.afw.coord
 import lsst.log
 import lsst.log.utils
+import lsst.pex.exceptions
+import lsst.meas.base
 import lsst.meas.modelfit
 import lsst.meas.algorithms
 
@@ -86,8 +88,10 @@ class DoubleShapeletPsfApproxTestMixin(object):
     def checkBounds(self, msf):
         """Check that the bounds specified in the control object are met by a MultiShapeletFunction.
 
-        These requirements must be true after a call to any fit method or measure().
+        These requirements must be true after a call to any fit method or measure().  As the optimizer
+        steps along the bounds, a fit may end up exactly on one (up to round-off error).
         """
+        slack = 1.0 + 1E-10
         self.assertEqual(len(msf.getComponents()), 2)
         self.assertEqual(
             lsst.shapelet.computeSize(self.ctrl.innerOrder),
@@ -97,26 +101,28 @@ class DoubleShapeletPsfApproxTestMixin(object):
             lsst.shapelet.computeSize(self.ctrl.outerOrder),
             len(msf.getComponents()[1].getCoefficients())
         )
-        self.assertGreater(
-            self.ctrl.maxRadiusBoxFraction * (self.psf.computeKernelImage().getBBox().getArea())**0.5,
+        self.assertGreaterEqual(
+            self.ctrl.maxRadiusBoxFraction * (self.psf.computeKernelImage().getBBox().getArea())**0.5
+            * slack,
             lsst.afw.geom.ellipses.Axes(msf.getComponents()[0].getEllipse().getCore()).getA()
         )
-        self.assertGreater(
-            self.ctrl.maxRadiusBoxFraction * (self.psf.computeKernelImage().getBBox().getArea())**0.5,
+        self.assertGreaterEqual(
+            self.ctrl.maxRadiusBoxFraction * (self.psf.computeKernelImage().getBBox().getArea())**0.5
+            * slack,
             lsst.afw.geom.ellipses.Axes(msf.getComponents()[1].getEllipse().getCore()).getA()
         )
-        self.assertLess(
+        self.assertLessEqual(
             self.ctrl.minRadius,
-            lsst.afw.geom.ellipses.Axes(msf.getComponents()[0].getEllipse().getCore()).getB()
+            lsst.afw.geom.ellipses.Axes(msf.getComponents()[0].getEllipse().getCore()).getB() * slack
         )
-        self.assertLess(
+        self.assertLessEqual(
             self.ctrl.minRadius,
-            lsst.afw.geom.ellipses.Axes(msf.getComponents()[1].getEllipse().getCore()).getB()
+            lsst.afw.geom.ellipses.Axes(msf.getComponents()[1].getEllipse().getCore()).getB() * slack
         )
-        self.assertLess(
+        self.assertLessEqual(
             self.ctrl.minRadiusDiff,
             (msf.getComponents()[1].getEllipse().getCore().getDeterminantRadius()
-             - msf.getComponents()[0].getEllipse().getCore().getDeterminantRadius())
+             - msf.getComponents()[0].getEllipse().getCore().getDeterminantRadius()) * slack
         )
 
     def checkRatios(self, msf):
@@ -280,6 +286,29 @@ class DoubleShapeletPsfApproxTestMixin(object):
                 derivatives[:, i].reshape(image.getHeight(), image.getWidth()),
                 atol=1E-11
             )
+        # The initial parameters should satisfy the objective's hard constraints.
+        constraints = objective.getConstraints()
+        self.assertIsNotNone(constraints)
+        self.assertTrue(constraints.isFeasible(parameters))
+        # The fused normal-equations pass should agree with the residuals and derivatives.
+        self.assertTrue(objective.hasNormalEquations())
+        jtr = numpy.zeros(parameters.size, dtype=float)
+        jtj = numpy.zeros((parameters.size, parameters.size), dtype=float)
+        chiSq = objective.computeNormalEquations(parameters, jtr, jtj)
+        self.assertFloatsAlmostEqual(chiSq, 0.5*numpy.dot(residuals, residuals), rtol=1E-12)
+        self.assertFloatsAlmostEqual(jtr, numpy.dot(derivatives.transpose(), residuals), rtol=1E-10,
+                                     atol=1E-14)
+        self.assertFloatsAlmostEqual(numpy.tril(jtj), numpy.tril(numpy.dot(derivatives.transpose(),
+                                                                           derivatives)), rtol=1E-10)
+        # An Optimizer that uses the normal equations never computes the residuals.
+        optimizerCtrl = lsst.meas.modelfit.OptimizerControl()
+        self.assertTrue(optimizerCtrl.doUseNormalEquations)
+        optimizer = lsst.meas.modelfit.Optimizer(objective, parameters, optimizerCtrl)
+        with self.assertRaises(lsst.pex.exceptions.LogicError):
+            optimizer.getResiduals()
+        optimizerCtrl.doUseNormalEquations = False
+        optimizer = lsst.meas.modelfit.Optimizer(objective, parameters, optimizerCtrl)
+        self.assertFloatsAlmostEqual(optimizer.getResiduals(), residuals, rtol=1E-12, atol=1E-14)
 
     def testFitProfile(self):
         """Test that fitProfile() does not modify the ellipticity, that it improves the fit, and
@@ -322,6 +351,22 @@ class DoubleShapeletPsfApproxTestMixin(object):
             self.assertLessEqual(bestChiSq, computeChiSq(msf))
             component.setEllipse(original)
 
+    def testFitProfileSpeculative(self):
+        """Test that evaluating trial steps concurrently gives the same result as evaluating
+        them one at a time.
+        """
+        image = self.psf.computeKernelImage()
+        msf1 = self.Algorithm.initializeResult(self.ctrl)
+        self.Algorithm.fitMoments(msf1, self.ctrl, image)
+        msf2 = lsst.shapelet.MultiShapeletFunction(msf1)
+        self.Algorithm.fitProfile(msf1, self.ctrl, image)
+        self.ctrl.optimizer.nTrialSteps = 3
+        self.Algorithm.fitProfile(msf2, self.ctrl, image)
+        for c1, c2 in zip(msf1.getComponents(), msf2.getComponents()):
+            self.assertFloatsAlmostEqual(c1.getCoefficients(), c2.getCoefficients(), rtol=1E-12)
+            self.assertFloatsAlmostEqual(c1.getEllipse().getParameterVector(),
+                                         c2.getEllipse().getParameterVector(), rtol=1E-12)
+
     def testFitShapelets(self):
         """Test that fitShapelets() does not modify the zeroth order coefficients or ellipse,
         that it improves the fit, and that small perturbations to the higher-order coefficients
@@ -357,6 +402,40 @@ class DoubleShapeletPsfApproxTestMixin(object):
                 self.assertLessEqual(bestChiSq, computeChiSq(msf))
                 component.getCoefficients()[i] = original
 
+    def testMeasureCatalog(self):
+        """Test that seeded catalog-level fits are as good as independent per-source fits.
+        """
+        schema = lsst.afw.table.SourceTable.makeMinimalSchema()
+        centroidKey = lsst.afw.table.Point2DKey.addFields(schema, "centroid", "centroid", "pixel")
+        schema.getAliasMap().set("slot_Centroid", "centroid")
+        algorithm = self.Algorithm(self.ctrl, "seeded", schema)
+        key = lsst.shapelet.MultiShapeletFunctionKey(schema["seeded"])
+        catalog = lsst.afw.table.SourceCatalog(schema)
+        for x, y in numpy.random.uniform(-50.0, 50.0, size=(10, 2)):
+            catalog.addNew().set(centroidKey, lsst.afw.geom.Point2D(x, y))
+        algorithm.measureCatalog(catalog, self.exposure)
+        reference = lsst.afw.table.SourceCatalog(schema)
+        for record in catalog:
+            self.assertFalse(record.get("seeded_flag"))
+            msf = record.get(key)
+            self.checkBounds(msf)
+            self.checkFitQuality(msf)
+            referenceRecord = reference.addNew()
+            referenceRecord.assign(record)
+            algorithm.measure(referenceRecord, self.exposure)
+            dataImage, referenceImage = self.makeImages(referenceRecord.get(key))
+            dataImage, modelImage = self.makeImages(msf)
+            self.assertFloatsAlmostEqual(modelImage.getArray(), referenceImage.getArray(), atol=self.atol)
+        # Threaded fits differ only in where chunk boundaries break the chain of seeds.
+        threaded = lsst.afw.table.SourceCatalog(schema)
+        threaded.extend(reference, deep=True)
+        algorithm.measureCatalog(threaded, self.exposure, nThreads=3)
+        for record, threadedRecord in zip(catalog, threaded):
+            self.assertFalse(threadedRecord.get("seeded_flag"))
+            dataImage, modelImage = self.makeImages(record.get(key))
+            dataImage, threadedImage = self.makeImages(threadedRecord.get(key))
+            self.assertFloatsAlmostEqual(threadedImage.getArray(), modelImage.getArray(), atol=self.atol)
+
     def testSingleFrameConfigIO(self):
         config1 = lsst.meas.base.SingleFrameMeasurementTask.ConfigClass()
         config2 = lsst.meas.base.SingleFrameMeasurementTask.ConfigClass()
@@ -403,6 +482,90 @@ class HigherOrderTestCase1(DoubleShapeletPsfApproxTestMixin, lsst.utils.tests.Te
         )
 
 
+class ConstrainedProfileTestCase(lsst.utils.tests.TestCase):
+
+    def setUp(self):
+        numpy.random.seed(500)
+        # Two Gaussian components fit to a single Gaussian want to have the same radius, so the fit
+        # ends up pinned to the minRadiusDiff constraint.
+        self.psf = lsst.afw.detection.GaussianPsf(25, 25, 2.0)
+        self.ctrl = lsst.meas.modelfit.DoubleShapeletPsfApproxControl()
+        self.ctrl.innerOrder = 0
+        self.ctrl.outerOrder = 0
+
+    def tearDown(self):
+        del self.psf
+        del self.ctrl
+
+    def testDefault(self):
+        self.assertTrue(self.ctrl.optimizer.doUseConstraints)
+        config = lsst.meas.base.SingleFrameMeasurementConfig()
+        self.assertTrue(config.plugins["modelfit_DoubleShapeletPsfApprox"].optimizer.doUseConstraints)
+
+    def testFewerIterations(self):
+        """Test that stepping along an active constraint converges in fewer outer iterations than
+        rejecting the steps that cross it, to a fit that is at least as good.
+        """
+        Algorithm = lsst.meas.modelfit.DoubleShapeletPsfApproxAlgorithm
+        image = self.psf.computeKernelImage()
+        msf = Algorithm.initializeResult(self.ctrl)
+        Algorithm.fitMoments(msf, self.ctrl, image)
+        moments = msf.evaluate().computeMoments()
+        r0 = moments.getCore().getDeterminantRadius()
+        objective = Algorithm.makeObjective(moments, self.ctrl, image)
+        parameters = numpy.array([
+            msf.getComponents()[0].getCoefficients()[0],
+            msf.getComponents()[1].getCoefficients()[0],
+            msf.getComponents()[0].getEllipse().getCore().getDeterminantRadius() / r0,
+            msf.getComponents()[1].getEllipse().getCore().getDeterminantRadius() / r0,
+        ])
+        constraints = objective.getConstraints()
+        self.assertTrue(constraints.isFeasible(parameters))
+        results = {}
+        for doUseConstraints in (False, True):
+            ctrl = lsst.meas.modelfit.OptimizerControl()
+            ctrl.doUseConstraints = doUseConstraints
+            optimizer = lsst.meas.modelfit.Optimizer(objective, parameters, ctrl)
+            optimizer.run()
+            self.assertTrue(optimizer.getState() & lsst.meas.modelfit.Optimizer.CONVERGED)
+            results[doUseConstraints] = optimizer
+        constrained = results[True]
+        unconstrained = results[False]
+        # the prior rejects every infeasible step, so the unconstrained fit stays strictly feasible
+        self.assertTrue(constraints.isFeasible(unconstrained.getParameters()))
+        radii = constrained.getParameters()[2:]
+        self.assertFloatsAlmostEqual(radii[1] - radii[0], constraints.inequalityVector[0], rtol=1E-6)
+        self.assertLess(constrained.getOuterIterCount(), unconstrained.getOuterIterCount())
+        self.assertLessEqual(constrained.getObjectiveValue(),
+                             unconstrained.getObjectiveValue()*(1.0 + 1E-8))
+
+
+class SpatialSeedIndexTestCase(lsst.utils.tests.TestCase):
+
+    def testNearest(self):
+        """Test that only fitted sources within the maximum distance are returned as seeds.
+        """
+        positions = [lsst.afw.geom.Point2D(0.0, 0.0), lsst.afw.geom.Point2D(10.0, 0.0),
+                     lsst.afw.geom.Point2D(3.0, 0.0), lsst.afw.geom.Point2D(float("nan"), 0.0)]
+        index = lsst.meas.modelfit.SpatialSeedIndex(positions, 8.0)
+        self.assertEqual(sorted(index.getOrder()), [0, 1, 2, 3])
+        self.assertEqual(index.getOrder()[-1], 3)
+        self.assertEqual(index.findNearest(2), -1)
+        index.markFitted(0)
+        self.assertEqual(index.findNearest(2), 0)
+        self.assertEqual(index.findNearest(1), -1)
+        index.markFitted(2)
+        self.assertEqual(index.findNearest(1), 2)
+        self.assertEqual(index.findNearest(0), 2)
+        index.markFitted(3)
+        self.assertEqual(index.findNearest(3), -1)
+        # Disabling seeding leaves the input order alone.
+        index = lsst.meas.modelfit.SpatialSeedIndex(positions, 0.0)
+        self.assertEqual(index.getOrder(), [0, 1, 2, 3])
+        index.markFitted(0)
+        self.assertEqual(index.findNearest(2), -1)
+
+
 class TestMemory(lsst.utils.tests.MemoryTestCase):
     pass
 
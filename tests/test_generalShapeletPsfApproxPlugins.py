@@ -98,6 +98,67 @@ class GeneralShapeletPsfApproxPluginsTestCase(lsst.utils.tests.TestCase):
         self.assertEqual(len(msfSingleGaussian.getComponents()), 1)
         self.checkResult(msfSingleGaussian)
 
+    def testMeasureCatalog(self):
+        """Test that seeded catalog-level fits match the single-source results.
+        """
+        self.exposure.setPsf(self.psf)
+        config = self.makeBlankConfig()
+        config.plugins.names = ["modelfit_GeneralShapeletPsfApprox"]
+        config.plugins["modelfit_GeneralShapeletPsfApprox"].sequence = ["SingleGaussian", "DoubleGaussian"]
+        task = lsst.meas.base.SingleFrameMeasurementTask(config=config, schema=self.schema)
+        plugin = task.plugins["modelfit_GeneralShapeletPsfApprox"]
+        measCat = lsst.afw.table.SourceCatalog(self.schema)
+        for x, y in numpy.random.uniform(0.0, 40.0, size=(6, 2)):
+            measCat.addNew().set(self.centroidKey, lsst.afw.geom.Point2D(x, y))
+        for nThreads in (1, 3):
+            plugin.measureCatalog(measCat, self.exposure, nThreads=nThreads)
+            for name, nComponents in (("SingleGaussian", 1), ("DoubleGaussian", 2)):
+                key = lsst.shapelet.MultiShapeletFunctionKey(
+                    self.schema["modelfit"]["GeneralShapeletPsfApprox"][name]
+                )
+                for measRecord in measCat:
+                    self.assertFalse(measRecord.get("modelfit_GeneralShapeletPsfApprox_%s_flag" % name))
+                    msf = measRecord.get(key)
+                    self.assertEqual(len(msf.getComponents()), nComponents)
+                    self.checkResult(msf)
+
+    def testMeasureCatalogFailedMiddle(self):
+        """Test that when a fitter in the middle of the sequence fails, unseeded catalog-level fits of
+        the next one start from the last fitter that succeeded, just as single-source fits do.
+        """
+        psfImage = lsst.afw.image.ImageD(os.path.join(self.psfDir, "galsimPsf_0.9.fits"))
+        psfImage.setXY0(lsst.afw.geom.Point2I(0, 0))
+        self.exposure.setPsf(lsst.meas.algorithms.KernelPsf(lsst.afw.math.FixedKernel(psfImage)))
+        config = self.makeBlankConfig()
+        config.plugins.names = ["modelfit_GeneralShapeletPsfApprox"]
+        pluginConfig = config.plugins["modelfit_GeneralShapeletPsfApprox"]
+        pluginConfig.sequence = ["SingleGaussian", "DoubleGaussian", "Full"]
+        pluginConfig.models["DoubleGaussian"].optimizer.maxOuterIterations = 1
+        pluginConfig.maxSeedDistance = 0.0
+        task = lsst.meas.base.SingleFrameMeasurementTask(config=config, schema=self.schema)
+        plugin = task.plugins["modelfit_GeneralShapeletPsfApprox"]
+        expected = lsst.afw.table.SourceCatalog(self.schema)
+        for x, y in numpy.random.uniform(0.0, 40.0, size=(4, 2)):
+            expected.addNew().set(self.centroidKey, lsst.afw.geom.Point2D(x, y))
+        catalog = expected.copy(deep=True)
+        task.run(expected, self.exposure)
+        plugin.measureCatalog(catalog, self.exposure)
+        key = lsst.shapelet.MultiShapeletFunctionKey(
+            self.schema["modelfit"]["GeneralShapeletPsfApprox"]["Full"]
+        )
+        for expectedRecord, record in zip(expected, catalog):
+            self.assertTrue(record.get("modelfit_GeneralShapeletPsfApprox_DoubleGaussian_flag"))
+            self.assertFalse(record.get("modelfit_GeneralShapeletPsfApprox_SingleGaussian_flag"))
+            self.assertFalse(record.get("modelfit_GeneralShapeletPsfApprox_Full_flag"))
+            self.assertFalse(expectedRecord.get("modelfit_GeneralShapeletPsfApprox_Full_flag"))
+            for expectedComponent, component in zip(expectedRecord.get(key).getComponents(),
+                                                    record.get(key).getComponents()):
+                self.assertFloatsAlmostEqual(component.getCoefficients(),
+                                             expectedComponent.getCoefficients(), rtol=1E-8, atol=1E-12)
+                self.assertFloatsAlmostEqual(component.getEllipse().getParameterVector(),
+                                             expectedComponent.getEllipse().getParameterVector(),
+                                             rtol=1E-8)
+
     def testForced(self):
         self.exposure.setPsf(self.psf)
         config = lsst.meas.base.ForcedMeasurementTask.ConfigClass()
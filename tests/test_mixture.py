@@ -29,6 +29,7 @@ import numpy
 import lsst.utils.tests
 import lsst.afw.geom.ellipses
 import lsst.afw.image
+import lsst.afw.math
 import lsst.afw.detection
 import lsst.shapelet.tests
 import lsst.meas.modelfit
@@ -121,6 +122,108 @@ class MixtureTestCase(lsst.utils.tests.TestCase):
             self.assertFloatsAlmostEqual(x.var(), sigma * df / (df - 2), rtol=5E-2)
             self.assertLess(scipy.stats.normaltest(x)[1], 0.05)
 
+    def testQuasiRandom(self):
+        """Test that quasi-random draws have the right moments, with more accuracy than
+        pseudo-random draws of the same size.
+        """
+        m = self.makeRandomMixture(2, 1)
+        mu = m[0].getMu()
+        sigma = m[0].getSigma()
+        x = numpy.zeros((20000, 2), dtype=float)
+        m.drawQuasiRandom(self.rng, x)
+        self.assertTrue(numpy.isfinite(x).all())
+        self.assertFloatsAlmostEqual(x.mean(axis=0), mu, rtol=2E-3)
+        self.assertFloatsAlmostEqual(numpy.cov(x, rowvar=False), sigma, rtol=1E-2)
+        # Repeated calls should be scrambled differently.
+        y = numpy.zeros((20000, 2), dtype=float)
+        m.drawQuasiRandom(self.rng, y)
+        self.assertFalse((x == y).all())
+        # Multiple components, Student's T: check the overall mean against the analytic one.
+        t = self.makeRandomMixture(3, 4, df=8.0)
+        x = numpy.zeros((50000, 3), dtype=float)
+        t.drawQuasiRandom(self.rng, x)
+        self.assertTrue(numpy.isfinite(x).all())
+        self.assertFloatsAlmostEqual(x.mean(axis=0), sum(c.weight*c.getMu() for c in t), atol=2E-2)
+        # Compare the accuracy of the moments to pseudo-random draws of the same size, using the
+        # root-mean-square error over several independent (differently scrambled) point sets.
+        x = numpy.zeros((2000, 2), dtype=float)
+        meanErrors = {"quasi": [], "pseudo": []}
+        covErrors = {"quasi": [], "pseudo": []}
+        for i in range(10):
+            for name, draw in (("quasi", m.drawQuasiRandom), ("pseudo", m.draw)):
+                draw(self.rng, x)
+                meanErrors[name].append(((x.mean(axis=0) - mu)**2).sum())
+                covErrors[name].append(((numpy.cov(x, rowvar=False) - sigma)**2).sum())
+        self.assertLess(numpy.mean(meanErrors["quasi"])**0.5, 0.5*numpy.mean(meanErrors["pseudo"])**0.5)
+        self.assertLess(numpy.mean(covErrors["quasi"])**0.5, 0.5*numpy.mean(covErrors["pseudo"])**0.5)
+
+    def testKMeans(self):
+        """Test that makeFromKMeans recovers well-separated clusters, independent of the number
+        of threads, and that fitMixture works with it.
+        """
+        truth = [lsst.meas.modelfit.Mixture.Component(0.2, numpy.array([0.0, 0.0]), numpy.identity(2)),
+                 lsst.meas.modelfit.Mixture.Component(0.3, numpy.array([20.0, 0.0]), 2*numpy.identity(2)),
+                 lsst.meas.modelfit.Mixture.Component(0.5, numpy.array([0.0, 20.0]),
+                                                      numpy.array([[1.0, 0.5], [0.5, 2.0]]))]
+        m = lsst.meas.modelfit.Mixture(2, truth)
+        x = numpy.zeros((5000, 2), dtype=float)
+        m.draw(self.rng, x)
+        w = numpy.ones(x.shape[0], dtype=float)
+        results = [lsst.meas.modelfit.Mixture.makeFromKMeans(x, w, 3, lsst.afw.math.Random("MT19937", 5),
+                                                             nThreads=nThreads)
+                   for nThreads in (1, 3)]
+        for c1, c2 in zip(*results):
+            self.assertEqual(c1.weight, c2.weight)
+            self.assertFloatsEqual(c1.getMu(), c2.getMu())
+            self.assertFloatsEqual(c1.getSigma(), c2.getSigma())
+        for expected in m:
+            fit = min(results[0], key=lambda c: numpy.sum((c.getMu() - expected.getMu())**2))
+            self.assertFloatsAlmostEqual(fit.weight, expected.weight, atol=0.03)
+            self.assertFloatsAlmostEqual(fit.getMu(), expected.getMu(), atol=0.15)
+            self.assertFloatsAlmostEqual(fit.getSigma(), expected.getSigma(), atol=0.3)
+        # fitMixture's (e1, e2, r) clustering and the MixturePrior restriction
+        data = numpy.zeros((2000, 3), dtype=float)
+        data[:, :2] = 0.3*numpy.random.randn(2000, 2)
+        data[:, 2] = numpy.random.randn(2000) - 1.0
+        mixture = lsst.meas.modelfit.fitMixture(data, 3, nIterations=2)
+        self.assertEqual(len(mixture), 3)
+        for c in mixture:
+            self.assertFloatsEqual(c.getMu()[:2], 0.0)
+            self.assertGreater(c.weight, 0.0)
+
+    def testFitMixtureTolerance(self):
+        """Test that fitMixture's EM iterations stop early when started from k-means, without changing
+        the result significantly.
+        """
+        data = numpy.zeros((4000, 3), dtype=float)
+        data[:2000, :2] = 0.2*numpy.random.randn(2000, 2)
+        data[:2000, 2] = 0.3*numpy.random.randn(2000) - 2.0
+        data[2000:, :2] = 0.4*numpy.random.randn(2000, 2)
+        data[2000:, 2] = 0.3*numpy.random.randn(2000) + 0.5
+        original = lsst.meas.modelfit.Mixture.updateEM
+        counts = []
+
+        def countingUpdateEM(self, *args, **kwds):
+            counts[-1] += 1
+            return original(self, *args, **kwds)
+
+        def fit(**kwds):
+            counts.append(0)
+            mixture = lsst.meas.modelfit.fitMixture(data, 2, rng=lsst.afw.math.Random("MT19937", 5), **kwds)
+            p = numpy.zeros(data.shape[0], dtype=float)
+            mixture.evaluate(data, p)
+            return numpy.log(p).mean()
+
+        lsst.meas.modelfit.Mixture.updateEM = countingUpdateEM
+        try:
+            fullLogLikelihood = fit(tolerance=0.0)
+            logLikelihood = fit()
+        finally:
+            lsst.meas.modelfit.Mixture.updateEM = original
+        self.assertEqual(counts[0], 20)
+        self.assertLess(counts[1], counts[0]//2)
+        self.assertFloatsAlmostEqual(logLikelihood, fullLogLikelihood, atol=1E-4)
+
     def testPersistence(self):
         """Test table-based persistence of Mixtures"""
         filename = "testMixturePersistence.fits"
@@ -139,6 +242,9 @@ class MixtureTestCase(lsst.utils.tests.TestCase):
         epsilon = 1E-7
         g = self.makeRandomMixture(3, 4)
         t = self.makeRandomMixture(4, 3, df=4.0)
+        # dimensions above 4 don't use the fixed-size kernels, so test those too
+        g6 = self.makeRandomMixture(6, 3)
+        t5 = self.makeRandomMixture(5, 2, df=4.0)
 
         def doTest(mixture, point):
             n = mixture.getDimension()
@@ -178,6 +284,12 @@ class MixtureTestCase(lsst.utils.tests.TestCase):
         for x in numpy.random.randn(10, t.getDimension()):
             doTest(t, x)
 
+        for x in numpy.random.randn(10, g6.getDimension()):
+            doTest(g6, x)
+
+        for x in numpy.random.randn(10, t5.getDimension()):
+            doTest(t5, x)
+
 
 class TestMemory(lsst.utils.tests.MemoryTestCase):
     pass
@@ -0,0 +1,364 @@
+#
+# LSST Data Management System
+#
+# Copyright 2008-2016  AURA/LSST.
+#
+# This product includes software developed by the
+# LSST Project (http://www.lsst.org/).
+#
+# This program is free software: you can redistribute it and/or modify
+# it under the terms of the GNU General Public License as published by
+# the Free Software Foundation, either version 3 of the License, or
+# (at your option) any later version.
+#
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU General Public License for more details.
+#
+# You should have received a copy of the LSST License Statement and
+# the GNU General Public License along with this program.  If not,
+# see <https://www.lsstcorp.org/LegalNotices/>.
+#
+import unittest
+import numpy
+
+import lsst.utils.tests
+import lsst.shapelet
+import lsst.afw.coord
+import lsst.afw.geom.ellipses
+import lsst.afw.image
+import lsst.afw.detection
+import lsst.afw.table
+import lsst.pex.exceptions
+import lsst.meas.modelfit
+
+
+class TrustRegionSolverTestCase(lsst.utils.tests.TestCase):
+
+    def setUp(self):
+        numpy.random.seed(500)
+
+    def makeProblem(self, n, shift=0.0):
+        a = numpy.random.randn(n + 2, n)
+        F = numpy.dot(a.transpose(), a) + (0.1 - shift)*numpy.identity(n)
+        g = numpy.random.randn(n)
+        return F, g
+
+    @staticmethod
+    def evaluateModel(F, g, x):
+        return numpy.dot(g, x) + 0.5*numpy.dot(x, numpy.dot(F, x))
+
+    def testUnconstrained(self):
+        """Test that truncated CG finds the Newton step when it lies inside the trust region.
+        """
+        F, g = self.makeProblem(6)
+        x1 = numpy.zeros(6, dtype=float)
+        x2 = numpy.zeros(6, dtype=float)
+        lsst.meas.modelfit.solveTrustRegion(x1, F, g, 1E6, 1E-8)
+        lsst.meas.modelfit.solveTrustRegionCG(x2, F, g, 1E6, 1E-12)
+        self.assertFloatsAlmostEqual(x2, -numpy.linalg.solve(F, g), rtol=1E-8, atol=1E-12)
+        self.assertFloatsAlmostEqual(x1, x2, rtol=1E-8, atol=1E-12)
+
+    def testConstrained(self):
+        """Test that truncated CG steps are on the boundary when the constraint is active, and
+        at least as good as the Cauchy point (and no better than the exact solution).
+        """
+        for shift in (0.0, 3.0):
+            F, g = self.makeProblem(6, shift=shift)
+            r = 0.2
+            x1 = numpy.zeros(6, dtype=float)
+            x2 = numpy.zeros(6, dtype=float)
+            lsst.meas.modelfit.solveTrustRegion(x1, F, g, r, 1E-8)
+            lsst.meas.modelfit.solveTrustRegionCG(x2, F, g, r, 1E-12)
+            self.assertFloatsAlmostEqual(numpy.linalg.norm(x2), r, rtol=1E-12)
+            cauchy = -g*r/numpy.linalg.norm(g)
+            q2 = self.evaluateModel(F, g, x2)
+            self.assertLessEqual(q2, self.evaluateModel(F, g, cauchy) + 1E-12)
+            self.assertGreaterEqual(q2, self.evaluateModel(F, g, x1) - 1E-12)
+
+    def testControl(self):
+        ctrl = lsst.meas.modelfit.OptimizerControl()
+        self.assertEqual(ctrl.trustRegionSolver, "AUTO")
+        ctrl.trustRegionSolver = "CG"
+        self.assertEqual(ctrl.trustRegionSolver, "CG")
+
+
+class QuadraticObjective(lsst.meas.modelfit.OptimizerObjective):
+    """Objective with residuals x - center, and optional hard constraints.
+    """
+
+    def __init__(self, center, constraints=None):
+        lsst.meas.modelfit.OptimizerObjective.__init__(self, len(center), len(center))
+        self.center = center
+        self.constraints = constraints
+
+    def computeResiduals(self, parameters, residuals):
+        residuals[:] = parameters - self.center
+
+    def differentiateResiduals(self, parameters, derivatives):
+        derivatives[:, :] = numpy.identity(len(self.center))
+        return True
+
+    def getConstraints(self):
+        return self.constraints
+
+
+class OptimizerConstraintsTestCase(lsst.utils.tests.TestCase):
+
+    def setUp(self):
+        # The constraints are x[0] <= 1, x[1] >= 0, and x[0] + x[2] <= 1.2, and the unconstrained
+        # minimum violates all of them.  The constrained minimum has all three active, with Lagrange
+        # multipliers (0.7, 1.0, 0.3).
+        self.center = numpy.array([2.0, -1.0, 0.5])
+        self.constraints = lsst.meas.modelfit.OptimizerConstraints(3, 1)
+        self.constraints.upper[0] = 1.0
+        self.constraints.lower[1] = 0.0
+        self.constraints.inequalityMatrix[0, :] = [-1.0, 0.0, -1.0]
+        self.constraints.inequalityVector[0] = -1.2
+        self.solution = numpy.array([1.0, 0.0, 0.2])
+        self.start = numpy.array([0.0, 0.5, 0.0])
+        self.ctrl = lsst.meas.modelfit.OptimizerControl()
+        self.ctrl.doUseConstraints = True
+
+    def makeHistory(self):
+        schema = lsst.afw.table.Schema()
+        for name in ("outer", "inner", "state"):
+            schema.addField(name, type=numpy.int32, doc="")
+        for name in ("objective", "prior", "trust"):
+            schema.addField(name, type=float, doc="")
+        schema.addField("parameters", type="ArrayD", size=3, doc="")
+        return lsst.meas.modelfit.OptimizerHistoryRecorder(schema), lsst.afw.table.BaseCatalog(schema)
+
+    def checkFeasible(self, x, tol=1E-10):
+        self.assertLessEqual(x[0], self.constraints.upper[0] + tol)
+        self.assertGreaterEqual(x[1], self.constraints.lower[1] - tol)
+        self.assertGreaterEqual(numpy.dot(self.constraints.inequalityMatrix[0], x),
+                                self.constraints.inequalityVector[0] - tol)
+
+    def testConstrainedMinimum(self):
+        """Test that the optimizer converges to the constrained minimum with the right active set,
+        and that every point it evaluates is feasible.
+        """
+        objective = QuadraticObjective(self.center, self.constraints)
+        optimizer = lsst.meas.modelfit.Optimizer(objective, self.start, self.ctrl)
+        recorder, history = self.makeHistory()
+        optimizer.run(recorder, history)
+        self.assertTrue(optimizer.getState() & lsst.meas.modelfit.Optimizer.CONVERGED)
+        self.assertFalse(optimizer.getState() & lsst.meas.modelfit.Optimizer.FAILED)
+        x = optimizer.getParameters()
+        self.assertFloatsAlmostEqual(x, self.solution, atol=1E-8)
+        # all three constraints are active
+        self.assertFloatsAlmostEqual(x[0], self.constraints.upper[0], atol=1E-8)
+        self.assertFloatsAlmostEqual(x[1], self.constraints.lower[1], atol=1E-8)
+        self.assertFloatsAlmostEqual(numpy.dot(self.constraints.inequalityMatrix[0], x),
+                                     self.constraints.inequalityVector[0], atol=1E-8)
+        # the gradient is balanced by non-negative multipliers for the active constraints
+        gradient = optimizer.getGradient()
+        normals = numpy.array([[-1.0, 0.0, 0.0], [0.0, 1.0, 0.0], [-1.0, 0.0, -1.0]])
+        multipliers = numpy.linalg.solve(normals.transpose(), gradient)
+        self.assertFloatsAlmostEqual(multipliers, numpy.array([0.7, 1.0, 0.3]), atol=1E-8)
+        self.assertGreater(len(history), 1)
+        parametersKey = history.getSchema()["parameters"].asKey()
+        for record in history:
+            self.checkFeasible(record.get(parametersKey))
+
+    def testInfeasibleStart(self):
+        """Test that a start point outside the bounds is clamped to them.
+        """
+        objective = QuadraticObjective(self.center, self.constraints)
+        optimizer = lsst.meas.modelfit.Optimizer(objective, numpy.array([0.0, -0.5, 0.0]), self.ctrl)
+        self.assertFloatsEqual(optimizer.getParameters(), numpy.array([0.0, 0.0, 0.0]))
+        optimizer.run()
+        self.assertFloatsAlmostEqual(optimizer.getParameters(), self.solution, atol=1E-8)
+
+    def testDisabled(self):
+        """Test that constraints are ignored unless doUseConstraints is set.
+        """
+        self.assertFalse(lsst.meas.modelfit.OptimizerControl().doUseConstraints)
+        self.ctrl.doUseConstraints = False
+        objective = QuadraticObjective(self.center, self.constraints)
+        optimizer = lsst.meas.modelfit.Optimizer(objective, self.start, self.ctrl)
+        optimizer.run()
+        self.assertTrue(optimizer.getState() & lsst.meas.modelfit.Optimizer.CONVERGED)
+        self.assertFloatsAlmostEqual(optimizer.getParameters(), self.center, atol=1E-8)
+
+
+def makeGaussianFit():
+    """Return an OptimizerObjective for fitting a Gaussian model to a noisy elliptical Gaussian image,
+    along with the model and the starting nonlinear and amplitude parameters.
+    """
+    position = lsst.afw.coord.IcrsCoord(45.0*lsst.afw.geom.degrees, 45.0*lsst.afw.geom.degrees)
+    cdelt = (0.2*lsst.afw.geom.arcseconds).asDegrees()
+    wcs = lsst.afw.image.makeWcs(position, lsst.afw.geom.Point2D(), cdelt, 0.0, 0.0, cdelt)
+    calib = lsst.afw.image.Calib()
+    calib.setFluxMag0(10000)
+    bbox = lsst.afw.geom.Box2I(lsst.afw.geom.Point2I(-30, -30), lsst.afw.geom.Point2I(30, 30))
+    exposure = lsst.afw.image.ExposureF(bbox)
+    exposure.setWcs(wcs)
+    exposure.setCalib(calib)
+    psf = lsst.shapelet.MultiShapeletFunction()
+    psf.addComponent(lsst.shapelet.ShapeletFunction(0, lsst.shapelet.HERMITE, 2.0))
+    psf.getComponents()[0].getCoefficients()[0] = 1.0
+    psf.normalize()
+    image = exposure.getMaskedImage().getImage().getArray()
+    y, x = numpy.mgrid[-30:31, -30:31]
+    image[:, :] = 50.0*numpy.exp(-0.5*(x**2/16.0 + y**2/9.0)) + numpy.random.randn(61, 61)
+    exposure.getMaskedImage().getVariance().set(1.0)
+    model = lsst.meas.modelfit.Model.makeGaussian(lsst.meas.modelfit.Model.FIXED_CENTER)
+    ellipses = model.makeEllipseVector()
+    ellipses[0].setCore(lsst.afw.geom.ellipses.Axes(3.0, 3.0, 0.0))
+    nonlinear = numpy.zeros(model.getNonlinearDim(), dtype=lsst.meas.modelfit.Scalar)
+    fixed = numpy.zeros(model.getFixedDim(), dtype=lsst.meas.modelfit.Scalar)
+    model.readEllipses(ellipses, nonlinear, fixed)
+    likelihood = lsst.meas.modelfit.UnitTransformedLikelihood(
+        model, fixed, lsst.meas.modelfit.UnitSystem(exposure), position, exposure,
+        lsst.afw.detection.Footprint(lsst.afw.geom.SpanSet(bbox)), psf,
+        lsst.meas.modelfit.UnitTransformedLikelihoodControl()
+    )
+    # start the amplitudes at their best-fit values for the initial nonlinear parameters
+    matrix = numpy.zeros((likelihood.getAmplitudeDim(), likelihood.getDataDim()),
+                         dtype=lsst.meas.modelfit.Pixel).transpose()
+    likelihood.computeModelMatrix(matrix, nonlinear)
+    amplitudes = numpy.linalg.solve(numpy.dot(matrix.transpose(), matrix),
+                                    numpy.dot(matrix.transpose(), likelihood.getData()))
+    objective = lsst.meas.modelfit.OptimizerObjective.makeFromLikelihood(likelihood)
+    return objective, model, nonlinear, amplitudes.astype(lsst.meas.modelfit.Scalar)
+
+
+class OptimizerConcurrencyTestCase(lsst.utils.tests.TestCase):
+
+    def setUp(self):
+        numpy.random.seed(500)
+        self.objective, self.model, nonlinear, amplitudes = makeGaussianFit()
+        self.start = numpy.concatenate([nonlinear, amplitudes])
+        self.ctrl = lsst.meas.modelfit.OptimizerControl()
+        # start with a trust region much too large, so the first steps are rejected several times
+        self.ctrl.trustRegionInitialSize = 20.0
+
+    def testConcurrentEvaluation(self):
+        """Test that evaluating batches of trial steps concurrently makes the same decisions and gets
+        the same results as evaluating them one at a time.
+        """
+        self.assertTrue(self.objective.supportsConcurrentEvaluation())
+        results = []
+        for nTrialSteps in (1, 4):
+            self.ctrl.nTrialSteps = nTrialSteps
+            optimizer = lsst.meas.modelfit.Optimizer(self.objective, self.start, self.ctrl)
+            optimizer.run()
+            self.assertTrue(optimizer.getState() & lsst.meas.modelfit.Optimizer.CONVERGED)
+            results.append(optimizer)
+        serial, concurrent = results
+        self.assertEqual(concurrent.getState(), serial.getState())
+        self.assertEqual(concurrent.getOuterIterCount(), serial.getOuterIterCount())
+        # Vectorized reductions may round differently depending on the alignment of the (per-thread)
+        # workspace arrays, so we allow for round-off error in the values.
+        self.assertFloatsAlmostEqual(concurrent.getParameters(), serial.getParameters(), rtol=1E-12)
+        self.assertFloatsAlmostEqual(concurrent.getObjectiveValue(), serial.getObjectiveValue(),
+                                     rtol=1E-12)
+        self.assertFloatsAlmostEqual(concurrent.getHessian(), serial.getHessian(), rtol=1E-10)
+
+
+class OptimizerCheckpointTestCase(lsst.utils.tests.TestCase):
+
+    def setUp(self):
+        numpy.random.seed(500)
+        self.objective, self.model, nonlinear, amplitudes = makeGaussianFit()
+        self.start = numpy.concatenate([nonlinear, amplitudes])
+        self.ctrl = lsst.meas.modelfit.OptimizerControl()
+
+    def testResume(self):
+        """Test that an optimizer restored from a state saved between steps finishes exactly as the
+        original does.
+        """
+        original = lsst.meas.modelfit.Optimizer(self.objective, self.start, self.ctrl)
+        for i in range(2):
+            self.assertTrue(original.step())
+        self.assertEqual(original.getOuterIterCount(), 2)
+        state = original.saveState()
+        self.assertIsInstance(state, bytes)
+        restored = lsst.meas.modelfit.Optimizer(self.objective, self.start, self.ctrl)
+        restored.restoreState(state)
+        self.assertEqual(restored.getOuterIterCount(), 2)
+        self.assertFloatsEqual(restored.getParameters(), original.getParameters())
+        self.assertFloatsEqual(restored.getHessian(), original.getHessian())
+        self.assertFloatsAlmostEqual(restored.getObjectiveValue(), original.getObjectiveValue(),
+                                     rtol=1E-14)
+        self.assertEqual(restored.run(), original.run())
+        self.assertEqual(restored.getState(), original.getState())
+        self.assertTrue(restored.getState() & lsst.meas.modelfit.Optimizer.CONVERGED)
+        self.assertFloatsEqual(restored.getParameters(), original.getParameters())
+
+    def testBadState(self):
+        optimizer = lsst.meas.modelfit.Optimizer(self.objective, self.start, self.ctrl)
+        state = optimizer.saveState()
+        with self.assertRaises(lsst.pex.exceptions.InvalidParameterError):
+            optimizer.restoreState(state[:-1])
+        with self.assertRaises(lsst.pex.exceptions.InvalidParameterError):
+            optimizer.restoreState(b"x" + state[1:])
+
+    def testStepCallback(self):
+        """Test that run() passes the optimizer to its callback after every successful step, and that
+        the states saved there can be resumed from.
+        """
+        optimizer = lsst.meas.modelfit.Optimizer(self.objective, self.start, self.ctrl)
+        counts = []
+        states = []
+
+        def onStep(current):
+            counts.append(current.getOuterIterCount())
+            states.append(current.saveState())
+
+        nSteps = optimizer.run(onStep)
+        self.assertTrue(optimizer.getState() & lsst.meas.modelfit.Optimizer.CONVERGED)
+        self.assertGreater(nSteps, 2)
+        self.assertEqual(counts, list(range(1, nSteps + 1)))
+        restored = lsst.meas.modelfit.Optimizer(self.objective, self.start, self.ctrl)
+        restored.restoreState(states[1])
+        self.assertEqual(restored.run(), nSteps)
+        self.assertEqual(restored.getState(), optimizer.getState())
+        self.assertFloatsEqual(restored.getParameters(), optimizer.getParameters())
+
+    def testMaxOuterIterations(self):
+        """Test that maxOuterIterations bounds the number of steps taken by each call to run(), and that
+        steps restored from a saved state count toward the limit of the next run().
+        """
+        def runBounded(maxOuterIterations):
+            self.ctrl.maxOuterIterations = maxOuterIterations
+            optimizer = lsst.meas.modelfit.Optimizer(self.objective, self.start, self.ctrl)
+            optimizer.run()
+            return optimizer
+
+        unbounded = lsst.meas.modelfit.Optimizer(self.objective, self.start, self.ctrl)
+        self.assertGreater(unbounded.run(), 2)
+        bounded = runBounded(2)
+        self.assertEqual(bounded.getOuterIterCount(), 2)
+        self.assertTrue(bounded.getState() & lsst.meas.modelfit.Optimizer.FAILED_MAX_OUTER_ITERATIONS)
+        # steps taken by step() don't count toward the limit of a later run()
+        stepped = lsst.meas.modelfit.Optimizer(self.objective, self.start, self.ctrl)
+        self.assertTrue(stepped.step())
+        state = stepped.saveState()
+        stepped.run()
+        self.assertFloatsEqual(stepped.getParameters(), runBounded(3).getParameters())
+        # but restored steps do
+        self.ctrl.maxOuterIterations = 2
+        restored = lsst.meas.modelfit.Optimizer(self.objective, self.start, self.ctrl)
+        restored.restoreState(state)
+        self.assertEqual(restored.run(), 2)
+        self.assertEqual(restored.getState(), bounded.getState())
+        self.assertFloatsEqual(restored.getParameters(), bounded.getParameters())
+        # only for the first run() after restoreState()
+        restored.run()
+        self.assertFloatsEqual(restored.getParameters(), runBounded(4).getParameters())
+
+
+class TestMemory(lsst.utils.tests.MemoryTestCase):
+    pass
+
+
+def setup_module(module):
+    lsst.utils.tests.init()
+
+if __name__ == "__main__":
+    lsst.utils.tests.init()
+    unittest.main()
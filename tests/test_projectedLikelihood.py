@@ -30,6 +30,7 @@ from lsst.afw.geom import AffineXYTransform
 import lsst.afw.image
 import lsst.afw.math
 import lsst.afw.detection
+import lsst.pex.exceptions
 import lsst.meas.modelfit
 
 
@@ -205,6 +206,15 @@ class UnitTransformedLikelihoodTestCase(lsst.utils.tests.TestCase):
         l0b = lsst.meas.modelfit.UnitTransformedLikelihood(self.model, self.fixed, self.sys0, self.position,
                                                            efv, ctrl)
         self.checkLikelihood(l0b, data)
+        # test with a shared, precomputed inverse-sigma plane
+        inverseSigma = lsst.meas.modelfit.InverseSigmaImage(self.exposure0.getMaskedImage().getVariance())
+        self.assertTrue(inverseSigma.isFor(self.exposure0.getMaskedImage().getVariance()))
+        self.assertFloatsAlmostEqual(inverseSigma.get().getArray(), var**-0.5, rtol=1E-6)
+        l0e = lsst.meas.modelfit.UnitTransformedLikelihood(self.model, self.fixed, self.sys0, self.position,
+                                                           self.exposure0, self.footprint0, self.psf0, ctrl,
+                                                           inverseSigma)
+        self.checkLikelihood(l0e, data)
+        self.assertFloatsAlmostEqual(l0e.getVariance(), l0a.getVariance(), rtol=1E-6)
         # test with constant weights, using both ctors
         ctrl.usePixelWeights = False
         data = self.exposure0.getMaskedImage().getImage().getArray()
@@ -216,6 +226,39 @@ class UnitTransformedLikelihoodTestCase(lsst.utils.tests.TestCase):
                                                            efv, ctrl)
         self.checkLikelihood(l0d, data*weights)
 
+    def testEpochCulling(self):
+        """Test that epochs with little information are dropped from a multi-epoch likelihood.
+        """
+        ctrl = lsst.meas.modelfit.UnitTransformedLikelihoodControl()
+        ctrl.usePixelWeights = True
+        noisy = self.exposure0.Factory(self.exposure0, True)
+        noisy.getMaskedImage().getVariance().set(1000.0)
+        efv = [lsst.meas.modelfit.EpochFootprint(self.footprint0, self.exposure0, self.psf0),
+               lsst.meas.modelfit.EpochFootprint(self.footprint0, noisy, self.psf0)]
+        # no culling by default
+        l0 = lsst.meas.modelfit.UnitTransformedLikelihood(self.model, self.fixed, self.sys0, self.position,
+                                                          efv, ctrl)
+        self.assertEqual(l0.getDataDim(), 2*self.footprint0.getArea())
+        self.assertEqual(list(l0.getDroppedEpochs()), [])
+        self.assertEqual(len(l0.getEpochInformation()), 0)
+        ctrl.minEpochInformationFraction = 0.01
+        l1 = lsst.meas.modelfit.UnitTransformedLikelihood(self.model, self.fixed, self.sys0, self.position,
+                                                          efv, ctrl)
+        self.assertEqual(list(l1.getDroppedEpochs()), [1])
+        information = l1.getEpochInformation()
+        self.assertFloatsAlmostEqual(information[0]/information[1], 1000.0, rtol=1E-5)
+        self.checkLikelihood(l1, self.exposure0.getMaskedImage().getImage().getArray())
+        # the most informative epoch is always kept
+        ctrl.minEpochInformationFraction = 0.99
+        l2 = lsst.meas.modelfit.UnitTransformedLikelihood(self.model, self.fixed, self.sys0, self.position,
+                                                          efv[::-1], ctrl)
+        self.assertEqual(list(l2.getDroppedEpochs()), [0])
+        self.assertEqual(l2.getDataDim(), self.footprint0.getArea())
+        ctrl.minEpochInformationFraction = 1.0
+        with self.assertRaises(lsst.pex.exceptions.InvalidParameterError):
+            lsst.meas.modelfit.UnitTransformedLikelihood(self.model, self.fixed, self.sys0, self.position,
+                                                         efv, ctrl)
+
     def testProjected(self):
         """Test likelihood evaluation when the fit system is not the same as the data system.
         """
@@ -0,0 +1,267 @@
+#
+# LSST Data Management System
+#
+# Copyright 2008-2016  AURA/LSST.
+#
+# This product includes software developed by the
+# LSST Project (http://www.lsst.org/).
+#
+# This program is free software: you can redistribute it and/or modify
+# it under the terms of the GNU General Public License as published by
+# the Free Software Foundation, either version 3 of the License, or
+# (at your option) any later version.
+#
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU General Public License for more details.
+#
+# You should have received a copy of the LSST License Statement and
+# the GNU General Public License along with this program.  If not,
+# see <https://www.lsstcorp.org/LegalNotices/>.
+#
+import unittest
+import numpy
+
+import lsst.utils.tests
+import lsst.afw.math
+import lsst.afw.table
+import lsst.meas.modelfit
+
+
+class GaussianObjective(lsst.meas.modelfit.SamplingObjective):
+    """A SamplingObjective for an (unnormalized) Gaussian target density.
+    """
+
+    def __init__(self, mu, sigma):
+        lsst.meas.modelfit.SamplingObjective.__init__(self)
+        self.mu = mu
+        self.fisher = numpy.linalg.inv(sigma)
+        self.nCalls = 0
+
+    def getParameterDim(self):
+        return len(self.mu)
+
+    def __call__(self, parameters, sample):
+        self.nCalls += 1
+        d = parameters - self.mu
+        return 0.5*numpy.dot(d, numpy.dot(self.fisher, d))
+
+
+class OutlierObjective(GaussianObjective):
+    """A GaussianObjective that adds a large penalty to its first evaluation, giving that sample a log
+    weight far below those of all the others.
+    """
+
+    def __init__(self, mu, sigma, penalty):
+        GaussianObjective.__init__(self, mu, sigma)
+        self.penalty = penalty
+
+    def __call__(self, parameters, sample):
+        value = GaussianObjective.__call__(self, parameters, sample)
+        if self.nCalls == 1:
+            value += self.penalty
+        return value
+
+
+def makeSampleSchema(nDim):
+    schema = lsst.afw.table.Schema()
+    schema.addField("weight", type=float, doc="sample weight")
+    schema.addField("parameters", type="ArrayD", size=nDim, doc="sample parameters")
+    return schema
+
+
+def getSampleArrays(samples):
+    """Return the weights, parameters, objective and proposal values of a sample catalog as arrays.
+    """
+    schema = samples.getSchema()
+    keys = [schema[name].asKey() for name in ("weight", "parameters", "objective", "proposal")]
+    return [numpy.array([record.get(key) for record in samples]) for key in keys]
+
+
+def computeMoments(weights, parameters):
+    mean = numpy.dot(weights, parameters) / weights.sum()
+    d = parameters - mean
+    cov = numpy.dot(d.transpose() * weights, d) / weights.sum()
+    return mean, cov
+
+
+class AdaptiveImportanceSamplerTestCase(lsst.utils.tests.TestCase):
+
+    def setUp(self):
+        numpy.random.seed(500)
+        self.mu = numpy.array([1.0, -2.0])
+        self.sigma = numpy.array([[2.0, 0.6], [0.6, 1.0]])
+        self.objective = GaussianObjective(self.mu, self.sigma)
+
+    def makeProposal(self):
+        # A broad proposal, offset from the target, that the sampler has to adapt.
+        component = lsst.meas.modelfit.Mixture.Component(1.0, numpy.zeros(2), 4.0*numpy.identity(2))
+        return lsst.meas.modelfit.Mixture(2, [component])
+
+    def runSampler(self, ctrl, doRecycleSamples=False):
+        schema = makeSampleSchema(2)
+        rng = lsst.afw.math.Random("MT19937", 500)
+        sampler = lsst.meas.modelfit.AdaptiveImportanceSampler(schema, rng, {0: ctrl},
+                                                               doRecycleSamples=doRecycleSamples)
+        samples = lsst.afw.table.BaseCatalog(schema)
+        sampler.run(self.objective, self.makeProposal(), samples)
+        return sampler, samples
+
+    def testRecycleSamples(self):
+        """Test that recycling samples with deterministic mixture weights gives normalized weights
+        and moments consistent with both the target and the non-recycled estimates.
+        """
+        ctrl = lsst.meas.modelfit.ImportanceSamplerControl()
+        ctrl.nSamples = 2000
+        ctrl.nUpdateSteps = 1
+        ctrl.maxRepeat = 2  # targetPerplexity=1 is never met, so we always do three iterations
+        results = {}
+        for doRecycleSamples in (False, True):
+            sampler, samples = self.runSampler(ctrl, doRecycleSamples)
+            weights, parameters, objective, proposal = getSampleArrays(samples)
+            self.assertEqual(len(samples), ctrl.nSamples*(3 if doRecycleSamples else 1))
+            self.assertTrue(numpy.isfinite(proposal).all())
+            self.assertFloatsAlmostEqual(weights.sum(), 1.0, rtol=1E-12)
+            # weights are proportional to p/q, with q the (mixture) proposal density of each sample
+            ratio = weights / numpy.exp(proposal - objective)
+            self.assertFloatsAlmostEqual(ratio/ratio.mean(), 1.0, rtol=1E-8)
+            mean, cov = computeMoments(weights, parameters)
+            self.assertFloatsAlmostEqual(mean, self.mu, atol=0.15)
+            self.assertFloatsAlmostEqual(cov, self.sigma, atol=0.3)
+            ess = sampler.computeEffectiveSampleSizeFraction(samples)*len(samples)
+            results[doRecycleSamples] = (mean, cov, ess)
+        self.assertFloatsAlmostEqual(results[True][0], results[False][0], atol=0.15)
+        self.assertFloatsAlmostEqual(results[True][1], results[False][1], atol=0.3)
+        # recycling should make every objective evaluation count
+        self.assertGreater(results[True][2], results[False][2])
+
+    def testBlockSampling(self):
+        """Test that block sampling stops at the first block boundary at which the effective sample
+        size of the weights (computed directly here) reaches the target, and not before.
+        """
+        ctrl = lsst.meas.modelfit.ImportanceSamplerControl()
+        ctrl.nSamples = 4000
+        ctrl.nUpdateSteps = 0
+        ctrl.nBlockSamples = 100
+        ctrl.targetEffectiveSampleSize = 200.0
+
+        def computeEss(logWeights):
+            w = numpy.exp(logWeights - logWeights.max())
+            return w.sum()**2 / (w**2).sum()
+
+        sampler, samples = self.runSampler(ctrl)
+        weights, parameters, objective, proposal = getSampleArrays(samples)
+        n = len(samples)
+        self.assertEqual(self.objective.nCalls, n)
+        self.assertEqual(n % ctrl.nBlockSamples, 0)
+        self.assertLess(n, ctrl.nSamples)
+        # the catalog is in the order in which samples were drawn
+        logWeights = proposal - objective
+        ess = computeEss(logWeights)
+        self.assertGreaterEqual(ess, ctrl.targetEffectiveSampleSize)
+        self.assertLess(computeEss(logWeights[:n - ctrl.nBlockSamples]), ctrl.targetEffectiveSampleSize)
+        self.assertFloatsAlmostEqual(sampler.computeEffectiveSampleSizeFraction(samples)*n, ess, rtol=1E-10)
+
+        # An unreachable target uses all nSamples.
+        self.objective.nCalls = 0
+        ctrl.targetEffectiveSampleSize = 2.0*ctrl.nSamples
+        sampler, samples = self.runSampler(ctrl)
+        self.assertEqual(len(samples), ctrl.nSamples)
+        self.assertEqual(self.objective.nCalls, ctrl.nSamples)
+
+    def testClippedOutlierWeight(self):
+        """Test that a sample whose weight is more than e^100 below the largest one is clipped to zero,
+        so the effective sample size is exactly that of the other samples, and that it does not change
+        where block sampling stops.
+        """
+        ctrl = lsst.meas.modelfit.ImportanceSamplerControl()
+        ctrl.nSamples = 4000
+        ctrl.nUpdateSteps = 0
+        ctrl.nBlockSamples = 100
+        ctrl.targetEffectiveSampleSize = 200.0
+
+        def computeEss(logWeights):
+            w = numpy.exp(logWeights - logWeights.max())
+            return w.sum()**2 / (w**2).sum()
+
+        sampler, samples = self.runSampler(ctrl)
+        nExpected = len(samples)
+        self.objective = OutlierObjective(self.mu, self.sigma, penalty=1000.0)
+        sampler, samples = self.runSampler(ctrl)
+        weights, parameters, objective, proposal = getSampleArrays(samples)
+        n = len(samples)
+        self.assertEqual(n, nExpected)
+        # the catalog is in the order in which samples were drawn, so the outlier is the first one
+        logWeights = proposal - objective
+        self.assertLess(logWeights[0], logWeights.max() - 100.0)
+        self.assertEqual(weights[0], 0.0)
+        self.assertTrue((weights[1:] > 0.0).all())
+        self.assertFloatsAlmostEqual(weights[1:].sum(), 1.0, rtol=1E-12)
+        self.assertFloatsAlmostEqual(sampler.computeEffectiveSampleSizeFraction(samples)*n,
+                                     computeEss(logWeights[1:]), rtol=1E-10)
+
+
+class EnsembleSamplerTestCase(lsst.utils.tests.TestCase):
+
+    def setUp(self):
+        numpy.random.seed(500)
+        # A strongly-correlated target, to exercise the affine invariance of the stretch move.
+        self.mu = numpy.array([1.0, -2.0])
+        self.sigma = numpy.array([[2.0, 1.35], [1.35, 1.0]])
+        self.objective = GaussianObjective(self.mu, self.sigma)
+        self.ctrl = lsst.meas.modelfit.EnsembleSamplerControl()
+        self.ctrl.nWalkers = 32
+        self.ctrl.nBurnIn = 200
+        self.ctrl.nSteps = 1000
+
+    def runSampler(self, ctrl):
+        schema = makeSampleSchema(2)
+        rng = lsst.afw.math.Random("MT19937", 500)
+        sampler = lsst.meas.modelfit.EnsembleSampler(schema, rng, ctrl)
+        samples = lsst.afw.table.BaseCatalog(schema)
+        component = lsst.meas.modelfit.Mixture.Component(1.0, numpy.zeros(2), 4.0*numpy.identity(2))
+        sampler.run(self.objective, lsst.meas.modelfit.Mixture(2, [component]), samples)
+        return sampler, samples
+
+    def testGaussian(self):
+        """Test that samples of a Gaussian target have the right moments and a sane acceptance fraction.
+        """
+        sampler, samples = self.runSampler(self.ctrl)
+        weights, parameters, objective, proposal = getSampleArrays(samples)
+        self.assertEqual(len(samples), self.ctrl.nWalkers*self.ctrl.nSteps)
+        self.assertFloatsAlmostEqual(weights, 1.0/len(samples), rtol=1E-12)
+        self.assertTrue(numpy.isnan(proposal).all())
+        self.assertFloatsAlmostEqual(objective, [self.objective(p, None) for p in parameters], rtol=1E-12)
+        mean, cov = computeMoments(weights, parameters)
+        self.assertFloatsAlmostEqual(mean, self.mu, atol=0.15)
+        self.assertFloatsAlmostEqual(cov, self.sigma, atol=0.3)
+        # the stretch move with a=2 typically accepts 50-80% of moves on a 2-d Gaussian
+        self.assertGreater(sampler.getAcceptanceFraction(), 0.4)
+        self.assertLess(sampler.getAcceptanceFraction(), 0.9)
+
+    def testThreads(self):
+        """Test that results do not depend on the number of threads.
+        """
+        self.ctrl.nBurnIn = 10
+        self.ctrl.nSteps = 50
+        results = []
+        for nThreads in (1, 4):
+            self.ctrl.nThreads = nThreads
+            sampler, samples = self.runSampler(self.ctrl)
+            results.append((getSampleArrays(samples), sampler.getAcceptanceFraction()))
+        for array1, array2 in zip(results[0][0], results[1][0]):
+            numpy.testing.assert_array_equal(array1, array2)  # treats the NaN proposal values as equal
+        self.assertEqual(results[0][1], results[1][1])
+
+
+class TestMemory(lsst.utils.tests.MemoryTestCase):
+    pass
+
+
+def setup_module(module):
+    lsst.utils.tests.init()
+
+if __name__ == "__main__":
+    lsst.utils.tests.init()
+    unittest.main()
@@ -28,6 +28,7 @@ import numpy
 import lsst.utils.tests
 import lsst.shapelet
 import lsst.afw.geom.ellipses
+import lsst.afw.math
 import lsst.log
 import lsst.log.utils
 import lsst.meas.modelfit
@@ -127,6 +128,57 @@ class SoftenedLinearPriorTestCase(lsst.utils.tests.TestCase):
                 for r in logRadiusPoints:
                     self.checkDerivatives(e1, e2, r)
 
+    def testBounds(self):
+        """Test that fillBounds() reports the hard edges of the prior, and that the prior is
+        nonzero just inside them.
+        """
+        ctrl = self.prior.getControl()
+        nonlinearLower = numpy.full(3, -numpy.inf, dtype=lsst.meas.modelfit.Scalar)
+        nonlinearUpper = numpy.full(3, numpy.inf, dtype=lsst.meas.modelfit.Scalar)
+        amplitudeLower = numpy.full(1, -numpy.inf, dtype=lsst.meas.modelfit.Scalar)
+        amplitudeUpper = numpy.full(1, numpy.inf, dtype=lsst.meas.modelfit.Scalar)
+        self.assertTrue(self.prior.fillBounds(nonlinearLower, nonlinearUpper,
+                                              amplitudeLower, amplitudeUpper))
+        self.assertFloatsAlmostEqual(amplitudeLower, 0.0)
+        self.assertTrue(numpy.isinf(amplitudeUpper).all())
+        self.assertTrue(numpy.isinf(nonlinearLower[:2]).all())
+        self.assertTrue(numpy.isinf(nonlinearUpper[:2]).all())
+        self.assertGreater(nonlinearLower[2], ctrl.logRadiusMinOuter)
+        self.assertLess(nonlinearUpper[2], ctrl.logRadiusMaxOuter)
+        self.assertGreater(self.prior.evaluate(numpy.array([0.0, 0.0, nonlinearLower[2]]), amplitudeLower),
+                           0.0)
+        self.assertGreater(self.prior.evaluate(numpy.array([0.0, 0.0, nonlinearUpper[2]]), amplitudeLower),
+                           0.0)
+
+    def testAmplitudePosterior(self):
+        """Test that an AmplitudePosterior agrees with the Prior's marginalize() and maximize(),
+        and with the TruncatedGaussian they are built on.
+        """
+        nonlinear = numpy.array([0.1, -0.2, 0.5], dtype=lsst.meas.modelfit.Scalar)
+        logDensity = numpy.log(self.prior.evaluate(nonlinear, self.amplitudes))
+        for gradient, hessian in [(numpy.array([-2.0]), numpy.array([[1.5]])),
+                                  (numpy.array([-1.0, 0.5]), numpy.array([[2.0, 0.3], [0.3, 1.0]]))]:
+            posterior = self.prior.makeAmplitudePosterior(gradient, hessian, nonlinear)
+            tg = lsst.meas.modelfit.TruncatedGaussian.fromSeriesParameters(0.0, gradient, hessian)
+            self.assertFloatsAlmostEqual(posterior.marginalize(), tg.getLogIntegral() - logDensity,
+                                         rtol=1E-14)
+            self.assertFloatsAlmostEqual(posterior.marginalize(),
+                                         self.prior.marginalize(gradient, hessian, nonlinear), rtol=1E-14)
+            amplitudes1 = numpy.zeros(gradient.size, dtype=lsst.meas.modelfit.Scalar)
+            amplitudes2 = numpy.zeros(gradient.size, dtype=lsst.meas.modelfit.Scalar)
+            q1 = posterior.maximize(amplitudes1)
+            q2 = self.prior.maximize(gradient, hessian, nonlinear, amplitudes2)
+            self.assertFloatsAlmostEqual(amplitudes1, tg.maximize(), rtol=1E-14)
+            self.assertFloatsAlmostEqual(amplitudes1, amplitudes2, rtol=1E-14)
+            self.assertFloatsAlmostEqual(q1, q2, rtol=1E-14)
+            self.assertFloatsAlmostEqual(q1, tg.evaluateLog()(amplitudes1) - logDensity, rtol=1E-14)
+            rng = lsst.afw.math.Random("MT19937", 500)
+            samples = numpy.zeros((20, gradient.size), dtype=lsst.meas.modelfit.Scalar)
+            weights = numpy.zeros(20, dtype=lsst.meas.modelfit.Scalar)
+            posterior.drawAmplitudes(rng, samples, weights)
+            self.assertTrue((samples >= 0.0).all())
+            self.assertTrue((weights > 0.0).all())
+
     @unittest.skipIf(scipy is None, "could not import scipy")
     def testIntegral(self):
         """Test that the prior is properly normalized.